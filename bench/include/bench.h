@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchResult
+{
+    std::string name;
+    int64_t     iterations  = 0;
+    int         repetitions = 0;
+    // median of repetitions
+    double nsPerOp     = 0;
+    double bytesPerSec = 0;
+    // spread of repetitions
+    double minNsPerOp = 0;
+    double maxNsPerOp = 0;
+    // ns/op of every repetition, sorted
+    std::vector<double> samples;
+    // samples, frames... processed by one op, also reported as ns/<itemName> if it's set
+    int64_t     itemsPerOp = 0;
+    std::string itemName;
+};
+
+// one metric of a bench for --json and --baseline, compared by name and metric
+struct BenchMetric
+{
+    // case of main.cpp, e.g. swr, filled by recordBenchMetric
+    std::string benchCase;
+    std::string name;
+    // e.g. ns/op, ns/sample, fps, encode.busyFps
+    std::string metric;
+    bool        higherIsBetter = false;
+    // median of samples
+    double              value = 0;
+    std::vector<double> samples;
+};
+
+// repetitions of every runBench, default is 3
+void setBenchRepetitions(int repetitions);
+int  benchRepetitions();
+
+// --name=value of command line
+void        setBenchOption(const std::string& name, const std::string& value);
+std::string benchOption(const std::string& name, const std::string& defaultValue);
+
+// run fn `warmup` times without timing, then `iterations` times with timing for every
+// repetition, ns/op is the median of repetitions
+BenchResult runBench(const std::string&           name,
+                     int                          warmup,
+                     int                          iterations,
+                     int64_t                      bytesPerOp,
+                     const std::function<void()>& fn);
+
+// print and record the result as metrics
+void printBenchResult(const BenchResult& result);
+
+// -------------------------- report --------------------------
+// metrics recorded from now on belong to benchCase
+void setBenchCase(const std::string& benchCase);
+void recordBenchMetric(BenchMetric metric);
+// write every recorded metric as json
+bool writeBenchReport(const std::string& path);
+// compare recorded metrics with a report written by writeBenchReport, print and return the
+// number of regressions, -1 if the baseline can't be read. a metric regresses if its median
+// gets worse by more than threshold (0.05 is 5%) and, when both sides have 3 or more
+// samples, a one-sided Mann-Whitney U test says it's not noise at significance alpha
+int compareBenchBaseline(const std::string& path, double threshold, double alpha);
+
+// bench case, defined in bench/src/*_bench.cpp
+void benchHugePageFrame();
+void benchPixFmtConvert();
+void benchSampleFmtConvert();
+void benchDownscale();
+void benchAudioMixer();
+void benchQualityMeter();
+void benchFrameDiff();
+void benchSwsCache();
+void benchCodecPool();
+void benchCodecRegistry();
+void benchLogger();
+void benchFrame();
+void benchSwrConvertor();
+void benchSwsConvertor();
+void benchEncode();
+void benchWriteImage();
+void benchStageTimer();
+void benchEndToEnd();
@@ -0,0 +1,73 @@
+extern "C"
+{
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include "audio_mixer.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr int kInputs       = 16;
+constexpr int kFrameSamples = 1024;
+constexpr int kRate         = 48000;
+
+void benchMix(int outSampleFmt, const char* fmtName)
+{
+    std::vector<std::vector<int16_t>> pcm(kInputs, std::vector<int16_t>(kFrameSamples * 2));
+    for(auto& input : pcm)
+    {
+        for(auto& sample : input)
+        {
+            sample = rand() % 65536 - 32768;
+        }
+    }
+    std::vector<uint8_t> out(kFrameSamples * 2 * 8);
+    uint8_t*             dst[2] = {out.data(), out.data() + out.size() / 2};
+    int64_t              bytes  = (int64_t)kInputs * kFrameSamples * 2 * sizeof(int16_t);
+
+    for(SimdLevel level : {SimdLevel::C, SimdLevel::SSE2, SimdLevel::AVX2})
+    {
+        if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+        {
+            break;
+        }
+        AudioMixerParam param{
+            .channelLayout = AV_CH_LAYOUT_STEREO,
+            .sampleFmt     = outSampleFmt,
+            .frameSamples  = kFrameSamples,
+        };
+        AudioMixer mixer(param);
+        for(int i = 0; i < kInputs; i++)
+        {
+            mixer.addInput(AV_SAMPLE_FMT_S16, 1.0f / kInputs);
+        }
+        std::string name = std::string("16 x stereo 48k s16 -> ") + fmtName + " " +
+                           simdLevelName(level);
+        BenchResult result = runBench(name, 100, 5000, bytes, [&]() {
+            for(int i = 0; i < kInputs; i++)
+            {
+                const uint8_t* src[1] = {reinterpret_cast<const uint8_t*>(pcm[i].data())};
+                mixer.push(i, src, kFrameSamples);
+            }
+            mixer.mix(dst, level);
+        });
+        printBenchResult(result);
+        fprintf(stdout,
+                "    %.0fx real time\n",
+                kFrameSamples * 1e9 / kRate / std::max(result.nsPerOp, 1.0));
+    }
+}
+} // namespace
+
+void benchAudioMixer()
+{
+    benchMix(AV_SAMPLE_FMT_S16, "s16");
+    benchMix(AV_SAMPLE_FMT_FLTP, "fltp");
+}
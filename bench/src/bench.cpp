@@ -0,0 +1,109 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+namespace
+{
+int                                g_repetitions = 3;
+std::map<std::string, std::string> g_options;
+} // namespace
+
+void setBenchOption(const std::string& name, const std::string& value)
+{
+    g_options[name] = value;
+}
+
+std::string benchOption(const std::string& name, const std::string& defaultValue)
+{
+    auto it = g_options.find(name);
+    return it == g_options.end() ? defaultValue : it->second;
+}
+
+void setBenchRepetitions(int repetitions)
+{
+    g_repetitions = std::max(1, repetitions);
+}
+
+int benchRepetitions()
+{
+    return g_repetitions;
+}
+
+BenchResult runBench(const std::string&           name,
+                     int                          warmup,
+                     int                          iterations,
+                     int64_t                      bytesPerOp,
+                     const std::function<void()>& fn)
+{
+    for(int i = 0; i < warmup; i++)
+    {
+        fn();
+    }
+
+    std::vector<double> nsPerOps;
+    for(int rep = 0; rep < g_repetitions; rep++)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for(int i = 0; i < iterations; i++)
+        {
+            fn();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        double totalNs = std::chrono::duration<double, std::nano>(end - begin).count();
+        nsPerOps.push_back(iterations > 0 ? totalNs / iterations : 0);
+    }
+    std::sort(nsPerOps.begin(), nsPerOps.end());
+
+    BenchResult result;
+    result.name        = name;
+    result.iterations  = iterations;
+    result.repetitions = (int)nsPerOps.size();
+    result.nsPerOp     = nsPerOps[nsPerOps.size() / 2];
+    result.minNsPerOp  = nsPerOps.front();
+    result.maxNsPerOp  = nsPerOps.back();
+    result.samples     = nsPerOps;
+    if(result.nsPerOp > 0)
+    {
+        result.bytesPerSec = (double)bytesPerOp / (result.nsPerOp / 1e9);
+    }
+    return result;
+}
+
+void printBenchResult(const BenchResult& result)
+{
+    double spread = 0;
+    if(result.nsPerOp > 0)
+    {
+        spread = (result.maxNsPerOp - result.minNsPerOp) / 2 / result.nsPerOp * 100;
+    }
+    fprintf(stdout,
+            "%-48s %10ld iters %14.1f ns/op %6.1f%% %10.2f MB/s\n",
+            result.name.c_str(),
+            result.iterations,
+            result.nsPerOp,
+            spread,
+            result.bytesPerSec / (1024 * 1024));
+
+    BenchMetric metric{
+        .name    = result.name,
+        .metric  = "ns/op",
+        .value   = result.nsPerOp,
+        .samples = result.samples,
+    };
+    recordBenchMetric(metric);
+    if(result.itemsPerOp > 0 && !result.itemName.empty())
+    {
+        metric.metric = "ns/" + result.itemName;
+        metric.value  = result.nsPerOp / result.itemsPerOp;
+        for(double& sample : metric.samples)
+        {
+            sample /= result.itemsPerOp;
+        }
+        recordBenchMetric(metric);
+    }
+}
@@ -0,0 +1,102 @@
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+}
+
+#include "bench.h"
+#include "codec_pool.h"
+#include "frame.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace
+{
+constexpr int kWidth     = 640;
+constexpr int kHeight    = 360;
+constexpr int kFramerate = 30;
+// a 2 second clip
+constexpr int kClipFrames = 2 * kFramerate;
+
+void benchEncodeJob(const char* codecName)
+{
+    EncoderParam encodeParam{
+        .needEncode = true,
+        .codecName  = codecName,
+        .bitRate    = 1000000,
+        .width      = kWidth,
+        .height     = kHeight,
+        .gopSize    = kFramerate,
+        .pixFmt     = AV_PIX_FMT_YUV420P,
+        .framerate  = kFramerate,
+        .byName     = true,
+    };
+    CodecParam codecParam{.encodeParam = encodeParam};
+    if(!std::make_shared<VideoCodec>(codecParam)->encodeEnable())
+    {
+        fprintf(stdout, "%s is not available, skip\n", codecName);
+        return;
+    }
+
+    VideoFrameParam frameParam{
+        .enable    = true,
+        .width     = kWidth,
+        .height    = kHeight,
+        .pixFormat = AV_PIX_FMT_YUV420P,
+    };
+    auto      frame = std::make_shared<Frame>(frameParam);
+    AVPacket* pkt   = av_packet_alloc();
+    if(!frame->isValid() || !pkt)
+    {
+        av_packet_free(&pkt);
+        return;
+    }
+    for(int plane = 0; plane < 3; plane++)
+    {
+        int lines = plane == 0 ? kHeight : kHeight / 2;
+        memset(frame->data()[plane], 128, frame->lineSize(plane) * lines);
+    }
+    int64_t clipBytes =
+        (int64_t)av_image_get_buffer_size(AV_PIX_FMT_YUV420P, kWidth, kHeight, 1) * kClipFrames;
+
+    // one job: get an encoder, encode the clip, flush and release the encoder
+    auto runJob = [&](std::shared_ptr<VideoCodec> codec) {
+        auto cb = [](AVPacket*) {};
+        for(int i = 0; i < kClipFrames; i++)
+        {
+            frame->getAVFrame()->pts = i;
+            codec->encode(frame, pkt, cb);
+        }
+        codec->encode(frame, pkt, cb, true);
+    };
+
+    std::string name = std::string("2s 360p clip ") + codecName;
+    printBenchResult(runBench(name + " open per job", 2, 20, clipBytes, [&]() {
+        runJob(std::make_shared<VideoCodec>(codecParam));
+    }));
+
+    CodecPool& pool = CodecPool::instance();
+    pool.clear();
+    printBenchResult(runBench(name + " codec pool", 2, 20, clipBytes, [&]() {
+        runJob(pool.acquireVideo(codecParam));
+    }));
+    CodecPoolStats stats = pool.stats();
+    fprintf(stdout,
+            "    hits %lu misses %lu dropped %lu idle %zu\n",
+            stats.hits,
+            stats.misses,
+            stats.dropped,
+            stats.idle);
+
+    av_packet_free(&pkt);
+}
+} // namespace
+
+void benchCodecPool()
+{
+    benchEncodeJob("libx264");
+    benchEncodeJob("mpeg4");
+}
@@ -0,0 +1,66 @@
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+}
+
+#include "bench.h"
+#include "codec_registry.h"
+
+#include <cstdio>
+#include <string>
+
+namespace
+{
+// what Codec did before the registry: find by name, then walk the support lists
+bool findAndCheckLinear(const char* name, int format, uint64_t channelLayout, int sampleRate)
+{
+    const AVCodec* codec = avcodec_find_encoder_by_name(name);
+    if(!codec)
+        return false;
+
+    bool found = !codec->sample_fmts;
+    for(const AVSampleFormat* fmt = codec->sample_fmts; fmt && *fmt != AV_SAMPLE_FMT_NONE; fmt++)
+    {
+        found |= *fmt == format;
+    }
+    bool layoutFound = !codec->channel_layouts;
+    for(const uint64_t* layout = codec->channel_layouts; layout && *layout; layout++)
+    {
+        layoutFound |= *layout == channelLayout;
+    }
+    bool rateFound = !codec->supported_samplerates;
+    for(const int* rate = codec->supported_samplerates; rate && *rate; rate++)
+    {
+        rateFound |= *rate == sampleRate;
+    }
+    return found && layoutFound && rateFound;
+}
+} // namespace
+
+void benchCodecRegistry()
+{
+    // first call builds the tables
+    printBenchResult(
+        runBench("codec registry build", 0, 1, 0, [&]() { CodecRegistry::instance(); }));
+
+    for(const char* name : {"aac", "libfdk_aac", "libx264"})
+    {
+        std::string benchName    = std::string("find+check ") + name;
+        bool        linearResult = false;
+        printBenchResult(runBench(benchName + " linear", 100, 10000, 0, [&]() {
+            linearResult =
+                findAndCheckLinear(name, AV_SAMPLE_FMT_FLTP, AV_CH_LAYOUT_STEREO, 44100);
+        }));
+
+        bool              registryResult = false;
+        const std::string codecName      = name;
+        printBenchResult(runBench(benchName + " registry", 100, 10000, 0, [&]() {
+            const CodecCaps* caps = CodecRegistry::instance().findEncoder(codecName);
+            registryResult        = caps && caps->supportSampleFmt(AV_SAMPLE_FMT_FLTP) &&
+                             caps->supportChannelLayout(AV_CH_LAYOUT_STEREO) &&
+                             caps->supportSampleRate(44100);
+        }));
+        fprintf(stdout, "    supported %d/%d\n", linearResult, registryResult);
+    }
+}
@@ -0,0 +1,446 @@
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include "bench.h"
+#include "codec.h"
+#include "device.h"
+#include "frame.h"
+#include "job_metrics.h"
+#include "resample.h"
+#include "trace.h"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Resolution
+{
+    const char* name;
+    int         width;
+    int         height;
+};
+
+constexpr Resolution kResolutions[] = {
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"4K", 3840, 2160},
+};
+
+std::shared_ptr<Frame> makeVideoFrame(int width, int height, int pixFmt, int seed)
+{
+    VideoFrameParam param{
+        .enable    = true,
+        .width     = width,
+        .height    = height,
+        .pixFormat = pixFmt,
+    };
+    auto frame = std::make_shared<Frame>(param);
+    if(!frame->isValid())
+    {
+        return nullptr;
+    }
+    // gradient shifted by seed, so encoder has some motion to search
+    AVFrame*                  f    = frame->getAVFrame();
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)pixFmt);
+    for(int plane = 0; plane < 4 && f->data[plane]; plane++)
+    {
+        bool isChroma    = plane == 1 || plane == 2;
+        int  planeHeight = isChroma ? AV_CEIL_RSHIFT(height, desc->log2_chroma_h) : height;
+        for(int y = 0; y < planeHeight; y++)
+        {
+            uint8_t* line = f->data[plane] + y * f->linesize[plane];
+            for(int x = 0; x < f->linesize[plane]; x++)
+            {
+                line[x] = (uint8_t)(x + y * plane + seed);
+            }
+        }
+    }
+    return frame;
+}
+
+// -------------------------- swr --------------------------
+struct SwrCase
+{
+    const char*    name;
+    int64_t        inLayout;
+    AVSampleFormat inFmt;
+    int            inRate;
+    int64_t        outLayout;
+    AVSampleFormat outFmt;
+    int            outRate;
+};
+
+void benchSwrCase(const SwrCase& c)
+{
+    // one aac frame per convert
+    constexpr int kSamples = 1024;
+
+    int inChannels  = av_get_channel_layout_nb_channels(c.inLayout);
+    int outChannels = av_get_channel_layout_nb_channels(c.outLayout);
+    int inBytes     = kSamples * inChannels * av_get_bytes_per_sample(c.inFmt);
+    int outSamples  = kSamples;
+    int outBytes    = outSamples * outChannels * av_get_bytes_per_sample(c.outFmt);
+
+    ReampleParam param{
+        .outChannelLayout     = c.outLayout,
+        .outSampleFmt         = c.outFmt,
+        .outSampleRate        = c.outRate,
+        .inChannelLayout      = c.inLayout,
+        .inSampleFmt          = c.inFmt,
+        .inSampleRate         = c.inRate,
+        .logOffset            = 0,
+        .logCtx               = nullptr,
+        .fullOutputBufferSize = outBytes,
+    };
+    SwrConvertor convertor(param);
+    if(!convertor.enable())
+    {
+        fprintf(stderr, "failed to create swr convertor for %s\n", c.name);
+        return;
+    }
+
+    // packed input as read from a pcm file
+    std::vector<uint8_t> src(inBytes);
+    for(int i = 0; i < inBytes; i++)
+    {
+        src[i] = (uint8_t)(i * 7);
+    }
+    uint8_t* srcData = src.data();
+    uint8_t* dstData = static_cast<uint8_t*>(av_malloc(outBytes));
+    if(!dstData)
+    {
+        return;
+    }
+
+    int64_t outputBytes = 0;
+    auto    convert     = [&]() {
+        auto [data, size] = convertor.convert(&srcData, inBytes, &dstData, kSamples, outSamples);
+        outputBytes += size;
+        while(convertor.hasFullOutput())
+        {
+            auto [fullData, fullSize] = convertor.flushRemain(&dstData);
+            outputBytes += fullSize;
+        }
+    };
+    BenchResult result =
+        runBench(std::string("swr convert ") + c.name, 100, 5000, inBytes, convert);
+    result.itemsPerOp = kSamples;
+    result.itemName   = "sample";
+    printBenchResult(result);
+    fprintf(stdout, "    output %ld bytes\n", outputBytes);
+    av_free(dstData);
+}
+
+// -------------------------- encode --------------------------
+void benchVideoEncode(const char* codecName, const Resolution& resolution)
+{
+    EncoderParam encodeParam{
+        .needEncode = true,
+        .codecName  = codecName,
+        .bitRate    = 4000000,
+        .width      = resolution.width,
+        .height     = resolution.height,
+        .gopSize    = 60,
+        .pixFmt     = AV_PIX_FMT_YUV420P,
+        .framerate  = 30,
+        .byName     = true,
+    };
+    CodecParam codecParam{.encodeParam = encodeParam};
+    auto       codec = std::make_shared<VideoCodec>(codecParam);
+    if(!codec->encodeEnable())
+    {
+        fprintf(stdout, "    %s is not available\n", codecName);
+        return;
+    }
+
+    // a few different frames, so it isn't encoding a still image
+    std::vector<std::shared_ptr<Frame>> frames;
+    for(int i = 0; i < 8; i++)
+    {
+        auto frame = makeVideoFrame(resolution.width, resolution.height, AV_PIX_FMT_YUV420P, i * 3);
+        if(!frame)
+        {
+            return;
+        }
+        frames.push_back(frame);
+    }
+    AVPacket* pkt = av_packet_alloc();
+    if(!pkt)
+    {
+        return;
+    }
+
+    int64_t pts          = 0;
+    int64_t encodedBytes = 0;
+    auto    cb           = [&](AVPacket* p) { encodedBytes += p->size; };
+    int64_t frameBytes =
+        av_image_get_buffer_size(AV_PIX_FMT_YUV420P, resolution.width, resolution.height, 1);
+    auto encode = [&]() {
+        auto& frame                   = frames[pts % frames.size()];
+        frame->getAVFrame()->pts      = pts++;
+        codec->encode(frame, pkt, cb);
+    };
+    BenchResult result = runBench(std::string("encode ") + codecName + " " + resolution.name,
+                                  10,
+                                  60,
+                                  frameBytes,
+                                  encode);
+    result.itemsPerOp = 1;
+    result.itemName   = "frame";
+    printBenchResult(result);
+    fprintf(stdout, "    encoded %ld bytes of %ld frames\n", encodedBytes, pts);
+    av_packet_free(&pkt);
+}
+
+void benchAudioEncode(const char* codecName, AVSampleFormat sampleFmt)
+{
+    EncoderParam encodeParam{
+        .needEncode    = true,
+        .codecName     = codecName,
+        .bitRate       = 128000,
+        .sampleFmt     = sampleFmt,
+        .channelLayout = AV_CH_LAYOUT_STEREO,
+        .sampleRate    = 44100,
+        .byName        = true,
+    };
+    CodecParam codecParam{.encodeParam = encodeParam};
+    auto       codec = std::make_shared<AudioCodec>(codecParam);
+    if(!codec->encodeEnable())
+    {
+        fprintf(stdout, "    %s is not available\n", codecName);
+        return;
+    }
+
+    int             frameBytes = codec->frameSize(true) * 2 * av_get_bytes_per_sample(sampleFmt);
+    AudioFrameParam frameParam{
+        .enable        = true,
+        .frameSize     = frameBytes,
+        .channelLayout = AV_CH_LAYOUT_STEREO,
+        .format        = sampleFmt,
+    };
+    auto frame = std::make_shared<Frame>(frameParam);
+    // planar input is contiguous planes, same as the output of SwrConvertor
+    std::vector<uint8_t> pcm(frameBytes);
+    for(int i = 0; i < frameBytes; i++)
+    {
+        pcm[i] = (uint8_t)(i * 13);
+    }
+    if(sampleFmt == AV_SAMPLE_FMT_FLTP)
+    {
+        float* samples = reinterpret_cast<float*>(pcm.data());
+        for(int i = 0; i < frameBytes / 4; i++)
+        {
+            samples[i] = (i % 200 - 100) / 100.0f;
+        }
+    }
+    AVPacket* pkt = av_packet_alloc();
+    if(!frame->isValid() || !pkt)
+    {
+        av_packet_free(&pkt);
+        return;
+    }
+
+    int64_t  pts          = 0;
+    int64_t  encodedBytes = 0;
+    uint8_t* pcmData      = pcm.data();
+    auto     cb           = [&](AVPacket* p) { encodedBytes += p->size; };
+    auto     encode       = [&]() {
+        frame->writeAudioData(&pcmData, frameBytes);
+        frame->getAVFrame()->pts = pts;
+        pts += frame->getAVFrame()->nb_samples;
+        codec->encode(frame, pkt, cb);
+    };
+    std::string name = std::string("encode ") + codecName + " 44.1k stereo";
+    BenchResult result = runBench(name, 20, 500, frameBytes, encode);
+    result.itemsPerOp = codec->frameSize(true);
+    result.itemName   = "sample";
+    printBenchResult(result);
+    fprintf(stdout, "    encoded %ld bytes\n", encodedBytes);
+    av_packet_free(&pkt);
+}
+} // namespace
+
+void benchFrame()
+{
+    for(const Resolution& resolution : kResolutions)
+    {
+        VideoFrameParam param{
+            .enable    = true,
+            .width     = resolution.width,
+            .height    = resolution.height,
+            .pixFormat = AV_PIX_FMT_YUV420P,
+        };
+        int bufferSize =
+            Frame::videoBufferSize(resolution.width, resolution.height, param.pixFormat);
+        printBenchResult(runBench(std::string("frame ctor yuv420p ") + resolution.name,
+                                  10,
+                                  500,
+                                  bufferSize,
+                                  [&]() { auto frame = std::make_shared<Frame>(param); }));
+    }
+
+    // writeImageData points the frame to a raw image read from file
+    for(const Resolution& resolution : kResolutions)
+    {
+        int imageSize = av_image_get_buffer_size(
+            AV_PIX_FMT_YUV420P, resolution.width, resolution.height, 1);
+        std::vector<uint8_t> image(imageSize, 0x80);
+        auto frame = makeVideoFrame(resolution.width, resolution.height, AV_PIX_FMT_YUV420P, 0);
+        if(!frame)
+        {
+            continue;
+        }
+        printBenchResult(
+            runBench(std::string("frame writeImageData ") + resolution.name, 100, 100000, 0, [&]() {
+                frame->writeImageData(
+                    image.data(), AV_PIX_FMT_YUV420P, resolution.width, resolution.height);
+            }));
+    }
+}
+
+void benchSwrConvertor()
+{
+    const SwrCase cases[] = {
+        {"48k s16 -> 44.1k s16 stereo",
+         AV_CH_LAYOUT_STEREO,
+         AV_SAMPLE_FMT_S16,
+         48000,
+         AV_CH_LAYOUT_STEREO,
+         AV_SAMPLE_FMT_S16,
+         44100},
+        {"44.1k s16 -> 48k fltp stereo",
+         AV_CH_LAYOUT_STEREO,
+         AV_SAMPLE_FMT_S16,
+         44100,
+         AV_CH_LAYOUT_STEREO,
+         AV_SAMPLE_FMT_FLTP,
+         48000},
+        {"48k s16 stereo -> mono",
+         AV_CH_LAYOUT_STEREO,
+         AV_SAMPLE_FMT_S16,
+         48000,
+         AV_CH_LAYOUT_MONO,
+         AV_SAMPLE_FMT_S16,
+         48000},
+        {"48k s16 -> fltp stereo(kernel)",
+         AV_CH_LAYOUT_STEREO,
+         AV_SAMPLE_FMT_S16,
+         48000,
+         AV_CH_LAYOUT_STEREO,
+         AV_SAMPLE_FMT_FLTP,
+         48000},
+    };
+    for(const SwrCase& c : cases)
+    {
+        benchSwrCase(c);
+    }
+}
+
+void benchSwsConvertor()
+{
+    struct SwsCase
+    {
+        Resolution in;
+        Resolution out;
+        int        inPixFmt;
+    };
+    const SwsCase cases[] = {
+        {kResolutions[1], kResolutions[0], AV_PIX_FMT_YUV420P},
+        {kResolutions[2], kResolutions[1], AV_PIX_FMT_YUV420P},
+        {kResolutions[0], kResolutions[1], AV_PIX_FMT_YUV420P},
+        {kResolutions[1], kResolutions[1], AV_PIX_FMT_YUV422P},
+    };
+    for(const SwsCase& c : cases)
+    {
+        ReampleParam param{
+            .inWidth   = c.in.width,
+            .inHeight  = c.in.height,
+            .inPixFmt  = c.inPixFmt,
+            .outWidth  = c.out.width,
+            .outHeight = c.out.height,
+            .outPixFmt = AV_PIX_FMT_YUV420P,
+        };
+        SwsConvertor convertor(param);
+        auto         frame = makeVideoFrame(c.in.width, c.in.height, c.inPixFmt, 0);
+        if(!convertor.enable() || !frame)
+        {
+            continue;
+        }
+        std::string name = std::string("sws ") + c.in.name + " " +
+                           av_get_pix_fmt_name((AVPixelFormat)c.inPixFmt) + " -> " + c.out.name +
+                           " yuv420p";
+        int64_t bytes =
+            av_image_get_buffer_size((AVPixelFormat)c.inPixFmt, c.in.width, c.in.height, 1);
+        printBenchResult(runBench(name, 3, 50, bytes, [&]() { convertor.scale(frame); }));
+    }
+}
+
+void benchEncode()
+{
+    for(const char* codecName : {"libx264", "mpeg4", "mjpeg"})
+    {
+        benchVideoEncode(codecName, kResolutions[0]);
+    }
+    benchVideoEncode("libx264", kResolutions[1]);
+    benchAudioEncode("aac", AV_SAMPLE_FMT_FLTP);
+    benchAudioEncode("libfdk_aac", AV_SAMPLE_FMT_S16);
+}
+
+void benchWriteImage()
+{
+    std::ofstream ofs("/dev/null", std::ios::out | std::ios::binary);
+    VideoDevice   device;
+    for(const Resolution& resolution : kResolutions)
+    {
+        auto frame = makeVideoFrame(resolution.width, resolution.height, AV_PIX_FMT_YUV420P, 0);
+        if(!frame)
+        {
+            continue;
+        }
+        int64_t bytes = av_image_get_buffer_size(
+            AV_PIX_FMT_YUV420P, resolution.width, resolution.height, 1);
+        printBenchResult(runBench(std::string("writeImageToFile ") + resolution.name,
+                                  10,
+                                  200,
+                                  bytes,
+                                  [&]() { device.writeImageToFile(ofs, frame); }));
+    }
+}
+
+void benchStageTimer()
+{
+    // StageTimer is on every frame of every stage, it must be close to free without a job
+    printBenchResult(runBench("StageTimer disabled", 1000, 1000000, 0, []() {
+        StageTimer timer(Stage::SCALE);
+    }));
+
+    JobMetrics metrics;
+    {
+        JobMetricsScope scope(&metrics);
+        printBenchResult(runBench("StageTimer metrics", 1000, 100000, 0, []() {
+            StageTimer timer(Stage::SCALE);
+        }));
+    }
+
+    TraceRecorder trace("/dev/null");
+    {
+        JobMetricsScope metricsScope(&metrics);
+        TraceScope      traceScope(&trace);
+        printBenchResult(runBench("StageTimer metrics+trace", 1000, 100000, 0, []() {
+            StageTimer timer(Stage::SCALE);
+        }));
+    }
+    fprintf(stdout, "    %lu trace events dropped\n", trace.droppedCount());
+}
@@ -0,0 +1,124 @@
+extern "C"
+{
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+#include "bench.h"
+#include "downscale.h"
+#include "frame.h"
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+namespace
+{
+constexpr int kWidth  = 1920;
+constexpr int kHeight = 1080;
+
+std::shared_ptr<Frame> makeFrame(int width, int height)
+{
+    VideoFrameParam param{
+        .enable    = true,
+        .width     = width,
+        .height    = height,
+        .pixFormat = AV_PIX_FMT_YUV420P,
+    };
+    return std::make_shared<Frame>(param);
+}
+
+void fillRandom(std::shared_ptr<Frame> frame)
+{
+    for(int plane = 0; plane < 3; plane++)
+    {
+        int lines = plane == 0 ? kHeight : kHeight / 2;
+        for(int y = 0; y < lines; y++)
+        {
+            uint8_t* line = frame->data()[plane] + y * frame->lineSize(plane);
+            for(int x = 0; x < frame->lineSize(plane); x++)
+            {
+                line[x] = rand() & 0xFF;
+            }
+        }
+    }
+}
+
+void benchFactor(int factor)
+{
+    int  dstWidth  = kWidth / factor;
+    int  dstHeight = kHeight / factor;
+    auto srcFrame  = makeFrame(kWidth, kHeight);
+    auto dstFrame  = makeFrame(dstWidth, dstHeight);
+    if(!srcFrame->isValid() || !dstFrame->isValid())
+    {
+        return;
+    }
+    fillRandom(srcFrame);
+    int64_t     frameBytes = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, kWidth, kHeight, 1);
+    std::string pairName   = "1080p->" + std::to_string(dstHeight) + "p yuv420p";
+
+    for(auto [flags, flagName] : {std::pair<int, const char*>{SWS_BICUBIC, "bicubic"},
+                                  std::pair<int, const char*>{SWS_AREA, "area"}})
+    {
+        SwsContext* swsCtx = sws_getContext(kWidth,
+                                            kHeight,
+                                            AV_PIX_FMT_YUV420P,
+                                            dstWidth,
+                                            dstHeight,
+                                            AV_PIX_FMT_YUV420P,
+                                            flags,
+                                            nullptr,
+                                            nullptr,
+                                            nullptr);
+        if(!swsCtx)
+        {
+            continue;
+        }
+        std::string name = pairName + " swscale " + flagName;
+        printBenchResult(runBench(name, 10, 200, frameBytes, [&]() {
+            sws_scale(swsCtx,
+                      srcFrame->data(),
+                      srcFrame->lineSize(),
+                      0,
+                      kHeight,
+                      dstFrame->data(),
+                      dstFrame->lineSize());
+        }));
+        sws_freeContext(swsCtx);
+    }
+
+    for(auto [algorithm, algorithmName] :
+        {std::pair<ScaleAlgorithm, const char*>{ScaleAlgorithm::BOX, "box"},
+         std::pair<ScaleAlgorithm, const char*>{ScaleAlgorithm::BILINEAR, "bilinear"}})
+    {
+        for(SimdLevel level : {SimdLevel::C, SimdLevel::SSE2, SimdLevel::AVX2})
+        {
+            if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+            {
+                break;
+            }
+            std::string name = pairName + " " + algorithmName + " " + simdLevelName(level);
+            printBenchResult(runBench(name, 10, 200, frameBytes, [&]() {
+                downscale(srcFrame->data(),
+                          srcFrame->lineSize(),
+                          dstFrame->data(),
+                          dstFrame->lineSize(),
+                          AV_PIX_FMT_YUV420P,
+                          kWidth,
+                          kHeight,
+                          dstWidth,
+                          dstHeight,
+                          algorithm,
+                          level);
+            }));
+        }
+    }
+}
+} // namespace
+
+void benchDownscale()
+{
+    benchFactor(2);
+    benchFactor(4);
+}
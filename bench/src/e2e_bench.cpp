@@ -0,0 +1,537 @@
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/dict.h>
+#include <libavutil/pixfmt.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include "bench.h"
+#include "device.h"
+#include "job_metrics.h"
+#include "ladder.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace
+{
+struct EndToEndResult
+{
+    std::string name;
+    // duration of the synthetic source
+    double  mediaSeconds = 0;
+    int64_t frames       = 0;
+    double  wallSeconds  = 0;
+    double  cpuSeconds   = 0;
+    // peak of the whole process, not only this job
+    long             peakRssKb = 0;
+    JobMetricsReport report;
+};
+
+double cpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec +
+           usage.ru_stime.tv_usec / 1e6;
+}
+
+long peakRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+double framesPerSecond(const EndToEndResult& result)
+{
+    return result.wallSeconds > 0 ? result.frames / result.wallSeconds : 0;
+}
+
+void printEndToEndResult(const EndToEndResult& result)
+{
+    double fps = framesPerSecond(result);
+    double rtf = result.wallSeconds > 0 ? result.mediaSeconds / result.wallSeconds : 0;
+    double cpu = result.wallSeconds > 0 ? result.cpuSeconds / result.wallSeconds * 100 : 0;
+    fprintf(stdout,
+            "%-48s %8ld frames %9.1f fps %7.2fx realtime %8.2f s cpu %6.1f%% cpu %8.1f MB rss\n",
+            result.name.c_str(),
+            result.frames,
+            fps,
+            rtf,
+            result.cpuSeconds,
+            cpu,
+            result.peakRssKb / 1024.0);
+}
+
+// fps of the job and busy fps of every stage it went through, so a regression names the
+// stage
+void recordEndToEndResults(const std::vector<EndToEndResult>& results)
+{
+    BenchMetric fps{
+        .name           = results.front().name,
+        .metric         = "fps",
+        .higherIsBetter = true,
+    };
+    for(const EndToEndResult& result : results)
+    {
+        fps.samples.push_back(framesPerSecond(result));
+    }
+    std::sort(fps.samples.begin(), fps.samples.end());
+    fps.value = fps.samples[fps.samples.size() / 2];
+    recordBenchMetric(fps);
+
+    for(size_t stage = 0; stage < (size_t)Stage::COUNT; stage++)
+    {
+        BenchMetric busyFps{
+            .name           = results.front().name,
+            .metric         = std::string(stageName((Stage)stage)) + ".busyFps",
+            .higherIsBetter = true,
+        };
+        for(const EndToEndResult& result : results)
+        {
+            if(result.report.stages[stage].frames > 0)
+            {
+                busyFps.samples.push_back(result.report.stages[stage].busyFps);
+            }
+        }
+        if(busyFps.samples.size() != results.size())
+        {
+            continue;
+        }
+        std::sort(busyFps.samples.begin(), busyFps.samples.end());
+        busyFps.value = busyFps.samples[busyFps.samples.size() / 2];
+        recordBenchMetric(busyFps);
+    }
+}
+
+// run a job with metrics for every repetition, a device is opened for each of them since a
+// source can be read only once. frames are counted at stage, the median run by fps is printed
+void runJob(const std::string&                              name,
+            double                                          mediaSeconds,
+            Stage                                           stage,
+            ReadDeviceDataParam&                            params,
+            const std::function<std::unique_ptr<Device>()>& openDevice,
+            const std::function<void(Device&, ReadDeviceDataParam&)>& job)
+{
+    // the first repetition is traced to <trace>-<job>.json
+    static int  jobIndex    = 0;
+    std::string tracePrefix = benchOption("trace", "");
+
+    std::vector<EndToEndResult> results;
+    for(int rep = 0; rep < benchRepetitions(); rep++)
+    {
+        std::unique_ptr<Device> device = openDevice();
+        params.metrics                 = std::make_shared<JobMetrics>();
+        params.trace                   = nullptr;
+        if(rep == 0 && !tracePrefix.empty())
+        {
+            std::string filename = tracePrefix + "-" + std::to_string(jobIndex++) + ".json";
+            params.trace         = std::make_shared<TraceRecorder>(filename);
+            fprintf(stdout, "    trace %s\n", filename.c_str());
+        }
+
+        double cpuBegin = cpuSeconds();
+        auto   begin    = std::chrono::steady_clock::now();
+        job(*device, params);
+        auto end = std::chrono::steady_clock::now();
+
+        EndToEndResult result;
+        result.name         = name;
+        result.mediaSeconds = mediaSeconds;
+        result.report       = params.metrics->report();
+        result.frames       = result.report.stages[(size_t)stage].frames;
+        result.wallSeconds  = std::chrono::duration<double>(end - begin).count();
+        result.cpuSeconds   = cpuSeconds() - cpuBegin;
+        result.peakRssKb    = peakRssKb();
+        results.push_back(result);
+    }
+    std::sort(results.begin(), results.end(), [](const auto& a, const auto& b) {
+        return framesPerSecond(a) < framesPerSecond(b);
+    });
+    printEndToEndResult(results[results.size() / 2]);
+    recordEndToEndResults(results);
+}
+
+std::vector<std::string> splitList(const std::string& value)
+{
+    std::vector<std::string> items;
+    std::stringstream        ss(value);
+    std::string              item;
+    while(std::getline(ss, item, ','))
+    {
+        if(!item.empty())
+        {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::string tempFilename(const std::string& extension)
+{
+    return "/tmp/avdemo-e2e-" + std::to_string(getpid()) + "." + extension;
+}
+
+// -------------------------- video --------------------------
+// elementary stream the encoder writes, so it can be probed for decode
+const char* videoExtension(const std::string& codec)
+{
+    static const std::map<std::string, const char*> extensions = {
+        {"libx264", "h264"},
+        {"h264_nvenc", "h264"},
+        {"libx265", "hevc"},
+        {"mpeg4", "m4v"},
+        {"mjpeg", "mjpeg"},
+    };
+    auto it = extensions.find(codec);
+    return it == extensions.end() ? nullptr : it->second;
+}
+
+// renditions of the heights, frames are counted at decode so fps is of the source
+void benchLadder(const std::string&      name,
+                 const std::string&      encodedFile,
+                 int                     width,
+                 int                     height,
+                 int                     rate,
+                 int                     seconds,
+                 const std::string&      codec,
+                 const std::vector<int>& heights)
+{
+    LadderParam ladderParam;
+    std::string rungNames;
+    for(int rungHeight : heights)
+    {
+        // keep the aspect ratio, even for 4:2:0
+        int rungWidth = (int)((int64_t)width * rungHeight / height) & ~1;
+        ladderParam.rungs.push_back({
+            .outFilename = "/dev/null",
+            .encodeParam =
+                {
+                    .needEncode = true,
+                    .codecName  = codec,
+                    .bitRate    = (int64_t)rungWidth * rungHeight * rate / 10,
+                    .width      = rungWidth,
+                    .height     = rungHeight,
+                    .gopSize    = rate * 2,
+                    .maxBFrame  = 2,
+                    .hasBFrame  = 1,
+                    .pixFmt     = AV_PIX_FMT_YUV420P,
+                    .framerate  = rate,
+                    .byName     = true,
+                },
+        });
+        rungNames += (rungNames.empty() ? "" : ",") + std::to_string(rungHeight) + "p";
+    }
+
+    ReadDeviceDataParam params{};
+    runJob("ladder " + rungNames + " " + name,
+           seconds,
+           Stage::DECODE,
+           params,
+           [&]() {
+               return std::make_unique<VideoDevice>(encodedFile, DeviceType::ENCAPSULATE_FILE);
+           },
+           [&](Device& device, ReadDeviceDataParam& jobParams) {
+               ladderParam.metrics = jobParams.metrics;
+               ladderParam.trace   = jobParams.trace;
+               static_cast<VideoDevice&>(device).readAndEncodeLadder(ladderParam);
+           });
+}
+
+void benchVideoPipeline(const std::string& source,
+                        int                width,
+                        int                height,
+                        int                rate,
+                        int                seconds,
+                        const std::string& codec)
+{
+    const char* extension = videoExtension(codec);
+    if(!extension)
+    {
+        fprintf(stdout, "    don't know the stream format of %s, skip\n", codec.c_str());
+        return;
+    }
+    std::string size  = std::to_string(width) + "x" + std::to_string(height);
+    std::string graph = source + "=size=" + size + ":rate=" + std::to_string(rate) +
+                        ":duration=" + std::to_string(seconds) + ",format=yuv420p";
+    std::string encodedFile = tempFilename(extension);
+    std::string name        = source + " " + size + "@" + std::to_string(rate) + " " + codec;
+
+    // 1. lavfi -> scale -> encode -> file
+    {
+        ReampleParam scaleParam{
+            .outWidth  = width,
+            .outHeight = height,
+            .outPixFmt = AV_PIX_FMT_YUV420P,
+        };
+        EncoderParam encodeParam{
+            .needEncode = true,
+            .codecName  = codec,
+            .bitRate    = (int64_t)width * height * rate / 10,
+            .width      = width,
+            .height     = height,
+            .gopSize    = rate * 2,
+            .maxBFrame  = 2,
+            .hasBFrame  = 1,
+            .pixFmt     = AV_PIX_FMT_YUV420P,
+            .framerate  = rate,
+            .byName     = true,
+        };
+        ReadDeviceDataParam params{
+            .outFilename   = encodedFile,
+            .resampleParam = scaleParam,
+            .codecParam    = {.encodeParam = encodeParam},
+        };
+        runJob("readAndEncode " + name,
+               seconds,
+               Stage::ENCODE,
+               params,
+               [&]() { return std::make_unique<VideoDevice>(graph, DeviceType::LAVFI); },
+               &Device::readAndEncode);
+    }
+
+    // 2. file -> decode -> raw yuv
+    {
+        ReadDeviceDataParam params{
+            .outFilename  = "/dev/null",
+            .outWidth     = width,
+            .outHeight    = height,
+            .outPixFormat = AV_PIX_FMT_YUV420P,
+        };
+        runJob("readAndDecode " + name,
+               seconds,
+               Stage::DECODE,
+               params,
+               [&]() {
+                   return std::make_unique<VideoDevice>(encodedFile,
+                                                        DeviceType::ENCAPSULATE_FILE);
+               },
+               &Device::readAndDecode);
+    }
+
+    // 3. file -> decode once -> scale/encode every rung, and every rung alone for comparison
+    std::vector<int> heights;
+    for(const std::string& rungHeight : splitList(benchOption("ladder", "")))
+    {
+        heights.push_back(std::stoi(rungHeight));
+    }
+    if(!heights.empty())
+    {
+        benchLadder(name, encodedFile, width, height, rate, seconds, codec, heights);
+        if(heights.size() > 1)
+        {
+            for(int rungHeight : heights)
+            {
+                benchLadder(name, encodedFile, width, height, rate, seconds, codec, {rungHeight});
+            }
+        }
+    }
+    unlink(encodedFile.c_str());
+}
+
+// virtual camera paced to the wall clock -> capture thread -> decode/scale -> encode, frames
+// behind the camera are dropped by the capture thread, so fps below rate means the pipeline
+// doesn't keep up
+void benchLivePipeline(const std::string& source,
+                       const std::string& inputFormat,
+                       int                width,
+                       int                height,
+                       int                rate,
+                       int                seconds,
+                       const std::string& codec)
+{
+    std::string size = std::to_string(width) + "x" + std::to_string(height);
+    std::string name = "live " + source + " " + inputFormat + " " + size + "@" +
+                       std::to_string(rate) + " " + codec;
+
+    ReampleParam scaleParam{
+        .outWidth  = width,
+        .outHeight = height,
+        .outPixFmt = AV_PIX_FMT_YUV420P,
+    };
+    EncoderParam encodeParam{
+        .needEncode = true,
+        .codecName  = codec,
+        .bitRate    = (int64_t)width * height * rate / 10,
+        .width      = width,
+        .height     = height,
+        .gopSize    = rate * 2,
+        .maxBFrame  = 2,
+        .hasBFrame  = 1,
+        .pixFmt     = AV_PIX_FMT_YUV420P,
+        .framerate  = rate,
+        .byName     = true,
+    };
+    ReadDeviceDataParam params{
+        .outFilename   = "/dev/null",
+        .resampleParam = scaleParam,
+        .codecParam    = {.encodeParam = encodeParam},
+    };
+    runJob(name,
+           seconds,
+           Stage::ENCODE,
+           params,
+           [&]() {
+               AVDictionary* options = nullptr;
+               av_dict_set(&options, "video_size", size.c_str(), 0);
+               av_dict_set(&options, "framerate", std::to_string(rate).c_str(), 0);
+               av_dict_set(&options, "input_format", inputFormat.c_str(), 0);
+               av_dict_set(&options, "duration", std::to_string(seconds).c_str(), 0);
+               auto device =
+                   std::make_unique<VideoDevice>(source, DeviceType::VIRTUAL, options);
+               av_dict_free(&options);
+               return device;
+           },
+           &Device::readAndEncode);
+}
+
+// -------------------------- audio --------------------------
+struct AudioCodecInfo
+{
+    AVSampleFormat sampleFmt;
+    // nullptr if packets have no framing, the output can't be decoded again
+    const char* extension;
+};
+
+void benchAudioPipeline(const std::string& source,
+                        int                sampleRate,
+                        int                seconds,
+                        const std::string& codec)
+{
+    static const std::map<std::string, AudioCodecInfo> codecs = {
+        {"aac", {AV_SAMPLE_FMT_FLTP, nullptr}},
+        {"libfdk_aac", {AV_SAMPLE_FMT_S16, nullptr}},
+        {"mp2", {AV_SAMPLE_FMT_S16, "mp2"}},
+        {"libmp3lame", {AV_SAMPLE_FMT_S16P, "mp3"}},
+    };
+    auto it = codecs.find(codec);
+    if(it == codecs.end())
+    {
+        fprintf(stdout, "    don't know the sample format of %s, skip\n", codec.c_str());
+        return;
+    }
+    const AudioCodecInfo& info = it->second;
+
+    // packets of lavfi are packed s16 stereo, like alsa
+    std::string graph = source + "=sample_rate=" + std::to_string(sampleRate) +
+                        ":duration=" + std::to_string(seconds) +
+                        ",aformat=sample_fmts=s16:channel_layouts=stereo";
+    std::string encodedFile = tempFilename(info.extension ? info.extension : "raw");
+    std::string name = source + " " + std::to_string(sampleRate) + "Hz stereo " + codec;
+
+    // 1. lavfi -> resample -> encode -> file
+    {
+        ReampleParam swrParam{
+            .outChannelLayout = AV_CH_LAYOUT_STEREO,
+            .outSampleFmt     = info.sampleFmt,
+            .outSampleRate    = sampleRate,
+            .inChannelLayout  = AV_CH_LAYOUT_STEREO,
+            .inSampleFmt      = AV_SAMPLE_FMT_S16,
+            .inSampleRate     = sampleRate,
+            .logOffset        = 0,
+            .logCtx           = nullptr,
+        };
+        EncoderParam encodeParam{
+            .needEncode    = true,
+            .codecName     = codec,
+            .bitRate       = 128000,
+            .sampleFmt     = info.sampleFmt,
+            .channelLayout = AV_CH_LAYOUT_STEREO,
+            .sampleRate    = sampleRate,
+            .byName        = true,
+        };
+        ReadDeviceDataParam params{
+            .outFilename   = encodedFile,
+            .resampleParam = swrParam,
+            .codecParam    = {.encodeParam = encodeParam},
+        };
+        runJob("readAndEncode " + name,
+               seconds,
+               Stage::ENCODE,
+               params,
+               [&]() { return std::make_unique<AudioDevice>(graph, DeviceType::LAVFI); },
+               &Device::readAndEncode);
+    }
+
+    // 2. file -> decode -> pcm
+    if(info.extension)
+    {
+        ReadDeviceDataParam params{
+            .outFilename      = "/dev/null",
+            .outChannelLayout = AV_CH_LAYOUT_STEREO,
+            .outSampleFmt     = AV_SAMPLE_FMT_S16,
+            .outSampleRate    = sampleRate,
+        };
+        runJob("readAndDecode " + name,
+               seconds,
+               Stage::DECODE,
+               params,
+               [&]() {
+                   return std::make_unique<AudioDevice>(encodedFile,
+                                                        DeviceType::ENCAPSULATE_FILE);
+               },
+               &Device::readAndDecode);
+    }
+    unlink(encodedFile.c_str());
+}
+} // namespace
+
+// whole readAndEncode/readAndDecode jobs fed by lavfi generators, no device or media file is
+// needed. every job runs -r times. options:
+//   --seconds=5 --vsrc=testsrc2 --size=1280x720,1920x1080 --rate=30 --vcodec=libx264
+//   --asrc=sine,anoisesrc --samplerate=48000 --acodec=aac,mp2 --trace=/tmp/e2e
+//   --virtual=mjpeg,yuyv422 runs live jobs on a virtual camera of every input format too
+//   --ladder=720,480,360 encodes the decoded file into renditions of the heights in one
+//   ladder job, then in a job of every rung alone
+void benchEndToEnd()
+{
+    int seconds = std::stoi(benchOption("seconds", "5"));
+    int rate    = std::stoi(benchOption("rate", "30"));
+    for(const std::string& source : splitList(benchOption("vsrc", "testsrc2")))
+    {
+        for(const std::string& size : splitList(benchOption("size", "1280x720,1920x1080")))
+        {
+            int width = 0, height = 0;
+            if(sscanf(size.c_str(), "%dx%d", &width, &height) != 2)
+            {
+                fprintf(stderr, "invalid size %s\n", size.c_str());
+                continue;
+            }
+            for(const std::string& codec : splitList(benchOption("vcodec", "libx264")))
+            {
+                benchVideoPipeline(source, width, height, rate, seconds, codec);
+            }
+            // live jobs take the wall clock time of the media
+            for(const std::string& inputFormat : splitList(benchOption("virtual", "")))
+            {
+                for(const std::string& codec : splitList(benchOption("vcodec", "libx264")))
+                {
+                    benchLivePipeline(source, inputFormat, width, height, rate, seconds, codec);
+                }
+            }
+        }
+    }
+
+    int sampleRate = std::stoi(benchOption("samplerate", "48000"));
+    for(const std::string& source : splitList(benchOption("asrc", "sine,anoisesrc")))
+    {
+        for(const std::string& codec : splitList(benchOption("acodec", "aac,mp2")))
+        {
+            benchAudioPipeline(source, sampleRate, seconds, codec);
+        }
+    }
+}
@@ -0,0 +1,164 @@
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+#include "bench.h"
+#include "codec.h"
+#include "frame.h"
+#include "frame_allocator.h"
+
+#include <memory>
+
+namespace
+{
+constexpr int kWidth  = 3840;
+constexpr int kHeight = 2160;
+
+void fillPattern(std::shared_ptr<Frame> frame, int seed)
+{
+    AVFrame* f = frame->getAVFrame();
+    for(int y = 0; y < f->height; y++)
+    {
+        uint8_t* line = f->data[0] + y * f->linesize[0];
+        for(int x = 0; x < f->width; x++)
+        {
+            line[x] = (uint8_t)(x + y + seed);
+        }
+    }
+    // yuv422p chroma: half width, full height
+    for(int plane = 1; plane < 3; plane++)
+    {
+        for(int y = 0; y < f->height; y++)
+        {
+            uint8_t* line = f->data[plane] + y * f->linesize[plane];
+            for(int x = 0; x < f->width / 2; x++)
+            {
+                line[x] = (uint8_t)(x * plane + y + seed);
+            }
+        }
+    }
+}
+
+void benchScaleAndEncode(FrameAllocType allocType, const char* allocName)
+{
+    VideoFrameParam srcParam{
+        .enable    = true,
+        .width     = kWidth,
+        .height    = kHeight,
+        .pixFormat = AV_PIX_FMT_YUV422P,
+        .allocType = allocType,
+    };
+    VideoFrameParam dstParam{
+        .enable    = true,
+        .width     = kWidth,
+        .height    = kHeight,
+        .pixFormat = AV_PIX_FMT_YUV420P,
+        .allocType = allocType,
+    };
+    auto srcFrame = std::make_shared<Frame>(srcParam);
+    auto dstFrame = std::make_shared<Frame>(dstParam);
+    if(!srcFrame->isValid() || !dstFrame->isValid())
+    {
+        fprintf(stderr, "failed to alloc 4K frame with %s\n", allocName);
+        return;
+    }
+    fillPattern(srcFrame, 0);
+
+    SwsContext* swsCtx = sws_getContext(kWidth,
+                                        kHeight,
+                                        AV_PIX_FMT_YUV422P,
+                                        kWidth,
+                                        kHeight,
+                                        AV_PIX_FMT_YUV420P,
+                                        SWS_BICUBIC,
+                                        nullptr,
+                                        nullptr,
+                                        nullptr);
+    if(!swsCtx)
+    {
+        return;
+    }
+    int64_t frameBytes = av_image_get_buffer_size(AV_PIX_FMT_YUV422P, kWidth, kHeight, 1);
+
+    auto scale = [&]() {
+        sws_scale(swsCtx,
+                  srcFrame->data(),
+                  srcFrame->lineSize(),
+                  0,
+                  kHeight,
+                  dstFrame->data(),
+                  dstFrame->lineSize());
+    };
+    printBenchResult(runBench(std::string("scale 4K 422p->420p ") + allocName,
+                              3,
+                              60,
+                              frameBytes,
+                              scale));
+
+    EncoderParam encodeParam{
+        .needEncode = true,
+        .codecName  = "libx264",
+        .bitRate    = 8000000,
+        .width      = kWidth,
+        .height     = kHeight,
+        .gopSize    = 30,
+        .pixFmt     = AV_PIX_FMT_YUV420P,
+        .framerate  = 30,
+        .byName     = true,
+    };
+    CodecParam codecParam{.encodeParam = encodeParam};
+    auto       videoCodec = std::make_shared<VideoCodec>(codecParam);
+    AVPacket*  pkt        = av_packet_alloc();
+    if(videoCodec->encodeEnable() && pkt)
+    {
+        int64_t encodedBytes = 0;
+        auto    cb           = [&](AVPacket* p) { encodedBytes += p->size; };
+        auto    scaleEncode  = [&]() {
+            scale();
+            dstFrame->getAVFrame()->pts++;
+            videoCodec->encode(dstFrame, pkt, cb);
+        };
+        printBenchResult(runBench(std::string("scale+encode 4K libx264 ") + allocName,
+                                  5,
+                                  30,
+                                  frameBytes,
+                                  scaleEncode));
+        videoCodec->encode(dstFrame, pkt, cb, true);
+    }
+
+    if(pkt)
+    {
+        av_packet_free(&pkt);
+    }
+    sws_freeContext(swsCtx);
+}
+
+void benchPoolAlloc(FrameAllocType allocType, const char* allocName)
+{
+    int             bufferSize = Frame::videoBufferSize(kWidth, kHeight, AV_PIX_FMT_YUV420P);
+    FrameBufferPool pool(bufferSize, allocType);
+    VideoFrameParam param{
+        .enable    = true,
+        .width     = kWidth,
+        .height    = kHeight,
+        .pixFormat = AV_PIX_FMT_YUV420P,
+        .pool      = &pool,
+    };
+    printBenchResult(runBench(std::string("pooled 4K frame ctor ") + allocName,
+                              3,
+                              200,
+                              bufferSize,
+                              [&]() { auto frame = std::make_shared<Frame>(param); }));
+}
+} // namespace
+
+void benchHugePageFrame()
+{
+    benchScaleAndEncode(FrameAllocType::DEFAULT, "(normal page)");
+    benchScaleAndEncode(FrameAllocType::HUGE_PAGE, "(huge page)");
+    benchPoolAlloc(FrameAllocType::DEFAULT, "(normal page)");
+    benchPoolAlloc(FrameAllocType::HUGE_PAGE, "(huge page)");
+}
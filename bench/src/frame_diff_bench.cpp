@@ -0,0 +1,84 @@
+extern "C"
+{
+#include <libavutil/imgutils.h>
+}
+
+#include "bench.h"
+#include "frame.h"
+#include "frame_diff.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace
+{
+constexpr int kWidth  = 1920;
+constexpr int kHeight = 1080;
+
+// packed YUYV422, the usual format of a camera
+std::shared_ptr<Frame> makeFrame()
+{
+    VideoFrameParam param{
+        .enable    = true,
+        .width     = kWidth,
+        .height    = kHeight,
+        .pixFormat = AV_PIX_FMT_YUYV422,
+    };
+    return std::make_shared<Frame>(param);
+}
+} // namespace
+
+void benchFrameDiff()
+{
+    auto frame = makeFrame();
+    auto same  = makeFrame();
+    if(!frame->isValid() || !same->isValid())
+    {
+        return;
+    }
+    for(int y = 0; y < kHeight; y++)
+    {
+        uint8_t* line = frame->data()[0] + y * frame->lineSize(0);
+        for(int x = 0; x < kWidth * 2; x++)
+        {
+            line[x] = rand() & 0xFF;
+        }
+        memcpy(same->data()[0] + y * same->lineSize(0), line, kWidth * 2);
+    }
+    int64_t frameBytes = av_image_get_buffer_size(AV_PIX_FMT_YUYV422, kWidth, kHeight, 1);
+
+    // whole frame SAD, the cost of a static frame
+    for(SimdLevel level : {SimdLevel::C, SimdLevel::SSE2, SimdLevel::AVX2})
+    {
+        if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+        {
+            break;
+        }
+        std::string name = std::string("1080p yuyv422 sad ") + simdLevelName(level);
+        uint64_t    sad  = 0;
+        printBenchResult(runBench(name, 10, 200, frameBytes, [&]() {
+            sad = 0;
+            for(int y = 0; y < kHeight; y++)
+            {
+                sad += sadLine(frame->data()[0] + y * frame->lineSize(0),
+                               same->data()[0] + y * same->lineSize(0),
+                               kWidth * 2,
+                               level);
+            }
+        }));
+        fprintf(stdout, "    sad %lu\n", sad);
+    }
+
+    // detector on a static stream, every frame is compared and dropped
+    FrameDiffParam param{
+        .enable    = true,
+        .threshold = 1.0,
+    };
+    FrameDiffDetector detector(param);
+    detector.isDuplicate(frame->getAVFrame());
+    printBenchResult(runBench("1080p yuyv422 static frame detect", 10, 200, frameBytes, [&]() {
+        detector.isDuplicate(same->getAVFrame());
+    }));
+}
@@ -0,0 +1,90 @@
+// the bench is a release build, keep AV_LOG_D compiled in
+#define AV_LOG_MIN_LEVEL 0
+
+#include "bench.h"
+#include "log.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+namespace
+{
+// what AV_LOG_* did before the async logger
+#define SYNC_LOG_D(file, format, ...)                                                      \
+    {                                                                                      \
+        time_t    t = time(0);                                                             \
+        struct tm ptm;                                                                     \
+        memset(&ptm, 0, sizeof(ptm));                                                      \
+        localtime_r(&t, &ptm);                                                             \
+        fprintf(file,                                                                      \
+                "[ DEBUG] [%4d-%02d-%02d %02d:%02d:%02d ] [ %s:%s:%d ] " format "\n",      \
+                ptm.tm_year + 1900,                                                        \
+                ptm.tm_mon + 1,                                                            \
+                ptm.tm_mday,                                                               \
+                ptm.tm_hour,                                                               \
+                ptm.tm_min,                                                                \
+                ptm.tm_sec,                                                                \
+                __FILE__,                                                                  \
+                __FUNCTION__,                                                              \
+                __LINE__,                                                                  \
+                ##__VA_ARGS__);                                                            \
+    }
+} // namespace
+
+void benchLogger()
+{
+    FILE* devNull = fopen("/dev/null", "w");
+    if(!devNull)
+    {
+        fprintf(stderr, "can't open /dev/null\n");
+        return;
+    }
+    logSetOutput(devNull);
+    logFlush();
+    LogLevel level = logLevel();
+    logSetLevel(LogLevel::DEBUG);
+
+    // per packet log of the encode callback, fewer than a ring can hold so nothing is dropped.
+    // no rate limit, every call is written to the ring
+    uint32_t rateLimit = logRateLimit();
+    logSetRateLimit(0);
+    int size = 0;
+    printBenchResult(runBench("log sync fprintf", 100, 2000, 0, [&]() {
+        SYNC_LOG_D(devNull, "write data %d", size++);
+    }));
+    printBenchResult(runBench("log async", 100, 2000, 0, [&]() {
+        AV_LOG_D("write data %d", size++);
+    }));
+    logFlush();
+
+    const char* name = "libx264";
+    printBenchResult(runBench("log sync fprintf, string arg", 100, 2000, 0, [&]() {
+        size++;
+        SYNC_LOG_D(devNull, "codec %s frame %d pts %ld", name, size, (long)size * 512);
+    }));
+    printBenchResult(runBench("log async, string arg", 100, 2000, 0, [&]() {
+        size++;
+        AV_LOG_D("codec %s frame %d pts %ld", name, size, (long)size * 512);
+    }));
+    logFlush();
+    logSetRateLimit(rateLimit);
+
+    // a debug log left on in a hot loop
+    logSetLevel(LogLevel::INFO);
+    printBenchResult(runBench("log debug, filtered at runtime", 100, 100000, 0, [&]() {
+        AV_LOG_D("write data %d", size++);
+    }));
+    logSetLevel(LogLevel::DEBUG);
+    logSetRateLimit(10);
+    printBenchResult(runBench("log debug, rate limited", 100, 100000, 0, [&]() {
+        AV_LOG_D("write data %d", size++);
+    }));
+    logSetRateLimit(rateLimit);
+    logFlush();
+
+    fprintf(stdout, "    dropped %lu\n", logDroppedCount());
+    logSetLevel(level);
+    logSetOutput(nullptr);
+    fclose(devNull);
+}
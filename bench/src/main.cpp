@@ -0,0 +1,99 @@
+extern "C"
+{
+#include <libavdevice/avdevice.h>
+#include <libavutil/avutil.h>
+}
+
+#include "bench.h"
+#include "log.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    avdevice_register_all();
+    av_log_set_level(AV_LOG_ERROR);
+    logSetLevel(LogLevel::WARNING);
+
+    std::vector<std::pair<std::string, void (*)()>> cases = {
+        {"hugepage", benchHugePageFrame},
+        {"pixfmt", benchPixFmtConvert},
+        {"samplefmt", benchSampleFmtConvert},
+        {"downscale", benchDownscale},
+        {"mixer", benchAudioMixer},
+        {"quality", benchQualityMeter},
+        {"framediff", benchFrameDiff},
+        {"swscache", benchSwsCache},
+        {"codecpool", benchCodecPool},
+        {"codecregistry", benchCodecRegistry},
+        {"log", benchLogger},
+        {"frame", benchFrame},
+        {"swr", benchSwrConvertor},
+        {"sws", benchSwsConvertor},
+        {"encode", benchEncode},
+        {"writeimage", benchWriteImage},
+        {"stagetimer", benchStageTimer},
+        {"e2e", benchEndToEnd},
+    };
+
+    // ./avdemo-bench [-r repetitions] [--name=value...] [case name...], run all cases if no
+    // name is given. --json=path writes the results, --baseline=path compares them with
+    // a report written by --json and exits with 1 if any metric regressed, see
+    // compareBenchBaseline for --threshold=0.05 and --alpha=0.05
+    std::vector<std::string> names;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            setBenchRepetitions(atoi(argv[++i]));
+        }
+        else if(strncmp(argv[i], "--", 2) == 0 && strchr(argv[i], '='))
+        {
+            const char* eq = strchr(argv[i], '=');
+            setBenchOption(std::string(argv[i] + 2, eq - argv[i] - 2), eq + 1);
+        }
+        else
+        {
+            names.push_back(argv[i]);
+        }
+    }
+    for(auto& [name, fn] : cases)
+    {
+        bool selected = names.empty();
+        for(auto& selectedName : names)
+        {
+            if(selectedName == name)
+            {
+                selected = true;
+            }
+        }
+        if(selected)
+        {
+            fprintf(stdout, "---------- %s ----------\n", name.c_str());
+            setBenchCase(name);
+            fn();
+        }
+    }
+
+    std::string jsonPath = benchOption("json", "");
+    if(!jsonPath.empty() && !writeBenchReport(jsonPath))
+    {
+        return 2;
+    }
+    std::string baselinePath = benchOption("baseline", "");
+    if(!baselinePath.empty())
+    {
+        int regressions = compareBenchBaseline(baselinePath,
+                                               atof(benchOption("threshold", "0.05").c_str()),
+                                               atof(benchOption("alpha", "0.05").c_str()));
+        if(regressions != 0)
+        {
+            return regressions < 0 ? 2 : 1;
+        }
+    }
+    return 0;
+}
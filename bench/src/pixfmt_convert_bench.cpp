@@ -0,0 +1,111 @@
+extern "C"
+{
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+#include "bench.h"
+#include "frame.h"
+#include "pixfmt_convert.h"
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+namespace
+{
+constexpr int kWidth  = 1920;
+constexpr int kHeight = 1080;
+
+std::shared_ptr<Frame> makeFrame(int pixFmt)
+{
+    VideoFrameParam param{
+        .enable    = true,
+        .width     = kWidth,
+        .height    = kHeight,
+        .pixFormat = pixFmt,
+    };
+    return std::make_shared<Frame>(param);
+}
+
+void fillRandom(std::shared_ptr<Frame> frame)
+{
+    for(int plane = 0; plane < 4 && frame->data()[plane]; plane++)
+    {
+        // only yuv422p has full height chroma in the formats here
+        int lines = plane == 0 || frame->format() == AV_PIX_FMT_YUV422P ? kHeight : kHeight / 2;
+        for(int y = 0; y < lines; y++)
+        {
+            uint8_t* line = frame->data()[plane] + y * frame->lineSize(plane);
+            for(int x = 0; x < frame->lineSize(plane); x++)
+            {
+                line[x] = rand() & 0xFF;
+            }
+        }
+    }
+}
+
+void benchPair(int srcPixFmt, int dstPixFmt, const char* pairName)
+{
+    auto srcFrame = makeFrame(srcPixFmt);
+    auto dstFrame = makeFrame(dstPixFmt);
+    if(!srcFrame->isValid() || !dstFrame->isValid())
+    {
+        return;
+    }
+    fillRandom(srcFrame);
+    int64_t frameBytes = av_image_get_buffer_size((AVPixelFormat)srcPixFmt, kWidth, kHeight, 1);
+
+    SwsContext* swsCtx = sws_getContext(kWidth,
+                                        kHeight,
+                                        (AVPixelFormat)srcPixFmt,
+                                        kWidth,
+                                        kHeight,
+                                        (AVPixelFormat)dstPixFmt,
+                                        SWS_BICUBIC,
+                                        nullptr,
+                                        nullptr,
+                                        nullptr);
+    if(swsCtx)
+    {
+        printBenchResult(runBench(std::string(pairName) + " swscale", 10, 200, frameBytes, [&]() {
+            sws_scale(swsCtx,
+                      srcFrame->data(),
+                      srcFrame->lineSize(),
+                      0,
+                      kHeight,
+                      dstFrame->data(),
+                      dstFrame->lineSize());
+        }));
+        sws_freeContext(swsCtx);
+    }
+
+    for(SimdLevel level : {SimdLevel::C, SimdLevel::SSE2, SimdLevel::AVX2})
+    {
+        if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+        {
+            break;
+        }
+        std::string name = std::string(pairName) + " " + simdLevelName(level);
+        printBenchResult(runBench(name, 10, 200, frameBytes, [&]() {
+            convertPixFmt(srcFrame->data(),
+                          srcFrame->lineSize(),
+                          srcPixFmt,
+                          dstFrame->data(),
+                          dstFrame->lineSize(),
+                          dstPixFmt,
+                          kWidth,
+                          kHeight,
+                          level);
+        }));
+    }
+}
+} // namespace
+
+void benchPixFmtConvert()
+{
+    benchPair(AV_PIX_FMT_YUYV422, AV_PIX_FMT_YUV420P, "1080p yuyv422->yuv420p");
+    benchPair(AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P, "1080p nv12->yuv420p");
+    benchPair(AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, "1080p yuv420p->nv12");
+    benchPair(AV_PIX_FMT_YUV422P, AV_PIX_FMT_YUV420P, "1080p yuv422p->yuv420p");
+}
@@ -0,0 +1,71 @@
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+}
+
+#include "bench.h"
+#include "frame.h"
+#include "quality_meter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+namespace
+{
+constexpr int kWidth  = 1920;
+constexpr int kHeight = 1080;
+
+std::shared_ptr<Frame> makeFrame()
+{
+    VideoFrameParam param{
+        .enable    = true,
+        .width     = kWidth,
+        .height    = kHeight,
+        .pixFormat = AV_PIX_FMT_YUV420P,
+    };
+    return std::make_shared<Frame>(param);
+}
+} // namespace
+
+void benchQualityMeter()
+{
+    auto ref  = makeFrame();
+    auto dist = makeFrame();
+    if(!ref->isValid() || !dist->isValid())
+    {
+        return;
+    }
+    // distorted frame is the reference with small noise, like a encoded frame
+    for(int plane = 0; plane < 3; plane++)
+    {
+        int lines = plane == 0 ? kHeight : kHeight / 2;
+        for(int y = 0; y < lines; y++)
+        {
+            uint8_t* refLine  = ref->data()[plane] + y * ref->lineSize(plane);
+            uint8_t* distLine = dist->data()[plane] + y * dist->lineSize(plane);
+            for(int x = 0; x < ref->lineSize(plane); x++)
+            {
+                refLine[x]  = rand() & 0xFF;
+                distLine[x] = std::min(255, std::max(0, refLine[x] + rand() % 9 - 4));
+            }
+        }
+    }
+    int64_t frameBytes = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, kWidth, kHeight, 1);
+
+    for(SimdLevel level : {SimdLevel::C, SimdLevel::SSE2, SimdLevel::AVX2})
+    {
+        if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+        {
+            break;
+        }
+        FrameQuality quality;
+        std::string  name = std::string("1080p yuv420p psnr+ssim ") + simdLevelName(level);
+        printBenchResult(runBench(name, 10, 200, frameBytes, [&]() {
+            QualityMeter::measure(ref->getAVFrame(), dist->getAVFrame(), quality, level);
+        }));
+        fprintf(stdout, "    psnr %.3f ssim %.5f\n", quality.psnrAll, quality.ssimAll);
+    }
+}
@@ -0,0 +1,471 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+std::string              g_benchCase;
+std::vector<BenchMetric> g_metrics;
+
+// -------------------------- json --------------------------
+// just enough json to read back what writeBenchReport writes
+struct JsonValue
+{
+    enum Type
+    {
+        NUL,
+        BOOL,
+        NUMBER,
+        STRING,
+        ARRAY,
+        OBJECT,
+    };
+    Type        type    = NUL;
+    bool        boolean = false;
+    double      number  = 0;
+    std::string string;
+    // elements of an array, values of an object
+    std::vector<JsonValue>   values;
+    std::vector<std::string> keys;
+
+    const JsonValue* find(const std::string& key) const
+    {
+        for(size_t i = 0; i < keys.size(); i++)
+        {
+            if(keys[i] == key)
+            {
+                return &values[i];
+            }
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser
+{
+public:
+    explicit JsonParser(const std::string& text) : m_text(text) { }
+
+    bool parse(JsonValue& value)
+    {
+        return parseValue(value) && (skipSpace(), m_pos == m_text.size());
+    }
+
+private:
+    void skipSpace()
+    {
+        while(m_pos < m_text.size() && isspace((unsigned char)m_text[m_pos]))
+        {
+            m_pos++;
+        }
+    }
+
+    bool consume(char c)
+    {
+        skipSpace();
+        if(m_pos < m_text.size() && m_text[m_pos] == c)
+        {
+            m_pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool consumeWord(const char* word)
+    {
+        size_t length = strlen(word);
+        if(m_text.compare(m_pos, length, word) != 0)
+        {
+            return false;
+        }
+        m_pos += length;
+        return true;
+    }
+
+    bool parseString(std::string& str)
+    {
+        if(!consume('"'))
+        {
+            return false;
+        }
+        while(m_pos < m_text.size())
+        {
+            char c = m_text[m_pos++];
+            if(c == '"')
+            {
+                return true;
+            }
+            if(c != '\\')
+            {
+                str += c;
+                continue;
+            }
+            if(m_pos >= m_text.size())
+            {
+                return false;
+            }
+            c = m_text[m_pos++];
+            switch(c)
+            {
+            case 'n': str += '\n'; break;
+            case 't': str += '\t'; break;
+            case 'r': str += '\r'; break;
+            case 'b': str += '\b'; break;
+            case 'f': str += '\f'; break;
+            case 'u':
+                // only the control characters writeBenchReport escapes
+                if(m_pos + 4 > m_text.size())
+                {
+                    return false;
+                }
+                str += (char)strtol(m_text.substr(m_pos, 4).c_str(), nullptr, 16);
+                m_pos += 4;
+                break;
+            default: str += c; break;
+            }
+        }
+        return false;
+    }
+
+    bool parseValue(JsonValue& value)
+    {
+        skipSpace();
+        if(m_pos >= m_text.size())
+        {
+            return false;
+        }
+        char c = m_text[m_pos];
+        if(c == '{')
+        {
+            m_pos++;
+            value.type = JsonValue::OBJECT;
+            if(consume('}'))
+            {
+                return true;
+            }
+            do
+            {
+                std::string key;
+                skipSpace();
+                if(!parseString(key) || !consume(':'))
+                {
+                    return false;
+                }
+                value.keys.push_back(key);
+                value.values.emplace_back();
+                if(!parseValue(value.values.back()))
+                {
+                    return false;
+                }
+            } while(consume(','));
+            return consume('}');
+        }
+        if(c == '[')
+        {
+            m_pos++;
+            value.type = JsonValue::ARRAY;
+            if(consume(']'))
+            {
+                return true;
+            }
+            do
+            {
+                value.values.emplace_back();
+                if(!parseValue(value.values.back()))
+                {
+                    return false;
+                }
+            } while(consume(','));
+            return consume(']');
+        }
+        if(c == '"')
+        {
+            value.type = JsonValue::STRING;
+            return parseString(value.string);
+        }
+        if(consumeWord("true"))
+        {
+            value.type    = JsonValue::BOOL;
+            value.boolean = true;
+            return true;
+        }
+        if(consumeWord("false"))
+        {
+            value.type = JsonValue::BOOL;
+            return true;
+        }
+        if(consumeWord("null"))
+        {
+            value.type = JsonValue::NUL;
+            return true;
+        }
+        const char* begin = m_text.c_str() + m_pos;
+        char*       end   = nullptr;
+        value.type        = JsonValue::NUMBER;
+        value.number      = strtod(begin, &end);
+        if(end == begin)
+        {
+            return false;
+        }
+        m_pos += end - begin;
+        return true;
+    }
+
+    const std::string& m_text;
+    size_t             m_pos = 0;
+};
+
+std::string jsonString(const std::string& str)
+{
+    std::string out = "\"";
+    for(char c : str)
+    {
+        if(c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if((unsigned char)c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// -------------------------- statistics --------------------------
+double median(std::vector<double> samples)
+{
+    if(samples.empty())
+    {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+// P(U <= u) of the Mann-Whitney U statistic of n and m samples from the same distribution.
+// exact for small samples, normal approximation otherwise
+double mannWhitneyCdf(double u, int n, int m)
+{
+    if(n * m > 400)
+    {
+        double mean  = n * m / 2.0;
+        double sigma = std::sqrt(n * m * (n + m + 1) / 12.0);
+        return 0.5 * std::erfc(-(u + 0.5 - mean) / sigma / std::sqrt(2.0));
+    }
+
+    // counts[i][j][k]: orderings of i and j samples whose U is k, counts(i, j) is
+    // counts(i - 1, j) shifted by j plus counts(i, j - 1)
+    int                                           maxU = n * m;
+    std::vector<std::vector<std::vector<double>>> counts(
+        n + 1, std::vector<std::vector<double>>(m + 1, std::vector<double>(maxU + 1, 0)));
+    for(int i = 0; i <= n; i++)
+    {
+        for(int j = 0; j <= m; j++)
+        {
+            if(i == 0 || j == 0)
+            {
+                counts[i][j][0] = 1;
+                continue;
+            }
+            for(int k = 0; k <= i * j; k++)
+            {
+                counts[i][j][k] = counts[i][j - 1][k] + (k >= j ? counts[i - 1][j][k - j] : 0);
+            }
+        }
+    }
+    double total = 0, below = 0;
+    for(int k = 0; k <= maxU; k++)
+    {
+        total += counts[n][m][k];
+        if(k <= u)
+        {
+            below += counts[n][m][k];
+        }
+    }
+    return below / total;
+}
+
+// p-value of "current is worse than baseline"
+double regressionPValue(const std::vector<double>& baseline,
+                        const std::vector<double>& current,
+                        bool                       higherIsBetter)
+{
+    // pairs in which current is better, few of them means a regression
+    double u = 0;
+    for(double b : baseline)
+    {
+        for(double c : current)
+        {
+            if(c == b)
+            {
+                u += 0.5;
+            }
+            else if((c > b) == higherIsBetter)
+            {
+                u += 1;
+            }
+        }
+    }
+    return mannWhitneyCdf(u, (int)baseline.size(), (int)current.size());
+}
+} // namespace
+
+void setBenchCase(const std::string& benchCase)
+{
+    g_benchCase = benchCase;
+}
+
+void recordBenchMetric(BenchMetric metric)
+{
+    metric.benchCase = g_benchCase;
+    g_metrics.push_back(std::move(metric));
+}
+
+bool writeBenchReport(const std::string& path)
+{
+    std::ostringstream os;
+    os.precision(17);
+    os << "{\n  \"repetitions\": " << benchRepetitions() << ",\n  \"results\": [";
+    for(size_t i = 0; i < g_metrics.size(); i++)
+    {
+        const BenchMetric& metric = g_metrics[i];
+        os << (i == 0 ? "\n" : ",\n") << "    {\"case\": " << jsonString(metric.benchCase)
+           << ", \"name\": " << jsonString(metric.name)
+           << ", \"metric\": " << jsonString(metric.metric)
+           << ", \"better\": " << (metric.higherIsBetter ? "\"higher\"" : "\"lower\"")
+           << ", \"value\": " << metric.value << ", \"samples\": [";
+        for(size_t j = 0; j < metric.samples.size(); j++)
+        {
+            os << (j == 0 ? "" : ", ") << metric.samples[j];
+        }
+        os << "]}";
+    }
+    os << "\n  ]\n}\n";
+
+    std::ofstream ofs(path, std::ios::trunc);
+    if(!ofs.is_open())
+    {
+        fprintf(stderr, "failed to open %s\n", path.c_str());
+        return false;
+    }
+    ofs << os.str();
+    return ofs.good();
+}
+
+int compareBenchBaseline(const std::string& path, double threshold, double alpha)
+{
+    std::ifstream ifs(path);
+    if(!ifs.is_open())
+    {
+        fprintf(stderr, "failed to open baseline %s\n", path.c_str());
+        return -1;
+    }
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    std::string text = ss.str();
+
+    JsonValue        root;
+    const JsonValue* results = nullptr;
+    if(!JsonParser(text).parse(root) || !(results = root.find("results")) ||
+       results->type != JsonValue::ARRAY)
+    {
+        fprintf(stderr, "invalid baseline %s\n", path.c_str());
+        return -1;
+    }
+
+    fprintf(stdout,
+            "---------- baseline %s, threshold %.1f%%, alpha %.3f ----------\n",
+            path.c_str(),
+            threshold * 100,
+            alpha);
+    int regressions = 0, compared = 0;
+    for(const BenchMetric& metric : g_metrics)
+    {
+        const JsonValue* baseline = nullptr;
+        for(const JsonValue& result : results->values)
+        {
+            const JsonValue* name = result.find("name");
+            const JsonValue* key  = result.find("metric");
+            if(name && key && name->string == metric.name && key->string == metric.metric)
+            {
+                baseline = &result;
+                break;
+            }
+        }
+        if(!baseline)
+        {
+            continue;
+        }
+
+        std::vector<double> baselineSamples;
+        if(const JsonValue* samples = baseline->find("samples"))
+        {
+            for(const JsonValue& sample : samples->values)
+            {
+                baselineSamples.push_back(sample.number);
+            }
+        }
+        const JsonValue* value         = baseline->find("value");
+        double           baselineValue = value ? value->number : median(baselineSamples);
+        if(baselineValue <= 0 || metric.value <= 0)
+        {
+            continue;
+        }
+        compared++;
+
+        // > 0 is worse
+        double change = metric.higherIsBetter ? baselineValue / metric.value - 1
+                                              : metric.value / baselineValue - 1;
+        if(change <= threshold)
+        {
+            continue;
+        }
+        // too few repetitions to tell noise, the threshold alone decides
+        char significance[32] = "too few samples to test";
+        if(baselineSamples.size() >= 3 && metric.samples.size() >= 3)
+        {
+            double p = regressionPValue(baselineSamples, metric.samples, metric.higherIsBetter);
+            if(p > alpha)
+            {
+                fprintf(stdout,
+                        "noise: [%s] %s %s %+.1f%% (p=%.3f)\n",
+                        metric.benchCase.c_str(),
+                        metric.name.c_str(),
+                        metric.metric.c_str(),
+                        change * 100,
+                        p);
+                continue;
+            }
+            snprintf(significance, sizeof(significance), "p=%.3f", p);
+        }
+        regressions++;
+        fprintf(stdout,
+                "REGRESSION: [%s] %s %s %.4g -> %.4g (%+.1f%% worse, %s)\n",
+                metric.benchCase.c_str(),
+                metric.name.c_str(),
+                metric.metric.c_str(),
+                baselineValue,
+                metric.value,
+                change * 100,
+                significance);
+    }
+    fprintf(stdout, "%d of %d metrics regressed\n", regressions, compared);
+    return regressions;
+}
@@ -0,0 +1,122 @@
+extern "C"
+{
+#include <libavutil/channel_layout.h>
+#include <libavutil/mem.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+}
+
+#include "bench.h"
+#include "sample_convert.h"
+
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+// one aac frame of 48k stereo
+constexpr int kChannels  = 2;
+constexpr int kSamples   = 1024;
+constexpr int kRate      = 48000;
+constexpr int kIteration = 20000;
+
+void fillRandom(uint8_t* const data[], int sampleFmt)
+{
+    int planes = av_sample_fmt_is_planar((AVSampleFormat)sampleFmt) ? kChannels : 1;
+    int bytes  = av_get_bytes_per_sample((AVSampleFormat)sampleFmt) * kSamples * kChannels / planes;
+    for(int plane = 0; plane < planes; plane++)
+    {
+        for(int i = 0; i < bytes; i++)
+        {
+            data[plane][i] = rand() & 0xFF;
+        }
+    }
+    // random bytes of float/double may be nan or huge number, use [-1.0, 1.0)
+    if(av_get_packed_sample_fmt((AVSampleFormat)sampleFmt) == AV_SAMPLE_FMT_FLT)
+    {
+        for(int plane = 0; plane < planes; plane++)
+        {
+            float* samples = reinterpret_cast<float*>(data[plane]);
+            for(int i = 0; i < bytes / 4; i++)
+            {
+                samples[i] = (rand() % 65536 - 32768) / 32768.0f;
+            }
+        }
+    }
+    else if(av_get_packed_sample_fmt((AVSampleFormat)sampleFmt) == AV_SAMPLE_FMT_DBL)
+    {
+        for(int plane = 0; plane < planes; plane++)
+        {
+            double* samples = reinterpret_cast<double*>(data[plane]);
+            for(int i = 0; i < bytes / 8; i++)
+            {
+                samples[i] = (rand() % 65536 - 32768) / 32768.0;
+            }
+        }
+    }
+}
+
+void benchPair(int srcSampleFmt, int dstSampleFmt, const char* pairName)
+{
+    uint8_t** srcData = nullptr;
+    uint8_t** dstData = nullptr;
+    int       lineSize;
+    if(av_samples_alloc_array_and_samples(
+           &srcData, &lineSize, kChannels, kSamples, (AVSampleFormat)srcSampleFmt, 0) < 0 ||
+       av_samples_alloc_array_and_samples(
+           &dstData, &lineSize, kChannels, kSamples, (AVSampleFormat)dstSampleFmt, 0) < 0)
+    {
+        fprintf(stderr, "failed to alloc samples for %s\n", pairName);
+        return;
+    }
+    fillRandom(srcData, srcSampleFmt);
+    int64_t bytes = av_samples_get_buffer_size(
+        nullptr, kChannels, kSamples, (AVSampleFormat)srcSampleFmt, 1);
+
+    SwrContext* swrCtx = swr_alloc_set_opts(nullptr,
+                                            AV_CH_LAYOUT_STEREO,
+                                            (AVSampleFormat)dstSampleFmt,
+                                            kRate,
+                                            AV_CH_LAYOUT_STEREO,
+                                            (AVSampleFormat)srcSampleFmt,
+                                            kRate,
+                                            0,
+                                            nullptr);
+    if(swrCtx && swr_init(swrCtx) >= 0)
+    {
+        printBenchResult(
+            runBench(std::string(pairName) + " swresample", 100, kIteration, bytes, [&]() {
+                swr_convert(swrCtx, dstData, kSamples, (const uint8_t**)srcData, kSamples);
+            }));
+    }
+    swr_free(&swrCtx);
+
+    // there's only sse2 kernel for sample format
+    for(SimdLevel level : {SimdLevel::C, SimdLevel::SSE2})
+    {
+        if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+        {
+            break;
+        }
+        std::string name = std::string(pairName) + " " + simdLevelName(level);
+        printBenchResult(runBench(name, 100, kIteration, bytes, [&]() {
+            convertSampleFmt(
+                dstData, dstSampleFmt, srcData, srcSampleFmt, kChannels, kSamples, level);
+        }));
+    }
+
+    av_freep(&srcData[0]);
+    av_freep(&srcData);
+    av_freep(&dstData[0]);
+    av_freep(&dstData);
+}
+} // namespace
+
+void benchSampleFmtConvert()
+{
+    benchPair(AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_FLTP, "stereo 1024 s16->fltp");
+    benchPair(AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_S16, "stereo 1024 fltp->s16");
+    benchPair(AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_FLT, "stereo 1024 s16->flt");
+    benchPair(AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_S16, "stereo 1024 s32->s16");
+    benchPair(AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_DBLP, "stereo 1024 flt->dblp");
+}
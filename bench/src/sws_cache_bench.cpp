@@ -0,0 +1,44 @@
+extern "C"
+{
+#include <libswscale/swscale.h>
+}
+
+#include "bench.h"
+#include "sws_cache.h"
+
+#include <cstdio>
+
+// cost of scaler setup of a short job, sws_getContext every time vs checkout from cache
+void benchSwsCache()
+{
+    SwsContextKey key{
+        .inWidth   = 1920,
+        .inHeight  = 1080,
+        .inPixFmt  = AV_PIX_FMT_YUYV422,
+        .outWidth  = 1280,
+        .outHeight = 720,
+        .outPixFmt = AV_PIX_FMT_YUV420P,
+        .flags     = SWS_BICUBIC,
+    };
+
+    printBenchResult(runBench("1080p yuyv422 -> 720p yuv420p sws_getContext", 5, 200, 0, [&]() {
+        SwsContext* ctx = sws_getContext(key.inWidth,
+                                         key.inHeight,
+                                         (AVPixelFormat)key.inPixFmt,
+                                         key.outWidth,
+                                         key.outHeight,
+                                         (AVPixelFormat)key.outPixFmt,
+                                         key.flags,
+                                         nullptr,
+                                         nullptr,
+                                         nullptr);
+        sws_freeContext(ctx);
+    }));
+
+    SwsContextCache& cache = SwsContextCache::instance();
+    printBenchResult(runBench("1080p yuyv422 -> 720p yuv420p cache checkout", 5, 200, 0, [&]() {
+        cache.checkin(key, cache.checkout(key));
+    }));
+    SwsCacheStats stats = cache.stats();
+    fprintf(stdout, "    hits %lu misses %lu idle %zu\n", stats.hits, stats.misses, stats.idle);
+}
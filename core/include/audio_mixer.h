@@ -0,0 +1,87 @@
+#pragma once
+
+#include "simd.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct AudioMixerParam
+{
+    int64_t channelLayout;
+    // output format, S16/S32/FLT/DBL in planar or packed layout
+    int sampleFmt;
+    // samples of every channel in one output frame, usually frame size of the encoder
+    int frameSamples;
+};
+
+// Mix N pcm inputs with the same channel layout and sample rate into one stream.
+// Every input has its own gain and fifo, samples are aligned by their position in the
+// output timeline. Mixing is done in float with simd kernels and clipped to [-1.0, 1.0].
+class AudioMixer
+{
+public:
+    AudioMixer(const AudioMixerParam& param);
+
+    // dsiable copy-ctor and move-ctor
+    AudioMixer(const AudioMixer&) = delete;
+    AudioMixer& operator=(const AudioMixer) = delete;
+    AudioMixer(AudioMixer&&)                = delete;
+    AudioMixer& operator=(AudioMixer&&) = delete;
+
+    ~AudioMixer() = default;
+
+public:
+    bool isValid() const
+    {
+        return m_channels > 0;
+    }
+    // return index of the input, -1 if sampleFmt is not supported
+    int  addInput(int sampleFmt, float gain = 1.0f);
+    void setGain(int input, float gain);
+
+    // nbSamples of every channel in the format of the input.
+    // startSample is the position of the first sample in output timeline, -1 means right after
+    // the previous push. gap is filled with silence, samples before the position are dropped.
+    bool push(int input, const uint8_t* const data[], int nbSamples, int64_t startSample = -1);
+    // the input won't push anymore, it's silence from now on
+    void finish(int input);
+
+    // every input has a full frame or is finished
+    bool hasOutput() const;
+    // some samples are still in fifo
+    bool hasRemain() const;
+    // mix one frame into dst in output format, return nb samples of every channel.
+    // the last frame is padded with silence
+    int mix(uint8_t* const dst[], SimdLevel level = cpuSimdLevel());
+
+    int64_t mixedSamples() const
+    {
+        return m_mixedSamples;
+    }
+    int frameSamples() const
+    {
+        return m_param.frameSamples;
+    }
+
+private:
+    struct MixInput
+    {
+        int   sampleFmt = -1;
+        float gain      = 1.0f;
+        bool  finished  = false;
+        // interleaved float
+        std::vector<float> fifo;
+        size_t             readPos = 0;
+        // position of the end of fifo in output timeline
+        int64_t writePos = 0;
+    };
+
+    int queuedSamples(const MixInput& input) const;
+
+private:
+    AudioMixerParam       m_param;
+    int                   m_channels     = 0;
+    int64_t               m_mixedSamples = 0;
+    std::vector<MixInput> m_inputs;
+    std::vector<float>    m_mixBuffer;
+};
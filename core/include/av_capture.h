@@ -0,0 +1,22 @@
+#pragma once
+
+#include "device.h"
+
+#include <string>
+
+struct AVCaptureParam
+{
+    // container is guessed by the extension, such as out.mkv or out.mp4
+    std::string outFilename;
+    // resampleParam, codecParam, captureParam, metrics and trace of every stream, their
+    // outFilename and muxer are not used
+    ReadDeviceDataParam audioParam;
+    ReadDeviceDataParam videoParam;
+    // how far a stream may run behind the other in the output, and audio behind or ahead of
+    // the clock before its gap is skipped or its samples are dropped
+    int maxSkewMs = 500;
+};
+
+// capture an audio and a video device at the same time, every one is read, encoded and
+// timestamped against one monotonic clock on its own thread, then muxed into one file
+void captureAudioVideo(AudioDevice& audio, VideoDevice& video, AVCaptureParam& params);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "job_metrics.h"
+
+#include <cstdint>
+#include <map>
+
+class AVPacket;
+struct AVRational;
+
+// capture time of frames by their timestamp on the way from device to encoder. a frame
+// maps to the latest capture at or before its timestamp, so an audio frame gets the capture
+// time of the packet its first sample came from.
+class CaptureTimeMap
+{
+public:
+    CaptureTimeMap() = default;
+
+    // dsiable copy-ctor and move-ctor
+    CaptureTimeMap(const CaptureTimeMap&) = delete;
+    CaptureTimeMap& operator=(const CaptureTimeMap) = delete;
+    CaptureTimeMap(CaptureTimeMap&&)                = delete;
+    CaptureTimeMap& operator=(CaptureTimeMap&&) = delete;
+
+    ~CaptureTimeMap() = default;
+
+public:
+    void add(int64_t ts, int64_t captureUs);
+    // -1 if unknown. captures before the found one are forgotten
+    int64_t find(int64_t ts);
+
+private:
+    // frames dropped on the way are never looked up, the oldest are evicted
+    static constexpr size_t kMaxPending = 512;
+
+    std::map<int64_t, int64_t> m_captureUs;
+};
+
+// glass-to-packet latency of a live job, from the capture time of a device packet to its
+// encoded packet. the summary is logged every few seconds with the running maximum, and
+// recorded to the job metrics of this thread.
+class CaptureLatency
+{
+public:
+    CaptureLatency(const char* name);
+
+    // dsiable copy-ctor and move-ctor
+    CaptureLatency(const CaptureLatency&) = delete;
+    CaptureLatency& operator=(const CaptureLatency) = delete;
+    CaptureLatency(CaptureLatency&&)                = delete;
+    CaptureLatency& operator=(CaptureLatency&&) = delete;
+
+    ~CaptureLatency() = default;
+
+public:
+    // capture time of a packet just read from device on the monotonic clock, in us. the
+    // packet timestamp is used if it's on the wall clock or the monotonic clock like v4l2 and
+    // alsa, otherwise the time it's read
+    static int64_t captureTimeUs(const AVPacket* pkt, AVRational timeBase);
+
+    // a frame captured at captureUs left the pipeline now
+    void record(int64_t captureUs);
+    void logSummary() const;
+
+private:
+    const char*      m_name;
+    JobMetrics*      m_metrics;
+    LatencyHistogram m_histogram;
+    int64_t          m_lastLogUs = 0;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+class AVFormatContext;
+class AVPacket;
+
+// packets of a device recorded with the time they arrived, so a capture problem such as a
+// burst or jitter of a device can be replayed offline as a REPLAY device.
+// the file is the codec parameters of every stream, then for every packet:
+//   arrival(us since the first packet), capture delay(us), stream index, flags, size, data
+// in the byte order of the host.
+
+// write the packets read from a device into a recording
+class CaptureRecorder
+{
+public:
+    CaptureRecorder(const std::string& filename, AVFormatContext* fmtCtx);
+
+    // dsiable copy-ctor and move-ctor
+    CaptureRecorder(const CaptureRecorder&) = delete;
+    CaptureRecorder& operator=(const CaptureRecorder) = delete;
+    CaptureRecorder(CaptureRecorder&&)                = delete;
+    CaptureRecorder& operator=(CaptureRecorder&&) = delete;
+
+    ~CaptureRecorder();
+
+public:
+    bool isValid() const
+    {
+        return m_ofs.good();
+    }
+    // arrivalUs and captureUs are monotonic time
+    void write(const AVPacket* pkt, int64_t arrivalUs, int64_t captureUs);
+
+private:
+    std::string   m_filename;
+    std::ofstream m_ofs;
+    int64_t       m_firstArrivalUs = -1;
+    uint64_t      m_packets        = 0;
+};
+
+// read packets of a recording at the pace they arrived, or as fast as possible
+class CaptureReplayer
+{
+public:
+    CaptureReplayer(const std::string& filename, bool realtime);
+
+    // dsiable copy-ctor and move-ctor
+    CaptureReplayer(const CaptureReplayer&) = delete;
+    CaptureReplayer& operator=(const CaptureReplayer) = delete;
+    CaptureReplayer(CaptureReplayer&&)                = delete;
+    CaptureReplayer& operator=(CaptureReplayer&&) = delete;
+
+    ~CaptureReplayer() = default;
+
+public:
+    // add the recorded streams to fmtCtx
+    bool open(AVFormatContext* fmtCtx);
+    // the next packet like av_read_frame, AVERROR_EOF at the end of recording. timestamps
+    // are the recorded arrival minus capture delay, on the monotonic clock from the start of
+    // replay. the wall clock only paces a realtime replay, a fast replay keeps them too
+    int read(AVPacket* pkt);
+
+private:
+    std::string      m_filename;
+    std::ifstream    m_ifs;
+    bool             m_realtime;
+    AVFormatContext* m_fmtCtx  = nullptr;
+    int64_t          m_startUs = -1;
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class AVFormatContext;
+class AVPacket;
+class CaptureRecorder;
+class JobMetrics;
+class TraceRecorder;
+
+// what the capture thread does with a packet when the queue is full
+enum class OverflowPolicy : int
+{
+    // keep the latest, for live preview and streaming
+    DROP_OLDEST,
+    // keep what is queued, the gap is at the newest end
+    DROP_NEWEST,
+    // wait for the consumer, the device buffer overruns instead if it lasts too long
+    BLOCK,
+    // DROP_OLDEST for video, a late frame is worth less than the latest. BLOCK for audio,
+    // a dropped packet is an audible gap
+    BY_MEDIA_TYPE,
+};
+
+// stop a running capture from another thread
+class StopSignal
+{
+public:
+    void stop()
+    {
+        m_stopped.store(true, std::memory_order_relaxed);
+    }
+    bool stopped() const
+    {
+        return m_stopped.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> m_stopped{false};
+};
+
+struct CaptureParam
+{
+    // packets between the capture thread and the pipeline
+    int            queueSize      = 8;
+    OverflowPolicy overflowPolicy = OverflowPolicy::BY_MEDIA_TYPE;
+    // capture so many seconds, 0 captures until stopSignal or end of source
+    double                      durationSeconds = 0;
+    std::shared_ptr<StopSignal> stopSignal;
+    // stop after so many packets are read, 0 is no limit. a camera, microphone or endless
+    // virtual device job without any bound captures as many packets as before the capture
+    // thread, see Device::boundedCaptureParam
+    uint64_t maxPackets = 0;
+    // a packet taken later than it after capture is counted late, 0 disables
+    int lateThresholdMs = 100;
+    // try SCHED_FIFO for the capture thread, it needs CAP_SYS_NICE
+    bool realtimePriority = true;
+    // record every packet read with its arrival time, replay it as a REPLAY device
+    std::string recordFilename;
+};
+
+struct CaptureStats
+{
+    uint64_t captured = 0;
+    uint64_t dropped  = 0;
+    uint64_t late     = 0;
+    int      maxDepth = 0;
+};
+
+// read packets of a device on its own thread into a bounded queue, so a slow encoder doesn't
+// overrun the buffer of v4l2 or alsa silently. the READ stage of the job metrics and trace
+// of the thread creating it is timed on the capture thread.
+class CaptureThread
+{
+public:
+    // read a packet of fmtCtx like av_read_frame
+    using PacketReader = std::function<int(AVPacket*)>;
+
+    CaptureThread(AVFormatContext*    fmtCtx,
+                  PacketReader        reader,
+                  const CaptureParam& param,
+                  const char*         name);
+
+    // dsiable copy-ctor and move-ctor
+    CaptureThread(const CaptureThread&) = delete;
+    CaptureThread& operator=(const CaptureThread) = delete;
+    CaptureThread(CaptureThread&&)                = delete;
+    CaptureThread& operator=(CaptureThread&&) = delete;
+
+    ~CaptureThread();
+
+public:
+    void start();
+    // stop reading, the queued packets can still be taken
+    void stop();
+    // queue a packet read before start(), such as one to learn the frame size. it's recorded
+    // and counted like the packets read on the thread. the reference of pkt is moved
+    void pushPreRead(AVPacket* pkt, int64_t arrivalUs);
+
+    // wait for the next packet and move it into pkt with its capture time(us, monotonic).
+    // false if capture has ended and the queue is empty
+    bool pop(AVPacket* pkt, int64_t& captureUs);
+
+    CaptureStats stats() const;
+    void         logStats() const;
+
+private:
+    void run();
+    bool shouldStop(int64_t startUs) const;
+    void push(AVPacket* pkt, int64_t captureUs);
+    void raisePriority();
+
+    struct CapturedPacket
+    {
+        AVPacket* pkt;
+        int64_t   captureUs;
+    };
+
+private:
+    AVFormatContext* m_fmtCtx;
+    PacketReader     m_reader;
+    CaptureParam     m_param;
+    const char*      m_name;
+    JobMetrics*      m_metrics;
+    TraceRecorder*   m_trace;
+    std::thread      m_thread;
+
+    std::unique_ptr<CaptureRecorder> m_recorder;
+
+    mutable std::mutex         m_mutex;
+    std::condition_variable    m_notEmpty;
+    std::condition_variable    m_notFull;
+    std::deque<CapturedPacket> m_queue;
+    bool                       m_finished = false;
+    std::atomic<bool>          m_stop{false};
+
+    std::atomic<uint64_t> m_captured{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_late{0};
+    int                   m_maxDepth = 0;
+};
@@ -13,6 +13,7 @@ class AVCodec;
 class AVPacket;
 class Frame;
 class AVCodecParameters;
+struct CodecCaps;
 
 using FrameReceiveCB  = std::function<void(std::shared_ptr<Frame>)>;
 using PacketReceiveCB = std::function<void(AVPacket*)>;
@@ -48,6 +49,10 @@ struct EncoderParam
     int pixFmt = -1;
     // fps
     int framerate = 0;
+    // AVColorRange of input frame, AVCOL_RANGE_JPEG for full range
+    int colorRange = 0;
+    // codec headers in extradata instead of key frames, for containers like mp4
+    bool globalHeader = false;
 
     // control param
     // find encode by name
@@ -101,6 +106,10 @@ public:
     }
     virtual void decode(std::shared_ptr<Frame> frame, AVPacket* pkt, FrameReceiveCB cb, bool isFlush = false);
 
+    // drop buffered data and leave draining mode for the next job.
+    // return false if the codec can't be reset and has to be reopened
+    bool reset();
+
 public:
     // util func
     AVCodecContext* getCodecCtx(bool isEncode) const;
@@ -115,8 +124,11 @@ public:
 protected:
     // bool openDecoder(AVCodecContext* ctx, const std::string& name);
     // bool openDecoder(AVCodecContext* ctx, int codecId);
-    bool checkSupport(AVCodec* codec, const CodecParam& initParam, bool isEncode);
-    bool checkAudioSupport(AVCodec* codec, int format, uint64_t channelLayout, int64_t sampleRate);
+    bool checkSupport(const CodecCaps& caps, const CodecParam& initParam, bool isEncode);
+    bool checkAudioSupport(const CodecCaps& caps,
+                           int              format,
+                           uint64_t         channelLayout,
+                           int64_t          sampleRate);
 
 private:
     AVCodecContext* m_encodeCodecCtx = nullptr;
@@ -127,6 +139,11 @@ private:
     bool m_encodeEnable = false;
     bool m_decodeEnable = false;
 
+    // frames sent to the encoder and packets sent to the decoder not received yet, a trace
+    // counter
+    int64_t m_encodeQueued = 0;
+    int64_t m_decodeQueued = 0;
+
     MediaType m_codecMediaType;
 };
 
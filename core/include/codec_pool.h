@@ -0,0 +1,75 @@
+#pragma once
+
+#include "codec.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+struct CodecPoolStats
+{
+    // an idle instance is reused
+    uint64_t hits = 0;
+    // a new instance is opened
+    uint64_t misses = 0;
+    // a released instance can't be reset and is closed
+    uint64_t dropped = 0;
+    // instances waiting in pool
+    size_t idle = 0;
+};
+
+// Process-wide pool of opened codecs. Finding and opening a codec (lookahead of libx264,
+// fdk-aac tables) dominates the cost of a short job.
+// A codec is taken by acquireXXX and returned to the pool when the last shared_ptr is gone.
+// It's reset by avcodec_flush_buffers before it's reused; an encoder which can't leave the
+// draining mode (no AV_CODEC_CAP_ENCODER_FLUSH) is closed instead, prewarm opens the
+// instances of such encoders before the jobs start.
+class CodecPool
+{
+public:
+    static CodecPool& instance();
+
+    // dsiable copy-ctor and move-ctor
+    CodecPool(const CodecPool&) = delete;
+    CodecPool& operator=(const CodecPool) = delete;
+    CodecPool(CodecPool&&)                = delete;
+    CodecPool& operator=(CodecPool&&) = delete;
+
+public:
+    // the same param gets the same kind of instance, the codec may be invalid
+    // (encodeEnable/decodeEnable is false) as make_shared<XXXCodec> does
+    std::shared_ptr<AudioCodec> acquireAudio(const CodecParam& param);
+    std::shared_ptr<VideoCodec> acquireVideo(const CodecParam& param);
+
+    // open count instances of the param into pool
+    void prewarm(const CodecParam& param, MediaType mediaType, int count);
+
+    // max idle instances, the extra ones are closed
+    void setCapacity(size_t capacity);
+    // close all idle instances
+    void clear();
+
+    CodecPoolStats stats() const;
+
+private:
+    CodecPool() = default;
+    ~CodecPool();
+
+    // take an idle instance or open a new one, the result returns to pool when released
+    std::shared_ptr<Codec> acquire(const CodecParam& param, MediaType mediaType);
+    Codec*                 open(const CodecParam& param, MediaType mediaType);
+    void                   recycle(const std::string& key, Codec* codec);
+
+private:
+    mutable std::mutex m_mutex;
+    // most recently used at front
+    std::list<std::pair<std::string, std::unique_ptr<Codec>>> m_idle;
+    size_t                                                    m_capacity = 8;
+    uint64_t                                                  m_hits     = 0;
+    uint64_t                                                  m_misses   = 0;
+    uint64_t                                                  m_dropped  = 0;
+};
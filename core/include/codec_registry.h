@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class AVCodec;
+
+// capabilities of one codec, flattened from the zero terminated lists of AVCodec.
+// a codec without a list accepts anything
+struct CodecCaps
+{
+    AVCodec*    codec = nullptr;
+    std::string name;
+    int         codecId   = 0;
+    int         mediaType = -1;
+    bool        isEncoder = false;
+
+    bool anySampleFmt     = true;
+    bool anyChannelLayout = true;
+    bool anySampleRate    = true;
+    bool anyPixFmt        = true;
+    // bit i for AVSampleFormat i, planar formats included
+    uint64_t sampleFmtMask = 0;
+    // indexed by AVPixelFormat
+    std::vector<bool>            pixFmtMask;
+    std::unordered_set<uint64_t> channelLayouts;
+    std::unordered_set<int>      sampleRates;
+    // the order of the codec lists, the first one is the preferred one of codec
+    std::vector<int> sampleFmtList;
+    std::vector<int> sampleRateList;
+    std::vector<int> pixFmtList;
+
+    bool supportSampleFmt(int format) const;
+    bool supportChannelLayout(uint64_t channelLayout) const;
+    bool supportSampleRate(int64_t sampleRate) const;
+    bool supportPixFmt(int format) const;
+
+    // for format negotiation: the wanted value if it's supported, otherwise the preferred one
+    // of codec (the closest for sample rate). -1 if nothing is supported
+    int negotiateSampleFmt(int format) const;
+    int negotiateSampleRate(int sampleRate) const;
+    int negotiatePixFmt(int format) const;
+};
+
+// Capabilities of every codec in libavcodec, built once on the first use.
+// Lookup by name or id is a hash lookup instead of a linear walk of all codecs, and the
+// support check is a bit or set test instead of a walk of the lists.
+class CodecRegistry
+{
+public:
+    static const CodecRegistry& instance();
+
+    // dsiable copy-ctor and move-ctor
+    CodecRegistry(const CodecRegistry&) = delete;
+    CodecRegistry& operator=(const CodecRegistry) = delete;
+    CodecRegistry(CodecRegistry&&)                = delete;
+    CodecRegistry& operator=(CodecRegistry&&) = delete;
+
+public:
+    // nullptr if not found. lookup by id has the same result as avcodec_find_encoder/decoder,
+    // a non experimental codec first
+    const CodecCaps* findEncoder(const std::string& name) const;
+    const CodecCaps* findEncoder(int codecId) const;
+    const CodecCaps* findDecoder(const std::string& name) const;
+    const CodecCaps* findDecoder(int codecId) const;
+
+    size_t size() const
+    {
+        return m_caps.size();
+    }
+
+private:
+    CodecRegistry();
+    ~CodecRegistry() = default;
+
+private:
+    std::vector<CodecCaps>                             m_caps;
+    std::unordered_map<std::string, const CodecCaps*> m_encoderByName;
+    std::unordered_map<std::string, const CodecCaps*> m_decoderByName;
+    std::unordered_map<int, const CodecCaps*>         m_encoderById;
+    std::unordered_map<int, const CodecCaps*>         m_decoderById;
+};
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "../../utils/include/baseDefine.h"
+#include "capture_thread.h"
 #include "codec.h"
+#include "frame_diff.h"
+#include "frame_allocator.h"
 #include "resample.h"
 #include <string>
 
@@ -9,6 +12,7 @@
 #include <memory>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 class AVFormatContext;
 class SwrContext;
@@ -21,6 +25,14 @@ class VideoCodec;
 class AVPacket;
 class SwrConvertor;
 class AVDictionary;
+class JobMetrics;
+class TraceRecorder;
+class QualityMeter;
+class FrameCache;
+class MjpegPacketizer;
+class CaptureReplayer;
+class Muxer;
+struct LadderParam;
 
 enum class DeviceType : int
 {
@@ -28,6 +40,15 @@ enum class DeviceType : int
     VIDEO,
     ENCAPSULATE_FILE,
     PURE_FILE,
+    // libavdevice lavfi input, name is a filtergraph such as "testsrc2=size=1280x720:d=10".
+    // read like a hw device and ends at the end of source
+    LAVFI,
+    // synthetic camera or microphone on lavfi, paced to the wall clock with packets in the
+    // format of v4l2/alsa, name is a lavfi generator such as "testsrc2". see virtual_device.h
+    VIRTUAL,
+    // packets recorded by CaptureParam::recordFilename, name is the recording. replayed at
+    // the pace they arrived, or as fast as possible with option realtime=0
+    REPLAY,
 };
 
 struct AudioReaderParam
@@ -43,6 +64,12 @@ struct AudioReaderParam
     std::shared_ptr<Codec> audioCodec;
     std::shared_ptr<Frame>         frame;
     AVPacket*      pkt;
+    // hw device only
+    CaptureParam           captureParam;
+    std::shared_ptr<Muxer> muxer;
+    // read to learn the frame size, the first packet to encode
+    AVPacket* preReadPkt       = nullptr;
+    int64_t   preReadArrivalUs = 0;
 };
 
 struct VideoReaderParam
@@ -62,6 +89,15 @@ struct VideoReaderParam
     std::shared_ptr<Codec>      videoCodec;
     std::shared_ptr<Frame>      frame;
     AVPacket*   pkt;
+
+    FrameAllocType frameAllocType = FrameAllocType::DEFAULT;
+    ScaleAlgorithm scaleAlgorithm = ScaleAlgorithm::BICUBIC;
+    // compare the encoded frames with the source frames if set
+    std::shared_ptr<QualityMeter> qualityMeter;
+    FrameDiffParam                frameDiffParam;
+    // hw device only
+    CaptureParam           captureParam;
+    std::shared_ptr<Muxer> muxer;
 };
 
 struct ReadDeviceDataParam
@@ -80,6 +116,36 @@ struct ReadDeviceDataParam
     int outWidth;
     int outHeight;
     int outPixFormat;
+    // buffer backend of video frames
+    FrameAllocType frameAllocType = FrameAllocType::DEFAULT;
+    // compute PSNR/SSIM of the encoded video
+    bool measureQuality = false;
+    // skip scale/encode of duplicate frames of hw device, without a muxer the previous frame
+    // is repeated instead to keep the duration
+    FrameDiffParam frameDiffParam;
+    // take opened codecs from CodecPool instead of opening them for every job
+    bool useCodecPool = false;
+    // per stage timing of the job, printed as json at the end
+    std::shared_ptr<JobMetrics> metrics;
+    // chrome trace of the job, written to its file at the end
+    std::shared_ptr<TraceRecorder> trace;
+    // capture thread of hw device, how long it captures and what it drops
+    CaptureParam captureParam;
+    // hw device only, encoded packets are muxed into it on its clock instead of written to
+    // outFilename. see captureAudioVideo
+    std::shared_ptr<Muxer> muxer;
+};
+
+class AudioDevice;
+// input of AudioDevice::readAndMix, read from hw device if device is set, otherwise pcm file
+struct AudioMixInput
+{
+    std::shared_ptr<AudioDevice> device;
+    std::string                  inFilename;
+    int64_t                      inChannelLayout;
+    int                          inSampleFmt;
+    int                          inSampleRate;
+    float                        gain = 1.0f;
 };
 
 class Device
@@ -102,6 +168,11 @@ public:
 
 protected:
     int findStreamIdxByMediaType(int mediaType);
+    // read a packet of the device, timed as READ stage
+    int readPacket(AVPacket* pkt);
+    // a camera, microphone or a virtual one without duration never ends, a job with neither
+    // duration, stop signal nor packet limit captures defaultPackets
+    CaptureParam boundedCaptureParam(const CaptureParam& param, uint64_t defaultPackets) const;
 
     AVFormatContext* getFmtCtx() const;
     DeviceType       getDeviceType() const
@@ -117,20 +188,35 @@ private:
     std::string      m_deviceName;
     DeviceType       m_deviceType;
     AVFormatContext* m_fmtCtx = nullptr;
+    // a camera, microphone or virtual device without duration, see boundedCaptureParam
+    bool m_endless = false;
+    // virtual camera in mjpeg
+    std::unique_ptr<MjpegPacketizer> m_mjpeg;
+    std::unique_ptr<CaptureReplayer> m_replayer;
 };
 
 class AudioDevice : public Device
 {
 public:
     AudioDevice();
-    AudioDevice(const std::string& deviceName, DeviceType deviceType);
+    AudioDevice(const std::string& deviceName,
+                DeviceType         deviceType,
+                AVDictionary*      option = nullptr);
 
     ~AudioDevice();
 
     void readAndEncode(ReadDeviceDataParam& params) override;
     void readAndDecode(ReadDeviceDataParam& params) override;
 
+public:
+    // mix all inputs into one stream, then encode it by params.codecParam or write pcm
+    // in params.outChannelLayout/outSampleFmt/outSampleRate if no encoder
+    static void readAndMix(std::vector<AudioMixInput>& inputs, ReadDeviceDataParam& params);
+
 private:
+    // packets of an unbounded microphone job, what was recorded before the capture thread
+    static constexpr uint64_t kDefaultCapturePackets = 5000;
+
     // util func
     void readAudioFromHWDevice(AudioReaderParam& param);
     void readAudioFromStream(AudioReaderParam& param);
@@ -149,10 +235,29 @@ public:
     void readAndEncode(ReadDeviceDataParam& params) override;
     void readAndDecode(ReadDeviceDataParam& params) override;
 
+    // decode the video stream once until the end of source and encode it into every rung of
+    // the ladder on their own threads
+    void readAndEncodeLadder(LadderParam& params);
+
 public:
     void writeImageToFile(std::ofstream& ofs, std::shared_ptr<Frame> frame);
 
+    // decode the frame shown at pts(time base of the video stream) of an ENCAPSULATE_FILE in
+    // outWidth x outHeight outPixFmt, 0 or -1 keeps the size/format of the stream.
+    // if cache is set, every frame of the GOP around pts is cached, so scrubbing near pts is
+    // served from memory. the decoder is taken from CodecPool if useCodecPool is set, a
+    // scrubbing caller should set it. return nullptr if failed
+    std::shared_ptr<Frame> readFrameAt(int64_t     pts,
+                                       int         outWidth,
+                                       int         outHeight,
+                                       int         outPixFmt,
+                                       FrameCache* cache        = nullptr,
+                                       bool        useCodecPool = false);
+
 private:
+    // frames of an unbounded camera job, what was recorded before the capture thread
+    static constexpr uint64_t kDefaultCapturePackets = 30;
+
     void readVideoFromStream(VideoReaderParam& param);
     void readVideoFromHWDevice(VideoReaderParam& param);
 };
\ No newline at end of file
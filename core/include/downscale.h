@@ -0,0 +1,37 @@
+#pragma once
+
+#include "simd.h"
+#include <cstdint>
+
+// filter used by SwsConvertor when the size is changed
+enum class ScaleAlgorithm : int
+{
+    // swscale SWS_BICUBIC
+    BICUBIC,
+    // average of factor x factor source pixels
+    BOX,
+    // 2 taps interpolation at the center of output pixel. the same as BOX for 2:1,
+    // the middle 2x2 pixels for 4:1
+    BILINEAR,
+};
+
+// Hand-vectorized 2:1 and 4:1 downscaler for 8 bit planar YUV/GRAY (preview renditions).
+// return 0 if there's no kernel for the size pair, otherwise the factor (2 or 4).
+// every plane (including subsampled chroma) has to be divided exactly.
+int downscaleFactor(int pixFmt, int srcWidth, int srcHeight, int dstWidth, int dstHeight);
+
+bool hasDownscaleKernel(int pixFmt, int srcWidth, int srcHeight, int dstWidth, int dstHeight);
+
+// src and dst have the same pixFmt, algorithm should be BOX or BILINEAR.
+// return false if there's no kernel
+bool downscale(uint8_t* const src[],
+               const int      srcStride[],
+               uint8_t* const dst[],
+               const int      dstStride[],
+               int            pixFmt,
+               int            srcWidth,
+               int            srcHeight,
+               int            dstWidth,
+               int            dstHeight,
+               ScaleAlgorithm algorithm,
+               SimdLevel      level = cpuSimdLevel());
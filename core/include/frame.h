@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../../utils/include/baseDefine.h"
+#include "frame_allocator.h"
 #include <cstdint>
 
 struct AudioFrameParam
@@ -17,6 +18,11 @@ struct VideoFrameParam
     int  width;
     int  height;
     int  pixFormat;
+
+    // buffer backend, HUGE_PAGE helps 4K/8K frames with less TLB miss
+    FrameAllocType   allocType = FrameAllocType::DEFAULT;
+    // if set, take buffer from pool instead of alloc a new one(allocType is ignored)
+    FrameBufferPool* pool = nullptr;
 };
 
 class AVFrame;
@@ -54,6 +60,9 @@ public:
     int*      lineSize() const;
     uint8_t** data() const;
 
+    // buffer size of a video frame with 32 bytes aligned line size(include padding)
+    static int videoBufferSize(int width, int height, int pixFormat);
+
     int format() const;
     int channels() const;
     int nbSamples() const;
@@ -69,8 +78,13 @@ public:
         return m_isComplete;
     }
 
+private:
+    bool allocVideoBuffer(const VideoFrameParam& initParam);
+
 private:
     AVFrame* m_avFrame;
     bool     m_valid;
     bool     m_isComplete = false;
+    // nb_samples of a full audio frame
+    int m_audioSamples = 0;
 };
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class FrameAllocType : int
+{
+    // av_malloc, normal 4K pages
+    DEFAULT,
+    // mmap with MAP_HUGETLB, fall back to THP(madvise) and then normal pages
+    HUGE_PAGE,
+};
+
+class AVBufferRef;
+class AVBufferPool;
+
+// alloc a refcounted buffer, the buffer is released by av_buffer_unref
+AVBufferRef* allocFrameBuffer(int size, FrameAllocType allocType);
+
+// pool of same size frame buffers. mmap/munmap of huge page is expensive,
+// so frames with the same geometry should share a pool and reuse the mapping.
+class FrameBufferPool
+{
+public:
+    FrameBufferPool(int bufferSize, FrameAllocType allocType);
+    // dsiable copy-ctor and move-ctor
+    FrameBufferPool(const FrameBufferPool&) = delete;
+    FrameBufferPool& operator=(const FrameBufferPool) = delete;
+    FrameBufferPool(FrameBufferPool&&)                = delete;
+    FrameBufferPool& operator=(FrameBufferPool&&) = delete;
+
+    ~FrameBufferPool();
+
+public:
+    bool isValid() const
+    {
+        return m_pool != nullptr;
+    }
+    // get a buffer from pool, the buffer will be returned to pool after av_buffer_unref
+    AVBufferRef* get();
+
+    int bufferSize() const
+    {
+        return m_bufferSize;
+    }
+    FrameAllocType allocType() const
+    {
+        return m_allocType;
+    }
+
+private:
+    AVBufferPool*  m_pool       = nullptr;
+    int            m_bufferSize = 0;
+    FrameAllocType m_allocType  = FrameAllocType::DEFAULT;
+};
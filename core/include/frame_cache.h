@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class Frame;
+
+struct FrameCacheStats
+{
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t evictions = 0;
+    size_t   entries   = 0;
+    // buffer size of cached frames
+    size_t bytes         = 0;
+    size_t capacityBytes = 0;
+
+    double hitRatio() const
+    {
+        uint64_t total = hits + misses;
+        return total == 0 ? 0.0 : (double)hits / total;
+    }
+};
+
+// Memory bounded LRU cache of decoded(and scaled) frames for repeated random access.
+// A stream is identified by the file(path, size, mtime) and the output size/format. Every
+// frame covers [pts, endPts) of its stream, so a request between two frames hits the frame
+// shown at that time.
+class FrameCache
+{
+public:
+    FrameCache(size_t capacityBytes);
+
+    // dsiable copy-ctor and move-ctor
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache) = delete;
+    FrameCache(FrameCache&&)                = delete;
+    FrameCache& operator=(FrameCache&&) = delete;
+
+    ~FrameCache() = default;
+
+public:
+    static std::string streamKey(const std::string& filename, int width, int height, int pixFmt);
+
+    // the frame shown at pts, nullptr if it's not cached
+    std::shared_ptr<Frame> get(const std::string& streamKey, int64_t pts);
+    // the frame is owned by cache, it shouldn't be written anymore
+    void put(const std::string& streamKey, int64_t pts, int64_t endPts, std::shared_ptr<Frame> frame);
+
+    FrameCacheStats stats() const;
+    void            clear();
+
+private:
+    struct Entry
+    {
+        std::string            streamKey;
+        int64_t                pts    = 0;
+        int64_t                endPts = 0;
+        size_t                 bytes  = 0;
+        std::shared_ptr<Frame> frame;
+    };
+    using EntryList = std::list<Entry>;
+
+    void erase(EntryList::iterator it);
+
+private:
+    mutable std::mutex m_mutex;
+    size_t             m_capacityBytes = 0;
+    size_t             m_bytes         = 0;
+    // most recently used at front
+    EntryList m_lru;
+    // pts -> entry of every stream
+    std::unordered_map<std::string, std::map<int64_t, EntryList::iterator>> m_index;
+
+    uint64_t m_hits      = 0;
+    uint64_t m_misses    = 0;
+    uint64_t m_evictions = 0;
+};
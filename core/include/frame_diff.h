@@ -0,0 +1,80 @@
+#pragma once
+
+#include "simd.h"
+#include <cstdint>
+#include <vector>
+
+class AVFrame;
+
+struct FrameDiffParam
+{
+    bool enable = false;
+    // mean absolute difference of every byte, a frame not larger than it is a duplicate.
+    // 0 only drops identical frames, 1~2 absorbs sensor noise of a static camera
+    double threshold = 0;
+    // keep one frame after so many duplicates, 0 means no limit
+    int maxDuplicates = 0;
+};
+
+// sum of absolute difference of two lines
+uint64_t sadLine(const uint8_t* a, const uint8_t* b, int width, SimdLevel level = cpuSimdLevel());
+
+// Detect duplicate and static frames by SAD against the last kept frame.
+// All planes are compared in the input format, so packed formats (YUYV422 of camera) work too.
+// The comparison stops as soon as the SAD is over the threshold, a moving frame usually
+// costs only a few lines.
+class FrameDiffDetector
+{
+public:
+    FrameDiffDetector(const FrameDiffParam& param);
+
+    // dsiable copy-ctor and move-ctor
+    FrameDiffDetector(const FrameDiffDetector&) = delete;
+    FrameDiffDetector& operator=(const FrameDiffDetector) = delete;
+    FrameDiffDetector(FrameDiffDetector&&)                = delete;
+    FrameDiffDetector& operator=(FrameDiffDetector&&) = delete;
+
+    ~FrameDiffDetector() = default;
+
+public:
+    bool enable() const
+    {
+        return m_param.enable;
+    }
+    // return true if the frame can be dropped, otherwise it becomes the new reference
+    bool isDuplicate(const AVFrame* frame);
+
+    int64_t droppedFrames() const
+    {
+        return m_droppedFrames;
+    }
+    int64_t keptFrames() const
+    {
+        return m_keptFrames;
+    }
+
+private:
+    // bytes of every line and lines of every plane, false if the format is not supported
+    bool     updateLayout(const AVFrame* frame);
+    uint64_t frameSad(const AVFrame* frame, uint64_t limit) const;
+    void     keepReference(const AVFrame* frame);
+
+private:
+    FrameDiffParam m_param;
+    SimdLevel      m_level = SimdLevel::C;
+
+    int      m_width        = 0;
+    int      m_height       = 0;
+    int      m_pixFmt       = -1;
+    int      m_nbPlanes     = 0;
+    int      m_lineBytes[4] = {0};
+    int      m_lines[4]     = {0};
+    uint64_t m_frameBytes   = 0;
+    // planes of the last kept frame without padding
+    std::vector<uint8_t> m_reference;
+    bool                 m_hasReference = false;
+
+    int     m_duplicates    = 0;
+    int64_t m_droppedFrames = 0;
+    int64_t m_keptFrames    = 0;
+};
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+class AVFormatContext;
+class AVPacket;
+class TraceRecorder;
+
+enum class Stage : int
+{
+    // av_read_frame, raw file read
+    READ,
+    DECODE,
+    SCALE,
+    RESAMPLE,
+    ENCODE,
+    // output file write
+    WRITE,
+    COUNT,
+};
+
+const char* stageName(Stage stage);
+
+struct StageStats
+{
+    // timed calls
+    uint64_t count = 0;
+    // frames in(encode/scale/resample) or out(decode), packets for read/write
+    uint64_t frames  = 0;
+    uint64_t bytes   = 0;
+    uint64_t totalNs = 0;
+    // latency of one call
+    double p50Us = 0;
+    double p99Us = 0;
+    double maxUs = 0;
+    // frames per second of job wall time and of the time spent in this stage
+    double fps     = 0;
+    double busyFps = 0;
+};
+
+// capture of a live device to the encoded packet
+struct CaptureLatencyStats
+{
+    uint64_t count = 0;
+    double   p50Ms = 0;
+    double   p90Ms = 0;
+    double   p99Ms = 0;
+    double   maxMs = 0;
+};
+
+struct JobMetricsReport
+{
+    double                                          wallMs = 0;
+    std::array<StageStats, (size_t)Stage::COUNT> stages;
+    CaptureLatencyStats                             captureLatency;
+
+    std::string toJson() const;
+};
+
+// latency histogram with log2 buckets, every power of 2 is split into 8 linear sub buckets,
+// so a percentile is at most 12.5% off. recording is lock free.
+class LatencyHistogram
+{
+public:
+    void record(uint64_t ns);
+
+    // upper bound of the bucket of the percentile(0~1), in ns
+    uint64_t percentile(double p) const;
+    uint64_t max() const
+    {
+        return m_max.load(std::memory_order_relaxed);
+    }
+    uint64_t count() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr int kSubBits = 3;
+    static constexpr int kBuckets = 64 << kSubBits;
+
+    static int      bucketIndex(uint64_t ns);
+    static uint64_t bucketUpperBound(int index);
+
+private:
+    std::array<std::atomic<uint32_t>, kBuckets> m_buckets = {};
+    std::atomic<uint64_t>                       m_count{0};
+    std::atomic<uint64_t>                       m_max{0};
+};
+
+// timing of every stage of one job
+class JobMetrics
+{
+public:
+    JobMetrics();
+
+    // dsiable copy-ctor and move-ctor
+    JobMetrics(const JobMetrics&) = delete;
+    JobMetrics& operator=(const JobMetrics) = delete;
+    JobMetrics(JobMetrics&&)                = delete;
+    JobMetrics& operator=(JobMetrics&&) = delete;
+
+    ~JobMetrics() = default;
+
+public:
+    void             record(Stage stage, uint64_t ns, uint64_t frames, uint64_t bytes);
+    void             recordCaptureLatency(uint64_t ns);
+    JobMetricsReport report() const;
+
+    // job of this thread, StageTimer records to it
+    static JobMetrics* current();
+
+private:
+    friend class JobMetricsScope;
+    static void setCurrent(JobMetrics* metrics);
+
+    struct StageCounter
+    {
+        LatencyHistogram      histogram;
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> totalNs{0};
+    };
+
+private:
+    std::array<StageCounter, (size_t)Stage::COUNT> m_stages;
+    LatencyHistogram                               m_captureLatency;
+    std::chrono::steady_clock::time_point          m_start;
+};
+
+// make metrics the job of this thread in the scope, nullptr disables timing
+class JobMetricsScope
+{
+public:
+    JobMetricsScope(JobMetrics* metrics);
+
+    // dsiable copy-ctor and move-ctor
+    JobMetricsScope(const JobMetricsScope&) = delete;
+    JobMetricsScope& operator=(const JobMetricsScope) = delete;
+    JobMetricsScope(JobMetricsScope&&)                = delete;
+    JobMetricsScope& operator=(JobMetricsScope&&) = delete;
+
+    ~JobMetricsScope();
+
+private:
+    JobMetrics* m_prev = nullptr;
+};
+
+// time a stage with the monotonic clock until destructed, every running period is also a
+// span of the trace of this thread. it's two thread local loads and nothing else if the
+// thread has no job and no trace.
+class StageTimer
+{
+public:
+    StageTimer(Stage stage, uint64_t bytes = 0, uint64_t frames = 1);
+
+    // dsiable copy-ctor and move-ctor
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer) = delete;
+    StageTimer(StageTimer&&)                = delete;
+    StageTimer& operator=(StageTimer&&) = delete;
+
+    ~StageTimer();
+
+public:
+    // exclude the time of a callback running another stage
+    void pause();
+    void resume();
+
+    void addBytes(uint64_t bytes)
+    {
+        m_bytes += bytes;
+    }
+    void addFrames(uint64_t frames)
+    {
+        m_frames += frames;
+    }
+
+private:
+    JobMetrics*                           m_metrics = nullptr;
+    TraceRecorder*                        m_trace   = nullptr;
+    Stage                                 m_stage;
+    uint64_t                              m_bytes;
+    uint64_t                              m_frames;
+    uint64_t                              m_elapsedNs = 0;
+    bool                                  m_running   = false;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// timed io of READ/WRITE stage
+int  timedReadFrame(AVFormatContext* fmtCtx, AVPacket* pkt);
+int  timedReadsome(std::ifstream& ifs, uint8_t* data, int size);
+void timedWrite(std::ofstream& ofs, const uint8_t* data, int size);
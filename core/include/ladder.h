@@ -0,0 +1,101 @@
+#pragma once
+
+#include "codec.h"
+#include "frame_allocator.h"
+#include "resample.h"
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AVPacket;
+class Frame;
+class JobMetrics;
+class SwsConvertor;
+class TraceRecorder;
+class VideoCodec;
+
+// one rendition of an ABR ladder
+struct LadderRung
+{
+    std::string outFilename;
+    // encodeParam.width/height/pixFmt is the output of the rung
+    EncoderParam   encodeParam;
+    ScaleAlgorithm scaleAlgorithm = ScaleAlgorithm::BICUBIC;
+};
+
+// every source frame is decoded once and shared by the rungs, each rung scales and encodes
+// it on its own thread
+struct LadderParam
+{
+    std::vector<LadderRung> rungs;
+    // decoded frames a rung may fall behind, the decoder waits for the slowest rung
+    int            queueSize      = 8;
+    FrameAllocType frameAllocType = FrameAllocType::DEFAULT;
+    bool           useCodecPool   = false;
+    // per stage timing of all rungs, printed as json at the end
+    std::shared_ptr<JobMetrics> metrics;
+    // chrome trace of the job, written to its file at the end
+    std::shared_ptr<TraceRecorder> trace;
+};
+
+// scale and encode the decoded frames of a ladder into one rendition on its own thread
+class LadderRungEncoder
+{
+public:
+    LadderRungEncoder(const LadderRung&  rung,
+                      const LadderParam& param,
+                      int                inWidth,
+                      int                inHeight,
+                      int                inPixFmt);
+
+    // dsiable copy-ctor and move-ctor
+    LadderRungEncoder(const LadderRungEncoder&) = delete;
+    LadderRungEncoder& operator=(const LadderRungEncoder) = delete;
+    LadderRungEncoder(LadderRungEncoder&&)                = delete;
+    LadderRungEncoder& operator=(LadderRungEncoder&&) = delete;
+
+    ~LadderRungEncoder();
+
+public:
+    bool isValid() const
+    {
+        return m_valid;
+    }
+    void start();
+    // wait while the queue is full. the frame is shared by all rungs and only read, its pts
+    // is the index of the source frame
+    void push(std::shared_ptr<Frame> frame);
+    // no more frames, flush the encoder and wait for the thread
+    void finish();
+
+private:
+    void run();
+    bool pop(std::shared_ptr<Frame>& frame);
+
+private:
+    LadderRung                    m_rung;
+    int                           m_queueSize;
+    bool                          m_valid = false;
+    std::shared_ptr<VideoCodec>   m_codec;
+    std::shared_ptr<SwsConvertor> m_swsConvertor;
+    // refers to the buffers of the shared frame, the rung changes pts and picture type on it
+    std::shared_ptr<Frame> m_input;
+    AVPacket*              m_pkt = nullptr;
+    std::ofstream          m_ofs;
+    JobMetrics*            m_metrics;
+    TraceRecorder*         m_trace;
+    std::thread            m_thread;
+
+    std::mutex                         m_mutex;
+    std::condition_variable            m_notEmpty;
+    std::condition_variable            m_notFull;
+    std::deque<std::shared_ptr<Frame>> m_queue;
+    bool                               m_finished = false;
+    uint64_t                           m_frames   = 0;
+};
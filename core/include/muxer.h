@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class AVCodecContext;
+class AVFormatContext;
+class AVPacket;
+
+// mux the encoded streams of jobs running on several threads into one file, one stream of
+// every media type. packets are interleaved by timestamp, a stream without packets holds the
+// others back no longer than maxSkewUs. timestamps of all streams are on one monotonic clock
+// starting at clockStartUs()
+class Muxer
+{
+public:
+    // the container is guessed by the extension of filename
+    Muxer(const std::string& filename, int streams, int64_t maxSkewUs);
+
+    // dsiable copy-ctor and move-ctor
+    Muxer(const Muxer&) = delete;
+    Muxer& operator=(const Muxer) = delete;
+    Muxer(Muxer&&)                = delete;
+    Muxer& operator=(Muxer&&) = delete;
+
+    ~Muxer();
+
+public:
+    bool isValid() const
+    {
+        return m_fmtCtx != nullptr;
+    }
+    // encoders must put codec headers in extradata instead of packets, such as for mp4
+    bool    needGlobalHeader() const;
+    int64_t clockStartUs() const
+    {
+        return m_clockStartUs;
+    }
+    int64_t maxSkewUs() const
+    {
+        return m_maxSkewUs;
+    }
+
+    // add the stream of an opened encoder, the header is written once every stream is added.
+    // return the stream index, -1 if failed
+    int addStream(const AVCodecContext* codecCtx);
+    // the job of mediaType has ended, the header doesn't wait for it if it never added one
+    void endStream(int mediaType);
+    // write pkt in the time base of its encoder, wait for the header. thread safe
+    void write(int streamIdx, AVPacket* pkt);
+    // write the trailer and close the file
+    void close();
+
+private:
+    struct MuxStream
+    {
+        int mediaType;
+        // time base of the encoder
+        int timeBaseNum;
+        int timeBaseDen;
+    };
+
+    // with m_mutex held
+    void writeHeaderIfReady();
+
+private:
+    std::string      m_filename;
+    AVFormatContext* m_fmtCtx = nullptr;
+    int              m_streams;
+    int64_t          m_maxSkewUs;
+    int64_t          m_clockStartUs;
+
+    std::mutex              m_mutex;
+    std::condition_variable m_headerCond;
+    std::vector<MuxStream>  m_muxStreams;
+    bool                    m_headerWritten = false;
+    bool                    m_failed        = false;
+    uint64_t                m_packets       = 0;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "simd.h"
+#include <cstdint>
+
+// Hand-vectorized pixel format conversion without resize, for the common capture/encode pairs:
+//   YUYV422 -> YUV420P
+//   NV12    -> YUV420P
+//   YUV420P -> NV12
+//   YUV422P -> YUV420P
+// Luma and NV12<->YUV420P are bit-exact with swscale. Vertical chroma decimation
+// (YUYV422/YUV422P -> YUV420P) is the rounded average of two lines.
+
+bool hasPixFmtKernel(int srcPixFmt, int dstPixFmt);
+
+// YUVJ* -> YUV* with the same layout, other format is returned as it is
+int convertDeprecatedFormat(int format);
+
+// return false if there's no kernel for the pair, width/height are the same for src and dst
+bool convertPixFmt(uint8_t* const src[],
+                   const int      srcStride[],
+                   int            srcPixFmt,
+                   uint8_t* const dst[],
+                   const int      dstStride[],
+                   int            dstPixFmt,
+                   int            width,
+                   int            height,
+                   SimdLevel      level = cpuSimdLevel());
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "frame_allocator.h"
+#include "simd.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+
+class AVFrame;
+class AVPacket;
+class Codec;
+class Frame;
+
+// quality of one frame, plane 0/1/2 is Y/U/V, `all` is weighted by plane size
+struct FrameQuality
+{
+    double psnr[3] = {0};
+    double psnrAll = 0;
+    double ssim[3] = {0};
+    double ssimAll = 0;
+    // sum of squared error
+    uint64_t sse[3] = {0};
+};
+
+struct QualityStats
+{
+    int64_t frames = 0;
+    // average of every frame
+    double psnrMean[3] = {0};
+    double psnrAllMean = 0;
+    double ssimMean[3] = {0};
+    double ssimAllMean = 0;
+    // psnr of the total squared error
+    double psnrGlobal = 0;
+};
+
+struct QualityMeterParam
+{
+    int width;
+    int height;
+    // 8 bit planar YUV/GRAY
+    int pixFmt;
+    // print quality of every frame
+    bool logPerFrame = false;
+};
+
+// Compute PSNR/SSIM of encoded video inline: keep a copy of every frame sent to the encoder,
+// decode the packets from the encoder and compare the decoded frame with the source of the
+// same pts.
+class QualityMeter
+{
+public:
+    QualityMeter(const QualityMeterParam& param, std::shared_ptr<Codec> encoder);
+
+    // dsiable copy-ctor and move-ctor
+    QualityMeter(const QualityMeter&) = delete;
+    QualityMeter& operator=(const QualityMeter) = delete;
+    QualityMeter(QualityMeter&&)                = delete;
+    QualityMeter& operator=(QualityMeter&&) = delete;
+
+    ~QualityMeter();
+
+public:
+    bool isValid() const
+    {
+        return m_valid;
+    }
+    // call before the frame is sent to encoder, the frame is copied
+    void addSource(std::shared_ptr<Frame> frame);
+    // call for every packet from encoder
+    void addPacket(AVPacket* pkt);
+    // decode the remain frames
+    void flush();
+
+    QualityStats stats() const;
+    void         logSummary() const;
+
+    // compare two frames with the same size and format, return false if the format is not
+    // supported
+    static bool measure(const AVFrame* ref,
+                        const AVFrame* dist,
+                        FrameQuality&  quality,
+                        SimdLevel      level = cpuSimdLevel());
+
+private:
+    void onDecodedFrame(std::shared_ptr<Frame> frame);
+
+private:
+    bool                                      m_valid = false;
+    QualityMeterParam                         m_param;
+    std::shared_ptr<Codec>                    m_decoder;
+    std::shared_ptr<Frame>                    m_decodeFrame;
+    std::unique_ptr<FrameBufferPool>          m_pool;
+    std::map<int64_t, std::shared_ptr<Frame>> m_sources;
+
+    // aggregate
+    int64_t  m_frames          = 0;
+    double   m_psnrSum[3]      = {0};
+    double   m_psnrAllSum      = 0;
+    double   m_ssimSum[3]      = {0};
+    double   m_ssimAllSum      = 0;
+    uint64_t m_sseSum          = 0;
+    int64_t  m_samplesPerFrame = 0;
+};
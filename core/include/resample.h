@@ -1,8 +1,13 @@
 #pragma once
 
 #include "../../utils/include/baseDefine.h"
+#include "downscale.h"
+#include "frame_allocator.h"
+#include "sws_cache.h"
 #include <cstdint>
+#include <memory>
 #include <utility>
+#include <vector>
 
 extern "C"
 {
@@ -31,9 +36,13 @@ struct ReampleParam
     int outWidth  = 0;
     int outHeight = 0;
     int outPixFmt = -1;
+    // BOX/BILINEAR use the simd downscaler for 2:1 and 4:1, fallback to swscale otherwise
+    ScaleAlgorithm scaleAlgorithm = ScaleAlgorithm::BICUBIC;
 };
 
 class SwrContext;
+// audio resample. if only the sample format is changed, use simd kernel in sample_convert.h
+// instead of swresample.
 class SwrConvertor
 {
 public:
@@ -51,8 +60,10 @@ public:
 public:
     bool enable() const
     {
-        return m_enable && m_swrCtx != nullptr;
+        return m_enable && (m_swrCtx != nullptr || m_useKernel);
     }
+    // return one full output buffer at most, call flushRemain while hasFullOutput() to drain.
+    // planar output is returned as contiguous planes in dstData[0]
     std::pair<uint8_t**, int>
     convert(uint8_t** srcData, int srcSize, uint8_t** dstData, int inSamples, int outSamples);
 
@@ -60,14 +71,32 @@ public:
     {
         return m_curOutputBufferSize > 0;
     }
+    bool hasFullOutput() const
+    {
+        return m_curOutputBufferSize >= m_fullOutputBufferSize;
+    }
     std::pair<uint8_t**, int> flushRemain(uint8_t** dstData);
+    // after the last input, move the samples delayed in swr to the output buffer, then drain
+    // it by flushRemain. dstData holds outSamples at least
+    bool flushDelay(uint8_t** dstData, int outSamples);
 
     int64_t calcNBSample(int inSampleRate, int inNBSample, int outSampleRate);
 
 private:
-    bool        m_enable   = false;
-    SwrContext* m_swrCtx   = nullptr;
-    uint8_t*    m_tempData = nullptr;
+    std::pair<uint8_t**, int>
+    convertByKernel(uint8_t** srcData, int srcSize, uint8_t** dstData, int inSamples);
+    std::pair<uint8_t**, int> popOutput(uint8_t** dstData, int outBufferSize);
+    bool                      reserveTempBuffer(int needSize);
+
+private:
+    bool        m_enable         = false;
+    bool        m_useKernel      = false;
+    bool        m_planarTemp     = false;
+    SwrContext* m_swrCtx         = nullptr;
+    uint8_t*    m_tempData       = nullptr;
+    int         m_tempBufferSize = 0;
+    // write position of every plane in m_tempData
+    std::vector<uint8_t*> m_tempPlanes;
 
     // in/out param
     int          m_inChannel     = 0;
@@ -81,4 +110,53 @@ private:
 
     int m_curOutputBufferSize  = 0;
     int m_fullOutputBufferSize = 0;
-};
\ No newline at end of file
+};
+class Frame;
+class SwsContext;
+// video scale/pix format convert. for the no-resize pairs in pixfmt_convert.h and
+// 2:1/4:1 box/bilinear downscale in downscale.h, use simd kernel instead of swscale.
+class SwsConvertor
+{
+public:
+    SwsConvertor() = default;
+    SwsConvertor(const ReampleParam& scaleParam,
+                 FrameAllocType      allocType = FrameAllocType::DEFAULT);
+
+    // dsiable copy-ctor and move-ctor
+    SwsConvertor(const SwsConvertor&) = delete;
+    SwsConvertor& operator=(const SwsConvertor) = delete;
+    SwsConvertor(SwsConvertor&&)                = delete;
+    SwsConvertor& operator=(SwsConvertor&&) = delete;
+
+    ~SwsConvertor();
+
+public:
+    bool enable() const
+    {
+        return m_enable;
+    }
+    // scale to the output frame owned by convertor, return nullptr if failed.
+    // for a full range(YUVJ*) input with the same layout as output, the output is a reference
+    // of srcFrame relabeled with the output format and color_range, srcFrame is untouched.
+    std::shared_ptr<Frame> scale(std::shared_ptr<Frame> srcFrame);
+    // the output refers to the planes of the last input instead of a copy
+    bool isRelabel() const
+    {
+        return m_relabel;
+    }
+
+    // if the output keep full range data(color_range should be AVCOL_RANGE_JPEG)
+    static bool isFullRangeOutput(const ReampleParam& scaleParam);
+
+private:
+    bool                   m_enable    = false;
+    bool                   m_useKernel    = false;
+    bool                   m_useDownscale = false;
+    bool                   m_relabel      = false;
+    bool                   m_fullRange    = false;
+    SwsContext*            m_swsCtx       = nullptr;
+    // m_swsCtx is checked out from SwsContextCache with this key
+    SwsContextKey          m_swsKey;
+    std::shared_ptr<Frame> m_outFrame;
+    ReampleParam           m_ctxParam;
+};
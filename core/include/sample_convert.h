@@ -0,0 +1,20 @@
+#pragma once
+
+#include "simd.h"
+#include <cstdint>
+
+// Vectorized sample format conversion between S16/S32/FLT/DBL in planar or packed layout,
+// the same sample rate and channel layout. Result is the same as swresample's audioconvert.
+
+bool hasSampleFmtKernel(int srcSampleFmt, int dstSampleFmt);
+
+// convert nbSamples samples of every channel.
+// src/dst has one pointer for packed format and `channels` pointers for planar format.
+// return false if there's no kernel for the pair
+bool convertSampleFmt(uint8_t* const       dst[],
+                      int                  dstSampleFmt,
+                      const uint8_t* const src[],
+                      int                  srcSampleFmt,
+                      int                  channels,
+                      int                  nbSamples,
+                      SimdLevel            level = cpuSimdLevel());
@@ -0,0 +1,14 @@
+#pragma once
+
+// simd instruction set used by the hand-written kernels
+enum class SimdLevel : int
+{
+    C,
+    SSE2,
+    AVX2,
+};
+
+// detect by av_get_cpu_flags once, the result is cached
+SimdLevel cpuSimdLevel();
+
+const char* simdLevelName(SimdLevel level);
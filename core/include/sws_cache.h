@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <utility>
+
+class SwsContext;
+
+struct SwsContextKey
+{
+    int inWidth   = 0;
+    int inHeight  = 0;
+    int inPixFmt  = -1;
+    int outWidth  = 0;
+    int outHeight = 0;
+    int outPixFmt = -1;
+    int flags     = 0;
+
+    bool operator==(const SwsContextKey& other) const
+    {
+        return inWidth == other.inWidth && inHeight == other.inHeight &&
+               inPixFmt == other.inPixFmt && outWidth == other.outWidth &&
+               outHeight == other.outHeight && outPixFmt == other.outPixFmt &&
+               flags == other.flags;
+    }
+};
+
+struct SwsCacheStats
+{
+    uint64_t hits   = 0;
+    uint64_t misses = 0;
+    // contexts waiting in cache
+    size_t idle = 0;
+};
+
+// Process-wide cache of scaler contexts. Filter initialization of sws_getContext is expensive
+// for a lot of short jobs with the same geometry.
+// SwsContext is not thread safe, a context is owned by one thread between checkout and
+// checkin. Only idle contexts are kept in cache, the least recently used one is recycled by
+// sws_getCachedContext when the cache is full.
+class SwsContextCache
+{
+public:
+    static SwsContextCache& instance();
+
+    // dsiable copy-ctor and move-ctor
+    SwsContextCache(const SwsContextCache&) = delete;
+    SwsContextCache& operator=(const SwsContextCache) = delete;
+    SwsContextCache(SwsContextCache&&)                = delete;
+    SwsContextCache& operator=(SwsContextCache&&) = delete;
+
+public:
+    // return an idle context of the key or a new one, nullptr if failed
+    SwsContext* checkout(const SwsContextKey& key);
+    // give the context back to cache, the caller can't use it anymore
+    void checkin(const SwsContextKey& key, SwsContext* ctx);
+
+    // max idle contexts, the extra ones are released
+    void setCapacity(size_t capacity);
+    // release all idle contexts
+    void clear();
+
+    SwsCacheStats stats() const;
+
+private:
+    SwsContextCache() = default;
+    ~SwsContextCache();
+
+private:
+    mutable std::mutex m_mutex;
+    // most recently used at front
+    std::list<std::pair<SwsContextKey, SwsContext*>> m_idle;
+    size_t                                           m_capacity = 16;
+    uint64_t                                         m_hits     = 0;
+    uint64_t                                         m_misses   = 0;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Chrome trace event recording of a job, open the file in chrome://tracing or
+// ui.perfetto.dev. every thread appends to its own buffer without locking, the buffers are
+// merged when the trace is written, so write it after all threads of the job are done.
+class TraceRecorder
+{
+public:
+    // events of a thread beyond maxEventsPerThread are dropped
+    TraceRecorder(const std::string& filename, size_t maxEventsPerThread = 1 << 20);
+
+    // dsiable copy-ctor and move-ctor
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder) = delete;
+    TraceRecorder(TraceRecorder&&)                = delete;
+    TraceRecorder& operator=(TraceRecorder&&) = delete;
+
+    ~TraceRecorder() = default;
+
+public:
+    // complete event from begin to end, name must outlive the recorder
+    void span(const char*                           name,
+              std::chrono::steady_clock::time_point begin,
+              std::chrono::steady_clock::time_point end,
+              uint64_t                              frames,
+              uint64_t                              bytes);
+    // counter event, series >= 0 draws several lines in one track, e.g. inputs of a mixer
+    void counter(const char* name, int64_t value, int series = -1);
+
+    // write chrome trace json to the file
+    bool     write() const;
+    uint64_t droppedCount() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    // recorder of this thread, nullptr if tracing is disabled
+    static TraceRecorder* current();
+
+private:
+    friend class TraceScope;
+    static void setCurrent(TraceRecorder* recorder);
+
+    struct TraceEvent
+    {
+        // 'X' span or 'C' counter
+        char        phase;
+        const char* name;
+        int64_t     tsNs;
+        int64_t     durNs;
+        // frames of a span, value of a counter
+        int64_t  value;
+        uint64_t bytes;
+        int      series;
+    };
+
+    struct ThreadBuffer
+    {
+        int                     tid;
+        std::string             threadName;
+        std::vector<TraceEvent> events;
+    };
+
+    ThreadBuffer* threadBuffer();
+    void          append(const TraceEvent& event);
+
+private:
+    std::string                                m_filename;
+    size_t                                     m_maxEventsPerThread;
+    // identify the recorder in thread local caches, an address may be reused
+    uint64_t                                   m_id;
+    std::chrono::steady_clock::time_point      m_start;
+    mutable std::mutex                         m_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+    std::atomic<uint64_t>                      m_dropped{0};
+};
+
+// make recorder the trace of this thread in the scope, nullptr disables tracing
+class TraceScope
+{
+public:
+    TraceScope(TraceRecorder* recorder);
+
+    // dsiable copy-ctor and move-ctor
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope) = delete;
+    TraceScope(TraceScope&&)                = delete;
+    TraceScope& operator=(TraceScope&&) = delete;
+
+    ~TraceScope();
+
+private:
+    TraceRecorder* m_prev = nullptr;
+};
+
+namespace tracedetail
+{
+extern thread_local TraceRecorder* t_current;
+} // namespace tracedetail
+
+inline TraceRecorder* TraceRecorder::current()
+{
+    return tracedetail::t_current;
+}
+
+// queue depth and the like, a thread local load if tracing is disabled
+inline void traceCounter(const char* name, int64_t value, int series = -1)
+{
+    if(TraceRecorder* recorder = tracedetail::t_current)
+    {
+        recorder->counter(name, value, series);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+
+class AVCodecContext;
+class AVDictionary;
+class AVFrame;
+class AVPacket;
+class AVStream;
+
+// how a VIRTUAL device is opened. the device name is a lavfi generator with its arguments,
+// such as "testsrc2", "smptebars" or "sine=frequency=1000". options are named like those of
+// v4l2 and alsa, so a job switches to it without other changes:
+//   video: video_size(1280x720) framerate(30) input_format(yuyv422, mjpeg or a pixel format)
+//          mjpeg_qscale(3)
+//   audio: sample_rate(48000) channels(2) sample_format(s16) period_size(1024)
+//   both:  realtime(1) paces packets to the wall clock like a device, 0 reads as fast as
+//          possible. duration(seconds) ends the source, endless if not set
+struct VirtualDeviceSpec
+{
+    // empty if the device name is not a lavfi generator
+    std::string graph;
+    // raw images are encoded into jpeg packets like a usb camera in mjpeg
+    bool mjpeg       = false;
+    int  mjpegQscale = 3;
+    // no duration, the source never ends like a real device
+    bool endless = true;
+};
+
+VirtualDeviceSpec parseVirtualDevice(const std::string& source, AVDictionary* options);
+
+// replace the raw image packets of lavfi by their jpeg, the packets are then what v4l2 reads
+// from a camera in mjpeg
+class MjpegPacketizer
+{
+public:
+    MjpegPacketizer() = default;
+
+    // dsiable copy-ctor and move-ctor
+    MjpegPacketizer(const MjpegPacketizer&) = delete;
+    MjpegPacketizer& operator=(const MjpegPacketizer) = delete;
+    MjpegPacketizer(MjpegPacketizer&&)                = delete;
+    MjpegPacketizer& operator=(MjpegPacketizer&&) = delete;
+
+    ~MjpegPacketizer();
+
+public:
+    // open the encoder for the raw stream, then the codec parameters of stream are changed to
+    // mjpeg
+    bool open(AVStream* stream, int qscale);
+    // encode the image in pkt and move the jpeg into it, negative AVERROR if failed
+    int packetize(AVPacket* pkt);
+
+private:
+    AVCodecContext* m_codecCtx = nullptr;
+    AVFrame*        m_frame    = nullptr;
+    AVPacket*       m_jpegPkt  = nullptr;
+};
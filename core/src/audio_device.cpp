@@ -8,7 +8,9 @@ extern "C"
 #include <libavutil/avutil.h>
 #include <libavutil/common.h>
 #include <libavutil/frame.h>
+#include <libavutil/mathematics.h>
 #include <libavutil/opt.h>
+#include <libavutil/time.h>
 #include <libswresample/swresample.h>
 
 #include <libavutil/imgutils.h>
@@ -16,11 +18,19 @@ extern "C"
 }
 
 #include "../../utils/include/log.h"
+#include "audio_mixer.h"
 #include "codec.h"
+#include "codec_pool.h"
 #include "device.h"
 #include "frame.h"
+#include "capture_latency.h"
+#include "job_metrics.h"
+#include "muxer.h"
+#include "trace.h"
 #include "resample.h"
 
+#include <algorithm>
+#include <climits>
 #include <fstream>
 #include <iostream>
 
@@ -31,14 +41,19 @@ AudioDevice::AudioDevice()
     : Device()
 { }
 
-AudioDevice::AudioDevice(const std::string& deviceName, DeviceType deviceType)
-    : Device(deviceName, deviceType)
+AudioDevice::AudioDevice(const std::string& deviceName,
+                         DeviceType         deviceType,
+                         AVDictionary*      options)
+    : Device(deviceName, deviceType, options)
 { }
 
 AudioDevice::~AudioDevice() { }
 
 void AudioDevice::readAndEncode(ReadDeviceDataParam& params)
 {
+    JobMetricsScope metricsScope(params.metrics.get());
+    TraceScope      traceScope(params.trace.get());
+
     // 0. decied if is read from stream(file)
     bool readFromStream = false;
     if(params.inFilename != "")
@@ -52,19 +67,22 @@ void AudioDevice::readAndEncode(ReadDeviceDataParam& params)
     std::ifstream ifs(params.inFilename, std::ios::in);
 
     AVPacket      audioPacket;
-    int           frameSize = 0;
+    int           frameSize      = 0;
+    int64_t       preReadArrival = 0;
     av_init_packet(&audioPacket);
 
     // 2. codec
-    auto audioCodec = std::make_shared<AudioCodec>(params.codecParam);
+    auto audioCodec = params.useCodecPool ? CodecPool::instance().acquireAudio(params.codecParam)
+                                          : std::make_shared<AudioCodec>(params.codecParam);
 
     // 3. calc frame size
     if(!readFromStream)
     {
-        // need pre-read a frame if read from hw
-        if(av_read_frame(getFmtCtx(), &audioPacket) >= 0)
+        // need pre-read a frame if read from hw, it's encoded first
+        if(readPacket(&audioPacket) >= 0)
         {
-            frameSize = audioPacket.size;
+            frameSize      = audioPacket.size;
+            preReadArrival = av_gettime_relative();
         }
         else
         {
@@ -142,13 +160,18 @@ void AudioDevice::readAndEncode(ReadDeviceDataParam& params)
                             .swrConvertor = swrConvertor,
                             .audioCodec   = audioCodec,
                             .frame        = frame,
-                            .pkt          = newPkt};
+                            .pkt          = newPkt,
+                            .captureParam = params.captureParam,
+                            .muxer        = params.muxer};
 
     // 8. read and write/encode audio data
     if(!readFromStream)
     {
         // from hw device
+        param.preReadPkt       = &audioPacket;
+        param.preReadArrivalUs = preReadArrival;
         readAudioFromHWDevice(param);
+        av_packet_unref(&audioPacket);
     }
     else
     {
@@ -179,6 +202,14 @@ void AudioDevice::readAndEncode(ReadDeviceDataParam& params)
     {
         av_freep(&dstData);
     }
+    if(params.metrics)
+    {
+        AV_LOG_I("job metrics %s", params.metrics->report().toJson().c_str());
+    }
+    if(params.trace)
+    {
+        params.trace->write();
+    }
 }
 
 void AudioDevice::readAndDecode(ReadDeviceDataParam& params)
@@ -188,6 +219,8 @@ void AudioDevice::readAndDecode(ReadDeviceDataParam& params)
         AV_LOG_E("don't support read audio data to pcm.");
         return;
     }
+    JobMetricsScope metricsScope(params.metrics.get());
+    TraceScope      traceScope(params.trace.get());
     std::ofstream ofs(params.outFilename, std::ios::out);
 
     // 1. find audio stream
@@ -208,7 +241,8 @@ void AudioDevice::readAndDecode(ReadDeviceDataParam& params)
                              .avCodecPar = fmtCtx->streams[audioStreamIdx]->codecpar,
                              .byId       = true};
     CodecParam   codecParam = {.decodeParam = decodeParam};
-    auto audioCodec = std::make_shared<AudioCodec>(codecParam);
+    auto audioCodec = params.useCodecPool ? CodecPool::instance().acquireAudio(codecParam)
+                                          : std::make_shared<AudioCodec>(codecParam);
     if(!audioCodec->decodeEnable())
     {
         AV_LOG_D("can't use decode. please check it");
@@ -257,17 +291,23 @@ void AudioDevice::readAndDecode(ReadDeviceDataParam& params)
             if(outputData)
             {
                 AV_LOG_D("write audio success!!!, outputSize %d", outputSize);
-                ofs.write(reinterpret_cast<char*>(outputData[0]), outputSize);
+                timedWrite(ofs, outputData[0], outputSize);
+            }
+            // convert return one full buffer at most
+            while(swrConvertor->hasFullOutput())
+            {
+                auto [fullData, fullSize] = swrConvertor->flushRemain(&dstData);
+                timedWrite(ofs, fullData[0], fullSize);
             }
         }
         else
         {
-            ofs.write(reinterpret_cast<char*>(frame->data()[0]), frame->lineSize(0));
+            timedWrite(ofs, frame->data()[0], frame->lineSize(0));
         }
     };
 
     // 8. read and decode audio data
-    while(av_read_frame(fmtCtx, &packet) >= 0)
+    while(timedReadFrame(fmtCtx, &packet) >= 0)
     {
         if(packet.stream_index == audioStreamIdx)
         {
@@ -290,7 +330,7 @@ void AudioDevice::readAndDecode(ReadDeviceDataParam& params)
         auto [outputData, outputSize] = swrConvertor->flushRemain(&dstData);
         if(outputData)
         {
-            ofs.write(reinterpret_cast<char*>(outputData[0]), outputSize);
+            timedWrite(ofs, outputData[0], outputSize);
         }
     }
 
@@ -299,62 +339,180 @@ void AudioDevice::readAndDecode(ReadDeviceDataParam& params)
     {
         av_freep(&dstData);
     }
+    if(params.metrics)
+    {
+        AV_LOG_I("job metrics %s", params.metrics->report().toJson().c_str());
+    }
+    if(params.trace)
+    {
+        params.trace->write();
+    }
 }
 
 void AudioDevice::readAudioFromHWDevice(AudioReaderParam& param)
 {
-    if(getDeviceType() != DeviceType::AUDIO)
+    if(getDeviceType() != DeviceType::AUDIO && getDeviceType() != DeviceType::LAVFI &&
+       getDeviceType() != DeviceType::VIRTUAL && getDeviceType() != DeviceType::REPLAY)
     {
         AV_LOG_E("can't support read from hw device");
         return;
     }
+    int muxStream = -1;
+    if(param.muxer)
+    {
+        if(!param.audioCodec->encodeEnable())
+        {
+            AV_LOG_E("pcm can't be muxed");
+            return;
+        }
+        muxStream = param.muxer->addStream(param.audioCodec->getCodecCtx(true));
+        if(muxStream < 0)
+            return;
+    }
     AVPacket audioPacket;
     av_init_packet(&audioPacket);
 
-    int  recordCnt = 5000;
-    auto encodeCB  = [&](AVPacket* pkt) {
-        param.ofs.write(reinterpret_cast<char*>(pkt->data), pkt->size);
-    };
     auto* fmtCtx = getFmtCtx();
 
-    do
+    // capture time of every packet by its first sample in media time(us), an encoded frame
+    // takes the packet its first sample came from
+    CaptureLatency     captureLatency("audio");
+    CaptureTimeMap     packetCaptureUs;
+    AVCodecParameters* inPar        = fmtCtx->streams[0]->codecpar;
+    int                inFrameBytes =
+        inPar->channels * av_get_bytes_per_sample((AVSampleFormat)inPar->format);
+    int64_t            inSamples    = 0;
+    int64_t            outSamples   = 0;
+    AVRational         outSampleTb  = {1, std::max(1, param.audioCodec->sampleRate(true))};
+    AVRational         outTimeBase  = outSampleTb;
+    if(param.audioCodec->encodeEnable() && param.audioCodec->getCodecCtx(true)->time_base.num)
     {
-        recordCnt--;
-        if(param.swrConvertor->enable())
+        outTimeBase = param.audioCodec->getCodecCtx(true)->time_base;
+    }
+    // media time(us) of the first sample on the clock of the muxer, samples are continuous
+    // from it. it jumps over a gap longer than the skew allowed, such as of dropped packets,
+    // and samples ahead of the clock by more than the skew are dropped
+    int64_t anchorUs = 0;
+    bool    anchored = false;
+
+    auto encodeCB = [&](AVPacket* pkt) {
+        if(pkt->pts != AV_NOPTS_VALUE)
         {
-            auto [outputData, outputSize] = param.swrConvertor->convert(&audioPacket.data,
-                                                                       audioPacket.size,
-                                                                       &param.dstData,
-                                                                       param.inSamples,
-                                                                       param.outSamples);
-            if(outputData && outputSize)
+            int64_t mediaUs = av_rescale_q(pkt->pts, outTimeBase, AV_TIME_BASE_Q);
+            captureLatency.record(packetCaptureUs.find(mediaUs));
+        }
+        if(param.muxer)
+        {
+            param.muxer->write(muxStream, pkt);
+        }
+        else
+        {
+            timedWrite(param.ofs, pkt->data, pkt->size);
+        }
+    };
+    auto writeCB = [&](uint8_t** data, int size) {
+        if(param.audioCodec->encodeEnable() && param.frame->isValid())
+        {
+            param.frame->writeAudioData(data, size);
+            AVFrame* avFrame = param.frame->getAVFrame();
+            avFrame->pts     = av_rescale_q(
+                outSamples + av_rescale_q(anchorUs, AV_TIME_BASE_Q, outSampleTb),
+                outSampleTb,
+                outTimeBase);
+            outSamples += avFrame->nb_samples;
+            param.audioCodec->encode(param.frame, param.pkt, encodeCB);
+        }
+        else
+        {
+            timedWrite(param.ofs, data[0], size);
+        }
+    };
+
+    // read on the capture thread
+    CaptureThread capture(fmtCtx,
+                          [this](AVPacket* pkt) { return readPacket(pkt); },
+                          boundedCaptureParam(param.captureParam, kDefaultCapturePackets),
+                          "audio");
+    int64_t       captureUs = -1;
+    if(param.preReadPkt && param.preReadPkt->size > 0)
+    {
+        capture.pushPreRead(param.preReadPkt, param.preReadArrivalUs);
+    }
+    capture.start();
+    // a sound card running fast gets ahead of the clock, its packets are dropped until the
+    // clock catches up
+    bool     catchingUp     = false;
+    uint64_t droppedSamples = 0;
+    while(capture.pop(&audioPacket, captureUs))
+    {
+        if(inFrameBytes > 0 && inPar->sample_rate > 0)
+        {
+            int64_t mediaUs = av_rescale(inSamples, AV_TIME_BASE, inPar->sample_rate);
+            if(param.muxer && captureUs >= 0)
             {
-                if(param.audioCodec->encodeEnable() && param.frame->isValid())
+                int64_t clockUs = std::max<int64_t>(0, captureUs - param.muxer->clockStartUs());
+                // > 0 audio is behind the clock, < 0 ahead of it
+                int64_t driftUs = clockUs - (anchorUs + mediaUs);
+                if(!anchored)
+                {
+                    anchorUs = clockUs - mediaUs;
+                    anchored = true;
+                }
+                else if(driftUs > param.muxer->maxSkewUs())
                 {
-                    param.frame->writeAudioData(outputData, outputSize);
-                    param.audioCodec->encode(param.frame, param.pkt, encodeCB);
+                    AV_LOG_W("audio is %ld ms behind the clock, skip the gap", driftUs / 1000);
+                    anchorUs = clockUs - mediaUs;
+                }
+                else if(driftUs < -param.muxer->maxSkewUs() || (catchingUp && driftUs < 0))
+                {
+                    if(!catchingUp)
+                    {
+                        AV_LOG_W("audio is %ld ms ahead of the clock, drop samples",
+                                 -driftUs / 1000);
+                    }
+                    catchingUp = true;
+                    droppedSamples += audioPacket.size / inFrameBytes;
+                    av_packet_unref(&audioPacket);
+                    continue;
                 }
                 else
                 {
-                    param.ofs.write(reinterpret_cast<char*>(outputData[0]), outputSize);
+                    catchingUp = false;
                 }
             }
+            packetCaptureUs.add(anchorUs + mediaUs, captureUs);
+            inSamples += audioPacket.size / inFrameBytes;
         }
-        else
+        if(param.swrConvertor->enable())
         {
-            if(param.audioCodec->encodeEnable() && param.frame->isValid())
+            auto [outputData, outputSize] = param.swrConvertor->convert(&audioPacket.data,
+                                                                       audioPacket.size,
+                                                                       &param.dstData,
+                                                                       param.inSamples,
+                                                                       param.outSamples);
+            if(outputData && outputSize)
             {
-                param.frame->writeAudioData(&audioPacket.data, audioPacket.size);
-                param.audioCodec->encode(param.frame, param.pkt, encodeCB);
+                writeCB(outputData, outputSize);
             }
-            else
+            // convert return one full buffer at most
+            while(param.swrConvertor->hasFullOutput())
             {
-                param.ofs.write(reinterpret_cast<char*>(audioPacket.data), audioPacket.size);
+                auto [fullData, fullSize] = param.swrConvertor->flushRemain(&param.dstData);
+                writeCB(fullData, fullSize);
             }
         }
+        else
+        {
+            writeCB(&audioPacket.data, audioPacket.size);
+        }
 
         av_packet_unref(&audioPacket);
-    } while(av_read_frame(fmtCtx, &audioPacket) == 0 && recordCnt > 0);
+    }
+    capture.logStats();
+    if(droppedSamples > 0)
+    {
+        AV_LOG_I("dropped %lu samples of audio ahead of the clock", droppedSamples);
+    }
 
     // flush swr
     while(param.swrConvertor->hasRemain())
@@ -363,15 +521,7 @@ void AudioDevice::readAudioFromHWDevice(AudioReaderParam& param)
         AV_LOG_D("flush remain buffer size %d", remainBufferSize);
         if(remainData && remainBufferSize)
         {
-            if(param.audioCodec->encodeEnable() && param.frame->isValid())
-            {
-                param.frame->writeAudioData(remainData, remainBufferSize);
-                param.audioCodec->encode(param.frame, param.pkt, encodeCB);
-            }
-            else
-            {
-                param.ofs.write(reinterpret_cast<char*>(remainData[0]), remainBufferSize);
-            }
+            writeCB(remainData, remainBufferSize);
         }
     }
 
@@ -380,56 +530,57 @@ void AudioDevice::readAudioFromHWDevice(AudioReaderParam& param)
     {
         param.audioCodec->encode(param.frame, param.pkt, encodeCB, true);
     }
+    captureLatency.logSummary();
 }
 
 void AudioDevice::readAudioFromStream(AudioReaderParam& param)
 {
     auto cb = [&](AVPacket* pkt) {
-        param.ofs.write(reinterpret_cast<char*>(pkt->data), pkt->size);
+        timedWrite(param.ofs, pkt->data, pkt->size);
     };
-    int n   = 0;
-    int pts = 0;
-    while((n = param.ifs.readsome((char*)param.srcData, param.frameSize)) > 0)
+    int  n       = 0;
+    int  pts     = 0;
+    auto writeCB = [&](uint8_t** data, int size) {
+        if(param.audioCodec->encodeEnable())
+        {
+            if(param.frame->writeAudioData(data, size) == false)
+            {
+                return false;
+            }
+            pts += param.frame->getAVFrame()->nb_samples;
+            param.frame->getAVFrame()->pts = pts;
+            param.audioCodec->encode(param.frame, param.pkt, cb, false);
+        }
+        else
+        {
+            timedWrite(param.ofs, data[0], size);
+        }
+        return true;
+    };
+    while((n = timedReadsome(param.ifs, param.srcData, param.frameSize)) > 0)
     {
         if(param.swrConvertor->enable())
         {
             auto [outputData, outputSize] = param.swrConvertor->convert(
                 &param.srcData, n, &param.dstData, param.inSamples, param.outSamples);
-            if(outputData && outputSize)
+            if(outputData && outputSize && !writeCB(outputData, outputSize))
             {
-                if(param.audioCodec->encodeEnable())
-                {
-                    if(param.frame->writeAudioData(outputData, outputSize) == false)
-                    {
-                        return;
-                    }
-                    pts += param.frame->getAVFrame()->nb_samples;
-                    param.frame->getAVFrame()->pts = pts;
-                    param.audioCodec->encode(param.frame, param.pkt, cb, false);
-                }
-                else
-                {
-                    param.ofs.write(reinterpret_cast<char*>(outputData), outputSize);
-                }
+                return;
             }
-        }
-        else
-        {
-            if(param.audioCodec->encodeEnable())
+            // convert return one full buffer at most
+            while(param.swrConvertor->hasFullOutput())
             {
-                if(param.frame->writeAudioData(&param.srcData, n) == false)
+                auto [fullData, fullSize] = param.swrConvertor->flushRemain(&param.dstData);
+                if(!writeCB(fullData, fullSize))
                 {
                     return;
                 }
-                pts += param.frame->getAVFrame()->nb_samples;
-                param.frame->getAVFrame()->pts = pts;
-                param.audioCodec->encode(param.frame, param.pkt, cb, false);
-            }
-            else
-            {
-                param.ofs.write(reinterpret_cast<char*>(param.srcData), n);
             }
         }
+        else if(!writeCB(&param.srcData, n))
+        {
+            return;
+        }
     }
 
     // flush swr
@@ -439,22 +590,291 @@ void AudioDevice::readAudioFromStream(AudioReaderParam& param)
         auto [remainData, remainBufferSize] = param.swrConvertor->flushRemain(&param.dstData);
         if(remainData && remainBufferSize)
         {
-            if(param.audioCodec->encodeEnable())
+            writeCB(remainData, remainBufferSize);
+            AV_LOG_D("write audio success!!!, nb samples %d", remainBufferSize);
+        }
+    }
+
+    // flush encode
+    if(param.audioCodec->encodeEnable())
+    {
+        param.audioCodec->encode(param.frame, param.pkt, cb, true);
+    }
+}
+void AudioDevice::readAndMix(std::vector<AudioMixInput>& inputs, ReadDeviceDataParam& params)
+{
+    JobMetricsScope metricsScope(params.metrics.get());
+    TraceScope      traceScope(params.trace.get());
+    std::ofstream ofs(params.outFilename, std::ios::out);
+
+    // 1. codec, the output of mixer is the input of encoder
+    auto audioCodec = params.useCodecPool ? CodecPool::instance().acquireAudio(params.codecParam)
+                                          : std::make_shared<AudioCodec>(params.codecParam);
+    bool                needEncode  = audioCodec->encodeEnable();
+    const EncoderParam& encodeParam = params.codecParam.encodeParam;
+    int64_t outChannelLayout = needEncode ? encodeParam.channelLayout : params.outChannelLayout;
+    int     outSampleFmt     = needEncode ? encodeParam.sampleFmt : params.outSampleFmt;
+    int     outSampleRate    = needEncode ? encodeParam.sampleRate : params.outSampleRate;
+    int     frameSamples     = needEncode ? audioCodec->frameSize(true) : 0;
+    if(frameSamples <= 0)
+    {
+        // pcm or encoder without fixed frame size
+        frameSamples = 1024;
+    }
+    int outChannels = av_get_channel_layout_nb_channels(outChannelLayout);
+    int frameBytes =
+        frameSamples * outChannels * av_get_bytes_per_sample((AVSampleFormat)outSampleFmt);
+
+    // 2. mixer
+    AudioMixerParam mixerParam{
+        .channelLayout = outChannelLayout,
+        .sampleFmt     = outSampleFmt,
+        .frameSamples  = frameSamples,
+    };
+    AudioMixer mixer(mixerParam);
+    if(!mixer.isValid())
+    {
+        return;
+    }
+
+    // 3. sources, resample to packed float if the layout or rate is different from output
+    struct MixSource
+    {
+        std::shared_ptr<AudioDevice>   device;
+        std::unique_ptr<CaptureThread> capture;
+        std::ifstream                  ifs;
+        std::shared_ptr<SwrConvertor>  swrConvertor;
+        std::vector<uint8_t>           srcBuffer;
+        std::vector<uint8_t>           dstBuffer;
+        int                            input        = -1;
+        int                            inChannels   = 0;
+        int                            inSampleSize = 0;
+        int                            inSampleRate = 0;
+        bool                           eof          = false;
+    };
+    std::vector<std::unique_ptr<MixSource>> sources;
+    for(auto& mixInput : inputs)
+    {
+        auto source          = std::make_unique<MixSource>();
+        source->device       = mixInput.device;
+        source->inChannels   = av_get_channel_layout_nb_channels(mixInput.inChannelLayout);
+        source->inSampleSize = av_get_bytes_per_sample((AVSampleFormat)mixInput.inSampleFmt);
+        source->inSampleRate = mixInput.inSampleRate;
+        if(source->device)
+        {
+            // every device input is recorded into its own file, <recordFilename>.<input>
+            AudioDevice* device       = source->device.get();
+            CaptureParam captureParam =
+                device->boundedCaptureParam(params.captureParam, kDefaultCapturePackets);
+            if(!captureParam.recordFilename.empty())
+            {
+                captureParam.recordFilename += "." + std::to_string(sources.size());
+            }
+            source->capture = std::make_unique<CaptureThread>(
+                device->getFmtCtx(),
+                [device](AVPacket* pkt) { return device->readPacket(pkt); },
+                captureParam,
+                "mix");
+        }
+        else
+        {
+            source->ifs.open(mixInput.inFilename, std::ios::in);
+            source->srcBuffer.resize(frameSamples * source->inChannels * source->inSampleSize);
+        }
+
+        int mixFmt = mixInput.inSampleFmt;
+        if(mixInput.inChannelLayout != outChannelLayout || mixInput.inSampleRate != outSampleRate)
+        {
+            ReampleParam swrCtxParam = {.outChannelLayout = outChannelLayout,
+                                        .outSampleFmt     = AV_SAMPLE_FMT_FLT,
+                                        .outSampleRate    = outSampleRate,
+                                        .inChannelLayout  = mixInput.inChannelLayout,
+                                        .inSampleFmt = (AVSampleFormat)mixInput.inSampleFmt,
+                                        .inSampleRate = mixInput.inSampleRate,
+                                        .logOffset    = 0,
+                                        .logCtx       = nullptr,
+                                        .fullOutputBufferSize =
+                                            frameSamples * outChannels * (int)sizeof(float)};
+            source->swrConvertor = std::make_shared<SwrConvertor>(swrCtxParam);
+            if(!source->swrConvertor->enable())
             {
-                param.frame->writeAudioData(remainData, remainBufferSize);
-                param.audioCodec->encode(param.frame, param.pkt, cb);
+                AV_LOG_E("failed to create swr for mix input %s", mixInput.inFilename.c_str());
+                return;
+            }
+            mixFmt = AV_SAMPLE_FMT_FLT;
+        }
+        source->input = mixer.addInput(mixFmt, mixInput.gain);
+        if(source->input < 0)
+        {
+            return;
+        }
+        sources.push_back(std::move(source));
+    }
+
+    // 4. feed pcm of a source to mixer
+    int  floatFrameBytes = outChannels * (int)sizeof(float);
+    auto feed            = [&](MixSource& source, uint8_t* data, int size) {
+        int inSamples = size / (source.inChannels * source.inSampleSize);
+        if(!source.swrConvertor)
+        {
+            mixer.push(source.input, &data, inSamples);
+            return;
+        }
+        int64_t outSamples =
+            source.swrConvertor->calcNBSample(source.inSampleRate, inSamples, outSampleRate);
+        // swr writes outSamples, a full buffer of the convertor is frameSamples of float
+        size_t dstSize = std::max<int64_t>(outSamples, frameSamples) * floatFrameBytes;
+        if(source.dstBuffer.size() < dstSize)
+        {
+            source.dstBuffer.resize(dstSize);
+        }
+        uint8_t* dstData = source.dstBuffer.data();
+        auto [outputData, outputSize] =
+            source.swrConvertor->convert(&data, size, &dstData, inSamples, outSamples);
+        if(outputData)
+        {
+            mixer.push(source.input, outputData, outputSize / floatFrameBytes);
+        }
+        // convert return one full buffer at most
+        while(source.swrConvertor->hasFullOutput())
+        {
+            auto [fullData, fullSize] = source.swrConvertor->flushRemain(&dstData);
+            mixer.push(source.input, fullData, fullSize / floatFrameBytes);
+        }
+    };
+    auto finish = [&](MixSource& source) {
+        source.eof = true;
+        if(source.swrConvertor)
+        {
+            size_t dstSize = (size_t)frameSamples * floatFrameBytes;
+            if(source.dstBuffer.size() < dstSize)
+            {
+                source.dstBuffer.resize(dstSize);
+            }
+            // the tail of the input is still in the delay of swr
+            uint8_t* dstData = source.dstBuffer.data();
+            source.swrConvertor->flushDelay(&dstData, frameSamples);
+        }
+        while(source.swrConvertor && source.swrConvertor->hasRemain())
+        {
+            uint8_t* dstData              = source.dstBuffer.data();
+            auto [remainData, remainSize] = source.swrConvertor->flushRemain(&dstData);
+            mixer.push(source.input, remainData, remainSize / floatFrameBytes);
+        }
+        mixer.finish(source.input);
+    };
+
+    // 5. mix and encode/write
+    AudioFrameParam audioFrameParam = {
+        .enable        = needEncode,
+        .frameSize     = frameBytes,
+        .channelLayout = (uint64_t)outChannelLayout,
+        .format        = outSampleFmt,
+    };
+    auto                 frame  = std::make_shared<Frame>(audioFrameParam);
+    AVPacket*            newPkt = av_packet_alloc();
+    std::vector<uint8_t> pcmBuffer(frameBytes);
+    int64_t              pts      = 0;
+    auto                 encodeCB = [&](AVPacket* pkt) {
+        timedWrite(ofs, pkt->data, pkt->size);
+    };
+    auto mixOutput = [&]() {
+        if(needEncode && frame->isValid() && newPkt)
+        {
+            av_frame_make_writable(frame->getAVFrame());
+            pts += mixer.mix(frame->data());
+            frame->getAVFrame()->pts = pts;
+            audioCodec->encode(frame, newPkt, encodeCB);
+        }
+        else
+        {
+            uint8_t* planes[AV_NUM_DATA_POINTERS] = {nullptr};
+            int      lineSize                     = 0;
+            av_samples_fill_arrays(planes,
+                                   &lineSize,
+                                   pcmBuffer.data(),
+                                   outChannels,
+                                   frameSamples,
+                                   (AVSampleFormat)outSampleFmt,
+                                   0);
+            mixer.mix(planes);
+            timedWrite(ofs, pcmBuffer.data(), frameBytes);
+        }
+    };
+
+    AVPacket audioPacket;
+    av_init_packet(&audioPacket);
+    for(auto& source : sources)
+    {
+        if(source->capture)
+        {
+            source->capture->start();
+        }
+    }
+    int64_t captureUs = -1;
+    bool    active    = !sources.empty();
+    while(active)
+    {
+        active = false;
+        for(auto& source : sources)
+        {
+            if(source->eof)
+            {
+                continue;
+            }
+            if(source->capture)
+            {
+                if(!source->capture->pop(&audioPacket, captureUs))
+                {
+                    finish(*source);
+                    continue;
+                }
+                feed(*source, audioPacket.data, audioPacket.size);
+                av_packet_unref(&audioPacket);
             }
             else
             {
-                param.ofs.write(reinterpret_cast<char*>(remainData), remainBufferSize);
+                int n = timedReadsome(
+                    source->ifs, source->srcBuffer.data(), source->srcBuffer.size());
+                if(n <= 0)
+                {
+                    finish(*source);
+                    continue;
+                }
+                feed(*source, source->srcBuffer.data(), n);
             }
-            AV_LOG_D("write audio success!!!, nb samples %d", remainBufferSize);
+            active = true;
+        }
+
+        while(mixer.hasOutput())
+        {
+            mixOutput();
+        }
+    }
+    AV_LOG_D("mixed %ld samples of %zu inputs", mixer.mixedSamples(), sources.size());
+    for(auto& source : sources)
+    {
+        if(source->capture)
+        {
+            source->capture->logStats();
         }
     }
 
-    // flush encode
-    if(param.audioCodec->encodeEnable())
+    // 6. flush encode
+    if(needEncode && frame->isValid() && newPkt)
     {
-        param.audioCodec->encode(param.frame, param.pkt, cb, true);
+        audioCodec->encode(frame, newPkt, encodeCB, true);
+    }
+    if(newPkt)
+    {
+        av_packet_free(&newPkt);
+    }
+    if(params.metrics)
+    {
+        AV_LOG_I("job metrics %s", params.metrics->report().toJson().c_str());
     }
-}
\ No newline at end of file
+    if(params.trace)
+    {
+        params.trace->write();
+    }
+}
@@ -0,0 +1,315 @@
+#include "audio_mixer.h"
+#include "../../utils/include/log.h"
+#include "sample_convert.h"
+#include "trace.h"
+
+extern "C"
+{
+#include <libavutil/channel_layout.h>
+#include <libavutil/frame.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define MIXER_X86 1
+#    include <immintrin.h>
+#endif
+
+namespace
+{
+struct MixKernels
+{
+    // dst += src * gain
+    void (*mixAdd)(float* dst, const float* src, float gain, int count);
+    // clip to [-1.0, 1.0]
+    void (*clip)(float* data, int count);
+};
+
+// -------------------------- C --------------------------
+void mixAddC(float* dst, const float* src, float gain, int count)
+{
+    for(int i = 0; i < count; i++)
+    {
+        dst[i] += src[i] * gain;
+    }
+}
+
+void clipC(float* data, int count)
+{
+    for(int i = 0; i < count; i++)
+    {
+        data[i] = std::min(std::max(data[i], -1.0f), 1.0f);
+    }
+}
+
+const MixKernels kKernelsC = {
+    mixAddC,
+    clipC,
+};
+
+#ifdef MIXER_X86
+// -------------------------- SSE2 --------------------------
+__attribute__((target("sse2"))) void mixAddSSE2(float* dst, const float* src, float gain, int count)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    int          i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128 a = _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g));
+        __m128 b = _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_mul_ps(_mm_loadu_ps(src + i + 4), g));
+        _mm_storeu_ps(dst + i, a);
+        _mm_storeu_ps(dst + i + 4, b);
+    }
+    mixAddC(dst + i, src + i, gain, count - i);
+}
+
+__attribute__((target("sse2"))) void clipSSE2(float* data, int count)
+{
+    const __m128 minV = _mm_set1_ps(-1.0f);
+    const __m128 maxV = _mm_set1_ps(1.0f);
+    int          i    = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(data + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(data + i), minV), maxV));
+    }
+    clipC(data + i, count - i);
+}
+
+const MixKernels kKernelsSSE2 = {
+    mixAddSSE2,
+    clipSSE2,
+};
+
+// -------------------------- AVX2 --------------------------
+// mul + add instead of fma, the result is the same as C/SSE2 version
+__attribute__((target("avx2"))) void mixAddAVX2(float* dst, const float* src, float gain, int count)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    int          i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m256 a = _mm256_add_ps(_mm256_loadu_ps(dst + i),
+                                 _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+        __m256 b = _mm256_add_ps(_mm256_loadu_ps(dst + i + 8),
+                                 _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), g));
+        _mm256_storeu_ps(dst + i, a);
+        _mm256_storeu_ps(dst + i + 8, b);
+    }
+    mixAddSSE2(dst + i, src + i, gain, count - i);
+}
+
+__attribute__((target("avx2"))) void clipAVX2(float* data, int count)
+{
+    const __m256 minV = _mm256_set1_ps(-1.0f);
+    const __m256 maxV = _mm256_set1_ps(1.0f);
+    int          i    = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_ps(data + i,
+                         _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(data + i), minV), maxV));
+    }
+    clipSSE2(data + i, count - i);
+}
+
+const MixKernels kKernelsAVX2 = {
+    mixAddAVX2,
+    clipAVX2,
+};
+#endif
+
+const MixKernels& selectKernels(SimdLevel level)
+{
+#ifdef MIXER_X86
+    if(level == SimdLevel::AVX2)
+    {
+        return kKernelsAVX2;
+    }
+    if(level == SimdLevel::SSE2)
+    {
+        return kKernelsSSE2;
+    }
+#endif
+    return kKernelsC;
+}
+} // namespace
+
+AudioMixer::AudioMixer(const AudioMixerParam& param)
+    : m_param(param)
+{
+    m_channels = av_get_channel_layout_nb_channels(param.channelLayout);
+    if(m_channels <= 0 || param.frameSamples <= 0 ||
+       !hasSampleFmtKernel(AV_SAMPLE_FMT_FLT, param.sampleFmt))
+    {
+        AV_LOG_E("invalid mixer param, layout %ld fmt %d frameSamples %d",
+                 param.channelLayout,
+                 param.sampleFmt,
+                 param.frameSamples);
+        m_channels = 0;
+        return;
+    }
+    m_mixBuffer.resize((size_t)param.frameSamples * m_channels);
+}
+
+int AudioMixer::addInput(int sampleFmt, float gain)
+{
+    if(!isValid() || !hasSampleFmtKernel(sampleFmt, AV_SAMPLE_FMT_FLT))
+    {
+        AV_LOG_E("mixer can't support input fmt %d", sampleFmt);
+        return -1;
+    }
+    MixInput input;
+    input.sampleFmt = sampleFmt;
+    input.gain      = gain;
+    // join at the current position
+    input.writePos = m_mixedSamples;
+    m_inputs.push_back(std::move(input));
+    return (int)m_inputs.size() - 1;
+}
+
+void AudioMixer::setGain(int input, float gain)
+{
+    if(input < 0 || input >= (int)m_inputs.size())
+        return;
+    m_inputs[input].gain = gain;
+}
+
+bool AudioMixer::push(int input, const uint8_t* const data[], int nbSamples, int64_t startSample)
+{
+    if(input < 0 || input >= (int)m_inputs.size() || nbSamples <= 0)
+        return false;
+
+    MixInput& in = m_inputs[input];
+    if(in.finished)
+    {
+        AV_LOG_W("push to finished input %d", input);
+        return false;
+    }
+    if(startSample < 0)
+    {
+        startSample = in.writePos;
+    }
+
+    // drop the consumed part before growing fifo
+    if(in.readPos > 0 && in.readPos * 2 >= in.fifo.size())
+    {
+        in.fifo.erase(in.fifo.begin(), in.fifo.begin() + in.readPos);
+        in.readPos = 0;
+    }
+
+    // align to the output timeline
+    int skip = 0;
+    if(startSample > in.writePos)
+    {
+        in.fifo.resize(in.fifo.size() + (startSample - in.writePos) * m_channels, 0.0f);
+        in.writePos = startSample;
+    }
+    else if(startSample < in.writePos)
+    {
+        if(in.writePos - startSample >= nbSamples)
+            return true;
+        skip = (int)(in.writePos - startSample);
+    }
+
+    const uint8_t* src[AV_NUM_DATA_POINTERS] = {nullptr};
+    int            sampleSize = av_get_bytes_per_sample((AVSampleFormat)in.sampleFmt);
+    if(av_sample_fmt_is_planar((AVSampleFormat)in.sampleFmt))
+    {
+        if(m_channels > AV_NUM_DATA_POINTERS)
+            return false;
+        for(int ch = 0; ch < m_channels; ch++)
+        {
+            src[ch] = data[ch] + skip * sampleSize;
+        }
+    }
+    else
+    {
+        src[0] = data[0] + skip * sampleSize * m_channels;
+    }
+
+    int    count  = nbSamples - skip;
+    size_t offset = in.fifo.size();
+    in.fifo.resize(offset + (size_t)count * m_channels);
+    uint8_t* const dst[1] = {reinterpret_cast<uint8_t*>(in.fifo.data() + offset)};
+    if(!convertSampleFmt(dst, AV_SAMPLE_FMT_FLT, src, in.sampleFmt, m_channels, count))
+    {
+        in.fifo.resize(offset);
+        return false;
+    }
+    in.writePos += count;
+    return true;
+}
+
+void AudioMixer::finish(int input)
+{
+    if(input < 0 || input >= (int)m_inputs.size())
+        return;
+    m_inputs[input].finished = true;
+}
+
+int AudioMixer::queuedSamples(const MixInput& input) const
+{
+    return (int)((input.fifo.size() - input.readPos) / m_channels);
+}
+
+bool AudioMixer::hasOutput() const
+{
+    if(!isValid() || m_inputs.empty())
+        return false;
+
+    bool hasData = false;
+    for(const MixInput& input : m_inputs)
+    {
+        int queued = queuedSamples(input);
+        if(!input.finished && queued < m_param.frameSamples)
+        {
+            return false;
+        }
+        hasData |= queued > 0;
+    }
+    return hasData;
+}
+
+bool AudioMixer::hasRemain() const
+{
+    for(const MixInput& input : m_inputs)
+    {
+        if(queuedSamples(input) > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int AudioMixer::mix(uint8_t* const dst[], SimdLevel level)
+{
+    if(!isValid())
+        return 0;
+    if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+    {
+        level = cpuSimdLevel();
+    }
+    const MixKernels& kernels = selectKernels(level);
+
+    std::fill(m_mixBuffer.begin(), m_mixBuffer.end(), 0.0f);
+    int64_t frameEnd = m_mixedSamples + m_param.frameSamples;
+    for(size_t i = 0; i < m_inputs.size(); i++)
+    {
+        MixInput& input = m_inputs[i];
+        traceCounter("mixer queued samples", queuedSamples(input), (int)i);
+        int count = std::min(queuedSamples(input), m_param.frameSamples) * m_channels;
+        kernels.mixAdd(m_mixBuffer.data(), input.fifo.data() + input.readPos, input.gain, count);
+        input.readPos += count;
+        // a short input is padded with silence
+        input.writePos = std::max(input.writePos, frameEnd);
+    }
+    kernels.clip(m_mixBuffer.data(), (int)m_mixBuffer.size());
+
+    const uint8_t* const src[1] = {reinterpret_cast<const uint8_t*>(m_mixBuffer.data())};
+    convertSampleFmt(
+        dst, m_param.sampleFmt, src, AV_SAMPLE_FMT_FLT, m_channels, m_param.frameSamples, level);
+    m_mixedSamples = frameEnd;
+    return m_param.frameSamples;
+}
@@ -0,0 +1,50 @@
+#include "av_capture.h"
+#include "../../utils/include/log.h"
+#include "muxer.h"
+
+extern "C"
+{
+#include <libavutil/avutil.h>
+}
+
+#include <memory>
+#include <thread>
+
+#include <pthread.h>
+
+void captureAudioVideo(AudioDevice& audio, VideoDevice& video, AVCaptureParam& params)
+{
+    auto muxer =
+        std::make_shared<Muxer>(params.outFilename, 2, (int64_t)params.maxSkewMs * 1000);
+    if(!muxer->isValid())
+    {
+        return;
+    }
+    for(ReadDeviceDataParam* streamParam : {&params.audioParam, &params.videoParam})
+    {
+        streamParam->inFilename  = "";
+        streamParam->outFilename = "";
+        streamParam->muxer       = muxer;
+        streamParam->codecParam.encodeParam.globalHeader = muxer->needGlobalHeader();
+    }
+
+    // a job that fails before adding its stream must not hold the header of the other back
+    std::thread audioThread([&]() {
+        pthread_setname_np(pthread_self(), "av-audio");
+        audio.readAndEncode(params.audioParam);
+        muxer->endStream(AVMEDIA_TYPE_AUDIO);
+    });
+    std::thread videoThread([&]() {
+        pthread_setname_np(pthread_self(), "av-video");
+        video.readAndEncode(params.videoParam);
+        muxer->endStream(AVMEDIA_TYPE_VIDEO);
+    });
+    audioThread.join();
+    videoThread.join();
+    muxer->close();
+
+    for(ReadDeviceDataParam* streamParam : {&params.audioParam, &params.videoParam})
+    {
+        streamParam->muxer = nullptr;
+    }
+}
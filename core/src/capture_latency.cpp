@@ -0,0 +1,107 @@
+#include "capture_latency.h"
+#include "../../utils/include/log.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/time.h>
+}
+
+#include <cstdlib>
+
+namespace
+{
+// a packet timestamp this close to a clock is on that clock
+constexpr int64_t kClockToleranceUs = 10 * 1000000;
+constexpr int64_t kLogIntervalUs    = 5 * 1000000;
+} // namespace
+
+// -------------------------- CaptureTimeMap --------------------------
+void CaptureTimeMap::add(int64_t ts, int64_t captureUs)
+{
+    if(ts == AV_NOPTS_VALUE || captureUs < 0)
+        return;
+    m_captureUs[ts] = captureUs;
+    if(m_captureUs.size() > kMaxPending)
+    {
+        m_captureUs.erase(m_captureUs.begin());
+    }
+}
+
+int64_t CaptureTimeMap::find(int64_t ts)
+{
+    if(ts == AV_NOPTS_VALUE)
+        return -1;
+    auto it = m_captureUs.upper_bound(ts);
+    if(it == m_captureUs.begin())
+        return -1;
+    --it;
+    int64_t captureUs = it->second;
+    m_captureUs.erase(m_captureUs.begin(), it);
+    return captureUs;
+}
+
+// -------------------------- CaptureLatency --------------------------
+CaptureLatency::CaptureLatency(const char* name)
+    : m_name(name)
+    , m_metrics(JobMetrics::current())
+{ }
+
+int64_t CaptureLatency::captureTimeUs(const AVPacket* pkt, AVRational timeBase)
+{
+    int64_t monoNow = av_gettime_relative();
+    if(pkt->pts == AV_NOPTS_VALUE)
+        return monoNow;
+
+    int64_t ptsUs   = av_rescale_q(pkt->pts, timeBase, AV_TIME_BASE_Q);
+    int64_t wallNow = av_gettime();
+    if(llabs(wallNow - ptsUs) < kClockToleranceUs)
+    {
+        return monoNow - (wallNow - ptsUs);
+    }
+    if(llabs(monoNow - ptsUs) < kClockToleranceUs)
+    {
+        return ptsUs;
+    }
+    return monoNow;
+}
+
+void CaptureLatency::record(int64_t captureUs)
+{
+    if(captureUs < 0)
+        return;
+    int64_t  nowUs     = av_gettime_relative();
+    uint64_t latencyNs = nowUs > captureUs ? (nowUs - captureUs) * 1000 : 0;
+    uint64_t prevMax   = m_histogram.max();
+    m_histogram.record(latencyNs);
+    if(m_metrics)
+    {
+        m_metrics->recordCaptureLatency(latencyNs);
+    }
+    if(latencyNs > prevMax && m_histogram.count() > 1)
+    {
+        AV_LOG_D("%s capture latency new max %.2f ms", m_name, latencyNs / 1e6);
+    }
+    if(nowUs - m_lastLogUs >= kLogIntervalUs)
+    {
+        if(m_lastLogUs != 0)
+        {
+            logSummary();
+        }
+        m_lastLogUs = nowUs;
+    }
+}
+
+void CaptureLatency::logSummary() const
+{
+    if(m_histogram.count() == 0)
+        return;
+    AV_LOG_I("%s capture latency of %lu frames: p50 %.2f ms p90 %.2f ms p99 %.2f ms max %.2f ms",
+             m_name,
+             m_histogram.count(),
+             m_histogram.percentile(0.5) / 1e6,
+             m_histogram.percentile(0.9) / 1e6,
+             m_histogram.percentile(0.99) / 1e6,
+             m_histogram.max() / 1e6);
+}
@@ -0,0 +1,192 @@
+#include "capture_record.h"
+#include "../../utils/include/log.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/time.h>
+}
+
+#include <cstring>
+
+namespace
+{
+constexpr char kMagic[8] = {'A', 'V', 'D', 'R', 'E', 'C', '0', '1'};
+
+template <typename T>
+void writeValue(std::ofstream& ofs, T value)
+{
+    ofs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool readValue(std::ifstream& ifs, T& value)
+{
+    return (bool)ifs.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+} // namespace
+
+// -------------------------- CaptureRecorder --------------------------
+CaptureRecorder::CaptureRecorder(const std::string& filename, AVFormatContext* fmtCtx)
+    : m_filename(filename)
+    , m_ofs(filename, std::ios::out | std::ios::binary)
+{
+    if(!m_ofs)
+    {
+        AV_LOG_E("can't open capture recording %s", filename.c_str());
+        return;
+    }
+    m_ofs.write(kMagic, sizeof(kMagic));
+    writeValue<uint32_t>(m_ofs, fmtCtx->nb_streams);
+    for(unsigned int i = 0; i < fmtCtx->nb_streams; i++)
+    {
+        AVStream*          stream = fmtCtx->streams[i];
+        AVCodecParameters* par    = stream->codecpar;
+        writeValue<int32_t>(m_ofs, par->codec_type);
+        writeValue<int32_t>(m_ofs, par->codec_id);
+        writeValue<int32_t>(m_ofs, par->format);
+        writeValue<int32_t>(m_ofs, par->width);
+        writeValue<int32_t>(m_ofs, par->height);
+        writeValue<int32_t>(m_ofs, par->sample_rate);
+        writeValue<int32_t>(m_ofs, par->channels);
+        writeValue<uint64_t>(m_ofs, par->channel_layout);
+        writeValue<int32_t>(m_ofs, stream->time_base.num);
+        writeValue<int32_t>(m_ofs, stream->time_base.den);
+        writeValue<int32_t>(m_ofs, par->extradata_size);
+        m_ofs.write(reinterpret_cast<const char*>(par->extradata), par->extradata_size);
+    }
+}
+
+CaptureRecorder::~CaptureRecorder()
+{
+    if(m_ofs.is_open())
+    {
+        AV_LOG_I("recorded %lu packets to %s", m_packets, m_filename.c_str());
+    }
+}
+
+void CaptureRecorder::write(const AVPacket* pkt, int64_t arrivalUs, int64_t captureUs)
+{
+    if(!m_ofs)
+        return;
+    if(m_firstArrivalUs < 0)
+    {
+        m_firstArrivalUs = arrivalUs;
+    }
+    writeValue<int64_t>(m_ofs, arrivalUs - m_firstArrivalUs);
+    writeValue<int64_t>(m_ofs, captureUs >= 0 ? arrivalUs - captureUs : 0);
+    writeValue<int32_t>(m_ofs, pkt->stream_index);
+    writeValue<int32_t>(m_ofs, pkt->flags);
+    writeValue<int32_t>(m_ofs, pkt->size);
+    m_ofs.write(reinterpret_cast<const char*>(pkt->data), pkt->size);
+    m_packets++;
+}
+
+// -------------------------- CaptureReplayer --------------------------
+CaptureReplayer::CaptureReplayer(const std::string& filename, bool realtime)
+    : m_filename(filename)
+    , m_ifs(filename, std::ios::in | std::ios::binary)
+    , m_realtime(realtime)
+{ }
+
+bool CaptureReplayer::open(AVFormatContext* fmtCtx)
+{
+    char     magic[sizeof(kMagic)];
+    uint32_t nbStreams = 0;
+    if(!m_ifs.read(magic, sizeof(magic)) || memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+       !readValue(m_ifs, nbStreams))
+    {
+        AV_LOG_E("%s is not a capture recording", m_filename.c_str());
+        return false;
+    }
+    for(uint32_t i = 0; i < nbStreams; i++)
+    {
+        int32_t  codecType, codecId, format, width, height, sampleRate, channels;
+        uint64_t channelLayout;
+        int32_t  tbNum, tbDen, extradataSize;
+        if(!readValue(m_ifs, codecType) || !readValue(m_ifs, codecId) ||
+           !readValue(m_ifs, format) || !readValue(m_ifs, width) || !readValue(m_ifs, height) ||
+           !readValue(m_ifs, sampleRate) || !readValue(m_ifs, channels) ||
+           !readValue(m_ifs, channelLayout) || !readValue(m_ifs, tbNum) ||
+           !readValue(m_ifs, tbDen) || !readValue(m_ifs, extradataSize) || extradataSize < 0)
+        {
+            AV_LOG_E("truncated stream header of %s", m_filename.c_str());
+            return false;
+        }
+        AVStream* stream = avformat_new_stream(fmtCtx, nullptr);
+        if(!stream)
+        {
+            AV_LOG_E("alloc stream error");
+            return false;
+        }
+        AVCodecParameters* par = stream->codecpar;
+        par->codec_type        = (AVMediaType)codecType;
+        par->codec_id          = (AVCodecID)codecId;
+        par->format            = format;
+        par->width             = width;
+        par->height            = height;
+        par->sample_rate       = sampleRate;
+        par->channels          = channels;
+        par->channel_layout    = channelLayout;
+        stream->time_base      = {tbNum, tbDen};
+        if(extradataSize > 0)
+        {
+            par->extradata = static_cast<uint8_t*>(
+                av_mallocz(extradataSize + AV_INPUT_BUFFER_PADDING_SIZE));
+            if(!par->extradata)
+            {
+                AV_LOG_E("alloc extradata error");
+                return false;
+            }
+            par->extradata_size = extradataSize;
+            m_ifs.read(reinterpret_cast<char*>(par->extradata), extradataSize);
+        }
+    }
+    m_fmtCtx = fmtCtx;
+    return true;
+}
+
+int CaptureReplayer::read(AVPacket* pkt)
+{
+    int64_t arrivalUs, delayUs;
+    int32_t streamIndex, flags, size;
+    if(!readValue(m_ifs, arrivalUs) || !readValue(m_ifs, delayUs) ||
+       !readValue(m_ifs, streamIndex) || !readValue(m_ifs, flags) || !readValue(m_ifs, size))
+    {
+        return AVERROR_EOF;
+    }
+    if(streamIndex < 0 || streamIndex >= (int)m_fmtCtx->nb_streams || size < 0)
+    {
+        AV_LOG_E("corrupt packet in %s", m_filename.c_str());
+        return AVERROR_INVALIDDATA;
+    }
+    if(int ret = av_new_packet(pkt, size); ret < 0)
+    {
+        return ret;
+    }
+    if(!m_ifs.read(reinterpret_cast<char*>(pkt->data), size))
+    {
+        av_packet_unref(pkt);
+        return AVERROR_EOF;
+    }
+
+    // wait until the packet arrived in the recording
+    int64_t nowUs = av_gettime_relative();
+    if(m_startUs < 0)
+    {
+        m_startUs = nowUs - arrivalUs;
+    }
+    if(m_realtime && m_startUs + arrivalUs > nowUs)
+    {
+        av_usleep(m_startUs + arrivalUs - nowUs);
+    }
+
+    // the recorded time, a late or fast read doesn't change the durations and A/V sync
+    AVRational timeBase = m_fmtCtx->streams[streamIndex]->time_base;
+    pkt->stream_index   = streamIndex;
+    pkt->flags          = flags;
+    pkt->pts = pkt->dts = av_rescale_q(m_startUs + arrivalUs - delayUs, AV_TIME_BASE_Q, timeBase);
+    return 0;
+}
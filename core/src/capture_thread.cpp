@@ -0,0 +1,250 @@
+#include "capture_thread.h"
+#include "../../utils/include/log.h"
+#include "capture_latency.h"
+#include "capture_record.h"
+#include "job_metrics.h"
+#include "trace.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include <pthread.h>
+#include <sched.h>
+
+CaptureThread::CaptureThread(AVFormatContext*    fmtCtx,
+                             PacketReader        reader,
+                             const CaptureParam& param,
+                             const char*         name)
+    : m_fmtCtx(fmtCtx)
+    , m_reader(std::move(reader))
+    , m_param(param)
+    , m_name(name)
+    , m_metrics(JobMetrics::current())
+    , m_trace(TraceRecorder::current())
+{
+    m_param.queueSize = std::max(1, m_param.queueSize);
+    if(m_param.overflowPolicy == OverflowPolicy::BY_MEDIA_TYPE)
+    {
+        bool isAudio = fmtCtx && fmtCtx->nb_streams > 0 &&
+                       fmtCtx->streams[0]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO;
+        m_param.overflowPolicy = isAudio ? OverflowPolicy::BLOCK : OverflowPolicy::DROP_OLDEST;
+    }
+    if(!m_param.recordFilename.empty())
+    {
+        m_recorder = std::make_unique<CaptureRecorder>(m_param.recordFilename, fmtCtx);
+    }
+}
+
+CaptureThread::~CaptureThread()
+{
+    stop();
+    if(m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    for(CapturedPacket& captured : m_queue)
+    {
+        av_packet_free(&captured.pkt);
+    }
+}
+
+void CaptureThread::start()
+{
+    if(m_thread.joinable())
+        return;
+    m_thread = std::thread(&CaptureThread::run, this);
+}
+
+void CaptureThread::stop()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop.store(true, std::memory_order_relaxed);
+    m_notFull.notify_all();
+}
+
+void CaptureThread::pushPreRead(AVPacket* pkt, int64_t arrivalUs)
+{
+    AVPacket* captured = av_packet_alloc();
+    if(!captured)
+    {
+        AV_LOG_E("alloct packet error");
+        return;
+    }
+    av_packet_move_ref(captured, pkt);
+    int64_t captureUs = CaptureLatency::captureTimeUs(
+        captured, m_fmtCtx->streams[captured->stream_index]->time_base);
+    if(m_recorder)
+    {
+        m_recorder->write(captured, arrivalUs, captureUs);
+    }
+    m_captured.fetch_add(1, std::memory_order_relaxed);
+    push(captured, captureUs);
+}
+
+bool CaptureThread::shouldStop(int64_t startUs) const
+{
+    if(m_stop.load(std::memory_order_relaxed))
+        return true;
+    if(m_param.stopSignal && m_param.stopSignal->stopped())
+        return true;
+    if(m_param.maxPackets > 0 && m_captured.load(std::memory_order_relaxed) >= m_param.maxPackets)
+        return true;
+    return m_param.durationSeconds > 0 &&
+           av_gettime_relative() - startUs >= (int64_t)(m_param.durationSeconds * 1e6);
+}
+
+void CaptureThread::raisePriority()
+{
+    char threadName[16];
+    snprintf(threadName, sizeof(threadName), "capture-%s", m_name);
+    pthread_setname_np(pthread_self(), threadName);
+
+    if(!m_param.realtimePriority)
+        return;
+    sched_param schedParam;
+    memset(&schedParam, 0, sizeof(schedParam));
+    schedParam.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+    if(int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &schedParam); ret != 0)
+    {
+        AV_LOG_D("%s capture thread keeps normal priority: %s", m_name, strerror(ret));
+    }
+}
+
+void CaptureThread::run()
+{
+    JobMetricsScope metricsScope(m_metrics);
+    TraceScope      traceScope(m_trace);
+    raisePriority();
+
+    int64_t startUs = av_gettime_relative();
+    while(!shouldStop(startUs))
+    {
+        AVPacket* pkt = av_packet_alloc();
+        if(!pkt)
+        {
+            AV_LOG_E("alloct packet error");
+            break;
+        }
+        int ret = m_reader(pkt);
+        if(ret == AVERROR(EAGAIN))
+        {
+            av_packet_free(&pkt);
+            av_usleep(1000);
+            continue;
+        }
+        if(ret < 0)
+        {
+            av_packet_free(&pkt);
+            break;
+        }
+        int64_t captureUs =
+            CaptureLatency::captureTimeUs(pkt, m_fmtCtx->streams[pkt->stream_index]->time_base);
+        if(m_recorder)
+        {
+            // everything the device gave, before the overflow policy
+            m_recorder->write(pkt, av_gettime_relative(), captureUs);
+        }
+        m_captured.fetch_add(1, std::memory_order_relaxed);
+        push(pkt, captureUs);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_finished = true;
+    m_notEmpty.notify_all();
+}
+
+void CaptureThread::push(AVPacket* pkt, int64_t captureUs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if((int)m_queue.size() >= m_param.queueSize)
+    {
+        switch(m_param.overflowPolicy)
+        {
+        case OverflowPolicy::DROP_OLDEST:
+            av_packet_free(&m_queue.front().pkt);
+            m_queue.pop_front();
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case OverflowPolicy::DROP_NEWEST:
+            av_packet_free(&pkt);
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        case OverflowPolicy::BLOCK:
+            m_notFull.wait(lock, [&]() {
+                return (int)m_queue.size() < m_param.queueSize ||
+                       m_stop.load(std::memory_order_relaxed);
+            });
+            if((int)m_queue.size() >= m_param.queueSize)
+            {
+                av_packet_free(&pkt);
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            break;
+        case OverflowPolicy::BY_MEDIA_TYPE:
+            // resolved in the ctor
+            break;
+        }
+    }
+    m_queue.push_back({pkt, captureUs});
+    m_maxDepth = std::max(m_maxDepth, (int)m_queue.size());
+    traceCounter("capture queue", (int64_t)m_queue.size());
+    m_notEmpty.notify_one();
+}
+
+bool CaptureThread::pop(AVPacket* pkt, int64_t& captureUs)
+{
+    CapturedPacket captured;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [&]() { return !m_queue.empty() || m_finished; });
+        if(m_queue.empty())
+        {
+            return false;
+        }
+        captured = m_queue.front();
+        m_queue.pop_front();
+        m_notFull.notify_one();
+    }
+    av_packet_move_ref(pkt, captured.pkt);
+    av_packet_free(&captured.pkt);
+    captureUs = captured.captureUs;
+
+    if(m_param.lateThresholdMs > 0 &&
+       av_gettime_relative() - captureUs > (int64_t)m_param.lateThresholdMs * 1000)
+    {
+        m_late.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+CaptureStats CaptureThread::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return CaptureStats{
+        .captured = m_captured.load(std::memory_order_relaxed),
+        .dropped  = m_dropped.load(std::memory_order_relaxed),
+        .late     = m_late.load(std::memory_order_relaxed),
+        .maxDepth = m_maxDepth,
+    };
+}
+
+void CaptureThread::logStats() const
+{
+    CaptureStats captureStats = stats();
+    AV_LOG_I("%s capture: captured %lu, dropped %lu, late %lu, max queue %d/%d",
+             m_name,
+             captureStats.captured,
+             captureStats.dropped,
+             captureStats.late,
+             captureStats.maxDepth,
+             m_param.queueSize);
+}
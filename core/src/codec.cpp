@@ -1,6 +1,9 @@
 #include "codec.h"
 #include "../../utils/include/log.h"
+#include "codec_registry.h"
 #include "frame.h"
+#include "job_metrics.h"
+#include "trace.h"
 
 extern "C"
 {
@@ -8,6 +11,7 @@ extern "C"
 #include <libavutil/frame.h>
 }
 
+#include <algorithm>
 #include <ostream>
 #include <memory>
 
@@ -22,25 +26,32 @@ Codec::Codec(const CodecParam& initParam, MediaType mediaType)
 {
     if(initParam.encodeParam.needEncode)
     {
-        AVCodec* encodeCodec = nullptr;
+        const CodecCaps* encodeCaps = nullptr;
         if(initParam.encodeParam.byName)
         {
-            encodeCodec = avcodec_find_encoder_by_name(initParam.encodeParam.codecName.c_str());
+            encodeCaps = CodecRegistry::instance().findEncoder(initParam.encodeParam.codecName);
         }
         else if(initParam.encodeParam.byId)
         {
-            encodeCodec =
-                avcodec_find_encoder(static_cast<AVCodecID>(initParam.encodeParam.codecId));
+            encodeCaps = CodecRegistry::instance().findEncoder(initParam.encodeParam.codecId);
         }
         else
         {
             AV_LOG_E("you must set find encode by codec name or codec id");
             return;
         }
+        if(!encodeCaps)
+        {
+            AV_LOG_E("can't find encode %s(%d)",
+                     initParam.encodeParam.codecName.c_str(),
+                     initParam.encodeParam.codecId);
+            return;
+        }
 
-        if(checkSupport(encodeCodec, initParam, true))
+        if(checkSupport(*encodeCaps, initParam, true))
         {
-            m_encodeCodecCtx = avcodec_alloc_context3(encodeCodec);
+            AVCodec* encodeCodec = encodeCaps->codec;
+            m_encodeCodecCtx     = avcodec_alloc_context3(encodeCodec);
             if(m_encodeCodecCtx == nullptr)
             {
                 AV_LOG_E("Failed to alloc AVCodecContext with codec(%s)",
@@ -82,6 +93,13 @@ Codec::Codec(const CodecParam& initParam, MediaType mediaType)
                 // frame duration
                 m_encodeCodecCtx->time_base =
                     AVRational{m_encodeCodecCtx->framerate.den, m_encodeCodecCtx->framerate.num};
+                // full range(YUVJ) input is passed through, encoder need signal it in VUI
+                m_encodeCodecCtx->color_range = (AVColorRange)initParam.encodeParam.colorRange;
+            }
+
+            if(initParam.encodeParam.globalHeader)
+            {
+                m_encodeCodecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
             }
 
             if(int ret = avcodec_open2(m_encodeCodecCtx, encodeCodec, NULL); ret < 0)
@@ -103,30 +121,30 @@ Codec::Codec(const CodecParam& initParam, MediaType mediaType)
     // decoder
     if(initParam.decodeParam.needDecode)
     {
-        AVCodec* decodeCodec = nullptr;
+        const CodecCaps* decodeCaps = nullptr;
         if(initParam.decodeParam.byName)
         {
-            decodeCodec = avcodec_find_decoder_by_name(initParam.decodeParam.codecName.c_str());
+            decodeCaps = CodecRegistry::instance().findDecoder(initParam.decodeParam.codecName);
         }
         else if(initParam.decodeParam.byId)
         {
-            decodeCodec =
-                avcodec_find_decoder(static_cast<AVCodecID>(initParam.decodeParam.codecId));
+            decodeCaps = CodecRegistry::instance().findDecoder(initParam.decodeParam.codecId);
         }
         else
         {
             AV_LOG_E("you must set find decode by codec name or codec id");
             return;
         }
-        if(!decodeCodec)
+        if(!decodeCaps)
         {
             AV_LOG_E("can't find video decode %d", initParam.decodeParam.codecId);
             return;
         }
 
-        if(checkSupport(decodeCodec, initParam, false))
+        if(checkSupport(*decodeCaps, initParam, false))
         {
-            m_decodeCodecCtx = avcodec_alloc_context3(decodeCodec);
+            AVCodec* decodeCodec = decodeCaps->codec;
+            m_decodeCodecCtx     = avcodec_alloc_context3(decodeCodec);
             if(!m_decodeCodecCtx)
             {
                 AV_LOG_E("faild to alloc codec context");
@@ -171,11 +189,14 @@ void Codec::encode(std::shared_ptr<Frame> frame, AVPacket* pkt, PacketReceiveCB
 {
     if(!m_encodeEnable)
         return;
-    int res = 0;
+    // bytes of encoded packets, cb runs the next stage and isn't counted
+    StageTimer timer(Stage::ENCODE, 0, isFlush ? 0 : 1);
+    int        res = 0;
     if(!isFlush)
     {
         AVFrame* avFrame = frame->getAVFrame();
         res              = avcodec_send_frame(m_encodeCodecCtx, avFrame);
+        m_encodeQueued += res >= 0 ? 1 : 0;
     }
     else
     {
@@ -194,14 +215,21 @@ void Codec::encode(std::shared_ptr<Frame> frame, AVPacket* pkt, PacketReceiveCB
             AV_LOG_E("legitimate encoding errors");
             return;
         }
+        timer.addBytes(pkt->size);
+        m_encodeQueued = std::max<int64_t>(0, m_encodeQueued - 1);
+        timer.pause();
         cb(pkt);
+        timer.resume();
         av_packet_unref(pkt);
     }
+    traceCounter("encoder queue", isFlush ? 0 : m_encodeQueued);
 }
 
 void Codec::decode(std::shared_ptr<Frame> frame, AVPacket* pkt, FrameReceiveCB cb, bool isFlush)
 {
-    int res = -1;
+    // bytes of the packet and count of decoded frames
+    StageTimer timer(Stage::DECODE, isFlush ? 0 : pkt->size, 0);
+    int        res = -1;
     if(isFlush)
     {
         res = avcodec_send_packet(m_decodeCodecCtx, nullptr);
@@ -209,6 +237,7 @@ void Codec::decode(std::shared_ptr<Frame> frame, AVPacket* pkt, FrameReceiveCB c
     else
     {
         res = avcodec_send_packet(m_decodeCodecCtx, pkt);
+        m_decodeQueued += res >= 0 ? 1 : 0;
     }
     while(res >= 0)
     {
@@ -222,25 +251,54 @@ void Codec::decode(std::shared_ptr<Frame> frame, AVPacket* pkt, FrameReceiveCB c
             AV_LOG_E("legitimate decoding errors");
             return;
         }
+        timer.addFrames(1);
+        m_decodeQueued = std::max<int64_t>(0, m_decodeQueued - 1);
+        timer.pause();
         cb(frame);
+        timer.resume();
     }
+    traceCounter("decoder queue", isFlush ? 0 : m_decodeQueued);
 }
 
-bool Codec::checkSupport(AVCodec* codec, const CodecParam& initParam, bool isEncode)
+bool Codec::reset()
+{
+    if(m_encodeEnable)
+    {
+        // most encoders can't leave draining mode after flushed by a null frame
+#ifdef AV_CODEC_CAP_ENCODER_FLUSH
+        if(!(m_encodeCodec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH))
+        {
+            return false;
+        }
+        avcodec_flush_buffers(m_encodeCodecCtx);
+#else
+        return false;
+#endif
+    }
+    if(m_decodeEnable)
+    {
+        avcodec_flush_buffers(m_decodeCodecCtx);
+    }
+    m_encodeQueued = 0;
+    m_decodeQueued = 0;
+    return true;
+}
+
+bool Codec::checkSupport(const CodecCaps& caps, const CodecParam& initParam, bool isEncode)
 {
     bool isSupport = false;
     if(m_codecMediaType == MediaType::MEDIA_AUDIO)
     {
         if(isEncode)
         {
-            isSupport = checkAudioSupport(codec,
+            isSupport = checkAudioSupport(caps,
                                           initParam.encodeParam.sampleFmt,
                                           initParam.encodeParam.channelLayout,
                                           initParam.encodeParam.sampleRate);
         }
         else
         {
-            isSupport = checkAudioSupport(codec,
+            isSupport = checkAudioSupport(caps,
                                           initParam.decodeParam.avCodecPar->format,
                                           initParam.decodeParam.avCodecPar->channel_layout,
                                           initParam.decodeParam.avCodecPar->sample_rate);
@@ -258,89 +316,26 @@ bool Codec::checkSupport(AVCodec* codec, const CodecParam& initParam, bool isEnc
     return isSupport;
 }
 
-bool Codec::checkAudioSupport(AVCodec* codec,
-                              int      format,
-                              uint64_t channelLayout,
-                              int64_t  sampleRate)
+bool Codec::checkAudioSupport(const CodecCaps& caps,
+                              int              format,
+                              uint64_t         channelLayout,
+                              int64_t          sampleRate)
 {
-    int                   isFind     = false;
-    const AVSampleFormat* supportFmt = codec->sample_fmts;
-    if(supportFmt == nullptr)
-    {
-        AV_LOG_D("codec don't set support format, just skip check");
-        isFind = true;
-    }
-    else
-    {
-        while(supportFmt && *supportFmt != AV_SAMPLE_FMT_NONE)
-        {
-            if(*supportFmt == format)
-            {
-                isFind = true;
-                break;
-            }
-            supportFmt++;
-        }
-    }
-
-    if(!isFind)
+    if(!caps.supportSampleFmt(format))
     {
-        AV_LOG_E("codec %s don't support format %d", codec->name, format);
+        AV_LOG_E("codec %s don't support format %d", caps.name.c_str(), format);
         return false;
     }
-    isFind = false;
-
-    const uint64_t* supportChannelLayout = codec->channel_layouts;
-    if(supportChannelLayout == nullptr)
-    {
-        AV_LOG_D("codec don't set support channel layout, just skip check");
-        isFind = true;
-    }
-    else
-    {
-        while(supportChannelLayout && *supportChannelLayout != 0)
-        {
-            if(*supportChannelLayout == channelLayout)
-            {
-                isFind = true;
-                break;
-            }
-            supportChannelLayout++;
-        }
-    }
-
-    if(!isFind)
+    if(!caps.supportChannelLayout(channelLayout))
     {
-        AV_LOG_E("codec %s don't support channel layout %ld", codec->name, channelLayout);
+        AV_LOG_E("codec %s don't support channel layout %ld", caps.name.c_str(), channelLayout);
         return false;
     }
-    isFind = false;
-
-    const int* supportSampleRate = codec->supported_samplerates;
-    if(supportSampleRate == nullptr)
-    {
-        AV_LOG_D("codec don't set support sample rate, just skip check");
-        isFind = true;
-    }
-    else
-    {
-        while(supportSampleRate && *supportSampleRate != 0)
-        {
-            if(*supportSampleRate == sampleRate)
-            {
-                isFind = true;
-                break;
-            }
-            supportSampleRate++;
-        }
-    }
-
-    if(!isFind)
+    if(!caps.supportSampleRate(sampleRate))
     {
-        AV_LOG_E("codec %s don't support sample rate %ld", codec->name, sampleRate);
+        AV_LOG_E("codec %s don't support sample rate %ld", caps.name.c_str(), sampleRate);
         return false;
     }
-
     return true;
 }
 
@@ -0,0 +1,236 @@
+#include "codec_pool.h"
+#include "../../utils/include/log.h"
+
+#include <iterator>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+namespace
+{
+void appendField(std::string& key, int64_t value)
+{
+    key += std::to_string(value);
+    key += ',';
+}
+
+// every field used to open the codec, the same key gets the same codec context
+std::string codecParamKey(const CodecParam& param, MediaType mediaType)
+{
+    std::string key;
+    appendField(key, mediaType);
+
+    const EncoderParam& enc = param.encodeParam;
+    appendField(key, enc.needEncode);
+    if(enc.needEncode)
+    {
+        key += enc.byName ? enc.codecName : std::to_string(enc.codecId);
+        key += ',';
+        for(int64_t value : {enc.bitRate,
+                             (int64_t)enc.profile,
+                             (int64_t)enc.sampleFmt,
+                             (int64_t)enc.channelLayout,
+                             (int64_t)enc.sampleRate,
+                             (int64_t)enc.level,
+                             (int64_t)enc.width,
+                             (int64_t)enc.height,
+                             (int64_t)enc.gopSize,
+                             (int64_t)enc.keyintMin,
+                             (int64_t)enc.maxBFrame,
+                             (int64_t)enc.hasBFrame,
+                             (int64_t)enc.refs,
+                             (int64_t)enc.pixFmt,
+                             (int64_t)enc.framerate,
+                             (int64_t)enc.colorRange,
+                             (int64_t)enc.globalHeader})
+        {
+            appendField(key, value);
+        }
+    }
+
+    const DecoderParam& dec = param.decodeParam;
+    appendField(key, dec.needDecode);
+    if(dec.needDecode)
+    {
+        key += dec.byName ? dec.codecName : std::to_string(dec.codecId);
+        key += ',';
+        if(const AVCodecParameters* par = dec.avCodecPar)
+        {
+            for(int64_t value : {(int64_t)par->codec_id,
+                                 (int64_t)par->format,
+                                 (int64_t)par->width,
+                                 (int64_t)par->height,
+                                 (int64_t)par->channel_layout,
+                                 (int64_t)par->sample_rate,
+                                 (int64_t)par->profile,
+                                 // pcm/adpcm and raw video are opened by them
+                                 (int64_t)par->codec_tag,
+                                 (int64_t)par->block_align,
+                                 (int64_t)par->bits_per_coded_sample,
+                                 (int64_t)par->extradata_size})
+            {
+                appendField(key, value);
+            }
+            // sps/pps or AudioSpecificConfig
+            if(par->extradata && par->extradata_size > 0)
+            {
+                key.append(reinterpret_cast<const char*>(par->extradata), par->extradata_size);
+            }
+        }
+    }
+    return key;
+}
+
+// the codec is opened as the param asked
+bool isOpened(const Codec* codec, const CodecParam& param)
+{
+    return codec->encodeEnable() == param.encodeParam.needEncode &&
+           codec->decodeEnable() == param.decodeParam.needDecode;
+}
+} // namespace
+
+CodecPool& CodecPool::instance()
+{
+    static CodecPool pool;
+    return pool;
+}
+
+CodecPool::~CodecPool()
+{
+    clear();
+}
+
+Codec* CodecPool::open(const CodecParam& param, MediaType mediaType)
+{
+    if(mediaType == MediaType::MEDIA_AUDIO)
+    {
+        return new AudioCodec(param);
+    }
+    return new VideoCodec(param);
+}
+
+std::shared_ptr<Codec> CodecPool::acquire(const CodecParam& param, MediaType mediaType)
+{
+    std::string key   = codecParamKey(param, mediaType);
+    Codec*      codec = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(auto it = m_idle.begin(); it != m_idle.end(); ++it)
+        {
+            if(it->first == key)
+            {
+                codec = it->second.release();
+                m_idle.erase(it);
+                break;
+            }
+        }
+        if(codec)
+        {
+            m_hits++;
+        }
+        else
+        {
+            m_misses++;
+        }
+    }
+
+    // codec is opened out of lock
+    if(!codec)
+    {
+        codec = open(param, mediaType);
+        if(!isOpened(codec, param))
+        {
+            // a failed codec isn't pooled
+            return std::shared_ptr<Codec>(codec);
+        }
+    }
+    return std::shared_ptr<Codec>(codec, [this, key](Codec* released) { recycle(key, released); });
+}
+
+std::shared_ptr<AudioCodec> CodecPool::acquireAudio(const CodecParam& param)
+{
+    return std::static_pointer_cast<AudioCodec>(acquire(param, MediaType::MEDIA_AUDIO));
+}
+
+std::shared_ptr<VideoCodec> CodecPool::acquireVideo(const CodecParam& param)
+{
+    return std::static_pointer_cast<VideoCodec>(acquire(param, MediaType::MEDIA_VIDEO));
+}
+
+void CodecPool::recycle(const std::string& key, Codec* codec)
+{
+    std::unique_ptr<Codec> owned(codec);
+    if(!owned->reset())
+    {
+        AV_LOG_D("codec %s can't be reset, close it", owned->codecName(true));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_dropped++;
+        return;
+    }
+
+    std::unique_ptr<Codec> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle.emplace_front(key, std::move(owned));
+        if(m_idle.size() > m_capacity)
+        {
+            evicted = std::move(m_idle.back().second);
+            m_idle.pop_back();
+        }
+    }
+    // evicted codec is closed out of lock
+}
+
+void CodecPool::prewarm(const CodecParam& param, MediaType mediaType, int count)
+{
+    std::string key = codecParamKey(param, mediaType);
+    for(int i = 0; i < count; i++)
+    {
+        std::unique_ptr<Codec> codec(open(param, mediaType));
+        if(!isOpened(codec.get(), param))
+        {
+            AV_LOG_E("failed to prewarm codec");
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_idle.size() >= m_capacity)
+        {
+            return;
+        }
+        m_idle.emplace_back(key, std::move(codec));
+    }
+}
+
+void CodecPool::setCapacity(size_t capacity)
+{
+    std::list<std::pair<std::string, std::unique_ptr<Codec>>> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_capacity = capacity;
+        while(m_idle.size() > m_capacity)
+        {
+            evicted.splice(evicted.end(), m_idle, std::prev(m_idle.end()));
+        }
+    }
+}
+
+void CodecPool::clear()
+{
+    // codecs are closed after unlock
+    std::list<std::pair<std::string, std::unique_ptr<Codec>>> idle;
+    std::lock_guard<std::mutex>                               lock(m_mutex);
+    idle.swap(m_idle);
+}
+
+CodecPoolStats CodecPool::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    CodecPoolStats              stats;
+    stats.hits    = m_hits;
+    stats.misses  = m_misses;
+    stats.dropped = m_dropped;
+    stats.idle    = m_idle.size();
+    return stats;
+}
@@ -0,0 +1,186 @@
+#include "codec_registry.h"
+#include "../../utils/include/log.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include <cstdlib>
+
+namespace
+{
+CodecCaps buildCaps(const AVCodec* codec)
+{
+    CodecCaps caps;
+    caps.codec     = const_cast<AVCodec*>(codec);
+    caps.name      = codec->name;
+    caps.codecId   = codec->id;
+    caps.mediaType = codec->type;
+    caps.isEncoder = av_codec_is_encoder(codec);
+
+    if(const AVSampleFormat* fmt = codec->sample_fmts)
+    {
+        caps.anySampleFmt = false;
+        for(; *fmt != AV_SAMPLE_FMT_NONE; fmt++)
+        {
+            if(*fmt >= 0 && *fmt < 64)
+            {
+                caps.sampleFmtMask |= 1ULL << *fmt;
+            }
+            caps.sampleFmtList.push_back(*fmt);
+        }
+    }
+    if(const uint64_t* layout = codec->channel_layouts)
+    {
+        caps.anyChannelLayout = false;
+        for(; *layout != 0; layout++)
+        {
+            caps.channelLayouts.insert(*layout);
+        }
+    }
+    if(const int* rate = codec->supported_samplerates)
+    {
+        caps.anySampleRate = false;
+        for(; *rate != 0; rate++)
+        {
+            caps.sampleRates.insert(*rate);
+            caps.sampleRateList.push_back(*rate);
+        }
+    }
+    if(const AVPixelFormat* fmt = codec->pix_fmts)
+    {
+        caps.anyPixFmt = false;
+        caps.pixFmtMask.resize(AV_PIX_FMT_NB, false);
+        for(; *fmt != AV_PIX_FMT_NONE; fmt++)
+        {
+            if(*fmt >= 0 && *fmt < AV_PIX_FMT_NB)
+            {
+                caps.pixFmtMask[*fmt] = true;
+            }
+            caps.pixFmtList.push_back(*fmt);
+        }
+    }
+    return caps;
+}
+
+bool isExperimental(const CodecCaps* caps)
+{
+    return caps->codec->capabilities & AV_CODEC_CAP_EXPERIMENTAL;
+}
+
+template<typename Key>
+const CodecCaps* findCaps(const std::unordered_map<Key, const CodecCaps*>& map, const Key& key)
+{
+    auto it = map.find(key);
+    return it == map.end() ? nullptr : it->second;
+}
+} // namespace
+
+// -------------------------- CodecCaps --------------------------
+bool CodecCaps::supportSampleFmt(int format) const
+{
+    if(anySampleFmt)
+        return true;
+    return format >= 0 && format < 64 && (sampleFmtMask & (1ULL << format));
+}
+
+bool CodecCaps::supportChannelLayout(uint64_t channelLayout) const
+{
+    return anyChannelLayout || channelLayouts.count(channelLayout) > 0;
+}
+
+bool CodecCaps::supportSampleRate(int64_t sampleRate) const
+{
+    return anySampleRate || sampleRates.count((int)sampleRate) > 0;
+}
+
+bool CodecCaps::supportPixFmt(int format) const
+{
+    if(anyPixFmt)
+        return true;
+    return format >= 0 && format < (int)pixFmtMask.size() && pixFmtMask[format];
+}
+
+int CodecCaps::negotiateSampleFmt(int format) const
+{
+    if(supportSampleFmt(format))
+        return format;
+    return sampleFmtList.empty() ? -1 : sampleFmtList.front();
+}
+
+int CodecCaps::negotiateSampleRate(int sampleRate) const
+{
+    if(supportSampleRate(sampleRate))
+        return sampleRate;
+    int best = -1;
+    for(int rate : sampleRateList)
+    {
+        if(best < 0 || abs(rate - sampleRate) < abs(best - sampleRate))
+        {
+            best = rate;
+        }
+    }
+    return best;
+}
+
+int CodecCaps::negotiatePixFmt(int format) const
+{
+    if(supportPixFmt(format))
+        return format;
+    return pixFmtList.empty() ? -1 : pixFmtList.front();
+}
+
+// -------------------------- CodecRegistry --------------------------
+const CodecRegistry& CodecRegistry::instance()
+{
+    static const CodecRegistry registry;
+    return registry;
+}
+
+CodecRegistry::CodecRegistry()
+{
+    void*          opaque = nullptr;
+    const AVCodec* codec  = nullptr;
+    while((codec = av_codec_iterate(&opaque)))
+    {
+        m_caps.push_back(buildCaps(codec));
+    }
+
+    // m_caps won't change anymore, pointers to it are stable
+    for(const CodecCaps& caps : m_caps)
+    {
+        auto& byName = caps.isEncoder ? m_encoderByName : m_decoderByName;
+        auto& byId   = caps.isEncoder ? m_encoderById : m_decoderById;
+        byName.emplace(caps.name, &caps);
+
+        // the same rule as avcodec_find_encoder: the first non experimental one, or the first
+        // experimental one if there's no other
+        auto [it, inserted] = byId.emplace(caps.codecId, &caps);
+        if(!inserted && isExperimental(it->second) && !isExperimental(&caps))
+        {
+            it->second = &caps;
+        }
+    }
+    AV_LOG_D("codec registry with %zu codecs", m_caps.size());
+}
+
+const CodecCaps* CodecRegistry::findEncoder(const std::string& name) const
+{
+    return findCaps(m_encoderByName, name);
+}
+
+const CodecCaps* CodecRegistry::findEncoder(int codecId) const
+{
+    return findCaps(m_encoderById, codecId);
+}
+
+const CodecCaps* CodecRegistry::findDecoder(const std::string& name) const
+{
+    return findCaps(m_decoderByName, name);
+}
+
+const CodecCaps* CodecRegistry::findDecoder(int codecId) const
+{
+    return findCaps(m_decoderById, codecId);
+}
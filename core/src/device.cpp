@@ -14,11 +14,15 @@ extern "C"
 }
 
 #include "../../utils/include/log.h"
+#include "capture_record.h"
 #include "codec.h"
 #include "device.h"
 #include "frame.h"
+#include "job_metrics.h"
 #include "resample.h"
+#include "virtual_device.h"
 
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
@@ -35,19 +39,50 @@ Device::Device(const std::string& deviceName, DeviceType deviceType, AVDictionar
     , m_deviceType(deviceType)
 {
     // get format
-    AVInputFormat* inputFormat = nullptr;
-    std::string    url         = deviceName;
+    AVInputFormat*    inputFormat = nullptr;
+    std::string       url         = deviceName;
+    VirtualDeviceSpec spec;
     switch(m_deviceType)
     {
     case DeviceType::AUDIO:
         inputFormat = av_find_input_format("alsa");
+        m_endless   = true;
         break;
     case DeviceType::VIDEO:
         inputFormat = av_find_input_format("Video4Linux2");
+        m_endless   = true;
         break;
     case DeviceType::ENCAPSULATE_FILE:
         inputFormat = nullptr;
         break;
+    case DeviceType::LAVFI:
+        inputFormat = av_find_input_format("lavfi");
+        break;
+    case DeviceType::VIRTUAL:
+        inputFormat = av_find_input_format("lavfi");
+        spec        = parseVirtualDevice(deviceName, options);
+        url         = spec.graph;
+        m_endless   = spec.endless;
+        // options are for the virtual device, not lavfi
+        options = nullptr;
+        if(url.empty())
+            return;
+        break;
+    case DeviceType::REPLAY:
+    {
+        AVDictionaryEntry* realtime = av_dict_get(options, "realtime", nullptr, 0);
+        m_replayer = std::make_unique<CaptureReplayer>(
+            deviceName, !realtime || strcmp(realtime->value, "0") != 0);
+        m_fmtCtx = avformat_alloc_context();
+        if(!m_fmtCtx || !m_replayer->open(m_fmtCtx))
+        {
+            AV_LOG_E("Failed to open capture recording(%s)", m_deviceName.c_str());
+            avformat_free_context(m_fmtCtx);
+            m_fmtCtx = nullptr;
+            m_replayer.reset();
+        }
+        return;
+    }
     case DeviceType::PURE_FILE:
         AV_LOG_D("for pure file, don't need open device %d", (int)m_deviceType);
         return;
@@ -73,7 +108,8 @@ Device::Device(const std::string& deviceName, DeviceType deviceType, AVDictionar
         AV_LOG_D("success to open audio device(%s)", m_deviceName.c_str());
     }
 
-    if(deviceType == DeviceType::ENCAPSULATE_FILE || deviceType == DeviceType::VIDEO)
+    if(deviceType == DeviceType::ENCAPSULATE_FILE || deviceType == DeviceType::VIDEO ||
+       deviceType == DeviceType::LAVFI || deviceType == DeviceType::VIRTUAL)
     {
         if(avformat_find_stream_info(m_fmtCtx, NULL) < 0)
         {
@@ -81,6 +117,17 @@ Device::Device(const std::string& deviceName, DeviceType deviceType, AVDictionar
             return;
         }
     }
+
+    if(spec.mjpeg)
+    {
+        m_mjpeg = std::make_unique<MjpegPacketizer>();
+        if(!m_mjpeg->open(m_fmtCtx->streams[0], spec.mjpegQscale))
+        {
+            // the raw images are still readable
+            AV_LOG_E("virtual device %s falls back to raw images", m_deviceName.c_str());
+            m_mjpeg.reset();
+        }
+    }
 }
 Device::~Device()
 {
@@ -109,6 +156,48 @@ int Device::findStreamIdxByMediaType(int mediaType)
     return streamIdx;
 }
 
+int Device::readPacket(AVPacket* pkt)
+{
+    if(m_replayer)
+    {
+        // waiting for the recorded arrival is timed like a device read blocks
+        StageTimer timer(Stage::READ, 0, 0);
+        int        ret = m_replayer->read(pkt);
+        if(ret >= 0)
+        {
+            timer.addBytes(pkt->size);
+            timer.addFrames(1);
+        }
+        return ret;
+    }
+    if(!m_fmtCtx)
+        return AVERROR(EINVAL);
+    int ret = timedReadFrame(m_fmtCtx, pkt);
+    if(ret < 0 || !m_mjpeg)
+        return ret;
+    // a camera compresses in its hardware, not a stage of the job
+    ret = m_mjpeg->packetize(pkt);
+    if(ret < 0)
+    {
+        av_packet_unref(pkt);
+    }
+    return ret;
+}
+
+CaptureParam Device::boundedCaptureParam(const CaptureParam& param, uint64_t defaultPackets) const
+{
+    CaptureParam bounded = param;
+    if(!m_endless || param.durationSeconds > 0 || param.stopSignal || param.maxPackets > 0)
+    {
+        return bounded;
+    }
+    AV_LOG_W("capture of %s is not bounded, stop after %lu packets",
+             m_deviceName.c_str(),
+             defaultPackets);
+    bounded.maxPackets = defaultPackets;
+    return bounded;
+}
+
 AVFormatContext* Device::getFmtCtx() const
 {
     return m_fmtCtx;
@@ -0,0 +1,355 @@
+#include "downscale.h"
+#include "pixfmt_convert.h"
+
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define DOWNSCALE_X86 1
+#    include <immintrin.h>
+#endif
+
+namespace
+{
+struct PlaneLayout
+{
+    int pixFmt;
+    int planes;
+    int chromaShiftW;
+    int chromaShiftH;
+};
+
+const PlaneLayout kLayouts[] = {
+    {AV_PIX_FMT_YUV420P, 3, 1, 1},
+    {AV_PIX_FMT_YUV422P, 3, 1, 0},
+    {AV_PIX_FMT_YUV444P, 3, 0, 0},
+    {AV_PIX_FMT_GRAY8, 1, 0, 0},
+};
+
+const PlaneLayout* findLayout(int pixFmt)
+{
+    pixFmt = convertDeprecatedFormat(pixFmt);
+    for(const PlaneLayout& layout : kLayouts)
+    {
+        if(layout.pixFmt == pixFmt)
+        {
+            return &layout;
+        }
+    }
+    return nullptr;
+}
+
+// same as AV_CEIL_RSHIFT
+int ceilShift(int value, int shift)
+{
+    return -((-value) >> shift);
+}
+
+// line kernels, a plane is a loop of them
+struct DownscaleLineKernels
+{
+    // average of 2x2
+    void (*box2)(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int dstWidth);
+    // average of 4x4
+    void (*box4)(const uint8_t* const src[4], uint8_t* dst, int dstWidth);
+    // average of the middle 2x2 in 4x4
+    void (*bilinear4)(const uint8_t* const src[4], uint8_t* dst, int dstWidth);
+};
+
+// -------------------------- C --------------------------
+void box2C(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int dstWidth)
+{
+    for(int i = 0; i < dstWidth; i++)
+    {
+        dst[i] = (src0[2 * i] + src0[2 * i + 1] + src1[2 * i] + src1[2 * i + 1] + 2) >> 2;
+    }
+}
+
+void box4C(const uint8_t* const src[4], uint8_t* dst, int dstWidth)
+{
+    for(int i = 0; i < dstWidth; i++)
+    {
+        int sum = 0;
+        for(int y = 0; y < 4; y++)
+        {
+            sum += src[y][4 * i] + src[y][4 * i + 1] + src[y][4 * i + 2] + src[y][4 * i + 3];
+        }
+        dst[i] = (sum + 8) >> 4;
+    }
+}
+
+void bilinear4C(const uint8_t* const src[4], uint8_t* dst, int dstWidth)
+{
+    for(int i = 0; i < dstWidth; i++)
+    {
+        dst[i] = (src[1][4 * i + 1] + src[1][4 * i + 2] + src[2][4 * i + 1] + src[2][4 * i + 2] +
+                  2) >>
+                 2;
+    }
+}
+
+const DownscaleLineKernels kKernelsC = {
+    box2C,
+    box4C,
+    bilinear4C,
+};
+
+#ifdef DOWNSCALE_X86
+// -------------------------- SSE2 --------------------------
+__attribute__((target("sse2"))) void
+box2SSE2(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int dstWidth)
+{
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    const __m128i two     = _mm_set1_epi16(2);
+    int           i       = 0;
+    for(; i + 16 <= dstWidth; i += 16)
+    {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(src0 + 2 * i));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(src0 + 2 * i + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(src1 + 2 * i));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(src1 + 2 * i + 16));
+        // even + odd pixels of both lines in 16 bit
+        __m128i s0 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, lowMask), _mm_srli_epi16(a0, 8)),
+                                   _mm_add_epi16(_mm_and_si128(b0, lowMask), _mm_srli_epi16(b0, 8)));
+        __m128i s1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, lowMask), _mm_srli_epi16(a1, 8)),
+                                   _mm_add_epi16(_mm_and_si128(b1, lowMask), _mm_srli_epi16(b1, 8)));
+        s0         = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+        s1         = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(s0, s1));
+    }
+    box2C(src0 + 2 * i, src1 + 2 * i, dst + i, dstWidth - i);
+}
+
+// sum of 4 pixels(with weight) in `nbLines` lines for 16 source pixels, 4 x 32 bit
+__attribute__((target("sse2"))) inline __m128i
+sum4x4SSE2(const uint8_t* const* src, int nbLines, int offset, __m128i weight)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one  = _mm_set1_epi16(1);
+    __m128i       lo   = _mm_setzero_si128();
+    __m128i       hi   = _mm_setzero_si128();
+    for(int y = 0; y < nbLines; y++)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(src[y] + offset));
+        lo        = _mm_add_epi16(lo, _mm_unpacklo_epi8(x, zero));
+        hi        = _mm_add_epi16(hi, _mm_unpackhi_epi8(x, zero));
+    }
+    // 4080 at most, pack to 16 bit is safe
+    __m128i pairs = _mm_packs_epi32(_mm_madd_epi16(lo, weight), _mm_madd_epi16(hi, weight));
+    return _mm_madd_epi16(pairs, one);
+}
+
+__attribute__((target("sse2"))) inline void reduce4SSE2(const uint8_t* const* src,
+                                                        int                   nbLines,
+                                                        __m128i               weight,
+                                                        __m128i               round,
+                                                        int                   shift,
+                                                        uint8_t*              dst,
+                                                        int                   dstWidth)
+{
+    int i = 0;
+    for(; i + 16 <= dstWidth; i += 16)
+    {
+        __m128i q0 = sum4x4SSE2(src, nbLines, 4 * i, weight);
+        __m128i q1 = sum4x4SSE2(src, nbLines, 4 * i + 16, weight);
+        __m128i q2 = sum4x4SSE2(src, nbLines, 4 * i + 32, weight);
+        __m128i q3 = sum4x4SSE2(src, nbLines, 4 * i + 48, weight);
+        __m128i r0 = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(q0, q1), round), shift);
+        __m128i r1 = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(q2, q3), round), shift);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(r0, r1));
+    }
+}
+
+__attribute__((target("sse2"))) void box4SSE2(const uint8_t* const src[4], uint8_t* dst, int dstWidth)
+{
+    reduce4SSE2(src, 4, _mm_set1_epi16(1), _mm_set1_epi16(8), 4, dst, dstWidth);
+    int done = dstWidth & ~15;
+    const uint8_t* const tail[4] = {src[0] + 4 * done, src[1] + 4 * done, src[2] + 4 * done,
+                                    src[3] + 4 * done};
+    box4C(tail, dst + done, dstWidth - done);
+}
+
+__attribute__((target("sse2"))) void
+bilinear4SSE2(const uint8_t* const src[4], uint8_t* dst, int dstWidth)
+{
+    // only pixel 1 and 2 of every 4 pixels in line 1 and 2
+    reduce4SSE2(src + 1,
+                2,
+                _mm_setr_epi16(0, 1, 1, 0, 0, 1, 1, 0),
+                _mm_set1_epi16(2),
+                2,
+                dst,
+                dstWidth);
+    int done = dstWidth & ~15;
+    const uint8_t* const tail[4] = {src[0] + 4 * done, src[1] + 4 * done, src[2] + 4 * done,
+                                    src[3] + 4 * done};
+    bilinear4C(tail, dst + done, dstWidth - done);
+}
+
+const DownscaleLineKernels kKernelsSSE2 = {
+    box2SSE2,
+    box4SSE2,
+    bilinear4SSE2,
+};
+
+// -------------------------- AVX2 --------------------------
+// _mm256_packus_epi16 works in 128 bit lane, qword order after pack is 0 2 1 3
+#    define DOWNSCALE_FIX_PACK_ORDER 0xD8
+
+__attribute__((target("avx2"))) void
+box2AVX2(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int dstWidth)
+{
+    const __m256i lowMask = _mm256_set1_epi16(0x00FF);
+    const __m256i two     = _mm256_set1_epi16(2);
+    int           i       = 0;
+    for(; i + 32 <= dstWidth; i += 32)
+    {
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)(src0 + 2 * i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(src0 + 2 * i + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(src1 + 2 * i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(src1 + 2 * i + 32));
+        __m256i s0 = _mm256_add_epi16(
+            _mm256_add_epi16(_mm256_and_si256(a0, lowMask), _mm256_srli_epi16(a0, 8)),
+            _mm256_add_epi16(_mm256_and_si256(b0, lowMask), _mm256_srli_epi16(b0, 8)));
+        __m256i s1 = _mm256_add_epi16(
+            _mm256_add_epi16(_mm256_and_si256(a1, lowMask), _mm256_srli_epi16(a1, 8)),
+            _mm256_add_epi16(_mm256_and_si256(b1, lowMask), _mm256_srli_epi16(b1, 8)));
+        s0 = _mm256_srli_epi16(_mm256_add_epi16(s0, two), 2);
+        s1 = _mm256_srli_epi16(_mm256_add_epi16(s1, two), 2);
+        _mm256_storeu_si256(
+            (__m256i*)(dst + i),
+            _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), DOWNSCALE_FIX_PACK_ORDER));
+    }
+    box2SSE2(src0 + 2 * i, src1 + 2 * i, dst + i, dstWidth - i);
+}
+
+// 4:1 is bound by the horizontal reduction, AVX2 doesn't help much there
+const DownscaleLineKernels kKernelsAVX2 = {
+    box2AVX2,
+    box4SSE2,
+    bilinear4SSE2,
+};
+#endif
+
+const DownscaleLineKernels& selectKernels(SimdLevel level)
+{
+#ifdef DOWNSCALE_X86
+    if(level == SimdLevel::AVX2)
+    {
+        return kKernelsAVX2;
+    }
+    if(level == SimdLevel::SSE2)
+    {
+        return kKernelsSSE2;
+    }
+#endif
+    return kKernelsC;
+}
+
+void downscalePlane(const DownscaleLineKernels& k,
+                    const uint8_t*              src,
+                    int                         srcStride,
+                    uint8_t*                    dst,
+                    int                         dstStride,
+                    int                         dstWidth,
+                    int                         dstHeight,
+                    int                         factor,
+                    ScaleAlgorithm              algorithm)
+{
+    for(int y = 0; y < dstHeight; y++)
+    {
+        const uint8_t* line = src + factor * y * srcStride;
+        if(factor == 2)
+        {
+            k.box2(line, line + srcStride, dst + y * dstStride, dstWidth);
+            continue;
+        }
+        const uint8_t* const lines[4] = {
+            line, line + srcStride, line + 2 * srcStride, line + 3 * srcStride};
+        if(algorithm == ScaleAlgorithm::BOX)
+        {
+            k.box4(lines, dst + y * dstStride, dstWidth);
+        }
+        else
+        {
+            k.bilinear4(lines, dst + y * dstStride, dstWidth);
+        }
+    }
+}
+} // namespace
+
+int downscaleFactor(int pixFmt, int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+{
+    const PlaneLayout* layout = findLayout(pixFmt);
+    if(!layout || dstWidth <= 0 || dstHeight <= 0)
+    {
+        return 0;
+    }
+    int factor = srcWidth / dstWidth;
+    if(factor != 2 && factor != 4)
+    {
+        return 0;
+    }
+    if(srcWidth != dstWidth * factor || srcHeight != dstHeight * factor)
+    {
+        return 0;
+    }
+    // chroma of odd size is rounded up, it may not be divided exactly
+    if(layout->planes > 1 &&
+       (ceilShift(srcWidth, layout->chromaShiftW) !=
+            ceilShift(dstWidth, layout->chromaShiftW) * factor ||
+        ceilShift(srcHeight, layout->chromaShiftH) !=
+            ceilShift(dstHeight, layout->chromaShiftH) * factor))
+    {
+        return 0;
+    }
+    return factor;
+}
+
+bool hasDownscaleKernel(int pixFmt, int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+{
+    return downscaleFactor(pixFmt, srcWidth, srcHeight, dstWidth, dstHeight) != 0;
+}
+
+bool downscale(uint8_t* const src[],
+               const int      srcStride[],
+               uint8_t* const dst[],
+               const int      dstStride[],
+               int            pixFmt,
+               int            srcWidth,
+               int            srcHeight,
+               int            dstWidth,
+               int            dstHeight,
+               ScaleAlgorithm algorithm,
+               SimdLevel      level)
+{
+    int factor = downscaleFactor(pixFmt, srcWidth, srcHeight, dstWidth, dstHeight);
+    if(factor == 0 || algorithm == ScaleAlgorithm::BICUBIC)
+    {
+        return false;
+    }
+    // never use an instruction set the cpu doesn't have
+    if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+    {
+        level = cpuSimdLevel();
+    }
+    const DownscaleLineKernels& k      = selectKernels(level);
+    const PlaneLayout*          layout = findLayout(pixFmt);
+    for(int plane = 0; plane < layout->planes; plane++)
+    {
+        int shiftW = plane == 0 ? 0 : layout->chromaShiftW;
+        int shiftH = plane == 0 ? 0 : layout->chromaShiftH;
+        downscalePlane(k,
+                       src[plane],
+                       srcStride[plane],
+                       dst[plane],
+                       dstStride[plane],
+                       ceilShift(dstWidth, shiftW),
+                       ceilShift(dstHeight, shiftH),
+                       factor,
+                       algorithm);
+    }
+    return true;
+}
@@ -8,6 +8,8 @@ extern "C"
 #include <libavutil/imgutils.h>
 };
 
+#include <algorithm>
+
 Frame::Frame()
     : m_avFrame(nullptr)
     , m_valid(false)
@@ -58,7 +60,8 @@ Frame::Frame(const AudioFrameParam& initParam)
         AV_LOG_E("Failed to alloc frame buffer");
         return;
     }
-    m_valid = true;
+    m_audioSamples = m_avFrame->nb_samples;
+    m_valid        = true;
     AV_LOG_D("frame nb_samples %d channle layout %ld fromat %d",
              m_avFrame->nb_samples,
              m_avFrame->channel_layout,
@@ -66,6 +69,8 @@ Frame::Frame(const AudioFrameParam& initParam)
 }
 
 Frame::Frame(const VideoFrameParam& initParam)
+    : m_avFrame(nullptr)
+    , m_valid(false)
 {
     if(!initParam.enable)
     {
@@ -85,7 +90,16 @@ Frame::Frame(const VideoFrameParam& initParam)
     // init 0
     m_avFrame->pts = 0;
 
-    if(av_frame_get_buffer(m_avFrame, 32) < 0)
+    if(initParam.pool != nullptr || initParam.allocType != FrameAllocType::DEFAULT)
+    {
+        if(!allocVideoBuffer(initParam))
+        {
+            av_frame_free(&m_avFrame);
+            AV_LOG_E("Failed to alloc frame buffer with alloc type %d", (int)initParam.allocType);
+            return;
+        }
+    }
+    else if(av_frame_get_buffer(m_avFrame, 32) < 0)
     {
         av_frame_free(&m_avFrame);
         AV_LOG_E("Failed to alloc frame buffer");
@@ -107,6 +121,63 @@ Frame::~Frame()
     }
 }
 
+bool Frame::allocVideoBuffer(const VideoFrameParam& initParam)
+{
+    int bufferSize = videoBufferSize(initParam.width, initParam.height, initParam.pixFormat);
+    if(bufferSize < 0)
+    {
+        return false;
+    }
+
+    AVBufferRef* buf = nullptr;
+    if(initParam.pool != nullptr)
+    {
+        if(initParam.pool->bufferSize() < bufferSize)
+        {
+            AV_LOG_E("pool buffer size %d is less than frame buffer size %d",
+                     initParam.pool->bufferSize(),
+                     bufferSize);
+            return false;
+        }
+        buf = initParam.pool->get();
+    }
+    else
+    {
+        buf = allocFrameBuffer(bufferSize, initParam.allocType);
+    }
+    if(!buf)
+    {
+        return false;
+    }
+
+    if(av_image_fill_arrays(m_avFrame->data,
+                            m_avFrame->linesize,
+                            buf->data,
+                            (AVPixelFormat)initParam.pixFormat,
+                            initParam.width,
+                            initParam.height,
+                            32) < 0)
+    {
+        av_buffer_unref(&buf);
+        return false;
+    }
+    // frame own the buffer now
+    m_avFrame->buf[0]        = buf;
+    m_avFrame->extended_data = m_avFrame->data;
+    return true;
+}
+
+int Frame::videoBufferSize(int width, int height, int pixFormat)
+{
+    int size = av_image_get_buffer_size((AVPixelFormat)pixFormat, width, height, 32);
+    if(size < 0)
+    {
+        return size;
+    }
+    // same as av_frame_get_buffer, swscale/encoder simd may over read the end of plane
+    return size + 64;
+}
+
 bool Frame::writeAudioData(uint8_t** audioData, int32_t audioDataSize)
 {
     if(!m_valid)
@@ -114,17 +185,23 @@ bool Frame::writeAudioData(uint8_t** audioData, int32_t audioDataSize)
         AV_LOG_W("frame is not valid!");
         return false;
     }
-    if(m_avFrame->format == AV_SAMPLE_FMT_S16)
+    // the last buffer of a flush may be partial, its planes are packed at the stride of the
+    // samples it has instead of a full frame
+    int sampleBytes =
+        m_avFrame->channels * av_get_bytes_per_sample((AVSampleFormat)m_avFrame->format);
+    m_avFrame->nb_samples = m_audioSamples;
+    if(sampleBytes > 0 && audioDataSize > 0)
     {
-        av_samples_fill_arrays(m_avFrame->data,
-                               m_avFrame->linesize,
-                               audioData[0],
-                               m_avFrame->channels,
-                               m_avFrame->nb_samples,
-                               (AVSampleFormat)m_avFrame->format,
-                               0);
+        m_avFrame->nb_samples = std::min(m_audioSamples, audioDataSize / sampleBytes);
     }
-    else
+    // planar data is contiguous planes in audioData[0], see SwrConvertor::convert
+    if(av_samples_fill_arrays(m_avFrame->data,
+                              m_avFrame->linesize,
+                              audioData[0],
+                              m_avFrame->channels,
+                              m_avFrame->nb_samples,
+                              (AVSampleFormat)m_avFrame->format,
+                              0) < 0)
     {
         AV_LOG_E("don't support format %d yet", m_avFrame->format);
         return false;
@@ -0,0 +1,171 @@
+#include "frame_allocator.h"
+#include "../../utils/include/log.h"
+
+extern "C"
+{
+#include <libavutil/buffer.h>
+#include <libavutil/mem.h>
+}
+
+#include <atomic>
+
+#ifdef __linux__
+#    include <sys/mman.h>
+#endif
+
+namespace
+{
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+size_t alignUp(size_t size, size_t align)
+{
+    return (size + align - 1) / align * align;
+}
+
+#ifdef __linux__
+void unmapBuffer(void* opaque, uint8_t* data)
+{
+    munmap(data, reinterpret_cast<uintptr_t>(opaque));
+}
+
+// try MAP_HUGETLB(need reserved pages in /proc/sys/vm/nr_hugepages)
+uint8_t* mapHugeTLB(size_t mapSize)
+{
+#    ifdef MAP_HUGETLB
+    void* ptr = mmap(nullptr,
+                     mapSize,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                     -1,
+                     0);
+    if(ptr != MAP_FAILED)
+    {
+        return static_cast<uint8_t*>(ptr);
+    }
+#    endif
+    return nullptr;
+}
+
+// map with 2M alignment and ask the kernel to back it with transparent huge page
+uint8_t* mapTransparentHugePage(size_t mapSize)
+{
+    size_t reserveSize = mapSize + kHugePageSize;
+    void*  ptr =
+        mmap(nullptr, reserveSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ptr == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    // trim head and tail, keep a 2M aligned range
+    uintptr_t begin        = reinterpret_cast<uintptr_t>(ptr);
+    uintptr_t alignedBegin = alignUp(begin, kHugePageSize);
+    if(alignedBegin > begin)
+    {
+        munmap(ptr, alignedBegin - begin);
+    }
+    size_t tail = begin + reserveSize - (alignedBegin + mapSize);
+    if(tail > 0)
+    {
+        munmap(reinterpret_cast<void*>(alignedBegin + mapSize), tail);
+    }
+
+#    ifdef MADV_HUGEPAGE
+    if(madvise(reinterpret_cast<void*>(alignedBegin), mapSize, MADV_HUGEPAGE) != 0)
+    {
+        AV_LOG_D("madvise(MADV_HUGEPAGE) failed, THP may be disabled");
+    }
+#    endif
+    return reinterpret_cast<uint8_t*>(alignedBegin);
+}
+
+AVBufferRef* allocHugePageBuffer(int size)
+{
+    static std::atomic<bool> hugeTLBUnavailable{false};
+
+    size_t   mapSize = alignUp(size, kHugePageSize);
+    uint8_t* data    = nullptr;
+    if(!hugeTLBUnavailable.load(std::memory_order_relaxed))
+    {
+        data = mapHugeTLB(mapSize);
+        if(data == nullptr && !hugeTLBUnavailable.exchange(true))
+        {
+            AV_LOG_W("MAP_HUGETLB failed, fall back to transparent huge page");
+        }
+    }
+    if(data == nullptr)
+    {
+        data = mapTransparentHugePage(mapSize);
+    }
+    if(data == nullptr)
+    {
+        return nullptr;
+    }
+
+    AVBufferRef* buf = av_buffer_create(
+        data, size, unmapBuffer, reinterpret_cast<void*>(static_cast<uintptr_t>(mapSize)), 0);
+    if(!buf)
+    {
+        munmap(data, mapSize);
+    }
+    return buf;
+}
+#endif
+
+AVBufferRef* poolAlloc(void* opaque, int size)
+{
+    auto* pool = static_cast<FrameBufferPool*>(opaque);
+    return allocFrameBuffer(size, pool->allocType());
+}
+} // namespace
+
+AVBufferRef* allocFrameBuffer(int size, FrameAllocType allocType)
+{
+    if(size <= 0)
+    {
+        return nullptr;
+    }
+#ifdef __linux__
+    if(allocType == FrameAllocType::HUGE_PAGE)
+    {
+        if(AVBufferRef* buf = allocHugePageBuffer(size); buf)
+        {
+            return buf;
+        }
+        AV_LOG_W("failed to map huge page buffer(%d), fall back to normal page", size);
+    }
+#endif
+    return av_buffer_alloc(size);
+}
+
+// -------------------------- FrameBufferPool --------------------------
+FrameBufferPool::FrameBufferPool(int bufferSize, FrameAllocType allocType)
+    : m_bufferSize(bufferSize)
+    , m_allocType(allocType)
+{
+    m_pool = av_buffer_pool_init2(bufferSize, this, poolAlloc, nullptr);
+    if(!m_pool)
+    {
+        AV_LOG_E("Failed to init frame buffer pool, size %d", bufferSize);
+        return;
+    }
+    AV_LOG_D("frame buffer pool size %d alloc type %d", bufferSize, (int)allocType);
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+    // buffers still in use keep the pool alive, it's freed after the last one is returned
+    if(m_pool)
+    {
+        av_buffer_pool_uninit(&m_pool);
+    }
+}
+
+AVBufferRef* FrameBufferPool::get()
+{
+    if(!m_pool)
+    {
+        return nullptr;
+    }
+    return av_buffer_pool_get(m_pool);
+}
@@ -0,0 +1,118 @@
+#include "frame_cache.h"
+#include "../../utils/include/log.h"
+#include "frame.h"
+
+#include <iterator>
+
+#include <sys/stat.h>
+
+FrameCache::FrameCache(size_t capacityBytes)
+    : m_capacityBytes(capacityBytes)
+{ }
+
+std::string FrameCache::streamKey(const std::string& filename, int width, int height, int pixFmt)
+{
+    std::string key = filename;
+    // a rewritten file is a new stream
+    struct stat fileStat;
+    if(stat(filename.c_str(), &fileStat) == 0)
+    {
+        key += '|' + std::to_string(fileStat.st_size) + '|' + std::to_string(fileStat.st_mtime);
+    }
+    key += '|' + std::to_string(width) + 'x' + std::to_string(height) + '|' + std::to_string(pixFmt);
+    return key;
+}
+
+std::shared_ptr<Frame> FrameCache::get(const std::string& streamKey, int64_t pts)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto                        stream = m_index.find(streamKey);
+    if(stream != m_index.end())
+    {
+        // the last frame not after pts
+        auto it = stream->second.upper_bound(pts);
+        if(it != stream->second.begin())
+        {
+            EntryList::iterator entry = std::prev(it)->second;
+            if(pts < entry->endPts)
+            {
+                m_lru.splice(m_lru.begin(), m_lru, entry);
+                m_hits++;
+                return entry->frame;
+            }
+        }
+    }
+    m_misses++;
+    return nullptr;
+}
+
+void FrameCache::put(const std::string&     streamKey,
+                     int64_t                pts,
+                     int64_t                endPts,
+                     std::shared_ptr<Frame> frame)
+{
+    size_t bytes = Frame::videoBufferSize(frame->width(), frame->heigt(), frame->format());
+    if(bytes > m_capacityBytes)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto&                       stream = m_index[streamKey];
+    if(auto it = stream.find(pts); it != stream.end())
+    {
+        erase(it->second);
+    }
+    while(!m_lru.empty() && m_bytes + bytes > m_capacityBytes)
+    {
+        erase(std::prev(m_lru.end()));
+        m_evictions++;
+    }
+
+    m_lru.push_front(Entry{
+        .streamKey = streamKey,
+        .pts       = pts,
+        .endPts    = endPts,
+        .bytes     = bytes,
+        .frame     = frame,
+    });
+    // erase may remove the map of this stream
+    m_index[streamKey][pts] = m_lru.begin();
+    m_bytes += bytes;
+}
+
+void FrameCache::erase(EntryList::iterator it)
+{
+    auto stream = m_index.find(it->streamKey);
+    if(stream != m_index.end())
+    {
+        stream->second.erase(it->pts);
+        if(stream->second.empty())
+        {
+            m_index.erase(stream);
+        }
+    }
+    m_bytes -= it->bytes;
+    m_lru.erase(it);
+}
+
+FrameCacheStats FrameCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    FrameCacheStats             stats;
+    stats.hits          = m_hits;
+    stats.misses        = m_misses;
+    stats.evictions     = m_evictions;
+    stats.entries       = m_lru.size();
+    stats.bytes         = m_bytes;
+    stats.capacityBytes = m_capacityBytes;
+    return stats;
+}
+
+void FrameCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_index.clear();
+    m_lru.clear();
+    m_bytes = 0;
+}
@@ -0,0 +1,182 @@
+#include "frame_diff.h"
+#include "../../utils/include/log.h"
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define FRAME_DIFF_X86 1
+#    include <immintrin.h>
+#endif
+
+namespace
+{
+// -------------------------- C --------------------------
+uint64_t sadLineC(const uint8_t* a, const uint8_t* b, int width)
+{
+    uint64_t sad = 0;
+    for(int i = 0; i < width; i++)
+    {
+        sad += abs(a[i] - b[i]);
+    }
+    return sad;
+}
+
+#ifdef FRAME_DIFF_X86
+// -------------------------- SSE2 --------------------------
+__attribute__((target("sse2"))) uint64_t sadLineSSE2(const uint8_t* a, const uint8_t* b, int width)
+{
+    // psadbw sums 8 bytes into a 64 bit lane
+    __m128i acc = _mm_setzero_si128();
+    int     i   = 0;
+    for(; i + 16 <= width; i += 16)
+    {
+        acc = _mm_add_epi64(acc,
+                            _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)),
+                                         _mm_loadu_si128((const __m128i*)(b + i))));
+    }
+    alignas(16) uint64_t lanes[2];
+    _mm_store_si128((__m128i*)lanes, acc);
+    return lanes[0] + lanes[1] + sadLineC(a + i, b + i, width - i);
+}
+
+// -------------------------- AVX2 --------------------------
+__attribute__((target("avx2"))) uint64_t sadLineAVX2(const uint8_t* a, const uint8_t* b, int width)
+{
+    __m256i acc = _mm256_setzero_si256();
+    int     i   = 0;
+    for(; i + 32 <= width; i += 32)
+    {
+        acc = _mm256_add_epi64(acc,
+                               _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                               _mm256_loadu_si256((const __m256i*)(b + i))));
+    }
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256((__m256i*)lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sadLineSSE2(a + i, b + i, width - i);
+}
+#endif
+} // namespace
+
+uint64_t sadLine(const uint8_t* a, const uint8_t* b, int width, SimdLevel level)
+{
+    if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+    {
+        level = cpuSimdLevel();
+    }
+#ifdef FRAME_DIFF_X86
+    if(level == SimdLevel::AVX2)
+    {
+        return sadLineAVX2(a, b, width);
+    }
+    if(level == SimdLevel::SSE2)
+    {
+        return sadLineSSE2(a, b, width);
+    }
+#endif
+    return sadLineC(a, b, width);
+}
+
+FrameDiffDetector::FrameDiffDetector(const FrameDiffParam& param)
+    : m_param(param)
+    , m_level(cpuSimdLevel())
+{ }
+
+bool FrameDiffDetector::updateLayout(const AVFrame* frame)
+{
+    if(frame->width == m_width && frame->height == m_height && frame->format == m_pixFmt)
+    {
+        return m_nbPlanes > 0;
+    }
+    m_width        = frame->width;
+    m_height       = frame->height;
+    m_pixFmt       = frame->format;
+    m_nbPlanes     = 0;
+    m_frameBytes   = 0;
+    m_hasReference = false;
+
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)m_pixFmt);
+    if(!desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM)))
+    {
+        AV_LOG_W("frame diff can't support pix fmt %d", m_pixFmt);
+        return false;
+    }
+    int nbPlanes = av_pix_fmt_count_planes((AVPixelFormat)m_pixFmt);
+    for(int plane = 0; plane < nbPlanes; plane++)
+    {
+        bool isChroma      = (plane == 1 || plane == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        m_lineBytes[plane] = av_image_get_linesize((AVPixelFormat)m_pixFmt, m_width, plane);
+        m_lines[plane]     = isChroma ? -((-m_height) >> desc->log2_chroma_h) : m_height;
+        if(m_lineBytes[plane] <= 0)
+        {
+            return false;
+        }
+        m_frameBytes += (uint64_t)m_lineBytes[plane] * m_lines[plane];
+    }
+    m_nbPlanes = nbPlanes;
+    m_reference.resize(m_frameBytes);
+    return true;
+}
+
+uint64_t FrameDiffDetector::frameSad(const AVFrame* frame, uint64_t limit) const
+{
+    const uint8_t* ref = m_reference.data();
+    uint64_t       sad = 0;
+    for(int plane = 0; plane < m_nbPlanes; plane++)
+    {
+        for(int y = 0; y < m_lines[plane]; y++)
+        {
+            sad += sadLine(
+                frame->data[plane] + y * frame->linesize[plane], ref, m_lineBytes[plane], m_level);
+            if(sad > limit)
+            {
+                return sad;
+            }
+            ref += m_lineBytes[plane];
+        }
+    }
+    return sad;
+}
+
+void FrameDiffDetector::keepReference(const AVFrame* frame)
+{
+    uint8_t* ref = m_reference.data();
+    for(int plane = 0; plane < m_nbPlanes; plane++)
+    {
+        for(int y = 0; y < m_lines[plane]; y++)
+        {
+            memcpy(ref, frame->data[plane] + y * frame->linesize[plane], m_lineBytes[plane]);
+            ref += m_lineBytes[plane];
+        }
+    }
+    m_hasReference = true;
+    m_duplicates   = 0;
+    m_keptFrames++;
+}
+
+bool FrameDiffDetector::isDuplicate(const AVFrame* frame)
+{
+    if(!m_param.enable || !frame || !updateLayout(frame))
+    {
+        return false;
+    }
+    if(m_hasReference && (m_param.maxDuplicates <= 0 || m_duplicates < m_param.maxDuplicates))
+    {
+        uint64_t limit = (uint64_t)(m_param.threshold * m_frameBytes);
+        if(frameSad(frame, limit) <= limit)
+        {
+            m_duplicates++;
+            m_droppedFrames++;
+            return true;
+        }
+    }
+    keepReference(frame);
+    return false;
+}
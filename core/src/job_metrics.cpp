@@ -0,0 +1,286 @@
+#include "job_metrics.h"
+#include "trace.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+thread_local JobMetrics* t_currentMetrics = nullptr;
+
+uint64_t elapsedNs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+} // namespace
+
+const char* stageName(Stage stage)
+{
+    switch(stage)
+    {
+    case Stage::READ:
+        return "read";
+    case Stage::DECODE:
+        return "decode";
+    case Stage::SCALE:
+        return "scale";
+    case Stage::RESAMPLE:
+        return "resample";
+    case Stage::ENCODE:
+        return "encode";
+    case Stage::WRITE:
+        return "write";
+    default:
+        return "unknown";
+    }
+}
+
+// -------------------------- LatencyHistogram --------------------------
+int LatencyHistogram::bucketIndex(uint64_t ns)
+{
+    if(ns < (1u << kSubBits))
+    {
+        return (int)ns;
+    }
+    int msb   = 63 - __builtin_clzll(ns);
+    int shift = msb - kSubBits;
+    int sub   = (int)((ns >> shift) & ((1u << kSubBits) - 1));
+    return ((shift + 1) << kSubBits) + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int index)
+{
+    if(index < (1 << kSubBits))
+    {
+        return index;
+    }
+    int      shift = (index >> kSubBits) - 1;
+    uint64_t sub   = index & ((1 << kSubBits) - 1);
+    uint64_t lower = ((1ULL << kSubBits) + sub) << shift;
+    return lower + (1ULL << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    m_buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    uint64_t prevMax = m_max.load(std::memory_order_relaxed);
+    while(ns > prevMax && !m_max.compare_exchange_weak(prevMax, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t LatencyHistogram::percentile(double p) const
+{
+    uint64_t total = count();
+    if(total == 0)
+    {
+        return 0;
+    }
+    uint64_t target = std::max<uint64_t>(1, (uint64_t)std::ceil(p * total));
+    uint64_t seen   = 0;
+    for(int i = 0; i < kBuckets; i++)
+    {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if(seen >= target)
+        {
+            return std::min(bucketUpperBound(i), max());
+        }
+    }
+    return max();
+}
+
+// -------------------------- JobMetrics --------------------------
+JobMetrics::JobMetrics()
+    : m_start(std::chrono::steady_clock::now())
+{ }
+
+void JobMetrics::record(Stage stage, uint64_t ns, uint64_t frames, uint64_t bytes)
+{
+    StageCounter& counter = m_stages[(size_t)stage];
+    counter.histogram.record(ns);
+    counter.frames.fetch_add(frames, std::memory_order_relaxed);
+    counter.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counter.totalNs.fetch_add(ns, std::memory_order_relaxed);
+}
+
+void JobMetrics::recordCaptureLatency(uint64_t ns)
+{
+    m_captureLatency.record(ns);
+}
+
+JobMetricsReport JobMetrics::report() const
+{
+    JobMetricsReport report;
+    report.wallMs = elapsedNs(m_start) / 1e6;
+    for(size_t i = 0; i < m_stages.size(); i++)
+    {
+        const StageCounter& counter = m_stages[i];
+        StageStats&         stats   = report.stages[i];
+        stats.count                 = counter.histogram.count();
+        stats.frames                = counter.frames.load(std::memory_order_relaxed);
+        stats.bytes                 = counter.bytes.load(std::memory_order_relaxed);
+        stats.totalNs               = counter.totalNs.load(std::memory_order_relaxed);
+        stats.p50Us                 = counter.histogram.percentile(0.5) / 1e3;
+        stats.p99Us                 = counter.histogram.percentile(0.99) / 1e3;
+        stats.maxUs                 = counter.histogram.max() / 1e3;
+        if(report.wallMs > 0)
+        {
+            stats.fps = stats.frames * 1e3 / report.wallMs;
+        }
+        if(stats.totalNs > 0)
+        {
+            stats.busyFps = stats.frames * 1e9 / stats.totalNs;
+        }
+    }
+    report.captureLatency.count = m_captureLatency.count();
+    report.captureLatency.p50Ms = m_captureLatency.percentile(0.5) / 1e6;
+    report.captureLatency.p90Ms = m_captureLatency.percentile(0.9) / 1e6;
+    report.captureLatency.p99Ms = m_captureLatency.percentile(0.99) / 1e6;
+    report.captureLatency.maxMs = m_captureLatency.max() / 1e6;
+    return report;
+}
+
+JobMetrics* JobMetrics::current()
+{
+    return t_currentMetrics;
+}
+
+void JobMetrics::setCurrent(JobMetrics* metrics)
+{
+    t_currentMetrics = metrics;
+}
+
+std::string JobMetricsReport::toJson() const
+{
+    std::string json;
+    char        buffer[512];
+    snprintf(buffer, sizeof(buffer), "{\"wallMs\":%.3f,\"stages\":{", wallMs);
+    json += buffer;
+    for(size_t i = 0; i < stages.size(); i++)
+    {
+        const StageStats& stats = stages[i];
+        snprintf(buffer,
+                 sizeof(buffer),
+                 "%s\"%s\":{\"count\":%lu,\"frames\":%lu,\"bytes\":%lu,\"totalMs\":%.3f,"
+                 "\"p50Us\":%.1f,\"p99Us\":%.1f,\"maxUs\":%.1f,\"fps\":%.2f,\"busyFps\":%.2f}",
+                 i == 0 ? "" : ",",
+                 stageName((Stage)i),
+                 stats.count,
+                 stats.frames,
+                 stats.bytes,
+                 stats.totalNs / 1e6,
+                 stats.p50Us,
+                 stats.p99Us,
+                 stats.maxUs,
+                 stats.fps,
+                 stats.busyFps);
+        json += buffer;
+    }
+    snprintf(buffer,
+             sizeof(buffer),
+             "},\"captureLatency\":{\"count\":%lu,\"p50Ms\":%.2f,\"p90Ms\":%.2f,"
+             "\"p99Ms\":%.2f,\"maxMs\":%.2f}}",
+             captureLatency.count,
+             captureLatency.p50Ms,
+             captureLatency.p90Ms,
+             captureLatency.p99Ms,
+             captureLatency.maxMs);
+    json += buffer;
+    return json;
+}
+
+// -------------------------- JobMetricsScope --------------------------
+JobMetricsScope::JobMetricsScope(JobMetrics* metrics)
+    : m_prev(JobMetrics::current())
+{
+    JobMetrics::setCurrent(metrics);
+}
+
+JobMetricsScope::~JobMetricsScope()
+{
+    JobMetrics::setCurrent(m_prev);
+}
+
+// -------------------------- StageTimer --------------------------
+StageTimer::StageTimer(Stage stage, uint64_t bytes, uint64_t frames)
+    : m_metrics(JobMetrics::current())
+    , m_trace(TraceRecorder::current())
+    , m_stage(stage)
+    , m_bytes(bytes)
+    , m_frames(frames)
+{
+    resume();
+}
+
+StageTimer::~StageTimer()
+{
+    if(!m_metrics && !m_trace)
+        return;
+    pause();
+    if(m_metrics)
+    {
+        m_metrics->record(m_stage, m_elapsedNs, m_frames, m_bytes);
+    }
+}
+
+void StageTimer::pause()
+{
+    if(!m_running)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    m_elapsedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_start).count();
+    m_running = false;
+    if(m_trace)
+    {
+        m_trace->span(stageName(m_stage), m_start, now, m_frames, m_bytes);
+    }
+}
+
+void StageTimer::resume()
+{
+    if((!m_metrics && !m_trace) || m_running)
+        return;
+    m_start   = std::chrono::steady_clock::now();
+    m_running = true;
+}
+
+// -------------------------- timed io --------------------------
+int timedReadFrame(AVFormatContext* fmtCtx, AVPacket* pkt)
+{
+    // EOF or error is timed but not a packet
+    StageTimer timer(Stage::READ, 0, 0);
+    int        ret = av_read_frame(fmtCtx, pkt);
+    if(ret >= 0)
+    {
+        timer.addBytes(pkt->size);
+        timer.addFrames(1);
+    }
+    return ret;
+}
+
+int timedReadsome(std::ifstream& ifs, uint8_t* data, int size)
+{
+    StageTimer timer(Stage::READ, 0, 0);
+    int        n = (int)ifs.readsome(reinterpret_cast<char*>(data), size);
+    if(n > 0)
+    {
+        timer.addBytes(n);
+        timer.addFrames(1);
+    }
+    return n;
+}
+
+void timedWrite(std::ofstream& ofs, const uint8_t* data, int size)
+{
+    StageTimer timer(Stage::WRITE, size);
+    ofs.write(reinterpret_cast<const char*>(data), size);
+}
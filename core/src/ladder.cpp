@@ -0,0 +1,154 @@
+#include "ladder.h"
+#include "../../utils/include/log.h"
+#include "codec_pool.h"
+#include "frame.h"
+#include "job_metrics.h"
+#include "trace.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+#include <algorithm>
+
+#include <pthread.h>
+
+LadderRungEncoder::LadderRungEncoder(const LadderRung&  rung,
+                                     const LadderParam& param,
+                                     int                inWidth,
+                                     int                inHeight,
+                                     int                inPixFmt)
+    : m_rung(rung)
+    , m_queueSize(std::max(1, param.queueSize))
+    , m_metrics(JobMetrics::current())
+    , m_trace(TraceRecorder::current())
+{
+    ReampleParam scaleParam{
+        .inWidth        = inWidth,
+        .inHeight       = inHeight,
+        .inPixFmt       = inPixFmt,
+        .outWidth       = rung.encodeParam.width,
+        .outHeight      = rung.encodeParam.height,
+        .outPixFmt      = rung.encodeParam.pixFmt,
+        .scaleAlgorithm = rung.scaleAlgorithm,
+    };
+    // full range input may be passed through without convert
+    if(SwsConvertor::isFullRangeOutput(scaleParam))
+    {
+        m_rung.encodeParam.colorRange = AVCOL_RANGE_JPEG;
+    }
+    CodecParam codecParam{.encodeParam = m_rung.encodeParam};
+    m_codec = param.useCodecPool ? CodecPool::instance().acquireVideo(codecParam)
+                                 : std::make_shared<VideoCodec>(codecParam);
+    if(!m_codec->encodeEnable())
+    {
+        AV_LOG_E("can't open encoder of rung %s", rung.outFilename.c_str());
+        return;
+    }
+    m_swsConvertor = std::make_shared<SwsConvertor>(scaleParam, param.frameAllocType);
+    m_input        = std::make_shared<Frame>();
+    m_pkt          = av_packet_alloc();
+    if(!m_pkt)
+    {
+        AV_LOG_E("alloct packet error");
+        return;
+    }
+    m_ofs.open(rung.outFilename, std::ios::out | std::ios::binary);
+    m_valid = true;
+}
+
+LadderRungEncoder::~LadderRungEncoder()
+{
+    finish();
+    if(m_pkt)
+    {
+        av_packet_free(&m_pkt);
+    }
+}
+
+void LadderRungEncoder::start()
+{
+    if(!m_valid || m_thread.joinable())
+        return;
+    m_thread = std::thread(&LadderRungEncoder::run, this);
+}
+
+void LadderRungEncoder::push(std::shared_ptr<Frame> frame)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(!m_valid || m_finished)
+        return;
+    m_notFull.wait(lock, [&]() { return (int)m_queue.size() < m_queueSize; });
+    m_queue.push_back(std::move(frame));
+    m_notEmpty.notify_one();
+}
+
+void LadderRungEncoder::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished = true;
+        m_notEmpty.notify_all();
+    }
+    if(m_thread.joinable())
+    {
+        m_thread.join();
+        AV_LOG_I("rung %s encoded %lu frames", m_rung.outFilename.c_str(), m_frames);
+    }
+}
+
+bool LadderRungEncoder::pop(std::shared_ptr<Frame>& frame)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_notEmpty.wait(lock, [&]() { return !m_queue.empty() || m_finished; });
+    if(m_queue.empty())
+    {
+        return false;
+    }
+    frame = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_notFull.notify_one();
+    return true;
+}
+
+void LadderRungEncoder::run()
+{
+    JobMetricsScope metricsScope(m_metrics);
+    TraceScope      traceScope(m_trace);
+
+    char threadName[16];
+    snprintf(threadName, sizeof(threadName), "rung-%dp", m_rung.encodeParam.height);
+    pthread_setname_np(pthread_self(), threadName);
+
+    auto encodeCallback = [&](AVPacket* pkt) { timedWrite(m_ofs, pkt->data, pkt->size); };
+    int  gopSize        = m_rung.encodeParam.gopSize;
+
+    std::shared_ptr<Frame> frame;
+    while(pop(frame))
+    {
+        // a reference instead of copy, the planes are shared with the other rungs
+        av_frame_ref(m_input->getAVFrame(), frame->getAVFrame());
+        frame.reset();
+        int64_t pts = m_input->getAVFrame()->pts;
+
+        std::shared_ptr<Frame> outFrame = m_input;
+        if(m_swsConvertor->enable())
+        {
+            outFrame = m_swsConvertor->scale(m_input);
+        }
+        if(outFrame)
+        {
+            // key frames of every rung on the same source frames, so the segments of the
+            // renditions are aligned
+            outFrame->getAVFrame()->pts = pts;
+            outFrame->getAVFrame()->pict_type =
+                gopSize > 0 && pts % gopSize == 0 ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+            m_codec->encode(outFrame, m_pkt, encodeCallback);
+            m_frames++;
+        }
+        av_frame_unref(m_input->getAVFrame());
+    }
+    m_codec->encode(m_input, m_pkt, encodeCallback, true);
+}
@@ -0,0 +1,174 @@
+#include "muxer.h"
+#include "../../utils/include/log.h"
+#include "job_metrics.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+Muxer::Muxer(const std::string& filename, int streams, int64_t maxSkewUs)
+    : m_filename(filename)
+    , m_streams(streams)
+    , m_maxSkewUs(maxSkewUs)
+    , m_clockStartUs(av_gettime_relative())
+{
+    AVFormatContext* fmtCtx = nullptr;
+    if(int ret = avformat_alloc_output_context2(&fmtCtx, nullptr, nullptr, filename.c_str());
+       ret < 0)
+    {
+        char errors[1024];
+        av_strerror(ret, errors, sizeof(errors));
+        AV_LOG_E("can't find container of %s\nerror:%s", filename.c_str(), errors);
+        return;
+    }
+    if(!(fmtCtx->oformat->flags & AVFMT_NOFILE))
+    {
+        if(int ret = avio_open(&fmtCtx->pb, filename.c_str(), AVIO_FLAG_WRITE); ret < 0)
+        {
+            char errors[1024];
+            av_strerror(ret, errors, sizeof(errors));
+            AV_LOG_E("Failed to open %s\nerror:%s", filename.c_str(), errors);
+            avformat_free_context(fmtCtx);
+            return;
+        }
+    }
+    // a stream without packets holds the interleaving queue back no longer than it
+    fmtCtx->max_interleave_delta = maxSkewUs;
+    m_fmtCtx                     = fmtCtx;
+}
+
+Muxer::~Muxer()
+{
+    close();
+}
+
+bool Muxer::needGlobalHeader() const
+{
+    return m_fmtCtx && (m_fmtCtx->oformat->flags & AVFMT_GLOBALHEADER);
+}
+
+int Muxer::addStream(const AVCodecContext* codecCtx)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_fmtCtx || m_headerWritten || m_failed)
+    {
+        AV_LOG_E("can't add stream to %s", m_filename.c_str());
+        return -1;
+    }
+    // a failure leaves the streams of m_fmtCtx and m_muxStreams out of step, the muxer fails
+    AVStream* stream = avformat_new_stream(m_fmtCtx, nullptr);
+    if(!stream)
+    {
+        AV_LOG_E("alloc stream error");
+        m_failed = true;
+        m_headerCond.notify_all();
+        return -1;
+    }
+    if(avcodec_parameters_from_context(stream->codecpar, codecCtx) < 0)
+    {
+        AV_LOG_E("copy codec parameters error");
+        m_failed = true;
+        m_headerCond.notify_all();
+        return -1;
+    }
+    // audio encoders may leave time base to samples
+    AVRational timeBase = codecCtx->time_base;
+    if(timeBase.num <= 0 || timeBase.den <= 0)
+    {
+        timeBase = AVRational{1, codecCtx->sample_rate};
+    }
+    stream->time_base = timeBase;
+    m_muxStreams.push_back({
+        .mediaType   = codecCtx->codec_type,
+        .timeBaseNum = timeBase.num,
+        .timeBaseDen = timeBase.den,
+    });
+    writeHeaderIfReady();
+    return stream->index;
+}
+
+void Muxer::endStream(int mediaType)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const MuxStream& muxStream : m_muxStreams)
+    {
+        if(muxStream.mediaType == mediaType)
+            return;
+    }
+    m_streams--;
+    writeHeaderIfReady();
+}
+
+void Muxer::writeHeaderIfReady()
+{
+    if(!m_fmtCtx || m_headerWritten || m_failed || (int)m_muxStreams.size() < m_streams)
+        return;
+    if(m_muxStreams.empty())
+    {
+        AV_LOG_E("no stream to mux into %s", m_filename.c_str());
+        m_failed = true;
+    }
+    else if(int ret = avformat_write_header(m_fmtCtx, nullptr); ret < 0)
+    {
+        char errors[1024];
+        av_strerror(ret, errors, sizeof(errors));
+        AV_LOG_E("Failed to write header of %s\nerror:%s", m_filename.c_str(), errors);
+        m_failed = true;
+    }
+    else
+    {
+        m_headerWritten = true;
+    }
+    m_headerCond.notify_all();
+}
+
+void Muxer::write(int streamIdx, AVPacket* pkt)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_headerCond.wait(lock, [&]() { return m_headerWritten || m_failed; });
+    if(m_failed || !m_fmtCtx || streamIdx < 0 || streamIdx >= (int)m_muxStreams.size())
+        return;
+
+    StageTimer       timer(Stage::WRITE, pkt->size);
+    const MuxStream& muxStream = m_muxStreams[streamIdx];
+    av_packet_rescale_ts(pkt,
+                         AVRational{muxStream.timeBaseNum, muxStream.timeBaseDen},
+                         m_fmtCtx->streams[streamIdx]->time_base);
+    pkt->stream_index = streamIdx;
+    // the muxer takes the reference of pkt
+    if(int ret = av_interleaved_write_frame(m_fmtCtx, pkt); ret < 0)
+    {
+        char errors[1024];
+        av_strerror(ret, errors, sizeof(errors));
+        AV_LOG_E("Failed to mux packet of stream %d\nerror:%s", streamIdx, errors);
+        return;
+    }
+    m_packets++;
+}
+
+void Muxer::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_fmtCtx)
+        return;
+    if(m_headerWritten)
+    {
+        av_write_trailer(m_fmtCtx);
+        AV_LOG_I("muxed %lu packets of %d streams into %s",
+                 m_packets,
+                 (int)m_muxStreams.size(),
+                 m_filename.c_str());
+    }
+    if(!(m_fmtCtx->oformat->flags & AVFMT_NOFILE))
+    {
+        avio_closep(&m_fmtCtx->pb);
+    }
+    avformat_free_context(m_fmtCtx);
+    m_fmtCtx = nullptr;
+    // nothing is written after close
+    m_failed = true;
+    m_headerCond.notify_all();
+}
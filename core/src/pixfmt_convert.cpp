@@ -0,0 +1,467 @@
+#include "pixfmt_convert.h"
+
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define PIXFMT_X86 1
+#    include <immintrin.h>
+#endif
+
+namespace
+{
+// line kernels, a converter is a loop of them
+struct PixFmtLineKernels
+{
+    // Y0 U0 Y1 V0 -> Y0 Y1
+    void (*yuyvToY)(const uint8_t* src, uint8_t* dstY, int width);
+    // average U/V of two YUYV lines
+    void (*yuyvToUV)(
+        const uint8_t* src0, const uint8_t* src1, uint8_t* dstU, uint8_t* dstV, int chromaWidth);
+    // U0 V0 U1 V1 -> U0 U1 / V0 V1
+    void (*deinterleaveUV)(const uint8_t* src, uint8_t* dstU, uint8_t* dstV, int chromaWidth);
+    // U0 U1 / V0 V1 -> U0 V0 U1 V1
+    void (*interleaveUV)(const uint8_t* srcU, const uint8_t* srcV, uint8_t* dst, int chromaWidth);
+    // (a + b + 1) >> 1
+    void (*averageLine)(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int width);
+};
+
+// -------------------------- C --------------------------
+void yuyvToYC(const uint8_t* src, uint8_t* dstY, int width)
+{
+    for(int i = 0; i < width; i++)
+    {
+        dstY[i] = src[2 * i];
+    }
+}
+
+void yuyvToUVC(
+    const uint8_t* src0, const uint8_t* src1, uint8_t* dstU, uint8_t* dstV, int chromaWidth)
+{
+    for(int i = 0; i < chromaWidth; i++)
+    {
+        dstU[i] = (src0[4 * i + 1] + src1[4 * i + 1] + 1) >> 1;
+        dstV[i] = (src0[4 * i + 3] + src1[4 * i + 3] + 1) >> 1;
+    }
+}
+
+void deinterleaveUVC(const uint8_t* src, uint8_t* dstU, uint8_t* dstV, int chromaWidth)
+{
+    for(int i = 0; i < chromaWidth; i++)
+    {
+        dstU[i] = src[2 * i];
+        dstV[i] = src[2 * i + 1];
+    }
+}
+
+void interleaveUVC(const uint8_t* srcU, const uint8_t* srcV, uint8_t* dst, int chromaWidth)
+{
+    for(int i = 0; i < chromaWidth; i++)
+    {
+        dst[2 * i]     = srcU[i];
+        dst[2 * i + 1] = srcV[i];
+    }
+}
+
+void averageLineC(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int width)
+{
+    for(int i = 0; i < width; i++)
+    {
+        dst[i] = (src0[i] + src1[i] + 1) >> 1;
+    }
+}
+
+const PixFmtLineKernels kKernelsC = {
+    yuyvToYC,
+    yuyvToUVC,
+    deinterleaveUVC,
+    interleaveUVC,
+    averageLineC,
+};
+
+#ifdef PIXFMT_X86
+// -------------------------- SSE2 --------------------------
+__attribute__((target("sse2"))) void yuyvToYSSE2(const uint8_t* src, uint8_t* dstY, int width)
+{
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    int           i       = 0;
+    for(; i + 16 <= width; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16));
+        __m128i y = _mm_packus_epi16(_mm_and_si128(a, lowMask), _mm_and_si128(b, lowMask));
+        _mm_storeu_si128((__m128i*)(dstY + i), y);
+    }
+    yuyvToYC(src + 2 * i, dstY + i, width - i);
+}
+
+__attribute__((target("sse2"))) void yuyvToUVSSE2(
+    const uint8_t* src0, const uint8_t* src1, uint8_t* dstU, uint8_t* dstV, int chromaWidth)
+{
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    const __m128i zero    = _mm_setzero_si128();
+    int           i       = 0;
+    for(; i + 8 <= chromaWidth; i += 8)
+    {
+        __m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(src0 + 4 * i)),
+                                 _mm_loadu_si128((const __m128i*)(src1 + 4 * i)));
+        __m128i b = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(src0 + 4 * i + 16)),
+                                 _mm_loadu_si128((const __m128i*)(src1 + 4 * i + 16)));
+        // U0 V0 U1 V1 ...
+        __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        __m128i u  = _mm_packus_epi16(_mm_and_si128(uv, lowMask), zero);
+        __m128i v  = _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero);
+        _mm_storel_epi64((__m128i*)(dstU + i), u);
+        _mm_storel_epi64((__m128i*)(dstV + i), v);
+    }
+    yuyvToUVC(src0 + 4 * i, src1 + 4 * i, dstU + i, dstV + i, chromaWidth - i);
+}
+
+__attribute__((target("sse2"))) void
+deinterleaveUVSSE2(const uint8_t* src, uint8_t* dstU, uint8_t* dstV, int chromaWidth)
+{
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    int           i       = 0;
+    for(; i + 16 <= chromaWidth; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16));
+        __m128i u = _mm_packus_epi16(_mm_and_si128(a, lowMask), _mm_and_si128(b, lowMask));
+        __m128i v = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i*)(dstU + i), u);
+        _mm_storeu_si128((__m128i*)(dstV + i), v);
+    }
+    deinterleaveUVC(src + 2 * i, dstU + i, dstV + i, chromaWidth - i);
+}
+
+__attribute__((target("sse2"))) void
+interleaveUVSSE2(const uint8_t* srcU, const uint8_t* srcV, uint8_t* dst, int chromaWidth)
+{
+    int i = 0;
+    for(; i + 16 <= chromaWidth; i += 16)
+    {
+        __m128i u = _mm_loadu_si128((const __m128i*)(srcU + i));
+        __m128i v = _mm_loadu_si128((const __m128i*)(srcV + i));
+        _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi8(u, v));
+        _mm_storeu_si128((__m128i*)(dst + 2 * i + 16), _mm_unpackhi_epi8(u, v));
+    }
+    interleaveUVC(srcU + i, srcV + i, dst + 2 * i, chromaWidth - i);
+}
+
+__attribute__((target("sse2"))) void
+averageLineSSE2(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int width)
+{
+    int i = 0;
+    for(; i + 16 <= width; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src1 + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_avg_epu8(a, b));
+    }
+    averageLineC(src0 + i, src1 + i, dst + i, width - i);
+}
+
+const PixFmtLineKernels kKernelsSSE2 = {
+    yuyvToYSSE2,
+    yuyvToUVSSE2,
+    deinterleaveUVSSE2,
+    interleaveUVSSE2,
+    averageLineSSE2,
+};
+
+// -------------------------- AVX2 --------------------------
+// _mm256_packus_epi16 works in 128 bit lane, qword order after pack is 0 2 1 3
+#    define PIXFMT_FIX_PACK_ORDER 0xD8
+
+__attribute__((target("avx2"))) void yuyvToYAVX2(const uint8_t* src, uint8_t* dstY, int width)
+{
+    const __m256i lowMask = _mm256_set1_epi16(0x00FF);
+    int           i       = 0;
+    for(; i + 32 <= width; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + 2 * i + 32));
+        __m256i y =
+            _mm256_packus_epi16(_mm256_and_si256(a, lowMask), _mm256_and_si256(b, lowMask));
+        _mm256_storeu_si256((__m256i*)(dstY + i),
+                            _mm256_permute4x64_epi64(y, PIXFMT_FIX_PACK_ORDER));
+    }
+    yuyvToYSSE2(src + 2 * i, dstY + i, width - i);
+}
+
+__attribute__((target("avx2"))) void yuyvToUVAVX2(
+    const uint8_t* src0, const uint8_t* src1, uint8_t* dstU, uint8_t* dstV, int chromaWidth)
+{
+    const __m256i lowMask = _mm256_set1_epi16(0x00FF);
+    int           i       = 0;
+    for(; i + 16 <= chromaWidth; i += 16)
+    {
+        __m256i a = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(src0 + 4 * i)),
+                                    _mm256_loadu_si256((const __m256i*)(src1 + 4 * i)));
+        __m256i b = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i*)(src0 + 4 * i + 32)),
+                                    _mm256_loadu_si256((const __m256i*)(src1 + 4 * i + 32)));
+        __m256i uv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        uv         = _mm256_permute4x64_epi64(uv, PIXFMT_FIX_PACK_ORDER);
+        // U0-7 V0-7 | U8-15 V8-15 -> U0-15 | V0-15
+        __m256i planar =
+            _mm256_packus_epi16(_mm256_and_si256(uv, lowMask), _mm256_srli_epi16(uv, 8));
+        planar = _mm256_permute4x64_epi64(planar, PIXFMT_FIX_PACK_ORDER);
+        _mm_storeu_si128((__m128i*)(dstU + i), _mm256_castsi256_si128(planar));
+        _mm_storeu_si128((__m128i*)(dstV + i), _mm256_extracti128_si256(planar, 1));
+    }
+    yuyvToUVSSE2(src0 + 4 * i, src1 + 4 * i, dstU + i, dstV + i, chromaWidth - i);
+}
+
+__attribute__((target("avx2"))) void
+deinterleaveUVAVX2(const uint8_t* src, uint8_t* dstU, uint8_t* dstV, int chromaWidth)
+{
+    const __m256i lowMask = _mm256_set1_epi16(0x00FF);
+    int           i       = 0;
+    for(; i + 32 <= chromaWidth; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + 2 * i + 32));
+        __m256i u =
+            _mm256_packus_epi16(_mm256_and_si256(a, lowMask), _mm256_and_si256(b, lowMask));
+        __m256i v = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i*)(dstU + i),
+                            _mm256_permute4x64_epi64(u, PIXFMT_FIX_PACK_ORDER));
+        _mm256_storeu_si256((__m256i*)(dstV + i),
+                            _mm256_permute4x64_epi64(v, PIXFMT_FIX_PACK_ORDER));
+    }
+    deinterleaveUVSSE2(src + 2 * i, dstU + i, dstV + i, chromaWidth - i);
+}
+
+__attribute__((target("avx2"))) void
+interleaveUVAVX2(const uint8_t* srcU, const uint8_t* srcV, uint8_t* dst, int chromaWidth)
+{
+    int i = 0;
+    for(; i + 32 <= chromaWidth; i += 32)
+    {
+        // unpack works in 128 bit lane, so put U0-7/U8-15 in low lane and U16-23/U24-31 in high
+        __m256i u = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)(srcU + i)),
+                                             PIXFMT_FIX_PACK_ORDER);
+        __m256i v = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)(srcV + i)),
+                                             PIXFMT_FIX_PACK_ORDER);
+        _mm256_storeu_si256((__m256i*)(dst + 2 * i), _mm256_unpacklo_epi8(u, v));
+        _mm256_storeu_si256((__m256i*)(dst + 2 * i + 32), _mm256_unpackhi_epi8(u, v));
+    }
+    interleaveUVSSE2(srcU + i, srcV + i, dst + 2 * i, chromaWidth - i);
+}
+
+__attribute__((target("avx2"))) void
+averageLineAVX2(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int width)
+{
+    int i = 0;
+    for(; i + 32 <= width; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src0 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src1 + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_avg_epu8(a, b));
+    }
+    averageLineSSE2(src0 + i, src1 + i, dst + i, width - i);
+}
+
+const PixFmtLineKernels kKernelsAVX2 = {
+    yuyvToYAVX2,
+    yuyvToUVAVX2,
+    deinterleaveUVAVX2,
+    interleaveUVAVX2,
+    averageLineAVX2,
+};
+#endif
+
+const PixFmtLineKernels& selectKernels(SimdLevel level)
+{
+#ifdef PIXFMT_X86
+    if(level == SimdLevel::AVX2)
+    {
+        return kKernelsAVX2;
+    }
+    if(level == SimdLevel::SSE2)
+    {
+        return kKernelsSSE2;
+    }
+#endif
+    return kKernelsC;
+}
+
+void copyPlane(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride, int width, int height)
+{
+    for(int y = 0; y < height; y++)
+    {
+        memcpy(dst + y * dstStride, src + y * srcStride, width);
+    }
+}
+
+// -------------------------- converters --------------------------
+void yuyv422ToYuv420p(const PixFmtLineKernels& k,
+                      uint8_t* const           src[],
+                      const int                srcStride[],
+                      uint8_t* const           dst[],
+                      const int                dstStride[],
+                      int                      width,
+                      int                      height)
+{
+    int chromaWidth = (width + 1) / 2;
+    for(int y = 0; y < height; y += 2)
+    {
+        const uint8_t* line0 = src[0] + y * srcStride[0];
+        // odd height, the last chroma line come from one line
+        const uint8_t* line1 = y + 1 < height ? line0 + srcStride[0] : line0;
+
+        k.yuyvToY(line0, dst[0] + y * dstStride[0], width);
+        if(y + 1 < height)
+        {
+            k.yuyvToY(line1, dst[0] + (y + 1) * dstStride[0], width);
+        }
+        k.yuyvToUV(line0,
+                   line1,
+                   dst[1] + y / 2 * dstStride[1],
+                   dst[2] + y / 2 * dstStride[2],
+                   chromaWidth);
+    }
+}
+
+void nv12ToYuv420p(const PixFmtLineKernels& k,
+                   uint8_t* const           src[],
+                   const int                srcStride[],
+                   uint8_t* const           dst[],
+                   const int                dstStride[],
+                   int                      width,
+                   int                      height)
+{
+    copyPlane(src[0], srcStride[0], dst[0], dstStride[0], width, height);
+    int chromaWidth  = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    for(int y = 0; y < chromaHeight; y++)
+    {
+        k.deinterleaveUV(src[1] + y * srcStride[1],
+                         dst[1] + y * dstStride[1],
+                         dst[2] + y * dstStride[2],
+                         chromaWidth);
+    }
+}
+
+void yuv420pToNv12(const PixFmtLineKernels& k,
+                   uint8_t* const           src[],
+                   const int                srcStride[],
+                   uint8_t* const           dst[],
+                   const int                dstStride[],
+                   int                      width,
+                   int                      height)
+{
+    copyPlane(src[0], srcStride[0], dst[0], dstStride[0], width, height);
+    int chromaWidth  = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    for(int y = 0; y < chromaHeight; y++)
+    {
+        k.interleaveUV(src[1] + y * srcStride[1],
+                       src[2] + y * srcStride[2],
+                       dst[1] + y * dstStride[1],
+                       chromaWidth);
+    }
+}
+
+void yuv422pToYuv420p(const PixFmtLineKernels& k,
+                      uint8_t* const           src[],
+                      const int                srcStride[],
+                      uint8_t* const           dst[],
+                      const int                dstStride[],
+                      int                      width,
+                      int                      height)
+{
+    copyPlane(src[0], srcStride[0], dst[0], dstStride[0], width, height);
+    int chromaWidth = (width + 1) / 2;
+    for(int plane = 1; plane < 3; plane++)
+    {
+        for(int y = 0; y < height; y += 2)
+        {
+            const uint8_t* line0 = src[plane] + y * srcStride[plane];
+            const uint8_t* line1 = y + 1 < height ? line0 + srcStride[plane] : line0;
+            k.averageLine(line0, line1, dst[plane] + y / 2 * dstStride[plane], chromaWidth);
+        }
+    }
+}
+
+using PixFmtConverter = void (*)(const PixFmtLineKernels&,
+                                 uint8_t* const[],
+                                 const int[],
+                                 uint8_t* const[],
+                                 const int[],
+                                 int,
+                                 int);
+
+PixFmtConverter findConverter(int srcPixFmt, int dstPixFmt)
+{
+    if(srcPixFmt == AV_PIX_FMT_YUYV422 && dstPixFmt == AV_PIX_FMT_YUV420P)
+    {
+        return yuyv422ToYuv420p;
+    }
+    if(srcPixFmt == AV_PIX_FMT_NV12 && dstPixFmt == AV_PIX_FMT_YUV420P)
+    {
+        return nv12ToYuv420p;
+    }
+    if(srcPixFmt == AV_PIX_FMT_YUV420P && dstPixFmt == AV_PIX_FMT_NV12)
+    {
+        return yuv420pToNv12;
+    }
+    if(srcPixFmt == AV_PIX_FMT_YUV422P && dstPixFmt == AV_PIX_FMT_YUV420P)
+    {
+        return yuv422pToYuv420p;
+    }
+    return nullptr;
+}
+} // namespace
+
+bool hasPixFmtKernel(int srcPixFmt, int dstPixFmt)
+{
+    return findConverter(srcPixFmt, dstPixFmt) != nullptr;
+}
+
+bool convertPixFmt(uint8_t* const src[],
+                   const int      srcStride[],
+                   int            srcPixFmt,
+                   uint8_t* const dst[],
+                   const int      dstStride[],
+                   int            dstPixFmt,
+                   int            width,
+                   int            height,
+                   SimdLevel      level)
+{
+    PixFmtConverter converter = findConverter(srcPixFmt, dstPixFmt);
+    if(!converter)
+    {
+        return false;
+    }
+    // never use an instruction set the cpu doesn't have
+    if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+    {
+        level = cpuSimdLevel();
+    }
+    converter(selectKernels(level), src, srcStride, dst, dstStride, width, height);
+    return true;
+}
+
+int convertDeprecatedFormat(int format)
+{
+    switch(format)
+    {
+    case AV_PIX_FMT_YUVJ420P:
+        return AV_PIX_FMT_YUV420P;
+    case AV_PIX_FMT_YUVJ422P:
+        return AV_PIX_FMT_YUV422P;
+    case AV_PIX_FMT_YUVJ444P:
+        return AV_PIX_FMT_YUV444P;
+    case AV_PIX_FMT_YUVJ440P:
+        return AV_PIX_FMT_YUV440P;
+    case AV_PIX_FMT_YUVJ411P:
+        return AV_PIX_FMT_YUV411P;
+    default:
+        return format;
+    }
+}
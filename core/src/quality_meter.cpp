@@ -0,0 +1,518 @@
+#include "quality_meter.h"
+#include "../../utils/include/log.h"
+#include "codec.h"
+#include "frame.h"
+#include "pixfmt_convert.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define QUALITY_X86 1
+#    include <immintrin.h>
+#endif
+
+namespace
+{
+// psnr of identical planes
+constexpr double kMaxPsnr = 100.0;
+
+// sum of s1, s2, ss(a*a + b*b), s12 of a 4x4 block
+using SsimBlockSums = std::array<int, 4>;
+
+struct QualityKernels
+{
+    // sum of squared error of a line
+    uint64_t (*sseLine)(const uint8_t* a, const uint8_t* b, int width);
+    // sums of two horizontally adjacent 4x4 blocks
+    void (*ssim4x4x2)(
+        const uint8_t* a, int strideA, const uint8_t* b, int strideB, SsimBlockSums sums[2]);
+};
+
+// -------------------------- C --------------------------
+uint64_t sseLineC(const uint8_t* a, const uint8_t* b, int width)
+{
+    uint64_t sse = 0;
+    for(int i = 0; i < width; i++)
+    {
+        int diff = a[i] - b[i];
+        sse += diff * diff;
+    }
+    return sse;
+}
+
+void ssim4x4C(const uint8_t* a, int strideA, const uint8_t* b, int strideB, SsimBlockSums& sums)
+{
+    int s1 = 0, s2 = 0, ss = 0, s12 = 0;
+    for(int y = 0; y < 4; y++)
+    {
+        for(int x = 0; x < 4; x++)
+        {
+            int pa = a[y * strideA + x];
+            int pb = b[y * strideB + x];
+            s1 += pa;
+            s2 += pb;
+            ss += pa * pa + pb * pb;
+            s12 += pa * pb;
+        }
+    }
+    sums = {s1, s2, ss, s12};
+}
+
+void ssim4x4x2C(const uint8_t* a, int strideA, const uint8_t* b, int strideB, SsimBlockSums sums[2])
+{
+    ssim4x4C(a, strideA, b, strideB, sums[0]);
+    ssim4x4C(a + 4, strideA, b + 4, strideB, sums[1]);
+}
+
+const QualityKernels kKernelsC = {
+    sseLineC,
+    ssim4x4x2C,
+};
+
+#ifdef QUALITY_X86
+// -------------------------- SSE2 --------------------------
+__attribute__((target("sse2"))) uint64_t sseLineSSE2(const uint8_t* a, const uint8_t* b, int width)
+{
+    // 260100 at most every loop for a 32 bit lane, no overflow for 8K line
+    const __m128i zero = _mm_setzero_si128();
+    __m128i       acc  = _mm_setzero_si128();
+    int           i    = 0;
+    for(; i + 16 <= width; i += 16)
+    {
+        __m128i x  = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y  = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(y, zero));
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(y, zero));
+        acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    }
+    alignas(16) uint32_t lanes[4];
+    _mm_store_si128((__m128i*)lanes, acc);
+    return (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3] + sseLineC(a + i, b + i, width - i);
+}
+
+__attribute__((target("sse2"))) void
+ssim4x4x2SSE2(const uint8_t* a, int strideA, const uint8_t* b, int strideB, SsimBlockSums sums[2])
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i       s1   = _mm_setzero_si128();
+    __m128i       s2   = _mm_setzero_si128();
+    __m128i       ss   = _mm_setzero_si128();
+    __m128i       s12  = _mm_setzero_si128();
+    for(int y = 0; y < 4; y++)
+    {
+        __m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(a + y * strideA)), zero);
+        __m128i z = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(b + y * strideB)), zero);
+        s1        = _mm_add_epi16(s1, x);
+        s2        = _mm_add_epi16(s2, z);
+        ss  = _mm_add_epi32(ss, _mm_add_epi32(_mm_madd_epi16(x, x), _mm_madd_epi16(z, z)));
+        s12 = _mm_add_epi32(s12, _mm_madd_epi16(x, z));
+    }
+    // all in 32 bit lanes, lane 0/1 for block 0 and lane 2/3 for block 1
+    const __m128i one = _mm_set1_epi16(1);
+    alignas(16) int lanes[4][4];
+    _mm_store_si128((__m128i*)lanes[0], _mm_madd_epi16(s1, one));
+    _mm_store_si128((__m128i*)lanes[1], _mm_madd_epi16(s2, one));
+    _mm_store_si128((__m128i*)lanes[2], ss);
+    _mm_store_si128((__m128i*)lanes[3], s12);
+    for(int i = 0; i < 4; i++)
+    {
+        sums[0][i] = lanes[i][0] + lanes[i][1];
+        sums[1][i] = lanes[i][2] + lanes[i][3];
+    }
+}
+
+const QualityKernels kKernelsSSE2 = {
+    sseLineSSE2,
+    ssim4x4x2SSE2,
+};
+
+// -------------------------- AVX2 --------------------------
+__attribute__((target("avx2"))) uint64_t sseLineAVX2(const uint8_t* a, const uint8_t* b, int width)
+{
+    __m256i acc = _mm256_setzero_si256();
+    int     i   = 0;
+    for(; i + 32 <= width; i += 32)
+    {
+        __m256i x  = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i y  = _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(x, _mm256_setzero_si256()),
+                                      _mm256_unpacklo_epi8(y, _mm256_setzero_si256()));
+        __m256i hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(x, _mm256_setzero_si256()),
+                                      _mm256_unpackhi_epi8(y, _mm256_setzero_si256()));
+        acc        = _mm256_add_epi32(
+            acc, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+    }
+    alignas(32) uint32_t lanes[8];
+    _mm256_store_si256((__m256i*)lanes, acc);
+    uint64_t sse = 0;
+    for(uint32_t lane : lanes)
+    {
+        sse += lane;
+    }
+    return sse + sseLineSSE2(a + i, b + i, width - i);
+}
+
+// 4x4 block is too small for 256 bit, use sse2 version
+const QualityKernels kKernelsAVX2 = {
+    sseLineAVX2,
+    ssim4x4x2SSE2,
+};
+#endif
+
+const QualityKernels& selectKernels(SimdLevel level)
+{
+#ifdef QUALITY_X86
+    if(level == SimdLevel::AVX2)
+    {
+        return kKernelsAVX2;
+    }
+    if(level == SimdLevel::SSE2)
+    {
+        return kKernelsSSE2;
+    }
+#endif
+    return kKernelsC;
+}
+
+bool isSupported(const AVPixFmtDescriptor* desc)
+{
+    if(!desc || (desc->flags & AV_PIX_FMT_FLAG_RGB) || desc->comp[0].depth != 8)
+    {
+        return false;
+    }
+    // gray or planar yuv without alpha
+    return desc->nb_components == 1 ||
+           (desc->nb_components == 3 && (desc->flags & AV_PIX_FMT_FLAG_PLANAR));
+}
+
+// same as AV_CEIL_RSHIFT
+int ceilShift(int value, int shift)
+{
+    return -((-value) >> shift);
+}
+
+double psnr(uint64_t sse, int64_t samples)
+{
+    if(sse == 0 || samples == 0)
+    {
+        return kMaxPsnr;
+    }
+    return std::min(kMaxPsnr, 10.0 * log10(255.0 * 255.0 * samples / sse));
+}
+
+// ssim of a 8x8 window from the sums of its four 4x4 blocks, the same as x264/vf_ssim
+double ssimWindow(const SsimBlockSums& b0,
+                  const SsimBlockSums& b1,
+                  const SsimBlockSums& b2,
+                  const SsimBlockSums& b3)
+{
+    static const float c1 = .01 * .01 * 255 * 255 * 64;
+    static const float c2 = .03 * .03 * 255 * 255 * 64 * 63;
+
+    float s1    = b0[0] + b1[0] + b2[0] + b3[0];
+    float s2    = b0[1] + b1[1] + b2[1] + b3[1];
+    float ss    = b0[2] + b1[2] + b2[2] + b3[2];
+    float s12   = b0[3] + b1[3] + b2[3] + b3[3];
+    float vars  = ss * 64 - s1 * s1 - s2 * s2;
+    float covar = s12 * 64 - s1 * s2;
+    return (2 * s1 * s2 + c1) * (2 * covar + c2) / ((s1 * s1 + s2 * s2 + c1) * (vars + c2));
+}
+
+// average ssim of 8x8 windows with 4 pixels step
+double ssimPlane(const QualityKernels& k,
+                 const uint8_t*        a,
+                 int                   strideA,
+                 const uint8_t*        b,
+                 int                   strideB,
+                 int                   width,
+                 int                   height)
+{
+    int blocksW = width / 4;
+    int blocksH = height / 4;
+    if(blocksW < 2 || blocksH < 2)
+    {
+        return 1.0;
+    }
+    std::vector<SsimBlockSums> prev(blocksW);
+    std::vector<SsimBlockSums> cur(blocksW);
+    double                     ssim = 0;
+    for(int y = 0; y < blocksH; y++)
+    {
+        std::swap(prev, cur);
+        const uint8_t* lineA = a + 4 * y * strideA;
+        const uint8_t* lineB = b + 4 * y * strideB;
+        int            x     = 0;
+        for(; x + 2 <= blocksW; x += 2)
+        {
+            k.ssim4x4x2(lineA + 4 * x, strideA, lineB + 4 * x, strideB, &cur[x]);
+        }
+        if(x < blocksW)
+        {
+            ssim4x4C(lineA + 4 * x, strideA, lineB + 4 * x, strideB, cur[x]);
+        }
+        if(y == 0)
+        {
+            continue;
+        }
+        for(x = 0; x + 1 < blocksW; x++)
+        {
+            ssim += ssimWindow(prev[x], prev[x + 1], cur[x], cur[x + 1]);
+        }
+    }
+    return ssim / ((blocksW - 1) * (blocksH - 1));
+}
+} // namespace
+
+QualityMeter::QualityMeter(const QualityMeterParam& param, std::shared_ptr<Codec> encoder)
+    : m_param(param)
+{
+    const AVPixFmtDescriptor* desc =
+        av_pix_fmt_desc_get((AVPixelFormat)convertDeprecatedFormat(param.pixFmt));
+    if(!isSupported(desc))
+    {
+        AV_LOG_E("quality meter can't support pix fmt %d", param.pixFmt);
+        return;
+    }
+    if(!encoder || !encoder->encodeEnable())
+    {
+        AV_LOG_E("quality meter need an opened encoder");
+        return;
+    }
+
+    // decoder for the output of encoder
+    AVCodecContext*    encodeCtx = encoder->getCodecCtx(true);
+    AVCodecParameters* codecPar  = avcodec_parameters_alloc();
+    if(!codecPar || avcodec_parameters_from_context(codecPar, encodeCtx) < 0)
+    {
+        AV_LOG_E("failed to get codec parameters of encoder");
+        avcodec_parameters_free(&codecPar);
+        return;
+    }
+    DecoderParam decodeParam{.needDecode = true,
+                             .codecId    = encodeCtx->codec_id,
+                             .avCodecPar = codecPar,
+                             .byId       = true};
+    CodecParam   codecParam = {.decodeParam = decodeParam};
+    m_decoder               = std::make_shared<VideoCodec>(codecParam);
+    avcodec_parameters_free(&codecPar);
+    if(!m_decoder->decodeEnable())
+    {
+        AV_LOG_E("failed to open decoder for quality meter");
+        return;
+    }
+    m_decodeFrame = std::make_shared<Frame>();
+
+    // source frames wait for the encoder delay, take them from a pool
+    m_pool = std::make_unique<FrameBufferPool>(
+        Frame::videoBufferSize(param.width, param.height, param.pixFmt), FrameAllocType::DEFAULT);
+
+    m_samplesPerFrame = (int64_t)param.width * param.height;
+    if(desc->nb_components == 3)
+    {
+        m_samplesPerFrame += 2 * (int64_t)ceilShift(param.width, desc->log2_chroma_w) *
+                             ceilShift(param.height, desc->log2_chroma_h);
+    }
+    m_valid = m_decodeFrame->isValid() && m_pool->isValid();
+    AV_LOG_D("quality meter of %dx%d fmt %d, decoder %s",
+             param.width,
+             param.height,
+             param.pixFmt,
+             m_decoder->codecName(false));
+}
+
+QualityMeter::~QualityMeter()
+{
+    // source frames has to be released before the pool
+    m_sources.clear();
+}
+
+void QualityMeter::addSource(std::shared_ptr<Frame> frame)
+{
+    if(!m_valid)
+        return;
+
+    VideoFrameParam vFrameParam{
+        .enable    = true,
+        .width     = m_param.width,
+        .height    = m_param.height,
+        .pixFormat = frame->format(),
+        .pool      = m_pool.get(),
+    };
+    auto source = std::make_shared<Frame>(vFrameParam);
+    if(!source->isValid() || av_frame_copy(source->getAVFrame(), frame->getAVFrame()) < 0)
+    {
+        AV_LOG_W("failed to copy source frame of pts %ld", frame->getAVFrame()->pts);
+        return;
+    }
+    m_sources[frame->getAVFrame()->pts] = source;
+}
+
+void QualityMeter::addPacket(AVPacket* pkt)
+{
+    if(!m_valid)
+        return;
+    m_decoder->decode(
+        m_decodeFrame, pkt, [this](std::shared_ptr<Frame> frame) { onDecodedFrame(frame); });
+}
+
+void QualityMeter::flush()
+{
+    if(!m_valid)
+        return;
+    m_decoder->decode(
+        m_decodeFrame,
+        nullptr,
+        [this](std::shared_ptr<Frame> frame) { onDecodedFrame(frame); },
+        true);
+    m_sources.clear();
+}
+
+void QualityMeter::onDecodedFrame(std::shared_ptr<Frame> frame)
+{
+    AVFrame* decoded = frame->getAVFrame();
+    int64_t  pts = decoded->pts != AV_NOPTS_VALUE ? decoded->pts : decoded->best_effort_timestamp;
+    auto     it  = m_sources.find(pts);
+    if(it == m_sources.end())
+    {
+        AV_LOG_W("can't find source frame of pts %ld", pts);
+        return;
+    }
+
+    FrameQuality quality;
+    if(measure(it->second->getAVFrame(), decoded, quality))
+    {
+        m_frames++;
+        for(int i = 0; i < 3; i++)
+        {
+            m_psnrSum[i] += quality.psnr[i];
+            m_ssimSum[i] += quality.ssim[i];
+            m_sseSum += quality.sse[i];
+        }
+        m_psnrAllSum += quality.psnrAll;
+        m_ssimAllSum += quality.ssimAll;
+        if(m_param.logPerFrame)
+        {
+            AV_LOG_I("pts %ld PSNR y:%.3f u:%.3f v:%.3f all:%.3f SSIM y:%.5f u:%.5f v:%.5f all:%.5f",
+                     pts,
+                     quality.psnr[0],
+                     quality.psnr[1],
+                     quality.psnr[2],
+                     quality.psnrAll,
+                     quality.ssim[0],
+                     quality.ssim[1],
+                     quality.ssim[2],
+                     quality.ssimAll);
+        }
+    }
+    // frames before it are dropped by encoder, they will never come
+    m_sources.erase(m_sources.begin(), std::next(it));
+}
+
+QualityStats QualityMeter::stats() const
+{
+    QualityStats stats;
+    stats.frames = m_frames;
+    if(m_frames == 0)
+    {
+        return stats;
+    }
+    for(int i = 0; i < 3; i++)
+    {
+        stats.psnrMean[i] = m_psnrSum[i] / m_frames;
+        stats.ssimMean[i] = m_ssimSum[i] / m_frames;
+    }
+    stats.psnrAllMean = m_psnrAllSum / m_frames;
+    stats.ssimAllMean = m_ssimAllSum / m_frames;
+    stats.psnrGlobal  = psnr(m_sseSum, m_samplesPerFrame * m_frames);
+    return stats;
+}
+
+void QualityMeter::logSummary() const
+{
+    QualityStats s = stats();
+    AV_LOG_I("frames %ld PSNR y:%.3f u:%.3f v:%.3f mean:%.3f global:%.3f SSIM y:%.5f u:%.5f "
+             "v:%.5f all:%.5f",
+             s.frames,
+             s.psnrMean[0],
+             s.psnrMean[1],
+             s.psnrMean[2],
+             s.psnrAllMean,
+             s.psnrGlobal,
+             s.ssimMean[0],
+             s.ssimMean[1],
+             s.ssimMean[2],
+             s.ssimAllMean);
+}
+
+bool QualityMeter::measure(const AVFrame*  ref,
+                           const AVFrame*  dist,
+                           FrameQuality&   quality,
+                           SimdLevel       level)
+{
+    int pixFmt = convertDeprecatedFormat(ref->format);
+    if(pixFmt != convertDeprecatedFormat(dist->format) || ref->width != dist->width ||
+       ref->height != dist->height)
+    {
+        AV_LOG_W("can't compare %dx%d fmt %d with %dx%d fmt %d",
+                 ref->width,
+                 ref->height,
+                 ref->format,
+                 dist->width,
+                 dist->height,
+                 dist->format);
+        return false;
+    }
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)pixFmt);
+    if(!isSupported(desc))
+    {
+        return false;
+    }
+    // never use an instruction set the cpu doesn't have
+    if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+    {
+        level = cpuSimdLevel();
+    }
+    const QualityKernels& k = selectKernels(level);
+
+    uint64_t sseAll     = 0;
+    int64_t  samplesAll = 0;
+    double   ssimAll    = 0;
+    for(int plane = 0; plane < desc->nb_components; plane++)
+    {
+        int width  = plane == 0 ? ref->width : ceilShift(ref->width, desc->log2_chroma_w);
+        int height = plane == 0 ? ref->height : ceilShift(ref->height, desc->log2_chroma_h);
+
+        uint64_t sse = 0;
+        for(int y = 0; y < height; y++)
+        {
+            sse += k.sseLine(ref->data[plane] + y * ref->linesize[plane],
+                             dist->data[plane] + y * dist->linesize[plane],
+                             width);
+        }
+        quality.sse[plane]  = sse;
+        quality.psnr[plane] = psnr(sse, (int64_t)width * height);
+        quality.ssim[plane] = ssimPlane(k,
+                                        ref->data[plane],
+                                        ref->linesize[plane],
+                                        dist->data[plane],
+                                        dist->linesize[plane],
+                                        width,
+                                        height);
+        sseAll += sse;
+        samplesAll += (int64_t)width * height;
+        ssimAll += quality.ssim[plane] * width * height;
+    }
+    quality.psnrAll = psnr(sseAll, samplesAll);
+    quality.ssimAll = ssimAll / samplesAll;
+    return true;
+}
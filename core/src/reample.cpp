@@ -1,11 +1,19 @@
 #include "../../utils/include/log.h"
 #include "device.h"
+#include "frame.h"
+#include "job_metrics.h"
+#include "pixfmt_convert.h"
 #include "resample.h"
+#include "sample_convert.h"
+#include "trace.h"
+#include <algorithm>
 #include <cmath>
 
 extern "C"
 {
+#include <libavutil/frame.h>
 #include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
 }
 
 SwrConvertor::SwrConvertor(const ReampleParam& resampleParam)
@@ -30,34 +38,52 @@ SwrConvertor::SwrConvertor(const ReampleParam& resampleParam)
     m_inSampleSize  = av_get_bytes_per_sample(resampleParam.inSampleFmt);
     m_outSampleSize = av_get_bytes_per_sample(resampleParam.outSampleFmt);
 
-    m_swrCtx = swr_alloc_set_opts(nullptr,
-                                  resampleParam.outChannelLayout,
-                                  resampleParam.outSampleFmt,
-                                  resampleParam.outSampleRate,
-                                  resampleParam.inChannelLayout,
-                                  resampleParam.inSampleFmt,
-                                  resampleParam.inSampleRate,
-                                  resampleParam.logOffset,
-                                  resampleParam.logCtx);
-
-    if(!m_swrCtx)
+    if(resampleParam.inChannelLayout == resampleParam.outChannelLayout &&
+       resampleParam.inSampleRate == resampleParam.outSampleRate &&
+       hasSampleFmtKernel(resampleParam.inSampleFmt, resampleParam.outSampleFmt))
     {
-        AV_LOG_E("failed to alloct swr context.");
-        return;
+        // only sample format is changed
+        m_useKernel  = true;
+        m_planarTemp = av_sample_fmt_is_planar(resampleParam.outSampleFmt);
+        AV_LOG_D("use %s kernel for sample fmt %d -> %d",
+                 simdLevelName(cpuSimdLevel()),
+                 resampleParam.inSampleFmt,
+                 resampleParam.outSampleFmt);
     }
-
-    if(swr_init(m_swrCtx) < 0)
+    else
     {
-        AV_LOG_E("failed to init swr context.");
-        return;
+        m_swrCtx = swr_alloc_set_opts(nullptr,
+                                      resampleParam.outChannelLayout,
+                                      resampleParam.outSampleFmt,
+                                      resampleParam.outSampleRate,
+                                      resampleParam.inChannelLayout,
+                                      resampleParam.inSampleFmt,
+                                      resampleParam.inSampleRate,
+                                      resampleParam.logOffset,
+                                      resampleParam.logCtx);
+
+        if(!m_swrCtx)
+        {
+            AV_LOG_E("failed to alloct swr context.");
+            return;
+        }
+
+        if(swr_init(m_swrCtx) < 0)
+        {
+            AV_LOG_E("failed to init swr context.");
+            return;
+        }
     }
 
-    m_tempData =
-        static_cast<uint8_t*>(av_malloc(resampleParam.fullOutputBufferSize * TEMP_BUFFER_RATIO));
+    m_tempPlanes.resize(m_planarTemp ? m_outChannel : 1);
+    int align        = (int)m_tempPlanes.size() * m_outSampleSize;
+    m_tempBufferSize = resampleParam.fullOutputBufferSize * TEMP_BUFFER_RATIO;
+    m_tempBufferSize = (m_tempBufferSize + align - 1) / align * align;
+    m_tempData       = static_cast<uint8_t*>(av_malloc(m_tempBufferSize));
     m_curOutputBufferSize  = 0;
     m_fullOutputBufferSize = resampleParam.fullOutputBufferSize;
     AV_LOG_D("tempBufferSize %d m_fullOutputBufferSize %d",
-             resampleParam.fullOutputBufferSize * TEMP_BUFFER_RATIO,
+             m_tempBufferSize,
              m_fullOutputBufferSize);
 }
 
@@ -79,6 +105,10 @@ SwrConvertor::~SwrConvertor()
 std::pair<uint8_t**, int> SwrConvertor::convert(
     uint8_t** srcData, int srcSize, uint8_t** dstData, int inSamples, int outSamples)
 {
+    StageTimer timer(Stage::RESAMPLE, srcSize);
+    if(m_useKernel)
+        return convertByKernel(srcData, srcSize, dstData, inSamples);
+
     if(!m_swrCtx)
         return {nullptr, 0};
 
@@ -93,6 +123,8 @@ std::pair<uint8_t**, int> SwrConvertor::convert(
         return {nullptr, 0};
     }
     int outBufferSize = nbSampleOutput * m_outChannel * m_outSampleSize;
+    if(!reserveTempBuffer(m_curOutputBufferSize + outBufferSize))
+        return {nullptr, 0};
     memcpy(m_tempData + m_curOutputBufferSize, dstData[0], outBufferSize);
 
     m_curOutputBufferSize += outBufferSize;
@@ -101,17 +133,17 @@ std::pair<uint8_t**, int> SwrConvertor::convert(
     while((nbSampleRemain = swr_convert(m_swrCtx, dstData, outSamples, NULL, 0)) > 0)
     {
         int remainOutputBufferSize = nbSampleRemain * m_outChannel * m_outSampleSize;
+        if(!reserveTempBuffer(m_curOutputBufferSize + remainOutputBufferSize))
+            return {nullptr, 0};
         memcpy(m_tempData + m_curOutputBufferSize, dstData[0], remainOutputBufferSize);
         m_curOutputBufferSize += remainOutputBufferSize;
     }
 
     if(m_curOutputBufferSize >= m_fullOutputBufferSize)
     {
-        memcpy(dstData[0], m_tempData, m_fullOutputBufferSize);
-        m_curOutputBufferSize -= m_fullOutputBufferSize;
-        memcpy(m_tempData, m_tempData + m_fullOutputBufferSize, m_curOutputBufferSize);
-        return {dstData, m_fullOutputBufferSize};
+        return popOutput(dstData, m_fullOutputBufferSize);
     }
+    traceCounter("swr buffered bytes", m_curOutputBufferSize);
     return {nullptr, 0};
 }
 
@@ -128,23 +160,341 @@ std::pair<uint8_t**, int> SwrConvertor::flushRemain(uint8_t** dstData)
         {
             outBufferSize = m_curOutputBufferSize;
         }
-        memcpy(dstData[0], m_tempData, outBufferSize);
-        m_curOutputBufferSize -= outBufferSize;
-        if(m_curOutputBufferSize > 0)
-            memcpy(m_tempData, m_tempData + outBufferSize, m_curOutputBufferSize);
-        return {dstData, outBufferSize};
+        return popOutput(dstData, outBufferSize);
     }
     return {nullptr, 0};
 }
 
+bool SwrConvertor::flushDelay(uint8_t** dstData, int outSamples)
+{
+    // the kernel converts sample by sample without delay
+    if(!m_swrCtx)
+        return true;
+
+    int nbSampleRemain = 0;
+    while((nbSampleRemain = swr_convert(m_swrCtx, dstData, outSamples, NULL, 0)) > 0)
+    {
+        int remainOutputBufferSize = nbSampleRemain * m_outChannel * m_outSampleSize;
+        if(!reserveTempBuffer(m_curOutputBufferSize + remainOutputBufferSize))
+            return false;
+        memcpy(m_tempData + m_curOutputBufferSize, dstData[0], remainOutputBufferSize);
+        m_curOutputBufferSize += remainOutputBufferSize;
+    }
+    if(nbSampleRemain < 0)
+    {
+        char errors[1024];
+        av_strerror(nbSampleRemain, errors, sizeof(errors));
+        AV_LOG_E("flush swr error:%s", errors);
+        return false;
+    }
+    traceCounter("swr buffered bytes", m_curOutputBufferSize);
+    return true;
+}
+
 int64_t SwrConvertor::calcNBSample(int inSampleRate, int inNBSample, int outSampleRate)
 {
     if(!enable())
     {
         return -1;
     }
-    return av_rescale_rnd(swr_get_delay(m_swrCtx, inSampleRate) + inNBSample,
-                          outSampleRate,
-                          inSampleRate,
-                          AV_ROUND_UP);
-}
\ No newline at end of file
+    int64_t delay = m_swrCtx ? swr_get_delay(m_swrCtx, inSampleRate) : 0;
+    return av_rescale_rnd(delay + inNBSample, outSampleRate, inSampleRate, AV_ROUND_UP);
+}
+
+std::pair<uint8_t**, int>
+SwrConvertor::convertByKernel(uint8_t** srcData, int srcSize, uint8_t** dstData, int inSamples)
+{
+    // packed input from device/file may be shorter than inSamples
+    int nbSamples = inSamples;
+    if(!av_sample_fmt_is_planar(m_ctxParam.inSampleFmt) && srcSize > 0)
+    {
+        nbSamples = std::min(inSamples, srcSize / (m_inChannel * m_inSampleSize));
+    }
+    int outBufferSize = nbSamples * m_outChannel * m_outSampleSize;
+    if(nbSamples <= 0 || !reserveTempBuffer(m_curOutputBufferSize + outBufferSize))
+        return {nullptr, 0};
+
+    // planar output keep every plane in its own region of temp buffer
+    int planeSize = m_tempBufferSize / (int)m_tempPlanes.size();
+    int planeUsed = m_curOutputBufferSize / (int)m_tempPlanes.size();
+    for(size_t i = 0; i < m_tempPlanes.size(); i++)
+    {
+        m_tempPlanes[i] = m_tempData + i * planeSize + planeUsed;
+    }
+    if(!convertSampleFmt(m_tempPlanes.data(),
+                         m_ctxParam.outSampleFmt,
+                         srcData,
+                         m_ctxParam.inSampleFmt,
+                         m_inChannel,
+                         nbSamples))
+    {
+        AV_LOG_E("failed to convert sample fmt %d -> %d",
+                 m_ctxParam.inSampleFmt,
+                 m_ctxParam.outSampleFmt);
+        return {nullptr, 0};
+    }
+    m_curOutputBufferSize += outBufferSize;
+
+    if(m_curOutputBufferSize >= m_fullOutputBufferSize)
+    {
+        return popOutput(dstData, m_fullOutputBufferSize);
+    }
+    traceCounter("swr buffered bytes", m_curOutputBufferSize);
+    return {nullptr, 0};
+}
+
+std::pair<uint8_t**, int> SwrConvertor::popOutput(uint8_t** dstData, int outBufferSize)
+{
+    int planes    = (int)m_tempPlanes.size();
+    int planeSize = m_tempBufferSize / planes;
+    int planeUsed = m_curOutputBufferSize / planes;
+    int planeOut  = outBufferSize / planes;
+    for(int i = 0; i < planes; i++)
+    {
+        uint8_t* plane = m_tempData + i * planeSize;
+        memcpy(dstData[0] + i * planeOut, plane, planeOut);
+        memmove(plane, plane + planeOut, planeUsed - planeOut);
+    }
+    m_curOutputBufferSize -= outBufferSize;
+    traceCounter("swr buffered bytes", m_curOutputBufferSize);
+    return {dstData, outBufferSize};
+}
+
+bool SwrConvertor::reserveTempBuffer(int needSize)
+{
+    if(needSize <= m_tempBufferSize)
+        return true;
+
+    // keep plane size aligned to sample
+    int planes    = (int)m_tempPlanes.size();
+    int align     = planes * m_outSampleSize;
+    int newSize   = std::max(needSize, m_tempBufferSize * 2);
+    newSize       = (newSize + align - 1) / align * align;
+    uint8_t* data = static_cast<uint8_t*>(av_malloc(newSize));
+    if(!data)
+    {
+        AV_LOG_E("failed to grow swr temp buffer to %d", newSize);
+        return false;
+    }
+    int planeUsed = m_curOutputBufferSize / planes;
+    for(int i = 0; i < planes; i++)
+    {
+        memcpy(data + i * (newSize / planes),
+               m_tempData + i * (m_tempBufferSize / planes),
+               planeUsed);
+    }
+    av_free(m_tempData);
+    m_tempData       = data;
+    m_tempBufferSize = newSize;
+    AV_LOG_D("grow swr temp buffer to %d", newSize);
+    return true;
+}
+
+// -------------------------- SwsConvertor --------------------------
+namespace
+{
+// the closest swscale filter if there's no downscale kernel
+int swsFlags(ScaleAlgorithm algorithm)
+{
+    switch(algorithm)
+    {
+    case ScaleAlgorithm::BOX:
+        return SWS_AREA;
+    case ScaleAlgorithm::BILINEAR:
+        return SWS_BILINEAR;
+    default:
+        return SWS_BICUBIC;
+    }
+}
+} // namespace
+
+SwsConvertor::SwsConvertor(const ReampleParam& scaleParam, FrameAllocType allocType)
+    : m_enable(false)
+    , m_ctxParam(scaleParam)
+{
+    bool sameSize =
+        scaleParam.inWidth == scaleParam.outWidth && scaleParam.inHeight == scaleParam.outHeight;
+    // YUVJ* has the same layout as YUV*, only the range is different
+    int inPixFmt = convertDeprecatedFormat(scaleParam.inPixFmt);
+    m_fullRange  = inPixFmt != scaleParam.inPixFmt;
+
+    if(sameSize && scaleParam.inPixFmt == scaleParam.outPixFmt)
+    {
+        AV_LOG_D("don't need sws");
+        return;
+    }
+
+    if(sameSize && inPixFmt == scaleParam.outPixFmt)
+    {
+        // the output refers to the planes of the input, no buffer of its own
+        m_outFrame = std::make_shared<Frame>();
+        if(!m_outFrame->isValid())
+        {
+            AV_LOG_E("failed to alloc sws output frame.");
+            return;
+        }
+        m_relabel = true;
+        m_enable  = true;
+        AV_LOG_D("relabel fmt %d -> %d with full color range", scaleParam.inPixFmt, inPixFmt);
+        return;
+    }
+
+    if(sameSize && hasPixFmtKernel(inPixFmt, scaleParam.outPixFmt))
+    {
+        m_useKernel         = true;
+        m_ctxParam.inPixFmt = inPixFmt;
+        AV_LOG_D("use %s kernel for fmt %d -> %d",
+                 simdLevelName(cpuSimdLevel()),
+                 inPixFmt,
+                 scaleParam.outPixFmt);
+    }
+    else if(scaleParam.scaleAlgorithm != ScaleAlgorithm::BICUBIC &&
+            scaleParam.inPixFmt == scaleParam.outPixFmt &&
+            hasDownscaleKernel(scaleParam.inPixFmt,
+                               scaleParam.inWidth,
+                               scaleParam.inHeight,
+                               scaleParam.outWidth,
+                               scaleParam.outHeight))
+    {
+        // output has the same format(and range) as input
+        m_useDownscale = true;
+        m_fullRange    = false;
+        AV_LOG_D("use %s downscale kernel for %dx%d -> %dx%d",
+                 simdLevelName(cpuSimdLevel()),
+                 scaleParam.inWidth,
+                 scaleParam.inHeight,
+                 scaleParam.outWidth,
+                 scaleParam.outHeight);
+    }
+    else
+    {
+        // swscale convert full range to the range of output format by itself
+        m_fullRange = false;
+        m_swsKey    = SwsContextKey{
+            .inWidth   = scaleParam.inWidth,
+            .inHeight  = scaleParam.inHeight,
+            .inPixFmt  = scaleParam.inPixFmt,
+            .outWidth  = scaleParam.outWidth,
+            .outHeight = scaleParam.outHeight,
+            .outPixFmt = scaleParam.outPixFmt,
+            .flags     = swsFlags(scaleParam.scaleAlgorithm),
+        };
+        m_swsCtx = SwsContextCache::instance().checkout(m_swsKey);
+        if(!m_swsCtx)
+        {
+            AV_LOG_E("failed to alloc sws context.");
+            return;
+        }
+    }
+
+    VideoFrameParam vFrameParam{
+        .enable    = true,
+        .width     = scaleParam.outWidth,
+        .height    = scaleParam.outHeight,
+        .pixFormat = scaleParam.outPixFmt,
+        .allocType = allocType,
+    };
+    m_outFrame = std::make_shared<Frame>(vFrameParam);
+    if(!m_outFrame->isValid())
+    {
+        AV_LOG_E("failed to alloc sws output frame.");
+        return;
+    }
+    m_enable = true;
+    AV_LOG_D("sws in w/h %d/%d fmt %d out w/h %d/%d fmt %d",
+             scaleParam.inWidth,
+             scaleParam.inHeight,
+             scaleParam.inPixFmt,
+             scaleParam.outWidth,
+             scaleParam.outHeight,
+             scaleParam.outPixFmt);
+}
+
+SwsConvertor::~SwsConvertor()
+{
+    if(m_swsCtx)
+    {
+        AV_LOG_D("give m_swsCtx back to cache");
+        SwsContextCache::instance().checkin(m_swsKey, m_swsCtx);
+    }
+}
+
+std::shared_ptr<Frame> SwsConvertor::scale(std::shared_ptr<Frame> srcFrame)
+{
+    if(!m_enable)
+        return nullptr;
+
+    StageTimer timer(Stage::SCALE,
+                     Frame::videoBufferSize(
+                         m_ctxParam.outWidth, m_ctxParam.outHeight, m_ctxParam.outPixFmt));
+    if(m_relabel)
+    {
+        // relabel a reference of the input, the input keeps its own format
+        const AVFrame* srcAVFrame = srcFrame->getAVFrame();
+        AVFrame*       avFrame    = m_outFrame->getAVFrame();
+        av_frame_unref(avFrame);
+        // planes of a decoded frame are refcounted and shared, raw packet planes are copied
+        if(av_frame_ref(avFrame, srcAVFrame) < 0)
+        {
+            AV_LOG_E("failed to ref frame to relabel");
+            return nullptr;
+        }
+        avFrame->format      = m_ctxParam.outPixFmt;
+        avFrame->color_range = AVCOL_RANGE_JPEG;
+        return m_outFrame;
+    }
+
+    if(m_useKernel)
+    {
+        convertPixFmt(srcFrame->data(),
+                      srcFrame->lineSize(),
+                      m_ctxParam.inPixFmt,
+                      m_outFrame->data(),
+                      m_outFrame->lineSize(),
+                      m_ctxParam.outPixFmt,
+                      m_ctxParam.outWidth,
+                      m_ctxParam.outHeight);
+        if(m_fullRange)
+        {
+            m_outFrame->getAVFrame()->color_range = AVCOL_RANGE_JPEG;
+        }
+    }
+    else if(m_useDownscale)
+    {
+        downscale(srcFrame->data(),
+                  srcFrame->lineSize(),
+                  m_outFrame->data(),
+                  m_outFrame->lineSize(),
+                  m_ctxParam.inPixFmt,
+                  m_ctxParam.inWidth,
+                  m_ctxParam.inHeight,
+                  m_ctxParam.outWidth,
+                  m_ctxParam.outHeight,
+                  m_ctxParam.scaleAlgorithm);
+    }
+    else
+    {
+        sws_scale(m_swsCtx,
+                  srcFrame->data(),
+                  srcFrame->lineSize(),
+                  0,
+                  m_ctxParam.inHeight,
+                  m_outFrame->data(),
+                  m_outFrame->lineSize());
+    }
+    return m_outFrame;
+}
+
+bool SwsConvertor::isFullRangeOutput(const ReampleParam& scaleParam)
+{
+    int inPixFmt = convertDeprecatedFormat(scaleParam.inPixFmt);
+    if(inPixFmt == scaleParam.inPixFmt)
+    {
+        return false;
+    }
+    if(scaleParam.inWidth != scaleParam.outWidth || scaleParam.inHeight != scaleParam.outHeight)
+    {
+        return false;
+    }
+    return inPixFmt == scaleParam.outPixFmt || hasPixFmtKernel(inPixFmt, scaleParam.outPixFmt);
+}
@@ -0,0 +1,567 @@
+#include "sample_convert.h"
+
+extern "C"
+{
+#include <libavutil/samplefmt.h>
+}
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define SAMPLE_X86 1
+#    include <immintrin.h>
+#endif
+
+namespace
+{
+enum SampleType
+{
+    SAMPLE_S16,
+    SAMPLE_S32,
+    SAMPLE_FLT,
+    SAMPLE_DBL,
+    SAMPLE_TYPE_NB,
+};
+
+const int kSampleSize[SAMPLE_TYPE_NB] = {2, 4, 4, 8};
+
+// bytes of the block buffer used when planar/packed layout is changed
+constexpr int kBlockBufferSize = 16 * 1024;
+
+bool parseSampleFmt(int sampleFmt, SampleType& type, bool& planar)
+{
+    planar = false;
+    switch(sampleFmt)
+    {
+    case AV_SAMPLE_FMT_S16P:
+        planar = true;
+        [[fallthrough]];
+    case AV_SAMPLE_FMT_S16:
+        type = SAMPLE_S16;
+        return true;
+    case AV_SAMPLE_FMT_S32P:
+        planar = true;
+        [[fallthrough]];
+    case AV_SAMPLE_FMT_S32:
+        type = SAMPLE_S32;
+        return true;
+    case AV_SAMPLE_FMT_FLTP:
+        planar = true;
+        [[fallthrough]];
+    case AV_SAMPLE_FMT_FLT:
+        type = SAMPLE_FLT;
+        return true;
+    case AV_SAMPLE_FMT_DBLP:
+        planar = true;
+        [[fallthrough]];
+    case AV_SAMPLE_FMT_DBL:
+        type = SAMPLE_DBL;
+        return true;
+    default:
+        return false;
+    }
+}
+
+using ConvertFunc    = void (*)(uint8_t* dst, const uint8_t* src, int count);
+using InterleaveFunc = void (*)(uint8_t* dst, const uint8_t* src, int planeStride, int channels, int count);
+using DeinterleaveFunc =
+    void (*)(uint8_t* const dst[], int dstOffset, const uint8_t* src, int channels, int count);
+
+struct SampleKernels
+{
+    ConvertFunc convert[SAMPLE_TYPE_NB][SAMPLE_TYPE_NB];
+    // index by log2(sample size) - 1
+    InterleaveFunc   interleave[3];
+    DeinterleaveFunc deinterleave[3];
+};
+
+int sizeClass(int sampleSize)
+{
+    return sampleSize == 2 ? 0 : (sampleSize == 4 ? 1 : 2);
+}
+
+inline int16_t clipInt16(long value)
+{
+    return (int16_t)std::min<long>(std::max<long>(value, INT16_MIN), INT16_MAX);
+}
+
+inline int32_t clipInt32(long long value)
+{
+    return (int32_t)std::min<long long>(std::max<long long>(value, INT32_MIN), INT32_MAX);
+}
+
+// -------------------------- C --------------------------
+// same expression as libswresample/audioconvert.c
+#define SAMPLE_CONVERT_C(name, otype, itype, expr)                 \
+    void name(uint8_t* dst, const uint8_t* src, int count)         \
+    {                                                              \
+        otype*       po = reinterpret_cast<otype*>(dst);           \
+        const itype* pi = reinterpret_cast<const itype*>(src);     \
+        for(int i = 0; i < count; i++)                             \
+        {                                                          \
+            po[i] = expr;                                          \
+        }                                                          \
+    }
+
+SAMPLE_CONVERT_C(s16ToS32C, int32_t, int16_t, pi[i] * (1 << 16))
+SAMPLE_CONVERT_C(s16ToFltC, float, int16_t, pi[i] * (1.0f / (1 << 15)))
+SAMPLE_CONVERT_C(s16ToDblC, double, int16_t, pi[i] * (1.0 / (1 << 15)))
+SAMPLE_CONVERT_C(s32ToS16C, int16_t, int32_t, pi[i] >> 16)
+SAMPLE_CONVERT_C(s32ToFltC, float, int32_t, pi[i] * (1.0f / (1U << 31)))
+SAMPLE_CONVERT_C(s32ToDblC, double, int32_t, pi[i] * (1.0 / (1U << 31)))
+SAMPLE_CONVERT_C(fltToS16C, int16_t, float, clipInt16(lrintf(pi[i] * (1 << 15))))
+SAMPLE_CONVERT_C(fltToS32C, int32_t, float, clipInt32(llrintf(pi[i] * (1U << 31))))
+SAMPLE_CONVERT_C(fltToDblC, double, float, pi[i])
+SAMPLE_CONVERT_C(dblToS16C, int16_t, double, clipInt16(lrint(pi[i] * (1 << 15))))
+SAMPLE_CONVERT_C(dblToS32C, int32_t, double, clipInt32(llrint(pi[i] * (1U << 31))))
+SAMPLE_CONVERT_C(dblToFltC, float, double, (float)pi[i])
+
+template<int kSize>
+void copySamples(uint8_t* dst, const uint8_t* src, int count)
+{
+    memcpy(dst, src, (size_t)count * kSize);
+}
+
+template<typename T>
+void interleaveC(uint8_t* dst, const uint8_t* src, int planeStride, int channels, int count)
+{
+    T* po = reinterpret_cast<T*>(dst);
+    for(int ch = 0; ch < channels; ch++)
+    {
+        const T* pi = reinterpret_cast<const T*>(src + ch * planeStride);
+        for(int i = 0; i < count; i++)
+        {
+            po[i * channels + ch] = pi[i];
+        }
+    }
+}
+
+template<typename T>
+void deinterleaveC(uint8_t* const dst[], int dstOffset, const uint8_t* src, int channels, int count)
+{
+    const T* pi = reinterpret_cast<const T*>(src);
+    for(int ch = 0; ch < channels; ch++)
+    {
+        T* po = reinterpret_cast<T*>(dst[ch] + dstOffset);
+        for(int i = 0; i < count; i++)
+        {
+            po[i] = pi[i * channels + ch];
+        }
+    }
+}
+
+// clang-format off
+const SampleKernels kKernelsC = {
+    {
+        {copySamples<2>, s16ToS32C,      s16ToFltC,      s16ToDblC},
+        {s32ToS16C,      copySamples<4>, s32ToFltC,      s32ToDblC},
+        {fltToS16C,      fltToS32C,      copySamples<4>, fltToDblC},
+        {dblToS16C,      dblToS32C,      dblToFltC,      copySamples<8>},
+    },
+    {interleaveC<int16_t>, interleaveC<int32_t>, interleaveC<int64_t>},
+    {deinterleaveC<int16_t>, deinterleaveC<int32_t>, deinterleaveC<int64_t>},
+};
+// clang-format on
+
+#ifdef SAMPLE_X86
+// -------------------------- SSE2 --------------------------
+#    define SAMPLE_SSE2 __attribute__((target("sse2")))
+
+SAMPLE_SSE2 void s16ToS32SSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int           i    = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_unpacklo_epi16(zero, x));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i + 16), _mm_unpackhi_epi16(zero, x));
+    }
+    s16ToS32C(dst + 4 * i, src + 2 * i, count - i);
+}
+
+SAMPLE_SSE2 void s16ToFltSSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / (1 << 15));
+    int          i     = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i x  = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps((float*)(dst + 4 * i), _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps((float*)(dst + 4 * i + 16), _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    s16ToFltC(dst + 4 * i, src + 2 * i, count - i);
+}
+
+SAMPLE_SSE2 void s16ToDblSSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    const __m128d scale = _mm_set1_pd(1.0 / (1 << 15));
+    int           i     = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i x  = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        double* po = (double*)(dst + 8 * i);
+        _mm_storeu_pd(po, _mm_mul_pd(_mm_cvtepi32_pd(lo), scale));
+        _mm_storeu_pd(po + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(lo, 0xEE)), scale));
+        _mm_storeu_pd(po + 4, _mm_mul_pd(_mm_cvtepi32_pd(hi), scale));
+        _mm_storeu_pd(po + 6, _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(hi, 0xEE)), scale));
+    }
+    s16ToDblC(dst + 8 * i, src + 2 * i, count - i);
+}
+
+SAMPLE_SSE2 void s32ToS16SSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    int i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(src + 4 * i)), 16);
+        __m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(src + 4 * i + 16)), 16);
+        _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_packs_epi32(a, b));
+    }
+    s32ToS16C(dst + 2 * i, src + 4 * i, count - i);
+}
+
+SAMPLE_SSE2 void s32ToFltSSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / (1U << 31));
+    int          i     = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+        _mm_storeu_ps((float*)(dst + 4 * i), _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+    }
+    s32ToFltC(dst + 4 * i, src + 4 * i, count - i);
+}
+
+SAMPLE_SSE2 void s32ToDblSSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    const __m128d scale = _mm_set1_pd(1.0 / (1U << 31));
+    int           i     = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i x  = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+        double* po = (double*)(dst + 8 * i);
+        _mm_storeu_pd(po, _mm_mul_pd(_mm_cvtepi32_pd(x), scale));
+        _mm_storeu_pd(po + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(x, 0xEE)), scale));
+    }
+    s32ToDblC(dst + 8 * i, src + 4 * i, count - i);
+}
+
+SAMPLE_SSE2 void fltToS16SSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    // clamp before convert, cvtps2dq return 0x80000000 for overflow
+    const __m128 scale = _mm_set1_ps(1 << 15);
+    const __m128 minV  = _mm_set1_ps(INT16_MIN);
+    const __m128 maxV  = _mm_set1_ps(INT16_MAX);
+    int          i     = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps((const float*)(src + 4 * i)), scale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps((const float*)(src + 4 * i + 16)), scale);
+        a        = _mm_min_ps(_mm_max_ps(a, minV), maxV);
+        b        = _mm_min_ps(_mm_max_ps(b, minV), maxV);
+        _mm_storeu_si128((__m128i*)(dst + 2 * i),
+                         _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+    fltToS16C(dst + 2 * i, src + 4 * i, count - i);
+}
+
+SAMPLE_SSE2 void fltToS32SSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    // 1.0 * 2^31 overflow to 0x80000000, flip it to 0x7FFFFFFF
+    const __m128 scale = _mm_set1_ps(1U << 31);
+    int          i     = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128  x        = _mm_mul_ps(_mm_loadu_ps((const float*)(src + 4 * i)), scale);
+        __m128i overflow = _mm_castps_si128(_mm_cmpge_ps(x, scale));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_xor_si128(_mm_cvtps_epi32(x), overflow));
+    }
+    fltToS32C(dst + 4 * i, src + 4 * i, count - i);
+}
+
+SAMPLE_SSE2 void fltToDblSSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    int i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128  x  = _mm_loadu_ps((const float*)(src + 4 * i));
+        double* po = (double*)(dst + 8 * i);
+        _mm_storeu_pd(po, _mm_cvtps_pd(x));
+        _mm_storeu_pd(po + 2, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+    }
+    fltToDblC(dst + 8 * i, src + 4 * i, count - i);
+}
+
+SAMPLE_SSE2 inline __m128i dblToS32x4(const double* pi, __m128d scale, __m128d minV, __m128d maxV)
+{
+    __m128d a = _mm_mul_pd(_mm_loadu_pd(pi), scale);
+    __m128d b = _mm_mul_pd(_mm_loadu_pd(pi + 2), scale);
+    a         = _mm_min_pd(_mm_max_pd(a, minV), maxV);
+    b         = _mm_min_pd(_mm_max_pd(b, minV), maxV);
+    return _mm_unpacklo_epi64(_mm_cvtpd_epi32(a), _mm_cvtpd_epi32(b));
+}
+
+SAMPLE_SSE2 void dblToS16SSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    const __m128d scale = _mm_set1_pd(1 << 15);
+    const __m128d minV  = _mm_set1_pd(INT16_MIN);
+    const __m128d maxV  = _mm_set1_pd(INT16_MAX);
+    int           i     = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        const double* pi = (const double*)(src + 8 * i);
+        __m128i       a  = dblToS32x4(pi, scale, minV, maxV);
+        __m128i       b  = dblToS32x4(pi + 4, scale, minV, maxV);
+        _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_packs_epi32(a, b));
+    }
+    dblToS16C(dst + 2 * i, src + 8 * i, count - i);
+}
+
+SAMPLE_SSE2 void dblToS32SSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    // int32 range is exact in double, so clamp is the same as av_clipl_int32
+    const __m128d scale = _mm_set1_pd(1U << 31);
+    const __m128d minV  = _mm_set1_pd(INT32_MIN);
+    const __m128d maxV  = _mm_set1_pd(INT32_MAX);
+    int           i     = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128((__m128i*)(dst + 4 * i),
+                         dblToS32x4((const double*)(src + 8 * i), scale, minV, maxV));
+    }
+    dblToS32C(dst + 4 * i, src + 8 * i, count - i);
+}
+
+SAMPLE_SSE2 void dblToFltSSE2(uint8_t* dst, const uint8_t* src, int count)
+{
+    int i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        const double* pi = (const double*)(src + 8 * i);
+        __m128        a  = _mm_cvtpd_ps(_mm_loadu_pd(pi));
+        __m128        b  = _mm_cvtpd_ps(_mm_loadu_pd(pi + 2));
+        _mm_storeu_ps((float*)(dst + 4 * i), _mm_movelh_ps(a, b));
+    }
+    dblToFltC(dst + 4 * i, src + 8 * i, count - i);
+}
+
+// stereo is the most common layout, other channel count use C version
+SAMPLE_SSE2 void
+interleave16SSE2(uint8_t* dst, const uint8_t* src, int planeStride, int channels, int count)
+{
+    if(channels != 2)
+    {
+        interleaveC<int16_t>(dst, src, planeStride, channels, count);
+        return;
+    }
+    const uint8_t* left  = src;
+    const uint8_t* right = src + planeStride;
+    int            i     = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i l = _mm_loadu_si128((const __m128i*)(left + 2 * i));
+        __m128i r = _mm_loadu_si128((const __m128i*)(right + 2 * i));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_unpacklo_epi16(l, r));
+        _mm_storeu_si128((__m128i*)(dst + 4 * i + 16), _mm_unpackhi_epi16(l, r));
+    }
+    for(; i < count; i++)
+    {
+        memcpy(dst + 4 * i, left + 2 * i, 2);
+        memcpy(dst + 4 * i + 2, right + 2 * i, 2);
+    }
+}
+
+SAMPLE_SSE2 void
+interleave32SSE2(uint8_t* dst, const uint8_t* src, int planeStride, int channels, int count)
+{
+    if(channels != 2)
+    {
+        interleaveC<int32_t>(dst, src, planeStride, channels, count);
+        return;
+    }
+    const uint8_t* left  = src;
+    const uint8_t* right = src + planeStride;
+    int            i     = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i l = _mm_loadu_si128((const __m128i*)(left + 4 * i));
+        __m128i r = _mm_loadu_si128((const __m128i*)(right + 4 * i));
+        _mm_storeu_si128((__m128i*)(dst + 8 * i), _mm_unpacklo_epi32(l, r));
+        _mm_storeu_si128((__m128i*)(dst + 8 * i + 16), _mm_unpackhi_epi32(l, r));
+    }
+    for(; i < count; i++)
+    {
+        memcpy(dst + 8 * i, left + 4 * i, 4);
+        memcpy(dst + 8 * i + 4, right + 4 * i, 4);
+    }
+}
+
+SAMPLE_SSE2 void
+deinterleave16SSE2(uint8_t* const dst[], int dstOffset, const uint8_t* src, int channels, int count)
+{
+    if(channels != 2)
+    {
+        deinterleaveC<int16_t>(dst, dstOffset, src, channels, count);
+        return;
+    }
+    uint8_t* left  = dst[0] + dstOffset;
+    uint8_t* right = dst[1] + dstOffset;
+    int      i     = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        // L0 R0 L1 R1 L2 R2 L3 R3 -> L0 L1 L2 L3 R0 R1 R2 R3
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + 4 * i + 16));
+        a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, _MM_SHUFFLE(3, 1, 2, 0)),
+                                _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm_shufflehi_epi16(_mm_shufflelo_epi16(b, _MM_SHUFFLE(3, 1, 2, 0)),
+                                _MM_SHUFFLE(3, 1, 2, 0));
+        a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(left + 2 * i), _mm_unpacklo_epi64(a, b));
+        _mm_storeu_si128((__m128i*)(right + 2 * i), _mm_unpackhi_epi64(a, b));
+    }
+    for(; i < count; i++)
+    {
+        memcpy(left + 2 * i, src + 4 * i, 2);
+        memcpy(right + 2 * i, src + 4 * i + 2, 2);
+    }
+}
+
+SAMPLE_SSE2 void
+deinterleave32SSE2(uint8_t* const dst[], int dstOffset, const uint8_t* src, int channels, int count)
+{
+    if(channels != 2)
+    {
+        deinterleaveC<int32_t>(dst, dstOffset, src, channels, count);
+        return;
+    }
+    uint8_t* left  = dst[0] + dstOffset;
+    uint8_t* right = dst[1] + dstOffset;
+    int      i     = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 a = _mm_loadu_ps((const float*)(src + 8 * i));
+        __m128 b = _mm_loadu_ps((const float*)(src + 8 * i + 16));
+        _mm_storeu_ps((float*)(left + 4 * i), _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps((float*)(right + 4 * i), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    for(; i < count; i++)
+    {
+        memcpy(left + 4 * i, src + 8 * i, 4);
+        memcpy(right + 4 * i, src + 8 * i + 4, 4);
+    }
+}
+
+// clang-format off
+const SampleKernels kKernelsSSE2 = {
+    {
+        {copySamples<2>, s16ToS32SSE2,   s16ToFltSSE2,   s16ToDblSSE2},
+        {s32ToS16SSE2,   copySamples<4>, s32ToFltSSE2,   s32ToDblSSE2},
+        {fltToS16SSE2,   fltToS32SSE2,   copySamples<4>, fltToDblSSE2},
+        {dblToS16SSE2,   dblToS32SSE2,   dblToFltSSE2,   copySamples<8>},
+    },
+    {interleave16SSE2, interleave32SSE2, interleaveC<int64_t>},
+    {deinterleave16SSE2, deinterleave32SSE2, deinterleaveC<int64_t>},
+};
+// clang-format on
+#endif
+
+const SampleKernels& selectKernels(SimdLevel level)
+{
+#ifdef SAMPLE_X86
+    if(level != SimdLevel::C)
+    {
+        return kKernelsSSE2;
+    }
+#endif
+    return kKernelsC;
+}
+} // namespace
+
+bool hasSampleFmtKernel(int srcSampleFmt, int dstSampleFmt)
+{
+    SampleType srcType, dstType;
+    bool       srcPlanar, dstPlanar;
+    return parseSampleFmt(srcSampleFmt, srcType, srcPlanar) &&
+           parseSampleFmt(dstSampleFmt, dstType, dstPlanar);
+}
+
+bool convertSampleFmt(uint8_t* const       dst[],
+                      int                  dstSampleFmt,
+                      const uint8_t* const src[],
+                      int                  srcSampleFmt,
+                      int                  channels,
+                      int                  nbSamples,
+                      SimdLevel            level)
+{
+    SampleType srcType, dstType;
+    bool       srcPlanar, dstPlanar;
+    if(!parseSampleFmt(srcSampleFmt, srcType, srcPlanar) ||
+       !parseSampleFmt(dstSampleFmt, dstType, dstPlanar) || channels <= 0)
+    {
+        return false;
+    }
+    if(static_cast<int>(level) > static_cast<int>(cpuSimdLevel()))
+    {
+        level = cpuSimdLevel();
+    }
+    const SampleKernels& kernels = selectKernels(level);
+    ConvertFunc          convert = kernels.convert[srcType][dstType];
+    int                  inSize  = kSampleSize[srcType];
+    int                  outSize = kSampleSize[dstType];
+
+    // same layout, convert directly
+    if(srcPlanar == dstPlanar)
+    {
+        if(srcPlanar)
+        {
+            for(int ch = 0; ch < channels; ch++)
+            {
+                convert(dst[ch], src[ch], nbSamples);
+            }
+        }
+        else
+        {
+            convert(dst[0], src[0], nbSamples * channels);
+        }
+        return true;
+    }
+
+    // layout changed, convert a block into the cache-hot buffer and then (de)interleave it
+    alignas(32) uint8_t block[kBlockBufferSize];
+    int                 blockSamples = kBlockBufferSize / (outSize * channels);
+    if(blockSamples <= 0)
+    {
+        return false;
+    }
+    for(int offset = 0; offset < nbSamples; offset += blockSamples)
+    {
+        int count = std::min(blockSamples, nbSamples - offset);
+        if(srcPlanar)
+        {
+            // planar -> packed
+            for(int ch = 0; ch < channels; ch++)
+            {
+                convert(block + ch * count * outSize, src[ch] + offset * inSize, count);
+            }
+            kernels.interleave[sizeClass(outSize)](
+                dst[0] + offset * channels * outSize, block, count * outSize, channels, count);
+        }
+        else
+        {
+            // packed -> planar
+            convert(block, src[0] + offset * channels * inSize, count * channels);
+            kernels.deinterleave[sizeClass(outSize)](
+                dst, offset * outSize, block, channels, count);
+        }
+    }
+    return true;
+}
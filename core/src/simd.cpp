@@ -0,0 +1,38 @@
+#include "simd.h"
+
+extern "C"
+{
+#include <libavutil/cpu.h>
+}
+
+SimdLevel cpuSimdLevel()
+{
+    static const SimdLevel level = []() {
+#if defined(__x86_64__) || defined(__i386__)
+        int flags = av_get_cpu_flags();
+        if(flags & AV_CPU_FLAG_AVX2)
+        {
+            return SimdLevel::AVX2;
+        }
+        if(flags & AV_CPU_FLAG_SSE2)
+        {
+            return SimdLevel::SSE2;
+        }
+#endif
+        return SimdLevel::C;
+    }();
+    return level;
+}
+
+const char* simdLevelName(SimdLevel level)
+{
+    switch(level)
+    {
+    case SimdLevel::AVX2:
+        return "avx2";
+    case SimdLevel::SSE2:
+        return "sse2";
+    default:
+        return "c";
+    }
+}
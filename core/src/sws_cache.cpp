@@ -0,0 +1,137 @@
+#include "sws_cache.h"
+#include "../../utils/include/log.h"
+
+#include <iterator>
+
+extern "C"
+{
+#include <libswscale/swscale.h>
+}
+
+SwsContextCache& SwsContextCache::instance()
+{
+    static SwsContextCache cache;
+    return cache;
+}
+
+SwsContextCache::~SwsContextCache()
+{
+    clear();
+}
+
+SwsContext* SwsContextCache::checkout(const SwsContextKey& key)
+{
+    SwsContext* ctx = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(auto it = m_idle.begin(); it != m_idle.end(); ++it)
+        {
+            if(it->first == key)
+            {
+                ctx = it->second;
+                m_idle.erase(it);
+                break;
+            }
+        }
+        if(ctx)
+        {
+            m_hits++;
+        }
+        else
+        {
+            m_misses++;
+            // recycle the least recently used one instead of growing the cache
+            if(!m_idle.empty() && m_idle.size() >= m_capacity)
+            {
+                ctx = m_idle.back().second;
+                m_idle.pop_back();
+            }
+        }
+    }
+
+    // returns ctx itself if it has the same param, otherwise frees it and allocs a new one.
+    // filter init is done out of lock
+    SwsContext* cachedCtx = sws_getCachedContext(ctx,
+                                                 key.inWidth,
+                                                 key.inHeight,
+                                                 (AVPixelFormat)key.inPixFmt,
+                                                 key.outWidth,
+                                                 key.outHeight,
+                                                 (AVPixelFormat)key.outPixFmt,
+                                                 key.flags,
+                                                 nullptr,
+                                                 nullptr,
+                                                 nullptr);
+    if(!cachedCtx)
+    {
+        AV_LOG_E("failed to alloc sws context %dx%d fmt %d -> %dx%d fmt %d",
+                 key.inWidth,
+                 key.inHeight,
+                 key.inPixFmt,
+                 key.outWidth,
+                 key.outHeight,
+                 key.outPixFmt);
+    }
+    return cachedCtx;
+}
+
+void SwsContextCache::checkin(const SwsContextKey& key, SwsContext* ctx)
+{
+    if(!ctx)
+        return;
+
+    SwsContext* evicted = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle.emplace_front(key, ctx);
+        if(m_idle.size() > m_capacity)
+        {
+            evicted = m_idle.back().second;
+            m_idle.pop_back();
+        }
+    }
+    if(evicted)
+    {
+        sws_freeContext(evicted);
+    }
+}
+
+void SwsContextCache::setCapacity(size_t capacity)
+{
+    std::list<std::pair<SwsContextKey, SwsContext*>> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_capacity = capacity;
+        while(m_idle.size() > m_capacity)
+        {
+            evicted.splice(evicted.end(), m_idle, std::prev(m_idle.end()));
+        }
+    }
+    for(auto& [key, ctx] : evicted)
+    {
+        sws_freeContext(ctx);
+    }
+}
+
+void SwsContextCache::clear()
+{
+    std::list<std::pair<SwsContextKey, SwsContext*>> idle;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        idle.swap(m_idle);
+    }
+    for(auto& [key, ctx] : idle)
+    {
+        sws_freeContext(ctx);
+    }
+}
+
+SwsCacheStats SwsContextCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SwsCacheStats               stats;
+    stats.hits   = m_hits;
+    stats.misses = m_misses;
+    stats.idle   = m_idle.size();
+    return stats;
+}
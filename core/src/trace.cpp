@@ -0,0 +1,220 @@
+#include "trace.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace tracedetail
+{
+thread_local TraceRecorder* t_current = nullptr;
+} // namespace tracedetail
+
+namespace
+{
+std::atomic<uint64_t> g_nextRecorderId{1};
+
+struct ThreadBufferCache
+{
+    uint64_t recorderId = 0;
+    void*    buffer     = nullptr;
+};
+thread_local ThreadBufferCache t_bufferCache;
+
+int64_t sinceNs(std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - start).count();
+}
+
+std::string jsonEscape(const std::string& str)
+{
+    std::string out;
+    for(char c : str)
+    {
+        if(c == '"' || c == '\\')
+        {
+            out += '\\';
+        }
+        if((unsigned char)c >= 0x20)
+        {
+            out += c;
+        }
+    }
+    return out;
+}
+} // namespace
+
+// -------------------------- TraceRecorder --------------------------
+TraceRecorder::TraceRecorder(const std::string& filename, size_t maxEventsPerThread)
+    : m_filename(filename)
+    , m_maxEventsPerThread(maxEventsPerThread)
+    , m_id(g_nextRecorderId.fetch_add(1, std::memory_order_relaxed))
+    , m_start(std::chrono::steady_clock::now())
+{ }
+
+TraceRecorder::ThreadBuffer* TraceRecorder::threadBuffer()
+{
+    if(t_bufferCache.recorderId == m_id)
+    {
+        return static_cast<ThreadBuffer*>(t_bufferCache.buffer);
+    }
+
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->tid = (int)syscall(SYS_gettid);
+    char name[16] = {0};
+    if(pthread_getname_np(pthread_self(), name, sizeof(name)) == 0)
+    {
+        buffer->threadName = name;
+    }
+    buffer->events.reserve(std::min<size_t>(m_maxEventsPerThread, 4096));
+
+    ThreadBuffer* result = buffer.get();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_buffers.push_back(std::move(buffer));
+    }
+    t_bufferCache.recorderId = m_id;
+    t_bufferCache.buffer     = result;
+    return result;
+}
+
+void TraceRecorder::append(const TraceEvent& event)
+{
+    ThreadBuffer* buffer = threadBuffer();
+    if(buffer->events.size() >= m_maxEventsPerThread)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer->events.push_back(event);
+}
+
+void TraceRecorder::span(const char*                           name,
+                         std::chrono::steady_clock::time_point begin,
+                         std::chrono::steady_clock::time_point end,
+                         uint64_t                              frames,
+                         uint64_t                              bytes)
+{
+    append(TraceEvent{
+        .phase  = 'X',
+        .name   = name,
+        .tsNs   = sinceNs(m_start, begin),
+        .durNs  = sinceNs(begin, end),
+        .value  = (int64_t)frames,
+        .bytes  = bytes,
+        .series = -1,
+    });
+}
+
+void TraceRecorder::counter(const char* name, int64_t value, int series)
+{
+    append(TraceEvent{
+        .phase  = 'C',
+        .name   = name,
+        .tsNs   = sinceNs(m_start, std::chrono::steady_clock::now()),
+        .durNs  = 0,
+        .value  = value,
+        .bytes  = 0,
+        .series = series,
+    });
+}
+
+bool TraceRecorder::write() const
+{
+    std::ofstream ofs(m_filename, std::ios::trunc);
+    if(!ofs.is_open())
+    {
+        AV_LOG_E("can't open trace file %s", m_filename.c_str());
+        return false;
+    }
+
+    int    pid   = (int)getpid();
+    size_t count = 0;
+    char   line[512];
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const auto& buffer : m_buffers)
+    {
+        if(!buffer->threadName.empty())
+        {
+            snprintf(line,
+                     sizeof(line),
+                     "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                     "\"args\":{\"name\":\"%s\"}}",
+                     count++ == 0 ? "" : ",",
+                     pid,
+                     buffer->tid,
+                     jsonEscape(buffer->threadName).c_str());
+            ofs << line;
+        }
+        for(const TraceEvent& event : buffer->events)
+        {
+            if(event.phase == 'X')
+            {
+                snprintf(line,
+                         sizeof(line),
+                         "%s\n{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"ts\":%.3f,"
+                         "\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                         "\"args\":{\"frames\":%ld,\"bytes\":%lu}}",
+                         count++ == 0 ? "" : ",",
+                         event.name,
+                         event.tsNs / 1e3,
+                         event.durNs / 1e3,
+                         pid,
+                         buffer->tid,
+                         event.value,
+                         event.bytes);
+            }
+            else
+            {
+                std::string series =
+                    event.series < 0 ? std::string("value") : std::to_string(event.series);
+                snprintf(line,
+                         sizeof(line),
+                         "%s\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+                         "\"args\":{\"%s\":%ld}}",
+                         count++ == 0 ? "" : ",",
+                         event.name,
+                         event.tsNs / 1e3,
+                         pid,
+                         buffer->tid,
+                         series.c_str(),
+                         event.value);
+            }
+            ofs << line;
+        }
+    }
+    ofs << "\n]}\n";
+    if(!ofs.good())
+    {
+        AV_LOG_E("failed to write trace file %s", m_filename.c_str());
+        return false;
+    }
+    AV_LOG_I("trace of %lu events written to %s, %lu dropped",
+             count,
+             m_filename.c_str(),
+             droppedCount());
+    return true;
+}
+
+void TraceRecorder::setCurrent(TraceRecorder* recorder)
+{
+    tracedetail::t_current = recorder;
+}
+
+// -------------------------- TraceScope --------------------------
+TraceScope::TraceScope(TraceRecorder* recorder)
+    : m_prev(TraceRecorder::current())
+{
+    TraceRecorder::setCurrent(recorder);
+}
+
+TraceScope::~TraceScope()
+{
+    TraceRecorder::setCurrent(m_prev);
+}
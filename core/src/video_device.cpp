@@ -8,7 +8,9 @@ extern "C"
 #include <libavutil/avutil.h>
 #include <libavutil/common.h>
 #include <libavutil/frame.h>
+#include <libavutil/mathematics.h>
 #include <libavutil/opt.h>
+#include <libavutil/time.h>
 #include <libswresample/swresample.h>
 
 #include <libavutil/imgutils.h>
@@ -17,10 +19,20 @@ extern "C"
 
 #include "../../utils/include/log.h"
 #include "codec.h"
+#include "codec_pool.h"
 #include "device.h"
 #include "frame.h"
+#include "frame_cache.h"
+#include "capture_latency.h"
+#include "job_metrics.h"
+#include "ladder.h"
+#include "muxer.h"
+#include "trace.h"
+#include "pixfmt_convert.h"
+#include "quality_meter.h"
 #include "resample.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <memory>
@@ -30,8 +42,6 @@ extern "C"
 
 #include <thread>
 
-int convertDeprecatedFormat(int format);
-
 VideoDevice::VideoDevice()
     : Device()
 { }
@@ -46,6 +56,8 @@ VideoDevice::~VideoDevice() { }
 
 void VideoDevice::readAndEncode(ReadDeviceDataParam& params)
 {
+    JobMetricsScope metricsScope(params.metrics.get());
+    TraceScope      traceScope(params.trace.get());
 
     bool isReadFromStream = params.inFilename != "";
 
@@ -77,7 +89,14 @@ void VideoDevice::readAndEncode(ReadDeviceDataParam& params)
         }
     }
 
-    auto videoCodec = std::make_shared<VideoCodec>(params.codecParam);
+    // full range input may be passed through without convert
+    if(SwsConvertor::isFullRangeOutput(params.resampleParam))
+    {
+        params.codecParam.encodeParam.colorRange = AVCOL_RANGE_JPEG;
+    }
+
+    auto videoCodec = params.useCodecPool ? CodecPool::instance().acquireVideo(params.codecParam)
+                                          : std::make_shared<VideoCodec>(params.codecParam);
 
     // 2. create packet
     AVPacket* packet = av_packet_alloc();
@@ -93,6 +112,7 @@ void VideoDevice::readAndEncode(ReadDeviceDataParam& params)
         .width     = params.resampleParam.inWidth,
         .height    = params.resampleParam.inHeight,
         .pixFormat = params.resampleParam.inPixFmt,
+        .allocType = params.frameAllocType,
     };
     auto frame = std::make_shared<Frame>(vFrameParam);
     int   frameBufferSize = av_image_get_buffer_size(
@@ -117,29 +137,66 @@ void VideoDevice::readAndEncode(ReadDeviceDataParam& params)
         .videoCodec = videoCodec,
         .frame      = frame,
         .pkt        = packet,
+        .frameAllocType = params.frameAllocType,
+        .scaleAlgorithm = params.resampleParam.scaleAlgorithm,
+        .frameDiffParam = params.frameDiffParam,
+        .captureParam   = params.captureParam,
+        .muxer          = params.muxer,
     };
+    if(params.measureQuality && videoCodec->encodeEnable())
+    {
+        QualityMeterParam meterParam{
+            .width  = videoCodec->width(true),
+            .height = videoCodec->height(true),
+            .pixFmt = videoCodec->pixFormat(true),
+        };
+        auto qualityMeter = std::make_shared<QualityMeter>(meterParam, videoCodec);
+        if(qualityMeter->isValid())
+        {
+            vReaderParam.qualityMeter = qualityMeter;
+        }
+    }
     // 4. read from stream
     if(isReadFromStream)
     {
-        uint8_t* srcBuffer = static_cast<uint8_t*>(av_malloc(frameBufferSize));
-        vReaderParam.srcData = srcBuffer;
-        readVideoFromStream(vReaderParam);
-        // 4.1 release buffer
-        if(srcBuffer)
+        // raw image is read into this buffer, so it need the same backend as frame
+        AVBufferRef* srcBuffer = allocFrameBuffer(frameBufferSize, params.frameAllocType);
+        if(!srcBuffer)
         {
-            av_freep(&srcBuffer);
+            AV_LOG_E("Failed to alloc src buffer");
+            av_packet_free(&packet);
+            return;
         }
+        vReaderParam.srcData = srcBuffer->data;
+        readVideoFromStream(vReaderParam);
+        // 4.1 release buffer
+        av_buffer_unref(&srcBuffer);
     }
     else
     {
         readVideoFromHWDevice(vReaderParam);
     }
 
-    // 5. release resource
+    // 5. decode the remain packets and print quality
+    if(vReaderParam.qualityMeter)
+    {
+        vReaderParam.qualityMeter->flush();
+        vReaderParam.qualityMeter->logSummary();
+    }
+
+    // 6. release resource
     if(packet)
     {
         av_packet_free(&packet);
     }
+    if(params.metrics)
+    {
+        AV_LOG_I("job metrics %s", params.metrics->report().toJson().c_str());
+    }
+    if(params.trace)
+    {
+        params.trace->write();
+    }
 }
 
 void VideoDevice::readAndDecode(ReadDeviceDataParam& params)
@@ -148,6 +205,8 @@ void VideoDevice::readAndDecode(ReadDeviceDataParam& params)
     {
         return;
     }
+    JobMetricsScope metricsScope(params.metrics.get());
+    TraceScope      traceScope(params.trace.get());
     int videoStreamIdx = findStreamIdxByMediaType(AVMediaType::AVMEDIA_TYPE_VIDEO);
     if(videoStreamIdx == -1)
     {
@@ -161,7 +220,8 @@ void VideoDevice::readAndDecode(ReadDeviceDataParam& params)
                              .avCodecPar = fmtCtx->streams[videoStreamIdx]->codecpar,
                              .byId       = true};
     CodecParam   codecParam = {.decodeParam = decodeParam};
-    auto videoCodec = std::make_shared<VideoCodec>(codecParam);
+    auto videoCodec = params.useCodecPool ? CodecPool::instance().acquireVideo(codecParam)
+                                          : std::make_shared<VideoCodec>(codecParam);
 
     AV_LOG_D("video format %s", fmtCtx->iformat->name);
     AV_LOG_D("video time %lds", (fmtCtx->duration) / 1000000);
@@ -181,62 +241,35 @@ void VideoDevice::readAndDecode(ReadDeviceDataParam& params)
         .width     = inWidth,
         .height    = inHeight,
         .pixFormat = inPixFmt,
+        .allocType = params.frameAllocType,
     };
     auto frame = std::make_shared<Frame>(vfp);
-    std::shared_ptr<Frame> swsOutFrame;
 
     int outputBufferSize = av_image_get_buffer_size(
         (AVPixelFormat)params.outPixFormat, params.outWidth, params.outHeight, 1);
     AV_LOG_D("outputBufferSize %d", outputBufferSize);
 
-    bool        isNeedSws = false;
-    SwsContext* swsCtx    = nullptr;
-    if(inWidth != params.outWidth || inHeight != params.outHeight ||
-       inPixFmt != params.outPixFormat)
-    {
-        swsCtx = sws_getContext(inWidth,
-                                inHeight,
-                                (AVPixelFormat)inPixFmt,
-                                params.outWidth,
-                                params.outHeight,
-                                (AVPixelFormat)params.outPixFormat,
-                                SWS_BICUBIC,
-                                nullptr,
-                                nullptr,
-                                nullptr);
-        if(swsCtx != nullptr)
-        {
-            VideoFrameParam swsOutVfp{
-                .enable    = true,
-                .width     = params.outWidth,
-                .height    = params.outHeight,
-                .pixFormat = params.outPixFormat,
-            };
-            swsOutFrame = std::make_shared<Frame>(swsOutVfp);
-            isNeedSws   = true;
-        }
-        AV_LOG_D(
-            "sws in w/h %d/%d out w/h %d/%d", inWidth, inHeight, params.outWidth, params.outHeight);
-    }
-    if(!isNeedSws)
-    {
-        AV_LOG_D("don't need sws");
-    }
+    ReampleParam scaleParam{
+        .inWidth        = inWidth,
+        .inHeight       = inHeight,
+        .inPixFmt       = inPixFmt,
+        .outWidth       = params.outWidth,
+        .outHeight      = params.outHeight,
+        .outPixFmt      = params.outPixFormat,
+        .scaleAlgorithm = params.resampleParam.scaleAlgorithm,
+    };
+    auto swsConvertor = std::make_shared<SwsConvertor>(scaleParam, params.frameAllocType);
 
     std::ofstream ofs(params.outFilename);
 
     // 7. decodec callback
     auto decodecCB = [&](std::shared_ptr<Frame> frame) {
-        if(isNeedSws)
+        if(swsConvertor->enable())
         {
-            sws_scale(swsCtx,
-                      frame->data(),
-                      frame->lineSize(),
-                      0,
-                      inHeight,
-                      swsOutFrame->data(),
-                      swsOutFrame->lineSize());
-            writeImageToFile(ofs, swsOutFrame);
+            if(auto swsOutFrame = swsConvertor->scale(frame); swsOutFrame)
+            {
+                writeImageToFile(ofs, swsOutFrame);
+            }
         }
         else
         {
@@ -244,7 +277,7 @@ void VideoDevice::readAndDecode(ReadDeviceDataParam& params)
         }
     };
 
-    while(av_read_frame(fmtCtx, packet) >= 0)
+    while(timedReadFrame(fmtCtx, packet) >= 0)
     {
         if(packet->stream_index == videoStreamIdx)
         {
@@ -266,10 +299,112 @@ void VideoDevice::readAndDecode(ReadDeviceDataParam& params)
     {
         av_packet_free(&packet);
     }
+    if(params.metrics)
+    {
+        AV_LOG_I("job metrics %s", params.metrics->report().toJson().c_str());
+    }
+    if(params.trace)
+    {
+        params.trace->write();
+    }
+}
 
-    if(swsCtx)
+void VideoDevice::readAndEncodeLadder(LadderParam& params)
+{
+    JobMetricsScope metricsScope(params.metrics.get());
+    TraceScope      traceScope(params.trace.get());
+
+    int videoStreamIdx = findStreamIdxByMediaType(AVMediaType::AVMEDIA_TYPE_VIDEO);
+    if(videoStreamIdx == -1)
     {
-        sws_freeContext(swsCtx);
+        AV_LOG_E("can't find video stream.");
+        return;
+    }
+    auto* fmtCtx = getFmtCtx();
+
+    // 1. the only decoder, raw images of a device are taken by rawvideo decoder
+    DecoderParam decodeParam{.needDecode = true,
+                             .codecId    = fmtCtx->streams[videoStreamIdx]->codecpar->codec_id,
+                             .avCodecPar = fmtCtx->streams[videoStreamIdx]->codecpar,
+                             .byId       = true};
+    CodecParam   codecParam = {.decodeParam = decodeParam};
+    auto videoCodec = params.useCodecPool ? CodecPool::instance().acquireVideo(codecParam)
+                                          : std::make_shared<VideoCodec>(codecParam);
+    if(!videoCodec->decodeEnable())
+    {
+        AV_LOG_E("can't open video decoder");
+        return;
+    }
+
+    // 2. a scaler and an encoder of every rung on its own thread
+    std::vector<std::unique_ptr<LadderRungEncoder>> rungEncoders;
+    for(const LadderRung& rung : params.rungs)
+    {
+        auto rungEncoder = std::make_unique<LadderRungEncoder>(rung,
+                                                               params,
+                                                               videoCodec->width(false),
+                                                               videoCodec->height(false),
+                                                               videoCodec->pixFormat(false));
+        if(!rungEncoder->isValid())
+        {
+            continue;
+        }
+        rungEncoder->start();
+        rungEncoders.push_back(std::move(rungEncoder));
+    }
+    if(rungEncoders.empty())
+    {
+        AV_LOG_E("no rung to encode");
+        return;
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    if(!packet)
+    {
+        AV_LOG_E("can't alloct packet");
+        return;
+    }
+
+    // 3. decode once, every rung takes the same refcounted frame. pts is the index of the
+    // source frame, so the frames of rungs are aligned
+    int64_t frameIndex   = 0;
+    auto    decodedFrame = std::make_shared<Frame>();
+    auto    decodecCB    = [&](std::shared_ptr<Frame> frame) {
+        auto sharedFrame = std::make_shared<Frame>();
+        av_frame_move_ref(sharedFrame->getAVFrame(), frame->getAVFrame());
+        sharedFrame->getAVFrame()->pts = frameIndex++;
+        for(auto& rungEncoder : rungEncoders)
+        {
+            rungEncoder->push(sharedFrame);
+        }
+    };
+
+    while(readPacket(packet) >= 0)
+    {
+        if(packet->stream_index == videoStreamIdx)
+        {
+            videoCodec->decode(decodedFrame, packet, decodecCB);
+        }
+        av_packet_unref(packet);
+    }
+    videoCodec->decode(decodedFrame, packet, decodecCB, true);
+
+    // 4. flush the encoders of rungs
+    for(auto& rungEncoder : rungEncoders)
+    {
+        rungEncoder->finish();
+    }
+    AV_LOG_I("ladder decoded %ld frames into %zu rungs", frameIndex, rungEncoders.size());
+
+    // 5. release resource
+    av_packet_free(&packet);
+    if(params.metrics)
+    {
+        AV_LOG_I("job metrics %s", params.metrics->report().toJson().c_str());
+    }
+    if(params.trace)
+    {
+        params.trace->write();
     }
 }
 
@@ -277,83 +412,51 @@ void VideoDevice::readVideoFromStream(VideoReaderParam& param)
 {
     int  n              = 0;
     auto encodeCallback = [&](AVPacket* pkt) {
-        param.ofs.write(reinterpret_cast<char*>(pkt->data), pkt->size);
+        timedWrite(param.ofs, pkt->data, pkt->size);
         AV_LOG_D("write data %d", pkt->size);
+        if(param.qualityMeter)
+        {
+            param.qualityMeter->addPacket(pkt);
+        }
     };
 
-    SwsContext*            swsCtx = nullptr;
-    std::shared_ptr<Frame> pSwrOutFrame;
-    bool                   isNeedSws = false;
-    if(param.inWidth != param.outWidth || param.inHeight != param.outHeight ||
-       param.inPixFmt != param.outPixFmt)
-    {
-        swsCtx = sws_getContext(param.inWidth,
-                                param.inHeight,
-                                (AVPixelFormat)param.inPixFmt,
-                                param.outWidth,
-                                param.outHeight,
-                                (AVPixelFormat)param.outPixFmt,
-                                SWS_BICUBIC,
-                                nullptr,
-                                nullptr,
-                                nullptr);
-        if(swsCtx != nullptr)
-        {
-            VideoFrameParam vFrameParam{
-                .enable    = true,
-                .width     = param.outWidth,
-                .height    = param.outHeight,
-                .pixFormat = param.outPixFmt,
-            };
-            pSwrOutFrame = std::make_shared<Frame>(vFrameParam);
-            isNeedSws    = true;
-        }
-        AV_LOG_D("sws in w/h %d/%d out w/h %d/%d",
-                 param.inWidth,
-                 param.inHeight,
-                 param.outWidth,
-                 param.outHeight);
-    }
-    if(!isNeedSws)
-    {
-        AV_LOG_D("don't need sws");
-    }
-
-    while((n = param.ifs.readsome((char*)param.srcData, param.frameSize)) > 0)
+    ReampleParam scaleParam{
+        .inWidth        = param.inWidth,
+        .inHeight       = param.inHeight,
+        .inPixFmt       = param.inPixFmt,
+        .outWidth       = param.outWidth,
+        .outHeight      = param.outHeight,
+        .outPixFmt      = param.outPixFmt,
+        .scaleAlgorithm = param.scaleAlgorithm,
+    };
+    auto swsConvertor = std::make_shared<SwsConvertor>(scaleParam, param.frameAllocType);
+
+    while((n = timedReadsome(param.ifs, param.srcData, param.frameSize)) > 0)
     {
         param.frame->writeImageData(
             param.srcData, (AVPixelFormat)param.inPixFmt, param.inWidth, param.inHeight);
-        if(isNeedSws)
-        {
-            sws_scale(swsCtx,
-                      param.frame->data(),
-                      param.frame->lineSize(),
-                      0,
-                      param.inHeight,
-                      pSwrOutFrame->data(),
-                      pSwrOutFrame->lineSize());
-            pSwrOutFrame->getAVFrame()->pts++;
-
-            if(param.videoCodec->encodeEnable())
+        std::shared_ptr<Frame> outFrame = param.frame;
+        if(swsConvertor->enable())
+        {
+            outFrame = swsConvertor->scale(param.frame);
+            if(!outFrame)
             {
-                param.videoCodec->encode(pSwrOutFrame, param.pkt, encodeCallback);
+                continue;
             }
-            else
+        }
+        outFrame->getAVFrame()->pts++;
+
+        if(param.videoCodec->encodeEnable())
+        {
+            if(param.qualityMeter)
             {
-                writeImageToFile(param.ofs, param.frame);
+                param.qualityMeter->addSource(outFrame);
             }
+            param.videoCodec->encode(outFrame, param.pkt, encodeCallback);
         }
         else
         {
-            param.frame->getAVFrame()->pts++;
-            if(param.videoCodec->encodeEnable())
-            {
-                param.videoCodec->encode(param.frame, param.pkt, encodeCallback);
-            }
-            else
-            {
-                writeImageToFile(param.ofs, param.frame);
-            }
+            writeImageToFile(param.ofs, outFrame);
         }
     }
 
@@ -361,67 +464,43 @@ void VideoDevice::readVideoFromStream(VideoReaderParam& param)
     {
         param.videoCodec->encode(param.frame, param.pkt, encodeCallback, true);
     }
-
-    if(swsCtx)
-    {
-        sws_freeContext(swsCtx);
-    }
 }
 
 void VideoDevice::readVideoFromHWDevice(VideoReaderParam& param)
 {
-    if(getDeviceType() != DeviceType::VIDEO)
+    if(getDeviceType() != DeviceType::VIDEO && getDeviceType() != DeviceType::LAVFI &&
+       getDeviceType() != DeviceType::VIRTUAL && getDeviceType() != DeviceType::REPLAY)
     {
         AV_LOG_E("can't support read from hw device");
         return;
     }
-    int recordCnt = 30;
-
     //1. init param
-    auto*                  fmtCtx = getFmtCtx();
-    SwsContext*            swsCtx = nullptr;
-    std::shared_ptr<Frame> pSwrOutFrame;
-    bool                   isNeedSws    = false;
-    bool                   isNeedDecode = param.videoCodec->decodeEnable();
-    param.inPixFmt                      = convertDeprecatedFormat(param.inPixFmt);
+    auto* fmtCtx       = getFmtCtx();
+    bool  isNeedDecode = param.videoCodec->decodeEnable();
+    int   muxStream    = -1;
+    if(param.muxer)
+    {
+        if(!param.videoCodec->encodeEnable())
+        {
+            AV_LOG_E("raw video can't be muxed");
+            return;
+        }
+        muxStream = param.muxer->addStream(param.videoCodec->getCodecCtx(true));
+        if(muxStream < 0)
+            return;
+    }
 
     //2. check if need sws
-    if(param.inWidth != param.outWidth || param.inHeight != param.outHeight ||
-       param.inPixFmt != param.outPixFmt)
-    {
-        swsCtx = sws_getContext(param.inWidth,
-                                param.inHeight,
-                                (AVPixelFormat)param.inPixFmt,
-                                param.outWidth,
-                                param.outHeight,
-                                (AVPixelFormat)param.outPixFmt,
-                                SWS_BICUBIC,
-                                nullptr,
-                                nullptr,
-                                nullptr);
-        if(swsCtx != nullptr)
-        {
-            VideoFrameParam vFrameParam{
-                .enable    = true,
-                .width     = param.outWidth,
-                .height    = param.outHeight,
-                .pixFormat = param.outPixFmt,
-            };
-            pSwrOutFrame = std::make_shared<Frame>(vFrameParam);
-            isNeedSws    = true;
-        }
-        AV_LOG_D("sws in w/h %d/%d fmt %d out w/h %d/%d fmt %d",
-                 param.inWidth,
-                 param.inHeight,
-                 param.inPixFmt,
-                 param.outWidth,
-                 param.outHeight,
-                 param.outPixFmt);
-    }
-    if(!isNeedSws)
-    {
-        AV_LOG_D("don't need sws");
-    }
+    ReampleParam scaleParam{
+        .inWidth        = param.inWidth,
+        .inHeight       = param.inHeight,
+        .inPixFmt       = param.inPixFmt,
+        .outWidth       = param.outWidth,
+        .outHeight      = param.outHeight,
+        .outPixFmt      = param.outPixFmt,
+        .scaleAlgorithm = param.scaleAlgorithm,
+    };
+    auto swsConvertor = std::make_shared<SwsConvertor>(scaleParam, param.frameAllocType);
 
     // 3. check if need decode
     std::shared_ptr<Frame> pDecodeFrame;
@@ -432,6 +511,7 @@ void VideoDevice::readVideoFromHWDevice(VideoReaderParam& param)
             .width     = param.inWidth,
             .height    = param.inHeight,
             .pixFormat = param.inPixFmt,
+            .allocType = param.frameAllocType,
         };
         pDecodeFrame = std::make_shared<Frame>(vDecodeFrameParam);
     }
@@ -443,62 +523,114 @@ void VideoDevice::readVideoFromHWDevice(VideoReaderParam& param)
         AV_LOG_E("alloct packet error");
         return;
     }
-    int  basePts        = 0;
-    auto encodeCallback = [&](AVPacket* pkt) {
-        param.ofs.write(reinterpret_cast<char*>(pkt->data), pkt->size);
+    // capture time of the frame in process, of decoder input and of encoder input
+    CaptureLatency captureLatency("video");
+    CaptureTimeMap packetCaptureUs;
+    CaptureTimeMap frameCaptureUs;
+    int64_t        captureUs = -1;
+
+    int64_t basePts        = 0;
+    auto    encodeCallback = [&](AVPacket* pkt) {
+        captureLatency.record(frameCaptureUs.find(pkt->pts));
+        if(param.qualityMeter)
+        {
+            param.qualityMeter->addPacket(pkt);
+        }
         AV_LOG_D("write data %d", pkt->size);
-        recordCnt--;
+        if(param.muxer)
+        {
+            param.muxer->write(muxStream, pkt);
+        }
+        else
+        {
+            timedWrite(param.ofs, pkt->data, pkt->size);
+        }
     };
 
     // 5. encode process
-    auto encodeProcess = [&](std::shared_ptr<Frame> frame) {
-        if(isNeedSws)
-        {
-            sws_scale(swsCtx,
-                      frame->data(),
-                      frame->lineSize(),
-                      0,
-                      param.inHeight,
-                      pSwrOutFrame->data(),
-                      pSwrOutFrame->lineSize());
-            pSwrOutFrame->getAVFrame()->pts = basePts++;
-            if(param.videoCodec->encodeEnable())
-            {
-                param.videoCodec->encode(pSwrOutFrame, newPkt, encodeCallback);
-            }
-            else
+    FrameDiffDetector      frameDiff(param.frameDiffParam);
+    std::shared_ptr<Frame> lastOutFrame;
+    auto encodeOut = [&](std::shared_ptr<Frame> outFrame) {
+        outFrame->getAVFrame()->pts = basePts++;
+        if(param.videoCodec->encodeEnable())
+        {
+            if(param.qualityMeter)
             {
-                writeImageToFile(param.ofs, pSwrOutFrame);
+                param.qualityMeter->addSource(outFrame);
             }
+            frameCaptureUs.add(outFrame->getAVFrame()->pts, captureUs);
+            param.videoCodec->encode(outFrame, newPkt, encodeCallback);
         }
         else
         {
-            param.frame->getAVFrame()->pts = basePts++;
-            if(param.videoCodec->encodeEnable())
+            writeImageToFile(param.ofs, outFrame);
+            captureLatency.record(captureUs);
+        }
+    };
+    auto encodeProcess = [&](std::shared_ptr<Frame> frame) {
+        if(frameDiff.isDuplicate(frame->getAVFrame()))
+        {
+            // a muxed stream is timestamped by the clock, the previous frame lasts until the
+            // next one. raw h264/yuv has no timestamp, repeat the previous frame without scale
+            // to keep the duration, the encoder codes it as a skip frame
+            if(!param.muxer && lastOutFrame)
             {
-                param.videoCodec->encode(frame, newPkt, encodeCallback);
+                // a relabeled output refers to the planes of a packet already released,
+                // relabel the duplicate instead
+                std::shared_ptr<Frame> repeatFrame = lastOutFrame;
+                if(swsConvertor->enable() && swsConvertor->isRelabel())
+                {
+                    repeatFrame = swsConvertor->scale(frame);
+                }
+                if(repeatFrame)
+                {
+                    encodeOut(repeatFrame);
+                }
             }
-            else
+            param.frame->setComplete(false);
+            return;
+        }
+        std::shared_ptr<Frame> outFrame = frame;
+        if(swsConvertor->enable())
+        {
+            outFrame = swsConvertor->scale(frame);
+            if(!outFrame)
             {
-                writeImageToFile(param.ofs, frame);
+                return;
             }
         }
+        if(param.muxer)
+        {
+            // on the clock of the muxer shared with audio, a frame dropped on the way leaves
+            // its gap in the stream
+            AVRational timeBase = param.videoCodec->getCodecCtx(true)->time_base;
+            int64_t    clockUs  = (captureUs >= 0 ? captureUs : av_gettime_relative()) -
+                              param.muxer->clockStartUs();
+            basePts = std::max(basePts, av_rescale_q(clockUs, AV_TIME_BASE_Q, timeBase));
+        }
+        encodeOut(outFrame);
+        lastOutFrame = outFrame;
         param.frame->setComplete(false);
     };
 
-    // 6. decodec callback
+    // 6. decodec callback, scale/encode the decoded frame directly instead of copy it
     auto decodecCB = [&](std::shared_ptr<Frame> frame) {
-        av_frame_copy_props(param.frame->getAVFrame(), frame->getAVFrame());
-        av_frame_copy(param.frame->getAVFrame(), frame->getAVFrame());
+        captureUs = packetCaptureUs.find(frame->getAVFrame()->best_effort_timestamp);
+        encodeProcess(frame);
     };
 
-    // 7. start recieve data from hw device
-    while(av_read_frame(fmtCtx, param.pkt) >= 0 && recordCnt > 0)
+    // 7. start recieve data from hw device, it's read on the capture thread
+    CaptureThread capture(fmtCtx,
+                          [this](AVPacket* pkt) { return readPacket(pkt); },
+                          boundedCaptureParam(param.captureParam, kDefaultCapturePackets),
+                          "video");
+    capture.start();
+    while(capture.pop(param.pkt, captureUs))
     {
         if(isNeedDecode)
         {
+            packetCaptureUs.add(param.pkt->pts, captureUs);
             param.videoCodec->decode(pDecodeFrame, param.pkt, decodecCB);
-            encodeProcess(param.frame);
         }
         else
         {
@@ -506,6 +638,7 @@ void VideoDevice::readVideoFromHWDevice(VideoReaderParam& param)
                 param.pkt->data, param.inPixFmt, param.inWidth, param.inHeight);
             encodeProcess(param.frame);
         }
+        av_packet_unref(param.pkt);
     }
 
     // 8. flush encoder
@@ -514,12 +647,16 @@ void VideoDevice::readVideoFromHWDevice(VideoReaderParam& param)
         param.videoCodec->encode(param.frame, param.pkt, encodeCallback, true);
     }
 
-    // 9. release resource
-    if(swsCtx)
+    if(frameDiff.enable())
     {
-        sws_freeContext(swsCtx);
+        AV_LOG_I("frame diff kept %ld frames, dropped %ld duplicate frames",
+                 frameDiff.keptFrames(),
+                 frameDiff.droppedFrames());
     }
+    capture.logStats();
+    captureLatency.logSummary();
 
+    // 9. release resource
     if(newPkt)
     {
         av_packet_free(&newPkt);
@@ -528,12 +665,14 @@ void VideoDevice::readVideoFromHWDevice(VideoReaderParam& param)
 
 void VideoDevice::writeImageToFile(std::ofstream& ofs, std::shared_ptr<Frame> frame)
 {
-    int format = convertDeprecatedFormat(frame->format());
+    StageTimer timer(Stage::WRITE);
+    int        format = convertDeprecatedFormat(frame->format());
     if(format == AVPixelFormat::AV_PIX_FMT_YUV420P)
     {
         int y_size = frame->width() * frame->heigt();
         int u_size = y_size / 4;
         int v_size = y_size / 4;
+        timer.addBytes(y_size + u_size + v_size);
         ofs.write(reinterpret_cast<char*>(frame->data()[0]), y_size);
         ofs.write(reinterpret_cast<char*>(frame->data()[1]), u_size);
         ofs.write(reinterpret_cast<char*>(frame->data()[2]), v_size);
@@ -543,6 +682,7 @@ void VideoDevice::writeImageToFile(std::ofstream& ofs, std::shared_ptr<Frame> fr
         int y_size = frame->width() * frame->heigt();
         int u_size = y_size / 2;
         int v_size = y_size / 2;
+        timer.addBytes(y_size + u_size + v_size);
         ofs.write(reinterpret_cast<char*>(frame->data()[0]), y_size);
         ofs.write(reinterpret_cast<char*>(frame->data()[1]), u_size);
         ofs.write(reinterpret_cast<char*>(frame->data()[2]), v_size);
@@ -553,21 +693,167 @@ void VideoDevice::writeImageToFile(std::ofstream& ofs, std::shared_ptr<Frame> fr
     }
 }
 
-int convertDeprecatedFormat(int format)
+std::shared_ptr<Frame> VideoDevice::readFrameAt(int64_t     pts,
+                                                int         outWidth,
+                                                int         outHeight,
+                                                int         outPixFmt,
+                                                FrameCache* cache,
+                                                bool        useCodecPool)
 {
-    switch(format)
-    {
-    case AV_PIX_FMT_YUVJ420P:
-        return AV_PIX_FMT_YUV420P;
-    case AV_PIX_FMT_YUVJ422P:
-        return AV_PIX_FMT_YUV422P;
-    case AV_PIX_FMT_YUVJ444P:
-        return AV_PIX_FMT_YUV444P;
-    case AV_PIX_FMT_YUVJ440P:
-        return AV_PIX_FMT_YUV440P;
-    case AV_PIX_FMT_YUVJ411P:
-        return AV_PIX_FMT_YUV411P;
-    default:
-        return format;
-    }
-}
\ No newline at end of file
+    if(getDeviceType() != DeviceType::ENCAPSULATE_FILE)
+    {
+        AV_LOG_E("random access is only supported by file");
+        return nullptr;
+    }
+    int videoStreamIdx = findStreamIdxByMediaType(AVMediaType::AVMEDIA_TYPE_VIDEO);
+    if(videoStreamIdx == -1)
+    {
+        AV_LOG_E("can't find video stream.");
+        return nullptr;
+    }
+    auto*              fmtCtx   = getFmtCtx();
+    AVCodecParameters* codecPar = fmtCtx->streams[videoStreamIdx]->codecpar;
+
+    outWidth  = outWidth > 0 ? outWidth : codecPar->width;
+    outHeight = outHeight > 0 ? outHeight : codecPar->height;
+    outPixFmt = outPixFmt >= 0 ? outPixFmt : codecPar->format;
+    std::string streamKey = FrameCache::streamKey(getDeviceName(), outWidth, outHeight, outPixFmt);
+    if(cache)
+    {
+        if(auto cachedFrame = cache->get(streamKey, pts); cachedFrame)
+        {
+            return cachedFrame;
+        }
+    }
+
+    // 1. decoder, a pooled one is reset when it goes back to pool
+    DecoderParam decodeParam{.needDecode = true,
+                             .codecId    = codecPar->codec_id,
+                             .avCodecPar = codecPar,
+                             .byId       = true};
+    CodecParam   codecParam = {.decodeParam = decodeParam};
+    auto videoCodec = useCodecPool ? CodecPool::instance().acquireVideo(codecParam)
+                                   : std::make_shared<VideoCodec>(codecParam);
+    if(!videoCodec->decodeEnable())
+    {
+        return nullptr;
+    }
+
+    // 2. seek to the key frame before pts
+    if(av_seek_frame(fmtCtx, videoStreamIdx, pts, AVSEEK_FLAG_BACKWARD) < 0)
+    {
+        AV_LOG_E("failed to seek to %ld", pts);
+        return nullptr;
+    }
+
+    ReampleParam scaleParam{
+        .inWidth   = codecPar->width,
+        .inHeight  = codecPar->height,
+        .inPixFmt  = codecPar->format,
+        .outWidth  = outWidth,
+        .outHeight = outHeight,
+        .outPixFmt = outPixFmt,
+    };
+    auto swsConvertor = std::make_shared<SwsConvertor>(scaleParam);
+    auto decodeFrame  = std::make_shared<Frame>();
+
+    // 3. decode the GOP around pts, the end pts of a frame is the pts of the next one
+    std::shared_ptr<Frame> result;
+    std::shared_ptr<Frame> prevFrame;
+    int64_t                prevPts      = 0;
+    int64_t                prevDuration = 0;
+    bool                   passed       = false;
+    auto finishPrevFrame = [&](int64_t endPts) {
+        if(!prevFrame)
+            return;
+        if(cache)
+        {
+            cache->put(streamKey, prevPts, endPts, prevFrame);
+        }
+        // the last frame not after pts, or the first frame if pts is before it
+        if(prevPts <= pts || !result)
+        {
+            result = prevFrame;
+        }
+        prevFrame = nullptr;
+    };
+    auto decodecCB = [&](std::shared_ptr<Frame> frame) {
+        AVFrame* avFrame  = frame->getAVFrame();
+        int64_t  framePts = avFrame->best_effort_timestamp;
+        if(framePts == AV_NOPTS_VALUE)
+        {
+            framePts = avFrame->pts;
+        }
+        if(framePts == AV_NOPTS_VALUE)
+        {
+            // can't be placed in the GOP or cached
+            AV_LOG_W("skip a frame without timestamp");
+            return;
+        }
+
+        std::shared_ptr<Frame> outFrame = frame;
+        if(swsConvertor->enable())
+        {
+            outFrame = swsConvertor->scale(frame);
+            if(!outFrame)
+            {
+                return;
+            }
+        }
+        // decoder and convertor reuse their frames, keep a copy
+        VideoFrameParam vFrameParam{
+            .enable    = true,
+            .width     = outWidth,
+            .height    = outHeight,
+            .pixFormat = outFrame->format(),
+        };
+        auto copyFrame = std::make_shared<Frame>(vFrameParam);
+        if(!copyFrame->isValid() ||
+           av_frame_copy(copyFrame->getAVFrame(), outFrame->getAVFrame()) < 0)
+        {
+            AV_LOG_E("failed to copy frame of pts %ld", framePts);
+            return;
+        }
+        av_frame_copy_props(copyFrame->getAVFrame(), avFrame);
+
+        finishPrevFrame(framePts);
+        prevFrame    = copyFrame;
+        prevPts      = framePts;
+        prevDuration = avFrame->pkt_duration;
+        passed |= framePts > pts;
+    };
+
+    AVPacket* packet = av_packet_alloc();
+    if(!packet)
+    {
+        AV_LOG_E("can't alloct packet");
+        return nullptr;
+    }
+    while(timedReadFrame(fmtCtx, packet) >= 0)
+    {
+        if(packet->stream_index == videoStreamIdx)
+        {
+            // the next GOP, the rest frames of this GOP come out by flush
+            if(passed && (packet->flags & AV_PKT_FLAG_KEY))
+            {
+                av_packet_unref(packet);
+                break;
+            }
+            videoCodec->decode(decodeFrame, packet, decodecCB);
+        }
+        av_packet_unref(packet);
+    }
+    videoCodec->decode(decodeFrame, packet, decodecCB, true);
+    finishPrevFrame(prevPts + std::max<int64_t>(prevDuration, 1));
+    av_packet_free(&packet);
+
+    if(cache)
+    {
+        FrameCacheStats stats = cache->stats();
+        AV_LOG_D("frame cache %zu frames %zu bytes, hit ratio %.3f",
+                 stats.entries,
+                 stats.bytes,
+                 stats.hitRatio());
+    }
+    return result;
+}
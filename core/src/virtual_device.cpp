@@ -0,0 +1,168 @@
+#include "virtual_device.h"
+#include "../../utils/include/log.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavformat/avformat.h>
+#include <libavutil/dict.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+}
+
+#include <cstdlib>
+
+namespace
+{
+std::string optionOr(AVDictionary* options, const char* key, const char* defaultValue)
+{
+    AVDictionaryEntry* entry = av_dict_get(options, key, nullptr, 0);
+    return entry ? entry->value : defaultValue;
+}
+} // namespace
+
+// -------------------------- VirtualDeviceSpec --------------------------
+VirtualDeviceSpec parseVirtualDevice(const std::string& source, AVDictionary* options)
+{
+    VirtualDeviceSpec spec;
+    std::string       filterName = source.substr(0, source.find('='));
+    const AVFilter*   filter     = avfilter_get_by_name(filterName.c_str());
+    if(!filter || avfilter_pad_count(filter->inputs) != 0 ||
+       avfilter_pad_count(filter->outputs) != 1)
+    {
+        AV_LOG_E("%s is not a lavfi source", filterName.c_str());
+        return spec;
+    }
+    bool isVideo = avfilter_pad_get_type(filter->outputs, 0) == AVMEDIA_TYPE_VIDEO;
+
+    // generator arguments follow those in the device name
+    std::string graph = source + (source.find('=') == std::string::npos ? "=" : ":");
+    if(isVideo)
+    {
+        std::string inputFormat = optionOr(options, "input_format", "yuyv422");
+        spec.mjpeg              = inputFormat == "mjpeg";
+        spec.mjpegQscale        = std::atoi(optionOr(options, "mjpeg_qscale", "3").c_str());
+        graph += "size=" + optionOr(options, "video_size", "1280x720") +
+                 ":rate=" + optionOr(options, "framerate", "30");
+        // jpeg of usb cameras is 4:2:2 full range
+        graph += ",format=" + (spec.mjpeg ? std::string("yuvj422p") : inputFormat);
+    }
+    else
+    {
+        // alsa reads packed samples of one period at a time
+        graph += "sample_rate=" + optionOr(options, "sample_rate", "48000");
+        graph += ",aformat=sample_fmts=" + optionOr(options, "sample_format", "s16") +
+                 ":channel_layouts=" + optionOr(options, "channels", "2") + "c";
+        graph += ",asetnsamples=n=" + optionOr(options, "period_size", "1024") + ":p=0";
+    }
+
+    std::string duration = optionOr(options, "duration", "");
+    if(!duration.empty())
+    {
+        spec.endless = false;
+        graph += isVideo ? ",trim=duration=" : ",atrim=duration=";
+        graph += duration;
+    }
+    if(optionOr(options, "realtime", "1") != "0")
+    {
+        graph += isVideo ? ",realtime" : ",arealtime";
+    }
+    spec.graph = graph;
+    AV_LOG_D("virtual device %s", spec.graph.c_str());
+    return spec;
+}
+
+// -------------------------- MjpegPacketizer --------------------------
+MjpegPacketizer::~MjpegPacketizer()
+{
+    if(m_codecCtx)
+    {
+        avcodec_free_context(&m_codecCtx);
+    }
+    if(m_frame)
+    {
+        av_frame_free(&m_frame);
+    }
+    if(m_jpegPkt)
+    {
+        av_packet_free(&m_jpegPkt);
+    }
+}
+
+bool MjpegPacketizer::open(AVStream* stream, int qscale)
+{
+    AVCodecParameters* codecpar = stream->codecpar;
+    const AVCodec*     codec    = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    if(!codec)
+    {
+        AV_LOG_E("can't find mjpeg encoder");
+        return false;
+    }
+    m_codecCtx = avcodec_alloc_context3(codec);
+    m_frame    = av_frame_alloc();
+    m_jpegPkt  = av_packet_alloc();
+    if(!m_codecCtx || !m_frame || !m_jpegPkt)
+    {
+        AV_LOG_E("alloc mjpeg encoder error");
+        return false;
+    }
+    m_codecCtx->width          = codecpar->width;
+    m_codecCtx->height         = codecpar->height;
+    m_codecCtx->pix_fmt        = (AVPixelFormat)codecpar->format;
+    m_codecCtx->color_range    = AVCOL_RANGE_JPEG;
+    m_codecCtx->time_base      = stream->time_base;
+    m_codecCtx->flags         |= AV_CODEC_FLAG_QSCALE;
+    m_codecCtx->global_quality = FF_QP2LAMBDA * qscale;
+    if(int ret = avcodec_open2(m_codecCtx, codec, nullptr); ret < 0)
+    {
+        char errors[1024];
+        av_strerror(ret, errors, sizeof(errors));
+        AV_LOG_E("open mjpeg encoder error %s", errors);
+        return false;
+    }
+
+    // what v4l2 gives for a camera in mjpeg after find stream info
+    codecpar->codec_id  = AV_CODEC_ID_MJPEG;
+    codecpar->codec_tag = 0;
+    return true;
+}
+
+int MjpegPacketizer::packetize(AVPacket* pkt)
+{
+    // lavfi packs the image without padding, the frame refers to the packet instead of copy
+    m_frame->format = m_codecCtx->pix_fmt;
+    m_frame->width  = m_codecCtx->width;
+    m_frame->height = m_codecCtx->height;
+    m_frame->pts    = pkt->pts;
+    m_frame->buf[0] = pkt->buf ? av_buffer_ref(pkt->buf) : nullptr;
+    int ret         = av_image_fill_arrays(m_frame->data,
+                                   m_frame->linesize,
+                                   pkt->data,
+                                   m_codecCtx->pix_fmt,
+                                   m_codecCtx->width,
+                                   m_codecCtx->height,
+                                   1);
+    if(ret >= 0)
+    {
+        ret = avcodec_send_frame(m_codecCtx, m_frame);
+    }
+    av_frame_unref(m_frame);
+    if(ret >= 0)
+    {
+        // mjpeg has no delay, every image gives its jpeg
+        ret = avcodec_receive_packet(m_codecCtx, m_jpegPkt);
+    }
+    if(ret < 0)
+    {
+        char errors[1024];
+        av_strerror(ret, errors, sizeof(errors));
+        AV_LOG_E("encode virtual mjpeg error %s", errors);
+        return ret;
+    }
+    m_jpegPkt->stream_index = pkt->stream_index;
+    m_jpegPkt->pos          = pkt->pos;
+    av_packet_unref(pkt);
+    av_packet_move_ref(pkt, m_jpegPkt);
+    return 0;
+}
@@ -14,24 +14,34 @@ extern "C"
 #include <string>
 #include <iostream>
 #include <fstream>
+#include "av_capture.h"
 #include "device.h"
 #include "resample.h"
 #include "codec.h"
+#include "codec_registry.h"
+#include "frame.h"
+#include "frame_cache.h"
 #include "log.h"
 
 void initParam()
 {
     avdevice_register_all();    
+    // build codec capability tables once, codecs of every job look up from it
+    CodecRegistry::instance();
     // av_log_set_level(AV_LOG_DEBUG);
+    // logSetLevel(LogLevel::INFO);
 }
 
 void testReadAudioFromDevice();
 void testReadAudioFromFile();
 void testReadPCMAndEncode();
+void testMixPCMAndEncode();
 
 void testReadVideoFromDevice();
 void testReadImageDataAndEncodeVideo();
 void testReadVideoDataFromFile();
+void testScrubVideoFrames();
+void testCaptureAudioVideo();
 
 int main()
 {
@@ -39,9 +49,12 @@ int main()
     // testReadAudioFromDevice();
     // testReadAudioFromFile();
     // testReadPCMAndEncode();
+    // testMixPCMAndEncode();
     // testReadVideoDataFromFile();
     testReadImageDataAndEncodeVideo();
     // testReadVideoFromDevice();
+    // testScrubVideoFrames();
+    // testCaptureAudioVideo();
     return 0;
 }
 
@@ -84,7 +97,8 @@ void testReadAudioFromDevice()
     {
         .outFilename = "out.aac",
         .resampleParam = swrCtxParam,
-        .codecParam = encoderParam
+        .codecParam = encoderParam,
+        .captureParam = {.durationSeconds = 10},
     };
 
     device.readAndEncode(readParams);
@@ -209,6 +223,52 @@ void testReadImageDataAndEncodeVideo()
     device.readAndEncode(readParams);
 }
 
+void testMixPCMAndEncode()
+{
+    EncoderParam audioEncodeParam
+    {
+        .needEncode = true,
+        .codecName = "libfdk_aac",
+        .bitRate = 0,
+        .profile = FF_PROFILE_AAC_HE_V2,
+        .sampleFmt = AV_SAMPLE_FMT_S16,
+        .channelLayout = AV_CH_LAYOUT_STEREO,
+        .sampleRate = 44100,
+        .byName = true,
+    };
+
+    CodecParam encoderParam =
+    {
+        .encodeParam = audioEncodeParam
+    };
+
+    std::vector<AudioMixInput> inputs
+    {
+        {
+            .inFilename = "/home/yeonon/learn/av/demo/build/out3.pcm",
+            .inChannelLayout = AV_CH_LAYOUT_STEREO,
+            .inSampleFmt = AV_SAMPLE_FMT_S16,
+            .inSampleRate = 44100,
+            .gain = 0.8f,
+        },
+        {
+            .device = std::make_shared<AudioDevice>("hw:0", DeviceType::AUDIO),
+            .inChannelLayout = AV_CH_LAYOUT_STEREO,
+            .inSampleFmt = AV_SAMPLE_FMT_S16,
+            .inSampleRate = 48000,
+        },
+    };
+
+    ReadDeviceDataParam readParams
+    {
+        .outFilename = "out_mix.aac",
+        .codecParam = encoderParam,
+        .captureParam = {.durationSeconds = 10},
+    };
+
+    AudioDevice::readAndMix(inputs, readParams);
+}
+
 void testReadVideoFromDevice()
 {
     AVDictionary* options = nullptr;
@@ -255,7 +315,110 @@ void testReadVideoFromDevice()
         .outFilename = "out3.h264",
         .resampleParam = scaleParam,
         .codecParam = codecParam,
+        .captureParam = {.durationSeconds = 2},
     };
 
     device.readAndEncode(param);
 }
+
+void testScrubVideoFrames()
+{
+    VideoDevice device("/home/yeonon/learn/av/demo/build/file_example_MP4_1920_18MG.mp4", DeviceType::ENCAPSULATE_FILE);
+
+    // 64MB of 360p preview frames
+    FrameCache cache(64 * 1024 * 1024);
+    std::ofstream ofs("./scrub.yuv");
+    // scrub back and forth around the same position, only the first request decodes
+    for(int i = 0; i < 100; i++)
+    {
+        int64_t pts = 90000 + (i % 10) * 3000;
+        auto frame = device.readFrameAt(
+            pts, 640, 360, AVPixelFormat::AV_PIX_FMT_YUV420P, &cache, true);
+        if(frame)
+        {
+            device.writeImageToFile(ofs, frame);
+        }
+    }
+
+    FrameCacheStats stats = cache.stats();
+    AV_LOG_I("hits %lu misses %lu hit ratio %.3f, %zu frames %zu bytes",
+             stats.hits,
+             stats.misses,
+             stats.hitRatio(),
+             stats.entries,
+             stats.bytes);
+}
+
+void testCaptureAudioVideo()
+{
+    AudioDevice audioDevice("hw:0", DeviceType::AUDIO);
+
+    AVDictionary* options = nullptr;
+    av_dict_set(&options, "video_size", "1280x720", 0);
+    av_dict_set(&options, "framerate", "30", 0);
+    av_dict_set(&options, "input_format", "mjpeg", 0);
+    VideoDevice videoDevice("/dev/video0", DeviceType::VIDEO, options);
+
+    ReampleParam swrCtxParam =
+    {
+        .outChannelLayout = AV_CH_LAYOUT_STEREO,
+        .outSampleFmt = AV_SAMPLE_FMT_FLTP,
+        .outSampleRate = 48000,
+        .inChannelLayout = AV_CH_LAYOUT_STEREO,
+        .inSampleFmt = AV_SAMPLE_FMT_S16,
+        .inSampleRate = 48000,
+        .logOffset = 0,
+        .logCtx = nullptr
+    };
+    EncoderParam audioEncodeParam
+    {
+        .needEncode = true,
+        .codecName = "aac",
+        .bitRate = 128000,
+        .sampleFmt = AV_SAMPLE_FMT_FLTP,
+        .channelLayout = AV_CH_LAYOUT_STEREO,
+        .sampleRate = 48000,
+        .byName = true,
+    };
+
+    ReampleParam scaleParam
+    {
+        .outWidth = 1280,
+        .outHeight = 720,
+        .outPixFmt = AVPixelFormat::AV_PIX_FMT_YUV420P,
+    };
+    EncoderParam videoEncodeParam
+    {
+        .needEncode = true,
+        .codecName = "libx264",
+        .bitRate = 2000000,
+        .width = scaleParam.outWidth,
+        .height = scaleParam.outHeight,
+        .gopSize = 60,
+        .maxBFrame = 2,
+        .hasBFrame = 1,
+        .pixFmt = AVPixelFormat(scaleParam.outPixFmt),
+        .framerate = 30,
+        .byName = true
+    };
+
+    // both stop after 10s, or share a StopSignal in their captureParam to stop them together
+    AVCaptureParam param
+    {
+        .outFilename = "out_av.mkv",
+        .audioParam =
+        {
+            .resampleParam = swrCtxParam,
+            .codecParam = {.encodeParam = audioEncodeParam},
+            .captureParam = {.durationSeconds = 10},
+        },
+        .videoParam =
+        {
+            .resampleParam = scaleParam,
+            .codecParam = {.encodeParam = videoEncodeParam},
+            .captureParam = {.durationSeconds = 10},
+        },
+    };
+
+    captureAudioVideo(audioDevice, videoDevice, param);
+}
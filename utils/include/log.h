@@ -1,50 +1,288 @@
 #pragma once
 
-#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
+#include <memory>
+#include <type_traits>
+
+// Asynchronous logger. AV_LOG_* copies the format pointer and the raw arguments into a ring
+// buffer of the calling thread, a background thread formats and writes them. The caller
+// never formats, locks or makes a syscall; when its ring is full the message is dropped and
+// counted. The format must be a string literal, it's stored as a pointer.
+//
+// Levels below AV_LOG_MIN_LEVEL are compiled out, arguments are not even evaluated. It's
+// INFO for NDEBUG builds and DEBUG otherwise, override with -DAV_LOG_MIN_LEVEL=n. Compiled in
+// levels are filtered by logSetLevel at runtime, and every call site below ERROR is rate
+// limited by logSetRateLimit, so debug logs left on don't flood a hot loop. Errors are never
+// suppressed.
+#define AV_LOG_LEVEL_DEBUG   0
+#define AV_LOG_LEVEL_INFO    1
+#define AV_LOG_LEVEL_WARNING 2
+#define AV_LOG_LEVEL_ERROR   3
+
+#ifndef AV_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define AV_LOG_MIN_LEVEL AV_LOG_LEVEL_INFO
+#else
+#define AV_LOG_MIN_LEVEL AV_LOG_LEVEL_DEBUG
+#endif
+#endif
+
+#if AV_LOG_MIN_LEVEL <= AV_LOG_LEVEL_DEBUG
+#define AV_LOG_D(format, ...) AV_LOG_IMPL(LogLevel::DEBUG, format, ##__VA_ARGS__)
+#else
+#define AV_LOG_D(format, ...) AV_LOG_DISABLED(format, ##__VA_ARGS__)
+#endif
+
+#if AV_LOG_MIN_LEVEL <= AV_LOG_LEVEL_INFO
+#define AV_LOG_I(format, ...) AV_LOG_IMPL(LogLevel::INFO, format, ##__VA_ARGS__)
+#else
+#define AV_LOG_I(format, ...) AV_LOG_DISABLED(format, ##__VA_ARGS__)
+#endif
+
+#if AV_LOG_MIN_LEVEL <= AV_LOG_LEVEL_WARNING
+#define AV_LOG_W(format, ...) AV_LOG_IMPL(LogLevel::WARNING, format, ##__VA_ARGS__)
+#else
+#define AV_LOG_W(format, ...) AV_LOG_DISABLED(format, ##__VA_ARGS__)
+#endif
+
+#define AV_LOG_E(format, ...) AV_LOG_IMPL(LogLevel::ERROR, format, ##__VA_ARGS__)
+
+#define AV_LOG_IMPL(level, format, ...)                                                    \
+    do                                                                                     \
+    {                                                                                      \
+        if(false)                                                                          \
+            logFormatCheck("" format, ##__VA_ARGS__);                                      \
+        if(logLevelEnabled(level))                                                         \
+        {                                                                                  \
+            static LogRateLimiter avLogLimiter;                                            \
+            int64_t               avLogNow        = logNowNs();                            \
+            uint32_t              avLogSuppressed = 0;                                     \
+            if((level) == LogLevel::ERROR ||                                               \
+               avLogLimiter.allow(avLogNow, avLogSuppressed))                              \
+            {                                                                              \
+                logWrite(level,                                                            \
+                         avLogNow,                                                         \
+                         avLogSuppressed,                                                  \
+                         __FILE__,                                                         \
+                         __FUNCTION__,                                                     \
+                         __LINE__,                                                         \
+                         "" format,                                                        \
+                         ##__VA_ARGS__);                                                   \
+            }                                                                              \
+        }                                                                                  \
+    } while(0)
+
+// type checked only, no code is generated
+#define AV_LOG_DISABLED(format, ...)                                                       \
+    do                                                                                     \
+    {                                                                                      \
+        if(false)                                                                          \
+            logFormatCheck("" format, ##__VA_ARGS__);                                      \
+    } while(0)
+
+enum class LogLevel : uint8_t
+{
+    DEBUG   = AV_LOG_LEVEL_DEBUG,
+    INFO    = AV_LOG_LEVEL_INFO,
+    WARNING = AV_LOG_LEVEL_WARNING,
+    ERROR   = AV_LOG_LEVEL_ERROR,
+};
+
+enum class LogArgType : uint8_t
+{
+    INT,
+    UINT,
+    DOUBLE,
+    STRING,
+    POINTER,
+};
 
-#define AV_LOG_I(format, ...)                                                              \
-{                                                                                          \
-    time_t t = time(0);                                                                    \
-    struct tm ptm;                                                                         \
-    memset(&ptm, 0, sizeof(ptm));                                                          \
-    localtime_r(&t, &ptm);                                                                 \
-    fprintf(stdout, "[ INFO ] [ %4d-%02d-%02d %02d:%02d:%02d ] [ %s:%s:%d ] " format "\n",   \
-            ptm.tm_year + 1900, ptm.tm_mon + 1, ptm.tm_mday, ptm.tm_hour,                  \
-            ptm.tm_min, ptm.tm_sec, __FILE__, __FUNCTION__ , __LINE__, ##__VA_ARGS__);     \
+// fixed part of a record, followed by the arguments as [type][value], a string argument is
+// [STRING][uint16 length][bytes]['\0']
+struct LogRecordHeader
+{
+    // whole record, 8 bytes aligned. 0 marks the padding at the end of ring
+    uint32_t    size;
+    LogLevel    level;
+    uint8_t     argc;
+    int         line;
+    // messages of the same call site dropped by rate limit before this one
+    uint32_t    suppressed;
+    int64_t     timeNs;
+    const char* file;
+    const char* func;
+    const char* format;
+};
+
+// reserve size bytes in the ring of this thread, nullptr if it's full
+uint8_t* logReserve(uint32_t size);
+// publish the reserved record
+void     logCommit();
+int64_t  logNowNs();
+// wait until every committed record is written
+void     logFlush();
+// write all levels to file instead of stdout(info)/stderr(others), nullptr restores them
+void     logSetOutput(FILE* file);
+uint64_t logDroppedCount();
+
+// messages below level are skipped at runtime, default is DEBUG
+void     logSetLevel(LogLevel level);
+LogLevel logLevel();
+// max messages per second of every call site below ERROR, 0 is unlimited. default is 100
+void     logSetRateLimit(uint32_t perSecond);
+uint32_t logRateLimit();
+
+namespace logdetail
+{
+extern std::atomic<int> g_runtimeLevel;
+extern std::atomic<uint32_t> g_rateLimit;
+} // namespace logdetail
+
+inline bool logLevelEnabled(LogLevel level)
+{
+    return (int)level >= logdetail::g_runtimeLevel.load(std::memory_order_relaxed);
+}
+
+// fixed window limiter of one call site, approximate under contention
+class LogRateLimiter
+{
+public:
+    bool allow(int64_t nowNs, uint32_t& suppressed)
+    {
+        uint32_t limit = logdetail::g_rateLimit.load(std::memory_order_relaxed);
+        if(limit != 0)
+        {
+            int64_t start = m_windowStart.load(std::memory_order_relaxed);
+            if(nowNs - start >= 1000000000 &&
+               m_windowStart.compare_exchange_strong(start, nowNs, std::memory_order_relaxed))
+            {
+                m_count.store(0, std::memory_order_relaxed);
+            }
+            if(m_count.fetch_add(1, std::memory_order_relaxed) >= limit)
+            {
+                m_suppressed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        suppressed = m_suppressed.load(std::memory_order_relaxed) == 0
+                         ? 0
+                         : m_suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    std::atomic<int64_t>  m_windowStart{0};
+    std::atomic<uint32_t> m_count{0};
+    std::atomic<uint32_t> m_suppressed{0};
+};
+
+// only for the compiler to check format and arguments
+inline void logFormatCheck(const char*, ...) __attribute__((format(printf, 1, 2)));
+inline void logFormatCheck(const char*, ...) { }
+
+namespace logdetail
+{
+// longer string arguments are truncated
+constexpr size_t kMaxStringArg = 512;
+
+inline size_t stringLength(const char* str)
+{
+    return str ? strnlen(str, kMaxStringArg) : 6;
 }
 
+template <typename T>
+size_t argSize(const T& arg)
+{
+    if constexpr(std::is_same_v<T, const char*> || std::is_same_v<T, char*>)
+    {
+        return 1 + sizeof(uint16_t) + stringLength(arg) + 1;
+    }
+    else
+    {
+        return 1 + 8;
+    }
+}
 
-#define AV_LOG_E(format, ...)                                                              \
-{                                                                                          \
-    time_t t = time(0);                                                                    \
-    struct tm ptm;                                                                         \
-    memset(&ptm, 0, sizeof(ptm));                                                          \
-    localtime_r(&t, &ptm);                                                                 \
-    fprintf(stderr, "[ ERROR] [%4d-%02d-%02d %02d:%02d:%02d ] [ %s:%s:%d ] " format "\n",    \
-            ptm.tm_year + 1900, ptm.tm_mon + 1, ptm.tm_mday, ptm.tm_hour,                  \
-            ptm.tm_min, ptm.tm_sec, __FILE__, __FUNCTION__ , __LINE__, ##__VA_ARGS__);     \
+template <typename T>
+uint8_t* writeValue(uint8_t* p, LogArgType type, T value)
+{
+    static_assert(sizeof(T) == 8);
+    *p++ = (uint8_t)type;
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
 }
 
-#define AV_LOG_D(format, ...)                                                              \
-{                                                                                          \
-    time_t t = time(0);                                                                    \
-    struct tm ptm;                                                                         \
-    memset(&ptm, 0, sizeof(ptm));                                                          \
-    localtime_r(&t, &ptm);                                                                 \
-    fprintf(stderr, "[ DEBUG] [%4d-%02d-%02d %02d:%02d:%02d ] [ %s:%s:%d ] " format "\n",    \
-            ptm.tm_year + 1900, ptm.tm_mon + 1, ptm.tm_mday, ptm.tm_hour,                  \
-            ptm.tm_min, ptm.tm_sec, __FILE__, __FUNCTION__ , __LINE__, ##__VA_ARGS__);     \
+template <typename T>
+uint8_t* writeArg(uint8_t* p, const T& arg)
+{
+    if constexpr(std::is_same_v<T, const char*> || std::is_same_v<T, char*>)
+    {
+        const char* str    = arg ? arg : "(null)";
+        uint16_t    length = (uint16_t)stringLength(arg);
+        *p++               = (uint8_t)LogArgType::STRING;
+        memcpy(p, &length, sizeof(length));
+        p += sizeof(length);
+        memcpy(p, str, length);
+        p[length] = '\0';
+        return p + length + 1;
+    }
+    else if constexpr(std::is_pointer_v<T> || std::is_null_pointer_v<T>)
+    {
+        return writeValue(p, LogArgType::POINTER, (uint64_t)(uintptr_t)arg);
+    }
+    else if constexpr(std::is_enum_v<T>)
+    {
+        return writeValue(p, LogArgType::INT, (int64_t)arg);
+    }
+    else if constexpr(std::is_floating_point_v<T>)
+    {
+        return writeValue(p, LogArgType::DOUBLE, (double)arg);
+    }
+    else if constexpr(std::is_integral_v<T> && std::is_signed_v<T>)
+    {
+        return writeValue(p, LogArgType::INT, (int64_t)arg);
+    }
+    else
+    {
+        static_assert(std::is_integral_v<T>, "unsupported log argument");
+        return writeValue(p, LogArgType::UINT, (uint64_t)arg);
+    }
 }
+} // namespace logdetail
+
+template <typename... Args>
+void logWrite(LogLevel    level,
+              int64_t     timeNs,
+              uint32_t    suppressed,
+              const char* file,
+              const char* func,
+              int         line,
+              const char* format,
+              Args... args)
+{
+    size_t size = sizeof(LogRecordHeader) + (logdetail::argSize(args) + ... + 0);
+    size        = (size + 7) & ~(size_t)7;
+    uint8_t* p  = logReserve((uint32_t)size);
+    if(!p)
+        return;
 
-#define AV_LOG_W(format, ...)                                                              \
-{                                                                                          \
-    time_t t = time(0);                                                                    \
-    struct tm ptm;                                                                         \
-    memset(&ptm, 0, sizeof(ptm));                                                          \
-    localtime_r(&t, &ptm);                                                                 \
-    fprintf(stderr, "[ WARNING ] [%4d-%02d-%02d %02d:%02d:%02d ] [ %s:%s:%d ] " format "\n",    \
-            ptm.tm_year + 1900, ptm.tm_mon + 1, ptm.tm_mday, ptm.tm_hour,                  \
-            ptm.tm_min, ptm.tm_sec, __FILE__, __FUNCTION__ , __LINE__, ##__VA_ARGS__);     \
+    LogRecordHeader header{
+        .size       = (uint32_t)size,
+        .level      = level,
+        .argc       = (uint8_t)sizeof...(args),
+        .line       = line,
+        .suppressed = suppressed,
+        .timeNs     = timeNs,
+        .file       = file,
+        .func       = func,
+        .format     = format,
+    };
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    ((p = logdetail::writeArg(p, args)), ...);
+    logCommit();
 }
-    
\ No newline at end of file
@@ -0,0 +1,694 @@
+#include "../include/log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+// single producer(the owner thread) single consumer(the logger thread) ring
+class LogRing
+{
+public:
+    static constexpr uint64_t kCapacity = 256 * 1024;
+
+    LogRing()
+        : m_data(new uint8_t[kCapacity])
+    { }
+
+    // dsiable copy-ctor and move-ctor
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing) = delete;
+    LogRing(LogRing&&)                = delete;
+    LogRing& operator=(LogRing&&) = delete;
+
+    ~LogRing() = default;
+
+public:
+    uint8_t* reserve(uint32_t size)
+    {
+        uint64_t tail       = m_tail.load(std::memory_order_relaxed);
+        uint64_t offset     = tail & (kCapacity - 1);
+        uint64_t contiguous = kCapacity - offset;
+        // a record never wraps, the tail of ring is skipped
+        uint64_t padding = size > contiguous ? contiguous : 0;
+        if(tail + padding + size - m_cachedHead > kCapacity)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if(tail + padding + size - m_cachedHead > kCapacity)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+        if(padding)
+        {
+            uint32_t marker = 0;
+            memcpy(m_data.get() + offset, &marker, sizeof(marker));
+            offset = 0;
+        }
+        m_reserved = tail + padding + size;
+        return m_data.get() + offset;
+    }
+
+    void commit()
+    {
+        m_tail.store(m_reserved, std::memory_order_release);
+    }
+
+    // call fn for every committed record, return false if ring is empty
+    template <typename Fn>
+    bool consume(Fn&& fn)
+    {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        uint64_t tail = m_tail.load(std::memory_order_acquire);
+        if(head == tail)
+            return false;
+        while(head < tail)
+        {
+            uint64_t offset = head & (kCapacity - 1);
+            uint32_t size   = 0;
+            memcpy(&size, m_data.get() + offset, sizeof(size));
+            if(size == 0)
+            {
+                head += kCapacity - offset;
+                continue;
+            }
+            fn(m_data.get() + offset);
+            head += size;
+        }
+        m_head.store(head, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+    uint64_t takeDropped()
+    {
+        return m_dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    std::atomic<bool> closed{false};
+
+private:
+    std::unique_ptr<uint8_t[]> m_data;
+    // written by consumer
+    alignas(64) std::atomic<uint64_t> m_head{0};
+    // written by producer
+    alignas(64) std::atomic<uint64_t> m_tail{0};
+    uint64_t              m_cachedHead = 0;
+    uint64_t              m_reserved   = 0;
+    std::atomic<uint64_t> m_dropped{0};
+};
+
+struct LogEntry
+{
+    int64_t     timeNs;
+    LogLevel    level;
+    std::string text;
+};
+
+const char* levelTag(LogLevel level)
+{
+    switch(level)
+    {
+    case LogLevel::DEBUG:
+        return "[ DEBUG]";
+    case LogLevel::INFO:
+        return "[ INFO ]";
+    case LogLevel::WARNING:
+        return "[ WARNING ]";
+    case LogLevel::ERROR:
+        return "[ ERROR]";
+    default:
+        return "[ UNKNOWN ]";
+    }
+}
+
+// printf of the serialized arguments, every conversion is formatted with its own snprintf
+class RecordFormatter
+{
+public:
+    RecordFormatter(const uint8_t* args, int argc)
+        : m_args(args)
+        , m_argc(argc)
+    { }
+
+    void format(const char* fmt, std::string& out)
+    {
+        const char* p = fmt;
+        while(*p)
+        {
+            if(*p != '%')
+            {
+                const char* next = strchr(p, '%');
+                size_t      n    = next ? next - p : strlen(p);
+                out.append(p, n);
+                p += n;
+                continue;
+            }
+            if(p[1] == '%')
+            {
+                out += '%';
+                p += 2;
+                continue;
+            }
+            p = formatSpec(p, out);
+        }
+    }
+
+private:
+    struct Arg
+    {
+        LogArgType  type;
+        int64_t     i   = 0;
+        uint64_t    u   = 0;
+        double      d   = 0;
+        const char* str = nullptr;
+    };
+
+    bool nextArg(Arg& arg)
+    {
+        if(m_index >= m_argc)
+            return false;
+        m_index++;
+        arg.type = (LogArgType)*m_args++;
+        switch(arg.type)
+        {
+        case LogArgType::STRING: {
+            uint16_t length = 0;
+            memcpy(&length, m_args, sizeof(length));
+            arg.str = reinterpret_cast<const char*>(m_args + sizeof(length));
+            m_args += sizeof(length) + length + 1;
+            return true;
+        }
+        case LogArgType::DOUBLE:
+            memcpy(&arg.d, m_args, sizeof(arg.d));
+            break;
+        default:
+            memcpy(&arg.u, m_args, sizeof(arg.u));
+            arg.i = (int64_t)arg.u;
+            if(arg.type == LogArgType::INT)
+            {
+                arg.d = (double)arg.i;
+            }
+            else
+            {
+                arg.d = (double)arg.u;
+            }
+            break;
+        }
+        m_args += 8;
+        return true;
+    }
+
+    // format one %[flags][width][.precision][length]conversion, return the char after it
+    const char* formatSpec(const char* p, std::string& out)
+    {
+        std::string spec = "%";
+        p++;
+        while(*p && strchr("-+ #0", *p))
+        {
+            spec += *p++;
+        }
+        p = appendNumber(p, spec);
+        if(*p == '.')
+        {
+            spec += *p++;
+            p = appendNumber(p, spec);
+        }
+        // the length of stored value is known, use our own
+        while(*p && strchr("hlLqjzt", *p))
+        {
+            p++;
+        }
+        char conv = *p;
+        if(!conv)
+        {
+            out += spec;
+            return p;
+        }
+        p++;
+
+        Arg arg;
+        if(!nextArg(arg))
+        {
+            out += "<missing>";
+            return p;
+        }
+        char buffer[1024];
+        int  n = -1;
+        switch(conv)
+        {
+        case 'd':
+        case 'i':
+            n = snprintf(buffer, sizeof(buffer), (spec + "lld").c_str(), (long long)arg.i);
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            n = snprintf(
+                buffer, sizeof(buffer), (spec + "ll" + conv).c_str(), (unsigned long long)arg.u);
+            break;
+        case 'c':
+            n = snprintf(buffer, sizeof(buffer), (spec + "c").c_str(), (int)arg.i);
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            n = snprintf(buffer, sizeof(buffer), (spec + conv).c_str(), arg.d);
+            break;
+        case 's':
+            if(arg.type == LogArgType::STRING)
+            {
+                n = snprintf(buffer, sizeof(buffer), (spec + "s").c_str(), arg.str);
+            }
+            break;
+        case 'p':
+            n = snprintf(buffer, sizeof(buffer), (spec + "p").c_str(), (void*)(uintptr_t)arg.u);
+            break;
+        default:
+            break;
+        }
+        if(n < 0)
+        {
+            out += "<?>";
+        }
+        else
+        {
+            out.append(buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+        }
+        return p;
+    }
+
+    // digits or '*' of width/precision
+    const char* appendNumber(const char* p, std::string& spec)
+    {
+        if(*p == '*')
+        {
+            Arg arg;
+            if(nextArg(arg))
+            {
+                spec += std::to_string(arg.i);
+            }
+            return p + 1;
+        }
+        while(*p >= '0' && *p <= '9')
+        {
+            spec += *p++;
+        }
+        return p;
+    }
+
+private:
+    const uint8_t* m_args;
+    int            m_argc;
+    int            m_index = 0;
+};
+
+// ring of the calling thread, cleared when the thread's ring is destroyed
+thread_local LogRing* t_ring = nullptr;
+// set once the ring is destroyed, records of later TLS destructors are written synchronously
+thread_local bool t_ringClosed = false;
+
+class Logger
+{
+public:
+    // never destructed, so logging in static destructors is still safe. it stops and
+    // drains at exit.
+    static Logger& instance()
+    {
+        static Logger* logger = new Logger();
+        return *logger;
+    }
+
+    // dsiable copy-ctor and move-ctor
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger) = delete;
+    Logger(Logger&&)                = delete;
+    Logger& operator=(Logger&&) = delete;
+
+public:
+    LogRing* ring()
+    {
+        struct RingHolder
+        {
+            std::shared_ptr<LogRing> ring;
+            ~RingHolder()
+            {
+                if(ring)
+                    ring->closed = true;
+                t_ring       = nullptr;
+                t_ringClosed = true;
+            }
+        };
+        thread_local RingHolder holder;
+        if(!holder.ring)
+        {
+            holder.ring = std::make_shared<LogRing>();
+            std::lock_guard<std::mutex> lock(m_ringMutex);
+            m_rings.push_back(holder.ring);
+        }
+        return holder.ring.get();
+    }
+
+    void committed(LogRing* ring)
+    {
+        // no logger thread at exit, the caller writes its own records
+        if(!m_running.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(m_ringMutex);
+            std::vector<LogEntry>       entries;
+            drain(*ring, entries);
+            write(entries);
+            return;
+        }
+        // wake the logger thread only if it's idle, a busy one drains it in its loop
+        m_pending.store(true);
+        if(m_sleeping.load())
+        {
+            std::lock_guard<std::mutex> lock(m_flushMutex);
+            m_flushCond.notify_all();
+        }
+    }
+
+    // for a thread whose ring is destroyed, the record is reserved, committed and written
+    // with m_syncMutex held
+    uint8_t* reserveSync(uint32_t size)
+    {
+        m_syncMutex.lock();
+        uint8_t* p = m_syncRing.reserve(size);
+        if(!p)
+        {
+            m_syncMutex.unlock();
+        }
+        return p;
+    }
+
+    void commitSync()
+    {
+        m_syncRing.commit();
+        {
+            std::lock_guard<std::mutex> lock(m_ringMutex);
+            std::vector<LogEntry>       entries;
+            drain(m_syncRing, entries);
+            write(entries);
+        }
+        m_syncMutex.unlock();
+    }
+
+    void flush()
+    {
+        if(!m_running.load(std::memory_order_acquire))
+            return;
+        std::unique_lock<std::mutex> lock(m_flushMutex);
+        uint64_t                     target = ++m_flushRequested;
+        m_flushCond.notify_all();
+        m_flushCond.wait(lock, [&]() { return m_flushDone >= target || !m_running; });
+    }
+
+    void setOutput(FILE* file)
+    {
+        std::lock_guard<std::mutex> lock(m_ringMutex);
+        m_output = file;
+    }
+
+    uint64_t dropped() const
+    {
+        return m_droppedTotal.load(std::memory_order_relaxed);
+    }
+
+private:
+    Logger()
+    {
+        m_running = true;
+        m_thread  = std::thread(&Logger::run, this);
+        std::atexit([]() { Logger::instance().stop(); });
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_flushMutex);
+            m_running = false;
+            m_flushCond.notify_all();
+        }
+        if(m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    void run()
+    {
+        std::vector<LogEntry> entries;
+        while(true)
+        {
+            uint64_t requested = 0;
+            bool     running   = true;
+            {
+                std::lock_guard<std::mutex> lock(m_flushMutex);
+                requested = m_flushRequested;
+                running   = m_running;
+            }
+
+            bool busy = false;
+            {
+                std::lock_guard<std::mutex> lock(m_ringMutex);
+                for(auto it = m_rings.begin(); it != m_rings.end();)
+                {
+                    busy |= drain(**it, entries);
+                    // the thread exited and everything of it is written
+                    if((*it)->closed && (*it)->empty())
+                    {
+                        it = m_rings.erase(it);
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+                // records of different threads are ordered by time
+                std::stable_sort(entries.begin(), entries.end(), [](auto& a, auto& b) {
+                    return a.timeNs < b.timeNs;
+                });
+                write(entries);
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(m_flushMutex);
+                m_flushDone = requested;
+                m_flushCond.notify_all();
+                if(!running)
+                    break;
+                if(!busy && m_flushRequested == requested && m_running)
+                {
+                    // sleep until a record is committed, flush or stop. the timeout is only a
+                    // safety net
+                    m_sleeping.store(true);
+                    m_flushCond.wait_for(lock, std::chrono::seconds(1), [&]() {
+                        return m_pending.exchange(false) || m_flushRequested != requested ||
+                               !m_running;
+                    });
+                    m_sleeping.store(false);
+                }
+            }
+        }
+    }
+
+    bool drain(LogRing& ring, std::vector<LogEntry>& entries)
+    {
+        if(uint64_t dropped = ring.takeDropped(); dropped > 0)
+        {
+            m_droppedTotal.fetch_add(dropped, std::memory_order_relaxed);
+            int64_t     now  = logNowNs();
+            std::string text =
+                formatPrefix(LogLevel::WARNING, now, __FILE__, __FUNCTION__, __LINE__);
+            text += "log ring is full, dropped " + std::to_string(dropped) + " messages\n";
+            entries.push_back(LogEntry{
+                .timeNs = now,
+                .level  = LogLevel::WARNING,
+                .text   = std::move(text),
+            });
+        }
+        return ring.consume([&](const uint8_t* record) {
+            LogRecordHeader header;
+            memcpy(&header, record, sizeof(header));
+            std::string     text =
+                formatPrefix(header.level, header.timeNs, header.file, header.func, header.line);
+            RecordFormatter(record + sizeof(header), header.argc).format(header.format, text);
+            if(header.suppressed > 0)
+            {
+                text += " (" + std::to_string(header.suppressed) + " suppressed by rate limit)";
+            }
+            text += '\n';
+            entries.push_back(LogEntry{
+                .timeNs = header.timeNs,
+                .level  = header.level,
+                .text   = std::move(text),
+            });
+        });
+    }
+
+    std::string formatPrefix(
+        LogLevel level, int64_t timeNs, const char* file, const char* func, int line)
+    {
+        // localtime_r only when the second changes
+        time_t seconds = timeNs / 1000000000;
+        if(seconds != m_cachedSecond)
+        {
+            struct tm ptm;
+            memset(&ptm, 0, sizeof(ptm));
+            localtime_r(&seconds, &ptm);
+            strftime(m_cachedTime, sizeof(m_cachedTime), "%Y-%m-%d %H:%M:%S", &ptm);
+            m_cachedSecond = seconds;
+        }
+        char buffer[512];
+        snprintf(buffer,
+                 sizeof(buffer),
+                 "%s [ %s ] [ %s:%s:%d ] ",
+                 levelTag(level),
+                 m_cachedTime,
+                 file,
+                 func,
+                 line);
+        return buffer;
+    }
+
+    void write(std::vector<LogEntry>& entries)
+    {
+        if(entries.empty())
+            return;
+        // stderr isn't buffered
+        bool outWritten = false;
+        for(auto& entry : entries)
+        {
+            FILE* file = m_output;
+            if(!file)
+            {
+                file = entry.level == LogLevel::INFO ? stdout : stderr;
+            }
+            fwrite(entry.text.data(), 1, entry.text.size(), file);
+            outWritten |= file != stderr;
+        }
+        if(outWritten)
+        {
+            fflush(m_output ? m_output : stdout);
+        }
+        entries.clear();
+    }
+
+private:
+    std::thread       m_thread;
+    std::atomic<bool> m_running{false};
+
+    // rings of all threads, also serializes formatting and writing
+    std::mutex                            m_ringMutex;
+    std::vector<std::shared_ptr<LogRing>> m_rings;
+    FILE*                                 m_output = nullptr;
+
+    std::mutex              m_flushMutex;
+    std::condition_variable m_flushCond;
+    uint64_t                m_flushRequested = 0;
+    uint64_t                m_flushDone      = 0;
+    // a record is committed since the logger thread last checked, and it's waiting for one
+    std::atomic<bool> m_pending{false};
+    std::atomic<bool> m_sleeping{false};
+
+    std::mutex m_syncMutex;
+    LogRing    m_syncRing;
+
+    std::atomic<uint64_t> m_droppedTotal{0};
+
+    time_t m_cachedSecond   = -1;
+    char   m_cachedTime[32] = {0};
+};
+} // namespace
+
+namespace logdetail
+{
+std::atomic<int>      g_runtimeLevel{AV_LOG_LEVEL_DEBUG};
+std::atomic<uint32_t> g_rateLimit{100};
+} // namespace logdetail
+
+uint8_t* logReserve(uint32_t size)
+{
+    if(t_ringClosed)
+    {
+        return Logger::instance().reserveSync(size);
+    }
+    if(!t_ring)
+    {
+        t_ring = Logger::instance().ring();
+    }
+    return t_ring->reserve(size);
+}
+
+void logCommit()
+{
+    if(t_ringClosed)
+    {
+        Logger::instance().commitSync();
+        return;
+    }
+    t_ring->commit();
+    Logger::instance().committed(t_ring);
+}
+
+int64_t logNowNs()
+{
+    // clock_gettime of vdso, no syscall
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void logFlush()
+{
+    Logger::instance().flush();
+}
+
+void logSetOutput(FILE* file)
+{
+    Logger::instance().setOutput(file);
+}
+
+uint64_t logDroppedCount()
+{
+    return Logger::instance().dropped();
+}
+
+void logSetLevel(LogLevel level)
+{
+    logdetail::g_runtimeLevel.store((int)level, std::memory_order_relaxed);
+}
+
+LogLevel logLevel()
+{
+    return (LogLevel)logdetail::g_runtimeLevel.load(std::memory_order_relaxed);
+}
+
+void logSetRateLimit(uint32_t perSecond)
+{
+    logdetail::g_rateLimit.store(perSecond, std::memory_order_relaxed);
+}
+
+uint32_t logRateLimit()
+{
+    return logdetail::g_rateLimit.load(std::memory_order_relaxed);
+}